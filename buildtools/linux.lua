@@ -1,4 +1,4 @@
 function doOperatingSystem()
 	defines {"LINUX"}
-	buildoptions { "-std=c++11" }
+	buildoptions { "-std=c++17" }
 end
@@ -12,6 +12,9 @@ function useToolkit(baseFolder)
 	baseFolder = baseFolder or ''
 	addToolkitIncludes(baseFolder)
 	links { "lptoolkit" }
+	if os.is("linux") then
+		links { "pthread" }
+	end
 	useNetwork()
 end
 
@@ -60,12 +60,36 @@ solution "Toolkit"
 	declareSimpleTest("statistics_test",  
 	{ "tests/statistics/**.hh", "tests/statistics/**.cpp", })
 	
+	declareSimpleTest("fiber_test",  
+	{ "tests/fiber/fiber_test.cpp", })
+	
+	declareSimpleTest("fiber_bench",  
+	{ "tests/fiber/fiber_bench.cpp", })
+	
+	declareSimpleTest("parallel_bench",  
+	{ "tests/parallel/parallel_bench.cpp", })
+	
+	declareSimpleTest("pool_bench",  
+	{ "tests/mem/pool_bench.cpp", })
+	
+	declareSimpleTest("hashmap_bench",  
+	{ "tests/hashmap/hashmap_bench.cpp", })
+	
+	declareSimpleTest("hash_bench",  
+	{ "tests/hashmap/hash_bench.cpp", })
+	
+	declareSimpleTest("concurrenthashmap_bench",  
+	{ "tests/hashmap/concurrenthashmap_bench.cpp", })
+	
 	declareSimpleTest("msg_client",  
 	{ "tests/network/**.hh", "tests/network/msg_client.cpp", })
 	
 	declareSimpleTest("msg_server",  
 	{ "tests/network/**.hh", "tests/network/msg_server.cpp", })
 	
+	declareSimpleTest("fiber_server",  
+	{ "tests/network/fiber_server.cpp", })
+	
 	declareSimpleTest("test_client",  
 	{ "tests/network/**.hh", "tests/network/test_client.cpp", })
 	
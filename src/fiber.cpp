@@ -1,5 +1,6 @@
 #include "toolkit/fiber.hh"
 
+#include <cstdlib>
 #include <mutex>
 #include <condition_variable>
 
@@ -8,7 +9,75 @@
 
 #include "toolkit/spinlockqueue.hh"
 #include "toolkit/circularqueue.hh"
+#include "toolkit/workstealingdeque.hh"
 #include "toolkit/parallel.hh"
+#include "toolkit/profile.hh"
+#include "toolkit/mem/linear_chunk_allocator.hh"
+
+#if defined(LINUX)
+#include <sys/mman.h>
+#include <unistd.h>
+
+////////////////////////////////////////////////////////////////////////////////
+// Minimal x86-64 SysV context switch. Only the callee-saved registers, MXCSR and
+// the x87 control word are preserved (the equivalent of FIBER_FLAG_FLOAT_SWITCH);
+// everything else is already clobbered by the call itself. Unlike swapcontext
+// this never touches the signal mask, so a switch is a handful of instructions
+// instead of a syscall.
+//
+//   lptk_fiber_switch(void** fromContext, void* toContext)
+//     pushes the callee-saved state, stores the stack pointer in *fromContext,
+//     then loads toContext as the stack pointer and pops its state.
+//
+//   lptk_fiber_start
+//     first 'return address' of a new fiber. The initial context puts the entry
+//     function in r13 and its argument in r12.
+#if !defined(__x86_64__)
+#error Linux fibers are only implemented for x86-64.
+#endif
+
+extern "C" void lptk_fiber_switch(void** fromContext, void* toContext);
+extern "C" void lptk_fiber_start();
+
+asm(R"(
+    .text
+    .globl lptk_fiber_switch
+    .type lptk_fiber_switch, @function
+    .p2align 4
+lptk_fiber_switch:
+    pushq %rbp
+    pushq %rbx
+    pushq %r12
+    pushq %r13
+    pushq %r14
+    pushq %r15
+    subq $8, %rsp
+    stmxcsr (%rsp)
+    fnstcw 4(%rsp)
+    movq %rsp, (%rdi)
+    movq %rsi, %rsp
+    ldmxcsr (%rsp)
+    fldcw 4(%rsp)
+    addq $8, %rsp
+    popq %r15
+    popq %r14
+    popq %r13
+    popq %r12
+    popq %rbx
+    popq %rbp
+    ret
+    .size lptk_fiber_switch, .-lptk_fiber_switch
+
+    .globl lptk_fiber_start
+    .type lptk_fiber_start, @function
+    .p2align 4
+lptk_fiber_start:
+    movq %r12, %rdi
+    callq *%r13
+    ud2
+    .size lptk_fiber_start, .-lptk_fiber_start
+)");
+#endif
 
 namespace lptk
 {
@@ -23,11 +92,38 @@ namespace lptk
             static void SetNext(Task* ptr, Task* next) { ptr->m_next = next; }
         };
 
-        void Task::Execute()
+        ////////////////////////////////////////////////////////////////////////////////
+        class TaskArena
         {
-            (*m_task)(m_userData);
-            m_counter->DecRef();
-        }
+        public:
+            struct NodeTraits
+            {
+                static TaskArena* GetNext(TaskArena* ptr) { return ptr->m_next; }
+                static void SetNext(TaskArena* ptr, TaskArena* next) { ptr->m_next = next; }
+            };
+            using Pool = lptk::IntrusiveSpinLockQueue<TaskArena>;
+
+            static constexpr size_t kBlockSize = 1 << 16;
+
+            explicit TaskArena(Pool* pool) : m_alloc(kBlockSize), m_pool(pool) {}
+
+            TaskArena(const TaskArena&) = delete;
+            TaskArena& operator=(const TaskArena&) = delete;
+            TaskArena(TaskArena&&) = delete;
+            TaskArena& operator=(TaskArena&&) = delete;
+
+            void* Alloc(size_t numBytes) { return m_alloc.Alloc(numBytes, 16); }
+            void Release()
+            {
+                m_alloc.Clear();
+                m_pool->push(this);
+            }
+        private:
+            mem::LinearChunkAllocator m_alloc;
+            Pool* m_pool;
+            // next in the pool, or in the counter's list while in use.
+            TaskArena* m_next = nullptr;
+        };
 
 
         ////////////////////////////////////////////////////////////////////////////////
@@ -48,23 +144,65 @@ namespace lptk
 
             ~Fiber();
 
-            bool Init(unsigned stackSize);
+            // stackMemory is owned by the caller (a FiberPool). It is null on windows,
+            // where the OS reserves the stack.
+            bool Init(StackClass stackClass, size_t stackSize, void* stackMemory);
             bool InitWithOwner(int ownerIndex, FiberHandle existingHandle);
             void Release();
 
             void Run();
             void Continue();
+
+            StackClass GetStackClass() const { return m_stackClass; }
+
+#if defined(PROFILE)
+            // Task events are ended when the fiber switches away and begun again when
+            // it resumes, so they always pair up on each thread's timeline.
+            void ProfileTaskBegin(TaskFunc fn)
+            {
+                ++m_numProfileTasks;
+                PROFILE_INSTANT("TaskFunc", reinterpret_cast<uintptr_t>(fn));
+                PROFILE_BEGIN("Task");
+            }
+            void ProfileTaskEnd()
+            {
+                --m_numProfileTasks;
+                PROFILE_END("Task");
+            }
+            void ProfileSuspend()
+            {
+                for (unsigned i = 0; i < m_numProfileTasks; ++i)
+                    PROFILE_END("Task");
+            }
+            void ProfileResume()
+            {
+                for (unsigned i = 0; i < m_numProfileTasks; ++i)
+                    PROFILE_BEGIN("Task");
+            }
+#endif
         private:
 
             int m_ownerThread = -1;
             Fiber* m_next = nullptr;
+            // thread fibers run on the thread's own stack, which is plenty.
+            StackClass m_stackClass = StackClass::Large;
+#if defined(PROFILE)
+            unsigned m_numProfileTasks = 0;
+#endif
 
 #if defined(WINDOWS)
             static void CALLBACK FiberMain(void* param);
             // actual implementation pointer (void* on windows)
             void* m_fiber = nullptr;
 #elif defined(LINUX)
-#error LinuxFiber implementation not yet implemented. You should do that!
+            static void FiberMain(void* param);
+            static void* MakeContext(void* stack, size_t stackSize, void (*entry)(void*), void* param);
+            // saved stack pointer of the suspended context. Null while running a
+            // thread fiber that hasn't been switched away from yet.
+            void* m_fiber = nullptr;
+            // the fiber currently executing on this thread, which is the one
+            // whose context gets saved by the next Continue().
+            static thread_local Fiber* s_runningFiber;
 #endif
         };
 
@@ -78,6 +216,81 @@ namespace lptk
             ptr->m_next = next;
         }
 
+        ////////////////////////////////////////////////////////////////////////////////
+        // All fibers of one stack class. On linux the stacks are carved out of a
+        // single mmap reservation: each slot is a PROT_NONE guard page followed by
+        // the stack, and the kernel only commits stack pages once they're touched.
+        class FiberPool
+        {
+        public:
+            FiberPool() = default;
+            ~FiberPool();
+
+            FiberPool(const FiberPool&) = delete;
+            FiberPool& operator=(const FiberPool&) = delete;
+            FiberPool(FiberPool&&) = delete;
+            FiberPool& operator=(FiberPool&&) = delete;
+
+            bool Init(StackClass stackClass, unsigned numFibers, size_t stackSize);
+
+            size_t size() const { return m_fibers.size(); }
+            Fiber* operator[](size_t index) { return m_fibers[index].get(); }
+        private:
+            lptk::DynAry<std::unique_ptr<Fiber>> m_fibers;
+#if defined(LINUX)
+            void* m_stackRegion = nullptr;
+            size_t m_stackRegionSize = 0;
+#endif
+        };
+
+        FiberPool::~FiberPool()
+        {
+            // fibers go first, their stacks live in the region.
+            m_fibers.clear();
+#if defined(LINUX)
+            if (m_stackRegion)
+                munmap(m_stackRegion, m_stackRegionSize);
+#endif
+        }
+
+        bool FiberPool::Init(StackClass stackClass, unsigned numFibers, size_t stackSize)
+        {
+            ASSERT(m_fibers.empty());
+            if (numFibers == 0)
+                return true;
+
+#if defined(LINUX)
+            const auto pageSize = size_t(sysconf(_SC_PAGESIZE));
+            stackSize = lptk::AlignValue(lptk::Max(stackSize, pageSize), pageSize);
+            const auto slotSize = stackSize + pageSize;
+
+            m_stackRegionSize = slotSize * numFibers;
+            m_stackRegion = mmap(nullptr, m_stackRegionSize, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+            if (m_stackRegion == MAP_FAILED)
+            {
+                m_stackRegion = nullptr;
+                return false;
+            }
+#endif
+
+            m_fibers.resize(numFibers);
+            for (unsigned i = 0; i < numFibers; ++i)
+            {
+                void* stackMemory = nullptr;
+#if defined(LINUX)
+                char* slot = reinterpret_cast<char*>(m_stackRegion) + i * slotSize;
+                if (mprotect(slot, pageSize, PROT_NONE) != 0)
+                    return false;
+                stackMemory = slot + pageSize;
+#endif
+                m_fibers[i] = make_unique<Fiber>();
+                if (!m_fibers[i]->Init(stackClass, stackSize, stackMemory))
+                    return false;
+            }
+            return true;
+        }
+
         ////////////////////////////////////////////////////////////////////////////////
         class FiberManager
         {
@@ -95,22 +308,30 @@ namespace lptk
             static bool Purge();
             static FiberManager* Get();
         
-            void RunTasks(Task* tasks, size_t numTasks, Counter* counter, int priority);
+            void RunTasks(Task* tasks, size_t numTasks, Counter* counter, int priority, StackClass stackClass,
+                TaskArena* arena = nullptr);
+            TaskArena* AcquireTaskArena();
+            void ReleaseTaskArenas(TaskArena* arenas);
             
             void YieldFiber();
-            void WaitForCounter(Counter* counter);
+            void WaitForCounter(Counter* counter, bool allowInlineTasks = true);
             void YieldFiberToService(FiberService* service, void* requestData);
             bool IsExitRequested() const;
           
             bool IsInFiberThread();
             int GetFiberThreadId();
+            unsigned GetNumFiberThreads() const { return unsigned(m_threadData.size()); }
+            Fiber* GetCurrentFiber();
 
             // used when starting a fiber to initialize the current fiber. 
             // Returns true if another fiber was run, false otherwise.
             void NextFiber();
 
+            // reschedules a list of fibers that were parked on a counter.
+            void WakeFibers(Fiber* fibers);
+
             // wait until we have a fiber available or a task available.
-            void NotifyTaskComplete();
+            void NotifyTaskComplete(StackClass taskClass);
             void NotifyServiceComplete();
             void WaitForFiber();
             void WaitForTasks();
@@ -119,35 +340,66 @@ namespace lptk
             void ResumeThisFiber(Fiber* currentFiber);
             void FinishFiber();
 
-            // get a task, or return null if none are available
-            Task* PopTask();
+            // get a task that fits the current fiber's stack, or return null if none are available.
+            // taskClass is what it was submitted as, to pass on to NotifyTaskComplete.
+            Task* PopTask(StackClass* taskClass);
         private:
+            Task* PopTask(int priority);
+            Task* PopLargeStackTask();
+            Task* StealTask(int priority);
+            Fiber* PopNextFiber();
+            void SwitchToFiber(Fiber* nextFiber, Counter* parkOn);
             void Cleanup();
             bool InitMain(const FiberInitStruct& init);
-            void NotifyWorkerThreadsOfTasks(unsigned numTasks);
+            void NotifyWorkerThreadsOfTasks(unsigned numTasks, StackClass taskClass = StackClass::Small);
+            // pushes a fiber that can run again where its thread will find it.
+            void Reschedule(Fiber* fiber, bool fromOtherThread);
 
             static void WorkerMain(FiberManager* fiberMgr, unsigned threadIndex);
 
             FiberInitStruct m_init;
             std::atomic<bool> m_exitRequested = false;
-            lptk::DynAry<std::unique_ptr<Fiber>> m_fibers;
+            FiberPool m_fiberPools[size_t(StackClass::Num)];
 
             struct ThreadData
             {
                 Fiber m_threadFiber;
                 Fiber* m_currentFiber = nullptr;
                 Fiber* m_lastFiber = nullptr;
+                // if set, m_lastFiber is parked on this counter instead of rescheduled.
+                Counter* m_lastFiberCounter = nullptr;
                 lptk::IntrusiveSpinLockQueue<Fiber> m_threadQueue;
+
+                // Tasks spawned by fibers while running on this thread. Only this
+                // thread pushes and pops, idle threads steal from the other end.
+                lptk::WorkStealingDeque<Task> m_lowPriorityTasks;
+                lptk::WorkStealingDeque<Task> m_highPriorityTasks;
+                uint32_t m_stealSeed = 0;
+
+                TaskArena::Pool m_taskArenas;
             };
             
             lptk::DynAry<lptk::Thread> m_workerThreads;
             lptk::DynAry<std::unique_ptr<ThreadData>> m_threadData;
 
+            // tasks submitted from threads that don't run fibers
             lptk::IntrusiveSpinLockQueue<Task> m_lowPriorityTaskQueue;
             lptk::IntrusiveSpinLockQueue<Task> m_highPriorityTaskQueue;
+            // large stack tasks, from anywhere. These should be rare enough that
+            // a shared queue is fine.
+            lptk::IntrusiveSpinLockQueue<Task> m_lowPriorityLargeTaskQueue;
+            lptk::IntrusiveSpinLockQueue<Task> m_highPriorityLargeTaskQueue;
             lptk::IntrusiveSpinLockQueue<Fiber> m_executeQueue;
 
+            // every arena ever made, and the pool for threads that don't run fibers.
+            lptk::DynAry<std::unique_ptr<TaskArena>> m_taskArenas;
+            Spinlock m_taskArenasLock;
+            TaskArena::Pool m_externalTaskArenas;
+
+            // Tasks submitted and not yet complete. Small fibers can't run large stack
+            // tasks, so those are counted apart and only wake large stack fibers.
             std::atomic<unsigned> m_numTasks = 0;
+            std::atomic<unsigned> m_numLargeTasks = 0;
             std::condition_variable m_hasTasksCondition;
             std::mutex m_hasTasksMutex;
 
@@ -163,6 +415,21 @@ namespace lptk
         std::unique_ptr<FiberManager> FiberManager::s_ptr;
         thread_local int FiberManager::s_currentThread = -1;
 
+        ////////////////////////////////////////////////////////////////////////////////
+        void Task::Execute()
+        {
+#if defined(PROFILE)
+            // look the fiber up again after, the task may have moved it to another thread.
+            FiberManager::Get()->GetCurrentFiber()->ProfileTaskBegin(m_task);
+            (*m_task)(m_userData);
+            FiberManager::Get()->GetCurrentFiber()->ProfileTaskEnd();
+#else
+            (*m_task)(m_userData);
+#endif
+            m_counter->DecRef();
+        }
+
+        ////////////////////////////////////////////////////////////////////////////////
         bool FiberManager::Init(const FiberInitStruct& init)
         {
             if (s_ptr)
@@ -200,10 +467,12 @@ namespace lptk
 #if defined(WINDOWS)
             void *mainFiber = ConvertThreadToFiberEx(nullptr, FIBER_FLAG_FLOAT_SWITCH);
 #elif defined(LINUX)
-#error linux version of FiberManager::InitThread not yet implemented
+            // the thread's context is captured the first time it switches away.
+            void* mainFiber = nullptr;
 #endif
 
             threadData.m_threadFiber.InitWithOwner(s_currentThread, mainFiber);
+            PROFILE_THREAD_NAME("Fiber Worker");
 
             // if we've exited Run, that means an exit was requested and we're shutting this thread down.
             threadData.m_threadFiber.Run();
@@ -216,39 +485,88 @@ namespace lptk
         
         void FiberManager::NextFiber()
         {
-            auto&& threadData = *m_threadData[s_currentThread];
-            const auto currentFiber = threadData.m_currentFiber;
-            ASSERT(currentFiber != nullptr);
+            Fiber* nextFiber = PopNextFiber();
+            if (nextFiber)
+                SwitchToFiber(nextFiber, nullptr);
+        }
 
-            Fiber* nextFiber = nullptr;
-            nextFiber = threadData.m_threadQueue.pop();
-            if(!nextFiber)
+        Fiber* FiberManager::PopNextFiber()
+        {
+            auto&& threadData = *m_threadData[s_currentThread];
+            Fiber* nextFiber = threadData.m_threadQueue.pop();
+            if (!nextFiber)
+            {
                 nextFiber = m_executeQueue.pop();
-            ASSERT(nextFiber != currentFiber);
 
-            if (nextFiber)
-            {
-                if (nextFiber->m_ownerThread >= 0 &&
+                // fibers owned by another thread may only resume there.
+                while (nextFiber &&
+                    nextFiber->m_ownerThread >= 0 &&
                     nextFiber->m_ownerThread != s_currentThread)
                 {
                     m_threadData[nextFiber->m_ownerThread]->m_threadQueue.push(nextFiber);
                     nextFiber = m_executeQueue.pop();
                 }
+            }
+            ASSERT(nextFiber != threadData.m_currentFiber);
+            return nextFiber;
+        }
 
-                if (nextFiber)
-                {
-                    threadData.m_lastFiber = currentFiber;
-                    nextFiber->Continue();
-                    ResumeThisFiber(currentFiber);
-                }
+        void FiberManager::SwitchToFiber(Fiber* nextFiber, Counter* parkOn)
+        {
+            auto&& threadData = *m_threadData[s_currentThread];
+            const auto currentFiber = threadData.m_currentFiber;
+            ASSERT(currentFiber != nullptr);
+
+            // the fiber we switch to decides what happens to this one, once its
+            // context has been saved. See ResumeThisFiber.
+            threadData.m_lastFiber = currentFiber;
+            threadData.m_lastFiberCounter = parkOn;
+#if defined(PROFILE)
+            currentFiber->ProfileSuspend();
+            PROFILE_INSTANT(parkOn ? "FiberPark" : "FiberSwitch", reinterpret_cast<uintptr_t>(nextFiber));
+#endif
+            nextFiber->Continue();
+            ResumeThisFiber(currentFiber);
+        }
+
+        void FiberManager::WakeFibers(Fiber* fibers)
+        {
+            while (fibers)
+            {
+                Fiber* next = FiberNodeTraits::GetNext(fibers);
+                Reschedule(fibers, true);
+                fibers = next;
             }
         }
 
+        void FiberManager::Reschedule(Fiber* fiber, bool fromOtherThread)
+        {
+            if (fiber->m_ownerThread < 0)
+            {
+                m_executeQueue.push(fiber);
+                return;
+            }
+
+            // a thread fiber. Its thread may be asleep in WaitForTasks on a small
+            // fiber, which wakes for it.
+            auto&& threadQueue = m_threadData[fiber->m_ownerThread]->m_threadQueue;
+            if (!fromOtherThread || fiber->m_ownerThread == s_currentThread)
+            {
+                threadQueue.push(fiber);
+                return;
+            }
+            std::unique_lock<std::mutex> lock(m_hasTasksMutex);
+            threadQueue.push(fiber);
+            lock.unlock();
+            m_hasTasksCondition.notify_all();
+        }
+
         void FiberManager::WaitForFiber()
         {
             auto numWaiting = m_numWaitingServiceFibers.load(std::memory_order_acquire);
             if (numWaiting == m_maxWaitingServiceFibers)
             {
+                PROFILE_SCOPE("WaitForFiber");
                 std::unique_lock<std::mutex> lock(m_allWaitingMutex);
                 m_allWaitingCondition.wait(lock, [&] {
                     numWaiting = m_numWaitingServiceFibers.load(std::memory_order_acquire);
@@ -262,14 +580,23 @@ namespace lptk
             if (s_currentThread == 0)
                 return;
 
-            auto numTasks = m_numTasks.load(std::memory_order_acquire);
-            if (numTasks == 0)
+            // Large stack tasks only wake fibers that can run them. A small fiber
+            // wakes when its thread fiber can run instead, which takes either kind,
+            // so idle threads end up waiting there.
+            auto&& threadData = *m_threadData[s_currentThread];
+            const bool canRunLarge = threadData.m_currentFiber->GetStackClass() == StackClass::Large;
+            auto hasWork = [&] {
+                if (m_numTasks.load(std::memory_order_acquire) > 0)
+                    return true;
+                if (canRunLarge)
+                    return m_numLargeTasks.load(std::memory_order_acquire) > 0;
+                return !threadData.m_threadQueue.empty();
+            };
+            if (!hasWork())
             {
+                PROFILE_SCOPE("WaitForTasks");
                 std::unique_lock<std::mutex> lock(m_hasTasksMutex);
-                m_hasTasksCondition.wait(lock, [&] {
-                    numTasks = m_numTasks.load(std::memory_order_acquire);
-                    return numTasks > 0;
-                });
+                m_hasTasksCondition.wait(lock, hasWork);
             }
         }
 
@@ -278,9 +605,15 @@ namespace lptk
             auto&& threadData = *m_threadData[s_currentThread];
             if (threadData.m_lastFiber)
             {
-                m_executeQueue.push(std::exchange(threadData.m_lastFiber, nullptr));
+                const auto lastFiber = std::exchange(threadData.m_lastFiber, nullptr);
+                const auto counter = std::exchange(threadData.m_lastFiberCounter, nullptr);
+                if (!counter || !counter->AddWaiter(lastFiber))
+                    Reschedule(lastFiber, false);
             }
             threadData.m_currentFiber = currentFiber;
+#if defined(PROFILE)
+            currentFiber->ProfileResume();
+#endif
         }
             
         void FiberManager::FinishFiber()
@@ -298,46 +631,124 @@ namespace lptk
             NextFiber();
         }
 
-        void FiberManager::WaitForCounter(Counter* counter)
+        void FiberManager::WaitForCounter(Counter* counter, bool allowInlineTasks)
         {
             while (!counter->IsZero())
             {
-                auto task = PopTask();
+                // park this fiber on the counter and let another fiber pick up
+                // tasks. The DecRef that reaches zero puts us back in the execute queue.
+                Fiber* nextFiber = PopNextFiber();
+                if (nextFiber)
+                {
+                    SwitchToFiber(nextFiber, counter);
+                    continue;
+                }
+
+                // every fiber is busy, so we can't suspend.
+                StackClass taskClass = StackClass::Small;
+                auto task = allowInlineTasks ? PopTask(&taskClass) : nullptr;
                 if (task)
                 {
                     // run a different task! This helps forward progress
                     // when we have subtasks that also wait on other counters,
                     // at the cost of stack space.
                     task->Execute();
-                    NotifyTaskComplete();
+                    NotifyTaskComplete(taskClass);
                 }
                 else
                 {
-                    WaitForTasks();
+                    if (allowInlineTasks)
+                        WaitForTasks();
                     WaitForFiber();
-                    NextFiber();
                 }
             }
+
+            counter->SyncNotify();
         }
 
-        Task* FiberManager::PopTask()
+        Task* FiberManager::PopTask(StackClass* taskClass)
         {
-            Task* task = nullptr;
+            // large stack tasks can only run here if we have the stack for them.
+            const auto currentFiber = m_threadData[s_currentThread]->m_currentFiber;
+            if (currentFiber->GetStackClass() == StackClass::Large)
+            {
+                if (auto task = PopLargeStackTask())
+                {
+                    *taskClass = StackClass::Large;
+                    return task;
+                }
+            }
+            *taskClass = StackClass::Small;
 
             // try to grab a high priority task
-            task = m_highPriorityTaskQueue.pop();
+            Task* task = PopTask(1);
             if (!task)
             {
                 // if that didn't work, grab a low priority task
-                task = m_lowPriorityTaskQueue.pop();
+                task = PopTask(0);
             }
             return task;
         }
+
+        Task* FiberManager::PopTask(int priority)
+        {
+            auto&& threadData = *m_threadData[s_currentThread];
+            Task* task = (priority == 0 ? threadData.m_lowPriorityTasks : threadData.m_highPriorityTasks).pop();
+            if (!task)
+                task = (priority == 0 ? m_lowPriorityTaskQueue : m_highPriorityTaskQueue).pop();
+            if (!task)
+                task = StealTask(priority);
+            return task;
+        }
+
+        Task* FiberManager::PopLargeStackTask()
+        {
+            Task* task = m_highPriorityLargeTaskQueue.pop();
+            if (!task)
+                task = m_lowPriorityLargeTaskQueue.pop();
+            return task;
+        }
+
+        Task* FiberManager::StealTask(int priority)
+        {
+            const auto numThreads = unsigned(m_threadData.size());
+            if (numThreads < 2)
+                return nullptr;
+
+            // xorshift to pick a random victim, then try everyone once from there.
+            auto&& threadData = *m_threadData[s_currentThread];
+            auto seed = threadData.m_stealSeed;
+            seed ^= seed << 13;
+            seed ^= seed >> 17;
+            seed ^= seed << 5;
+            threadData.m_stealSeed = seed;
+
+            const auto first = seed % numThreads;
+            for (unsigned i = 0; i < numThreads; ++i)
+            {
+                const auto victimIndex = (first + i) % numThreads;
+                if (int(victimIndex) == s_currentThread)
+                    continue;
+                auto&& victim = *m_threadData[victimIndex];
+                Task* task = (priority == 0 ? victim.m_lowPriorityTasks : victim.m_highPriorityTasks).steal();
+                if (task)
+                {
+                    PROFILE_INSTANT("Steal", victimIndex);
+                    return task;
+                }
+            }
+            return nullptr;
+        }
             
         bool FiberManager::IsInFiberThread()
         {
             return s_currentThread >= 0;
         }
+
+        Fiber* FiberManager::GetCurrentFiber()
+        {
+            return m_threadData[s_currentThread]->m_currentFiber;
+        }
             
         int FiberManager::GetFiberThreadId()
         {
@@ -350,22 +761,34 @@ namespace lptk
             const auto numWorkers = lptk::Max(1u, init.numWorkerThreads);
             const auto numFibers = lptk::Max(1u, init.numFibers);
 
-            m_fibers.resize(numFibers);
+            auto& smallPool = m_fiberPools[size_t(StackClass::Small)];
+            auto& largePool = m_fiberPools[size_t(StackClass::Large)];
+            if (!smallPool.Init(StackClass::Small, numFibers, init.stackSize) ||
+                !largePool.Init(StackClass::Large, init.numLargeFibers, init.largeStackSize))
+            {
+                return false;
+            }
 
-            m_maxWaitingServiceFibers = numFibers + numWorkers;
+            m_maxWaitingServiceFibers = unsigned(smallPool.size() + largePool.size()) + numWorkers;
 
-            for (unsigned i = 0; i < numFibers; ++i)
+            for (auto& pool : m_fiberPools)
             {
-                m_fibers[i] = make_unique<Fiber>();
-                m_fibers[i]->Init(init.stackSize);
-                m_executeQueue.push(m_fibers[i].get());
+                for (size_t i = 0; i < pool.size(); ++i)
+                    m_executeQueue.push(pool[i]);
             }
 
-            m_workerThreads.reserve(numWorkers - 1);
+            // all thread data must exist before any worker starts, since workers
+            // steal from each other.
             m_threadData.resize(numWorkers);
             for (unsigned i = 0; i < numWorkers; ++i)
             {
                 m_threadData[i] = make_unique<ThreadData>();
+                m_threadData[i]->m_stealSeed = 2463534242u + i * 0x9e3779b9u;
+            }
+
+            m_workerThreads.reserve(numWorkers - 1);
+            for (unsigned i = 0; i < numWorkers; ++i)
+            {
                 auto& threadData = *m_threadData[i];
 
                 if (i == 0) // main thread gets to be a fiber too!
@@ -374,16 +797,19 @@ namespace lptk
 #if defined(WINDOWS)
                     void* mainFiber = ConvertThreadToFiberEx(nullptr, FIBER_FLAG_FLOAT_SWITCH);
 #elif defined(LINUX)
-#error linux version of FiberManager::InitThread not yet implemented
+                    void* mainFiber = nullptr;
 #endif
                     // null owner means we'll never choose this fiber when scheduling a task - we'll
                     // only be able to return to it from waits and yields.
                     threadData.m_threadFiber.InitWithOwner(s_currentThread, mainFiber);
                     threadData.m_currentFiber = &threadData.m_threadFiber;
+                    PROFILE_THREAD_NAME("Fiber Main");
                 }
                 else
                 {
-                    m_workerThreads.push_back(lptk::Thread(WorkerMain, this, i));
+                    // lptk::Thread keeps lvalue arguments by reference, so pass the
+                    // index by value or the worker may read it after the loop moved on.
+                    m_workerThreads.push_back(lptk::Thread(WorkerMain, this, unsigned(i)));
                 }
             }
 
@@ -409,38 +835,92 @@ namespace lptk
             }
 
             m_threadData[0]->m_threadFiber.Release();
-            m_fibers.clear();
             m_threadData.clear();
 
         }
             
-        void FiberManager::RunTasks(Task* tasks, size_t numTasks, Counter* counter, int priority)
+        void FiberManager::RunTasks(Task* tasks, size_t numTasks, Counter* counter, int priority, StackClass stackClass,
+            TaskArena* arena)
         {
             if (numTasks == 0)
+            {
+                if (arena)
+                    arena->Release();
                 return;
+            }
             ASSERT(counter != nullptr);
             counter->IncRef(numTasks);
 
+            // attach only once the counter is held above zero by our own tasks.
+            if (arena)
+            {
+                counter->m_waitLock.lock();
+                TaskArena::NodeTraits::SetNext(arena, counter->m_arenas);
+                counter->m_arenas = arena;
+                counter->m_waitLock.unlock();
+            }
+
             for (size_t i = 0; i < numTasks; ++i)
                 tasks[i].SetCounter(counter);
-            (priority == 0 ? m_lowPriorityTaskQueue : m_highPriorityTaskQueue).push_range(tasks, numTasks);
 
-            NotifyWorkerThreadsOfTasks(unsigned(numTasks));
+            if (stackClass == StackClass::Large)
+            {
+                (priority == 0 ? m_lowPriorityLargeTaskQueue : m_highPriorityLargeTaskQueue).push_range(tasks, numTasks);
+            }
+            else if (s_currentThread >= 0)
+            {
+                // spawned from a fiber, keep the tasks local and let idle threads steal them.
+                auto&& threadData = *m_threadData[s_currentThread];
+                auto&& deque = (priority == 0 ? threadData.m_lowPriorityTasks : threadData.m_highPriorityTasks);
+                for (size_t i = 0; i < numTasks; ++i)
+                    deque.push(&tasks[i]);
+            }
+            else
+            {
+                (priority == 0 ? m_lowPriorityTaskQueue : m_highPriorityTaskQueue).push_range(tasks, numTasks);
+            }
+
+            NotifyWorkerThreadsOfTasks(unsigned(numTasks), stackClass);
+        }
+
+        TaskArena* FiberManager::AcquireTaskArena()
+        {
+            auto& pool = s_currentThread >= 0 ? m_threadData[s_currentThread]->m_taskArenas : m_externalTaskArenas;
+            if (auto arena = pool.pop())
+                return arena;
+
+            auto arena = make_unique<TaskArena>(&pool);
+            auto result = arena.get();
+            m_taskArenasLock.lock();
+            m_taskArenas.push_back(std::move(arena));
+            m_taskArenasLock.unlock();
+            return result;
         }
 
-        void FiberManager::NotifyWorkerThreadsOfTasks(unsigned numTasks)
+        void FiberManager::ReleaseTaskArenas(TaskArena* arenas)
         {
-            auto curNumTasks = m_numTasks.load(std::memory_order_acquire);
+            while (arenas)
+            {
+                auto next = TaskArena::NodeTraits::GetNext(arenas);
+                arenas->Release();
+                arenas = next;
+            }
+        }
+
+        void FiberManager::NotifyWorkerThreadsOfTasks(unsigned numTasks, StackClass taskClass)
+        {
+            auto&& taskCount = taskClass == StackClass::Large ? m_numLargeTasks : m_numTasks;
+            auto curNumTasks = taskCount.load(std::memory_order_acquire);
             if (curNumTasks == 0)
             {
                 std::unique_lock<std::mutex> lock(m_hasTasksMutex);
-                m_numTasks.fetch_add(numTasks, std::memory_order_acq_rel);
+                taskCount.fetch_add(numTasks, std::memory_order_acq_rel);
                 lock.unlock();
                 m_hasTasksCondition.notify_all();
             }
             else
             {
-                m_numTasks.fetch_add(numTasks, std::memory_order_acq_rel);
+                taskCount.fetch_add(numTasks, std::memory_order_acq_rel);
             }
         }
             
@@ -452,26 +932,26 @@ namespace lptk
             Counter serviceCounter;
             serviceCounter.IncRef();
             auto request = FiberService::ServiceRequest{fiber, requestData, &serviceCounter};
+            PROFILE_INSTANT("ServiceRequest", reinterpret_cast<uintptr_t>(service));
             service->PushServiceFiber(&request);
             m_numWaitingServiceFibers.fetch_add(1u, std::memory_order_release);
-            while (!serviceCounter.IsZero())
-            {
-                WaitForFiber();
-                NextFiber();
-            }
+            // no inline tasks here: they would likely call services too, and nest
+            // until the stack overflows when every fiber is waiting on a service.
+            WaitForCounter(&serviceCounter, false);
         }
             
-        void FiberManager::NotifyTaskComplete()
+        void FiberManager::NotifyTaskComplete(StackClass taskClass)
         {
-            const auto numTasks = m_numTasks.load(std::memory_order_acquire);
+            auto&& taskCount = taskClass == StackClass::Large ? m_numLargeTasks : m_numTasks;
+            const auto numTasks = taskCount.load(std::memory_order_acquire);
             if (numTasks == 1u)
             {
                 std::unique_lock<std::mutex> lock(m_hasTasksMutex);
-                m_numTasks.fetch_sub(1u, std::memory_order_acq_rel);
+                taskCount.fetch_sub(1u, std::memory_order_acq_rel);
             }
             else
             {
-                m_numTasks.fetch_sub(1u, std::memory_order_acq_rel);
+                taskCount.fetch_sub(1u, std::memory_order_acq_rel);
             }
 
             m_hasTasksCondition.notify_all();
@@ -500,6 +980,10 @@ namespace lptk
 
 
         ////////////////////////////////////////////////////////////////////////////////
+#if defined(LINUX)
+        thread_local Fiber* Fiber::s_runningFiber = nullptr;
+#endif
+
         Fiber::Fiber()
         {
         }
@@ -512,11 +996,17 @@ namespace lptk
 #endif
         }
             
-        bool Fiber::Init(unsigned stackSize)
+        bool Fiber::Init(StackClass stackClass, size_t stackSize, void* stackMemory)
         {
             ASSERT(m_fiber == nullptr);
+            m_stackClass = stackClass;
 #if defined(WINDOWS)
-            m_fiber = CreateFiberEx(stackSize, 0, FIBER_FLAG_FLOAT_SWITCH, &FiberMain, this);
+            // commit the default amount and reserve the rest, windows adds the guard page.
+            ASSERT(stackMemory == nullptr);
+            m_fiber = CreateFiberEx(0, stackSize, FIBER_FLAG_FLOAT_SWITCH, &FiberMain, this);
+#elif defined(LINUX)
+            if (stackMemory)
+                m_fiber = MakeContext(stackMemory, stackSize, &FiberMain, this);
 #endif
             if (m_fiber == nullptr)
                 return false;
@@ -529,6 +1019,11 @@ namespace lptk
             m_ownerThread = ownerIndex;
 #if defined(WINDOWS)
             m_fiber = existingHandle;
+#elif defined(LINUX)
+            // there is nothing to convert on linux, the calling thread simply
+            // becomes the running fiber.
+            lptk::unused_arg(existingHandle);
+            s_runningFiber = this;
 #endif
             return true;
         }
@@ -545,13 +1040,56 @@ namespace lptk
             fiber->Run();
             fiber->Release();
         }
+#elif defined(LINUX)
+        void Fiber::FiberMain(void* param)
+        {
+            auto fiber = reinterpret_cast<Fiber*>(param);
+            fiber->Run();
+            // Run only returns on the fiber owned by a thread, and those never
+            // start here. There is no caller frame to return to.
+            ASSERT(false);
+            std::abort();
+        }
+
+        void* Fiber::MakeContext(void* stack, size_t stackSize, void (*entry)(void*), void* param)
+        {
+            // Build the frame lptk_fiber_switch expects to pop, so that its 'ret'
+            // lands in lptk_fiber_start with a 16 byte aligned stack.
+            constexpr uint64_t kDefaultMxcsr = 0x1f80; // all exceptions masked, round to nearest
+            constexpr uint64_t kDefaultFpuCw = 0x037f; // all exceptions masked, extended precision
+
+            const auto top = (reinterpret_cast<uintptr_t>(stack) + stackSize) & ~uintptr_t(15);
+            void** sp = reinterpret_cast<void**>(top);
+            *--sp = nullptr; 
+            *--sp = nullptr; 
+            *--sp = reinterpret_cast<void*>(&lptk_fiber_start);
+            *--sp = nullptr; // rbp
+            *--sp = nullptr; // rbx
+            *--sp = param; // r12
+            *--sp = reinterpret_cast<void*>(entry); // r13
+            *--sp = nullptr; // r14
+            *--sp = nullptr; // r15
+            *--sp = reinterpret_cast<void*>(kDefaultMxcsr | (kDefaultFpuCw << 32));
+            return sp;
+        }
 #endif
         
         void Fiber::Continue()
         {
             if (m_fiber)
             {
+#if defined(WINDOWS)
                 SwitchToFiber(m_fiber);
+#elif defined(LINUX)
+                Fiber* current = s_runningFiber;
+                ASSERT(current != nullptr && current != this);
+                s_runningFiber = this;
+                // m_fiber is consumed here and rewritten when this fiber switches
+                // away again. Nothing after the switch may touch thread locals
+                // cached from before it, we may be resumed on another thread.
+                void* context = std::exchange(m_fiber, nullptr);
+                lptk_fiber_switch(&current->m_fiber, context);
+#endif
             }
         }
 
@@ -561,12 +1099,13 @@ namespace lptk
 
             while (!FiberManager::Get()->IsExitRequested())
             {
-                auto task = FiberManager::Get()->PopTask();
+                StackClass taskClass;
+                auto task = FiberManager::Get()->PopTask(&taskClass);
 
                 if (task)
                 {
                     task->Execute();
-                    FiberManager::Get()->NotifyTaskComplete();
+                    FiberManager::Get()->NotifyTaskComplete(taskClass);
                 }
                 else
                 {
@@ -585,6 +1124,42 @@ namespace lptk
 
 
 
+        ////////////////////////////////////////////////////////////////////////////////
+        void Counter::DecRefAndNotify()
+        {
+            m_waitLock.lock();
+            const auto prevCount = m_counter.fetch_sub(1u, std::memory_order_acq_rel);
+            ASSERT(prevCount > 0);
+            Fiber* waiters = prevCount == 1u ? std::exchange(m_waiters, nullptr) : nullptr;
+            TaskArena* arenas = prevCount == 1u ? std::exchange(m_arenas, nullptr) : nullptr;
+            m_waitLock.unlock();
+
+            // the counter may be destroyed from here on, only touch the waiters.
+            if (arenas)
+                FiberManager::Get()->ReleaseTaskArenas(arenas);
+            if (waiters)
+                FiberManager::Get()->WakeFibers(waiters);
+        }
+
+        bool Counter::AddWaiter(Fiber* fiber)
+        {
+            m_waitLock.lock();
+            const bool parked = !IsZero();
+            if (parked)
+            {
+                FiberNodeTraits::SetNext(fiber, m_waiters);
+                m_waiters = fiber;
+            }
+            m_waitLock.unlock();
+            return parked;
+        }
+
+        void Counter::SyncNotify()
+        {
+            m_waitLock.lock();
+            m_waitLock.unlock();
+        }
+
         ////////////////////////////////////////////////////////////////////////////////
         // this is the only function that gets called from a 'client' fiber, the rest
         // are used to implement the service 'update' function.
@@ -612,6 +1187,7 @@ namespace lptk
             
         void FiberService::Notify()
         {
+            WakeUpdate();
             if(!m_notified.exchange(true, std::memory_order_acq_rel))
                 m_semNotify.Release();
         }
@@ -629,10 +1205,17 @@ namespace lptk
             
         void FiberService::RunThread(FiberService* service)
         {
+            PROFILE_THREAD_NAME("Fiber Service");
             while (!service->m_finished.load(std::memory_order_acquire))
             {
-                if (!service->Update())
+                bool keepRunning;
                 {
+                    PROFILE_SCOPE("ServiceUpdate");
+                    keepRunning = service->Update();
+                }
+                if (!keepRunning)
+                {
+                    PROFILE_SCOPE("ServiceIdle");
                     service->WaitForUpdate();
                 }
             }
@@ -665,15 +1248,41 @@ namespace lptk
         {
             return FiberManager::Purge();
         }
+
+        bool IsInitialized()
+        {
+            return FiberManager::Get() != nullptr;
+        }
+
+        unsigned GetNumFiberThreads()
+        {
+            return FiberManager::Get()->GetNumFiberThreads();
+        }
         
-        void RunTasks(Task* tasks, size_t numTasks, Counter* counter, int priority)
+        void RunTasks(Task* tasks, size_t numTasks, Counter* counter, int priority, StackClass stackClass)
         {
-            FiberManager::Get()->RunTasks(tasks, numTasks, counter, priority);
+            FiberManager::Get()->RunTasks(tasks, numTasks, counter, priority, stackClass);
         }
         
-        void WaitForCounter(Counter* counter)
+        TaskArena* AcquireTaskArena()
+        {
+            return FiberManager::Get()->AcquireTaskArena();
+        }
+
+        void* AllocFromTaskArena(TaskArena* arena, size_t numBytes)
+        {
+            return arena->Alloc(numBytes);
+        }
+
+        void RunArenaTasks(Task* tasks, size_t numTasks, Counter* counter, TaskArena* arena, int priority,
+            StackClass stackClass)
+        {
+            FiberManager::Get()->RunTasks(tasks, numTasks, counter, priority, stackClass, arena);
+        }
+
+        void WaitForCounter(Counter* counter, bool allowInlineTasks)
         {
-            FiberManager::Get()->WaitForCounter(counter);
+            FiberManager::Get()->WaitForCounter(counter, allowInlineTasks);
         }
 
         void YieldFiber()
@@ -0,0 +1,215 @@
+#include "toolkit/fibersync.hh"
+
+namespace lptk
+{
+    namespace fiber
+    {
+        ////////////////////////////////////////////////////////////////////////////////
+        void FiberWaitList::push(FiberWaiter* waiter)
+        {
+            waiter->m_next = nullptr;
+            if (m_tail)
+                m_tail->m_next = waiter;
+            else
+                m_head = waiter;
+            m_tail = waiter;
+        }
+
+        FiberWaiter* FiberWaitList::pop()
+        {
+            FiberWaiter* waiter = m_head;
+            if (waiter)
+            {
+                m_head = waiter->m_next;
+                if (!m_head)
+                    m_tail = nullptr;
+            }
+            return waiter;
+        }
+
+        FiberWaiter* FiberWaitList::pop_all()
+        {
+            FiberWaiter* waiters = m_head;
+            m_head = m_tail = nullptr;
+            return waiters;
+        }
+
+        void FiberWaitList::Wait(FiberWaiter* waiter)
+        {
+            ASSERT(IsInFiberThread());
+            // no inline tasks: one could block on the lock we're about to be handed.
+            WaitForCounter(&waiter->m_counter, false);
+        }
+
+        void FiberWaitList::Wake(FiberWaiter* waiter)
+        {
+            waiter->m_counter.DecRef();
+        }
+
+        ////////////////////////////////////////////////////////////////////////////////
+        void FiberMutex::lock()
+        {
+            m_lock.lock();
+            if (!m_locked)
+            {
+                m_locked = true;
+                m_lock.unlock();
+                return;
+            }
+
+            FiberWaiter waiter;
+            m_waiters.push(&waiter);
+            m_lock.unlock();
+
+            // unlock() handed us the mutex before waking us.
+            FiberWaitList::Wait(&waiter);
+        }
+
+        bool FiberMutex::try_lock()
+        {
+            m_lock.lock();
+            const bool acquired = !m_locked;
+            m_locked = true;
+            m_lock.unlock();
+            return acquired;
+        }
+
+        void FiberMutex::unlock()
+        {
+            m_lock.lock();
+            ASSERT(m_locked);
+            FiberWaiter* next = m_waiters.pop();
+            m_locked = next != nullptr;
+            m_lock.unlock();
+
+            if (next)
+                FiberWaitList::Wake(next);
+        }
+
+        ////////////////////////////////////////////////////////////////////////////////
+        void FiberCondition::Wait(FiberMutex& mutex)
+        {
+            // queue up before releasing the mutex, so a notify made under the
+            // mutex right after can't be missed.
+            FiberWaiter waiter;
+            m_lock.lock();
+            m_waiters.push(&waiter);
+            m_lock.unlock();
+
+            mutex.unlock();
+            FiberWaitList::Wait(&waiter);
+            mutex.lock();
+        }
+
+        void FiberCondition::NotifyOne()
+        {
+            m_lock.lock();
+            FiberWaiter* waiter = m_waiters.pop();
+            m_lock.unlock();
+
+            if (waiter)
+                FiberWaitList::Wake(waiter);
+        }
+
+        void FiberCondition::NotifyAll()
+        {
+            m_lock.lock();
+            FiberWaiter* waiters = m_waiters.pop_all();
+            m_lock.unlock();
+
+            while (waiters)
+            {
+                // the waiter is gone once woken, read the link first.
+                FiberWaiter* next = waiters->m_next;
+                FiberWaitList::Wake(waiters);
+                waiters = next;
+            }
+        }
+
+        ////////////////////////////////////////////////////////////////////////////////
+        void FiberSemaphore::Acquire(unsigned long val)
+        {
+            if (val == 0)
+                return;
+
+            m_lock.lock();
+            if (m_waiters.empty() && m_count >= val)
+            {
+                m_count -= val;
+                m_lock.unlock();
+                return;
+            }
+
+            // taking counts one at a time could leave two fibers each holding
+            // part of what they need, so wait for all of it together.
+            FiberWaiter waiter;
+            waiter.m_wanted = val;
+            m_waiters.push(&waiter);
+            m_lock.unlock();
+
+            // Release passed the whole count on to us directly.
+            FiberWaitList::Wait(&waiter);
+        }
+
+        bool FiberSemaphore::TryAcquire()
+        {
+            m_lock.lock();
+            const bool acquired = m_waiters.empty() && m_count > 0;
+            if (acquired)
+                --m_count;
+            m_lock.unlock();
+            return acquired;
+        }
+
+        void FiberSemaphore::Release(unsigned long val)
+        {
+            FiberWaitList toWake;
+            m_lock.lock();
+            m_count += val;
+            while (FiberWaiter* waiter = m_waiters.front())
+            {
+                if (waiter->m_wanted > m_count)
+                    break;
+                m_count -= waiter->m_wanted;
+                m_waiters.pop();
+                toWake.push(waiter);
+            }
+            m_lock.unlock();
+
+            FiberWaiter* waiters = toWake.pop_all();
+            while (waiters)
+            {
+                FiberWaiter* next = waiters->m_next;
+                FiberWaitList::Wake(waiters);
+                waiters = next;
+            }
+        }
+
+        unsigned long FiberSemaphore::GetCount()
+        {
+            m_lock.lock();
+            const auto count = m_count;
+            m_lock.unlock();
+            return count;
+        }
+
+        ////////////////////////////////////////////////////////////////////////////////
+        void Latch::CountDown(size_t count)
+        {
+            for (; count != 0; --count)
+                m_counter.DecRef();
+        }
+
+        void Latch::Wait()
+        {
+            ASSERT(IsInFiberThread());
+            WaitForCounter(&m_counter);
+        }
+
+        void Latch::ArriveAndWait(size_t count)
+        {
+            CountDown(count);
+            Wait();
+        }
+    }
+}
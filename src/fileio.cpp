@@ -0,0 +1,460 @@
+#include "toolkit/fileio.hh"
+#include <cstring>
+
+#if defined(WINDOWS)
+#include <windows.h>
+#elif defined(LINUX)
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#endif
+
+namespace lptk
+{
+    namespace fiber
+    {
+        ////////////////////////////////////////////////////////////////////////////////
+        FileIOService::FileIOService(unsigned numThreads, unsigned queueDepth)
+        {
+            if (InitRing(lptk::Max(1u, queueDepth)))
+                return;
+
+            numThreads = lptk::Max(1u, numThreads);
+            m_poolThreads.reserve(numThreads);
+            for (unsigned i = 0; i < numThreads; ++i)
+                m_poolThreads.push_back(lptk::Thread(PoolThreadMain, this));
+        }
+
+        FileIOService::~FileIOService()
+        {
+            // anything still in flight has a suspended fiber waiting on it.
+            m_poolExit.store(true, std::memory_order_release);
+            m_poolSemaphore.Release((unsigned long)m_poolThreads.size());
+            for (auto&& thread : m_poolThreads)
+            {
+                if (thread.joinable())
+                    thread.join();
+            }
+
+            DrainRing();
+            ReleaseRing();
+        }
+
+        int64_t FileIOService::Read(FileHandle file, void* buffer, size_t size, uint64_t offset)
+        {
+            return Submit(Op::Read, file, buffer, size, offset);
+        }
+
+        int64_t FileIOService::Write(FileHandle file, const void* buffer, size_t size, uint64_t offset)
+        {
+            return Submit(Op::Write, file, const_cast<void*>(buffer), size, offset);
+        }
+
+        int64_t FileIOService::Submit(Op op, FileHandle file, void* buffer, size_t size, uint64_t offset)
+        {
+            ASSERT(IsInFiberThread());
+            IORequest ioRequest{ op, file, buffer, size, offset, -1 };
+            // ioRequest is safe on the stack, we don't come back until it's done.
+            EnqueueRequest(&ioRequest);
+            return ioRequest.m_result;
+        }
+
+        bool FileIOService::Update()
+        {
+            if (!IsUsingIoUring())
+            {
+                unsigned numRequests = 0;
+                while (auto request = PopServiceRequest())
+                {
+                    m_poolQueue.push(request);
+                    ++numRequests;
+                }
+                if (numRequests)
+                    m_poolSemaphore.Release(numRequests);
+                return false;
+            }
+
+            SubmitToRing();
+            if (m_numInFlight == 0)
+                return false;
+
+            // Blocks until something completes, or WakeUpdate pokes the wake
+            // eventfd for new requests or Stop.
+            ArmWake();
+            ReapRing();
+            return true;
+        }
+
+        void FileIOService::WakeUpdate()
+        {
+#if defined(LINUX)
+            if (m_ring.m_wakeFd < 0)
+                return;
+            const uint64_t one = 1;
+            const auto written = write(m_ring.m_wakeFd, &one, sizeof(one));
+            unused_arg(written); // only fails if the counter is already huge, which still wakes us.
+#endif
+        }
+
+        void FileIOService::CancelRequest(ServiceRequest* request)
+        {
+            reinterpret_cast<IORequest*>(request->GetData())->m_result = -1;
+        }
+
+        void FileIOService::PoolThreadMain(FileIOService* service)
+        {
+            for (;;)
+            {
+                service->m_poolSemaphore.Acquire();
+                auto request = service->m_poolQueue.pop();
+                if (!request)
+                {
+                    if (service->m_poolExit.load(std::memory_order_acquire))
+                        break;
+                    continue;
+                }
+
+                auto ioRequest = reinterpret_cast<IORequest*>(request->GetData());
+                ioRequest->m_result = Execute(ioRequest);
+                service->CompleteRequest(request);
+            }
+        }
+
+        int64_t FileIOService::Execute(IORequest* ioRequest)
+        {
+#if defined(WINDOWS)
+            OVERLAPPED overlapped = {};
+            overlapped.Offset = DWORD(ioRequest->m_offset);
+            overlapped.OffsetHigh = DWORD(ioRequest->m_offset >> 32);
+            const auto size = DWORD(lptk::Min<size_t>(ioRequest->m_size, 0x7fffffff));
+            DWORD numTransferred = 0;
+            const BOOL ok = ioRequest->m_op == Op::Read ?
+                ::ReadFile(ioRequest->m_file, ioRequest->m_buffer, size, &numTransferred, &overlapped) :
+                ::WriteFile(ioRequest->m_file, ioRequest->m_buffer, size, &numTransferred, &overlapped);
+            if (!ok)
+                return GetLastError() == ERROR_HANDLE_EOF ? 0 : -1;
+            return int64_t(numTransferred);
+#elif defined(LINUX)
+            ssize_t result;
+            do
+            {
+                result = ioRequest->m_op == Op::Read ?
+                    pread(ioRequest->m_file, ioRequest->m_buffer, ioRequest->m_size, off_t(ioRequest->m_offset)) :
+                    pwrite(ioRequest->m_file, ioRequest->m_buffer, ioRequest->m_size, off_t(ioRequest->m_offset));
+            } while (result < 0 && errno == EINTR);
+            return int64_t(result);
+#endif
+        }
+
+        ////////////////////////////////////////////////////////////////////////////////
+        FileHandle FileIOService::OpenFile(const char* filename, bool write)
+        {
+#if defined(WINDOWS)
+            return CreateFileA(filename, write ? GENERIC_WRITE : GENERIC_READ,
+                write ? 0 : FILE_SHARE_READ, nullptr, write ? CREATE_ALWAYS : OPEN_EXISTING,
+                FILE_ATTRIBUTE_NORMAL, nullptr);
+#elif defined(LINUX)
+            return write ?
+                open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644) :
+                open(filename, O_RDONLY | O_CLOEXEC);
+#endif
+        }
+
+        void FileIOService::CloseFile(FileHandle file)
+        {
+#if defined(WINDOWS)
+            CloseHandle(file);
+#elif defined(LINUX)
+            close(file);
+#endif
+        }
+
+        bool FileIOService::IsValid(FileHandle file)
+        {
+#if defined(WINDOWS)
+            return file != INVALID_HANDLE_VALUE;
+#elif defined(LINUX)
+            return file >= 0;
+#endif
+        }
+
+        int64_t FileIOService::GetFileSize(FileHandle file)
+        {
+#if defined(WINDOWS)
+            LARGE_INTEGER size;
+            if (!GetFileSizeEx(file, &size))
+                return -1;
+            return int64_t(size.QuadPart);
+#elif defined(LINUX)
+            struct stat buffer;
+            if (fstat(file, &buffer) < 0)
+                return -1;
+            return int64_t(buffer.st_size);
+#endif
+        }
+
+        ////////////////////////////////////////////////////////////////////////////////
+#if defined(LINUX)
+        static int IoUringEnter(int fd, unsigned toSubmit, unsigned minComplete)
+        {
+            const unsigned flags = minComplete ? IORING_ENTER_GETEVENTS : 0;
+            return int(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0));
+        }
+#endif
+
+        bool FileIOService::InitRing(unsigned queueDepth)
+        {
+#if defined(LINUX)
+            io_uring_params params = {};
+            const int fd = int(syscall(__NR_io_uring_setup, queueDepth, &params));
+            if (fd < 0) // no kernel support, or not allowed (seccomp, containers)
+                return false;
+            m_ring.m_fd = fd;
+            m_ring.m_numEntries = params.sq_entries;
+
+            m_ring.m_sqMapSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+            m_ring.m_cqMapSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+            m_ring.m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+
+            m_ring.m_sqMap = mmap(nullptr, m_ring.m_sqMapSize, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+            m_ring.m_cqMap = mmap(nullptr, m_ring.m_cqMapSize, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+            m_ring.m_sqes = mmap(nullptr, m_ring.m_sqesSize, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+            if (m_ring.m_sqMap == MAP_FAILED || m_ring.m_cqMap == MAP_FAILED || m_ring.m_sqes == MAP_FAILED)
+            {
+                ReleaseRing();
+                return false;
+            }
+
+            auto sq = reinterpret_cast<char*>(m_ring.m_sqMap);
+            m_ring.m_sqTail = reinterpret_cast<std::atomic<unsigned>*>(sq + params.sq_off.tail);
+            m_ring.m_sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+            m_ring.m_sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+            auto cq = reinterpret_cast<char*>(m_ring.m_cqMap);
+            m_ring.m_cqHead = reinterpret_cast<std::atomic<unsigned>*>(cq + params.cq_off.head);
+            m_ring.m_cqTail = reinterpret_cast<std::atomic<unsigned>*>(cq + params.cq_off.tail);
+            m_ring.m_cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+            m_ring.m_cqes = cq + params.cq_off.cqes;
+
+            // without it Update can't be interrupted, but still works.
+            m_ring.m_wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            return true;
+#else
+            unused_arg(queueDepth);
+            return false;
+#endif
+        }
+
+        void FileIOService::ReleaseRing()
+        {
+#if defined(LINUX)
+            if (m_ring.m_sqMap && m_ring.m_sqMap != MAP_FAILED)
+                munmap(m_ring.m_sqMap, m_ring.m_sqMapSize);
+            if (m_ring.m_cqMap && m_ring.m_cqMap != MAP_FAILED)
+                munmap(m_ring.m_cqMap, m_ring.m_cqMapSize);
+            if (m_ring.m_sqes && m_ring.m_sqes != MAP_FAILED)
+                munmap(m_ring.m_sqes, m_ring.m_sqesSize);
+            if (m_ring.m_fd >= 0)
+                close(m_ring.m_fd);
+            if (m_ring.m_wakeFd >= 0)
+                close(m_ring.m_wakeFd);
+#endif
+            m_ring = Ring();
+        }
+
+        unsigned FileIOService::SubmitToRing()
+        {
+#if defined(LINUX)
+            // Only take as many requests as there are free entries. Every request
+            // queued or in flight has an sqe or a cqe, so neither ring can overflow.
+            auto sqes = reinterpret_cast<io_uring_sqe*>(m_ring.m_sqes);
+            auto tail = m_ring.m_sqTail->load(std::memory_order_relaxed);
+            unsigned numAdded = 0;
+            while (m_numQueued + m_numInFlight < m_ring.m_numEntries)
+            {
+                auto request = PopServiceRequest();
+                if (!request)
+                    break;
+
+                auto ioRequest = reinterpret_cast<IORequest*>(request->GetData());
+                const auto index = tail & *m_ring.m_sqMask;
+                io_uring_sqe* sqe = &sqes[index];
+                memset(sqe, 0, sizeof(*sqe));
+                sqe->opcode = ioRequest->m_op == Op::Read ? IORING_OP_READ : IORING_OP_WRITE;
+                sqe->fd = ioRequest->m_file;
+                sqe->addr = reinterpret_cast<uint64_t>(ioRequest->m_buffer);
+                sqe->len = unsigned(lptk::Min<size_t>(ioRequest->m_size, 0x7ffff000));
+                sqe->off = ioRequest->m_offset;
+                sqe->user_data = reinterpret_cast<uint64_t>(request);
+                m_ring.m_sqArray[index] = index;
+
+                ++tail;
+                ++numAdded;
+                ++m_numQueued;
+            }
+
+            if (numAdded)
+                m_ring.m_sqTail->store(tail, std::memory_order_release);
+            SubmitQueued();
+            return numAdded;
+#else
+            return 0;
+#endif
+        }
+
+        // The whole batch goes to the kernel in one call, but it can take fewer
+        // than that. Only what it took is in flight, the rest stay queued and go
+        // again next time, once completions have freed up resources. With
+        // nothing in flight there's nothing to wait for, so they're done here.
+        void FileIOService::SubmitQueued()
+        {
+#if defined(LINUX)
+            if (m_numQueued == 0)
+                return;
+
+            int result;
+            while ((result = IoUringEnter(m_ring.m_fd, m_numQueued, 0)) < 0 && errno == EINTR) {}
+            if (result > 0)
+            {
+                const unsigned numTaken = lptk::Min(unsigned(result), m_numQueued);
+                m_numQueued -= numTaken;
+                m_numInFlight += numTaken;
+            }
+
+            const bool retryLater = result >= 0 || errno == EAGAIN || errno == EBUSY;
+            if (m_numQueued > 0 && (!retryLater || m_numInFlight == 0))
+                ExecuteQueued();
+#endif
+        }
+
+        // Takes the queued sqes back out of the ring and does their requests on
+        // this thread. Without SQPOLL the kernel only reads the tail inside
+        // io_uring_enter, so moving it back is safe.
+        void FileIOService::ExecuteQueued()
+        {
+#if defined(LINUX)
+            auto sqes = reinterpret_cast<io_uring_sqe*>(m_ring.m_sqes);
+            const auto tail = m_ring.m_sqTail->load(std::memory_order_relaxed);
+            const auto first = tail - m_numQueued;
+            m_ring.m_sqTail->store(first, std::memory_order_release);
+            m_numQueued = 0;
+
+            for (auto cur = first; cur != tail; ++cur)
+            {
+                const io_uring_sqe* sqe = &sqes[m_ring.m_sqArray[cur & *m_ring.m_sqMask]];
+                auto request = reinterpret_cast<ServiceRequest*>(sqe->user_data);
+                auto ioRequest = reinterpret_cast<IORequest*>(request->GetData());
+                ioRequest->m_result = Execute(ioRequest);
+                CompleteRequest(request);
+            }
+#endif
+        }
+
+        // Puts a poll on the wake eventfd in the ring, so the wait for completions
+        // in ReapRing also ends when WakeUpdate writes it. The completion
+        // ring is twice the size of the submission ring, so it always has room.
+        void FileIOService::ArmWake()
+        {
+#if defined(LINUX)
+            if (m_ring.m_wakeFd < 0 || m_ring.m_wakeArmed || m_numQueued > 0)
+                return;
+
+            auto sqes = reinterpret_cast<io_uring_sqe*>(m_ring.m_sqes);
+            const auto tail = m_ring.m_sqTail->load(std::memory_order_relaxed);
+            const auto index = tail & *m_ring.m_sqMask;
+            io_uring_sqe* sqe = &sqes[index];
+            memset(sqe, 0, sizeof(*sqe));
+            sqe->opcode = IORING_OP_POLL_ADD;
+            sqe->fd = m_ring.m_wakeFd;
+            sqe->poll_events = POLLIN;
+            sqe->user_data = kWakeUserData;
+            m_ring.m_sqArray[index] = index;
+            m_ring.m_sqTail->store(tail + 1, std::memory_order_release);
+
+            int result;
+            while ((result = IoUringEnter(m_ring.m_fd, 1, 0)) < 0 && errno == EINTR) {}
+            if (result == 1)
+                m_ring.m_wakeArmed = true;
+            else // not taken, same as ExecuteQueued.
+                m_ring.m_sqTail->store(tail, std::memory_order_release);
+#endif
+        }
+
+        unsigned FileIOService::ReapRing()
+        {
+#if defined(LINUX)
+            if (m_numInFlight == 0)
+                return 0;
+
+            // an interrupted or refused wait just reaps what's already there,
+            // the caller comes back for the rest.
+            const int result = IoUringEnter(m_ring.m_fd, 0, 1);
+            ASSERT(result >= 0 || errno == EINTR || errno == EAGAIN || errno == EBUSY);
+
+            auto cqes = reinterpret_cast<io_uring_cqe*>(m_ring.m_cqes);
+            auto head = m_ring.m_cqHead->load(std::memory_order_relaxed);
+            const auto tail = m_ring.m_cqTail->load(std::memory_order_acquire);
+            unsigned numReaped = 0;
+            for (; head != tail; ++head)
+            {
+                const io_uring_cqe* cqe = &cqes[head & *m_ring.m_cqMask];
+                if (cqe->user_data == kWakeUserData)
+                {
+                    m_ring.m_wakeArmed = false;
+                    uint64_t count;
+                    const auto numRead = read(m_ring.m_wakeFd, &count, sizeof(count));
+                    unused_arg(numRead); // nothing to clear if another wake already did.
+                    if (cqe->res < 0)
+                    {
+                        // no poll support, back to waiting for completions only.
+                        close(m_ring.m_wakeFd);
+                        m_ring.m_wakeFd = -1;
+                    }
+                    continue;
+                }
+                auto request = reinterpret_cast<ServiceRequest*>(cqe->user_data);
+                auto ioRequest = reinterpret_cast<IORequest*>(request->GetData());
+                if (cqe->res >= 0)
+                {
+                    ioRequest->m_result = cqe->res;
+                }
+                else if (cqe->res == -EINVAL || cqe->res == -EOPNOTSUPP)
+                {
+                    // kernel too old for plain read/write ops, do this one ourselves.
+                    ioRequest->m_result = Execute(ioRequest);
+                }
+                else
+                {
+                    ioRequest->m_result = -1;
+                }
+                CompleteRequest(request);
+                ++numReaped;
+            }
+            m_ring.m_cqHead->store(head, std::memory_order_release);
+            m_numInFlight -= numReaped;
+            return numReaped;
+#else
+            return 0;
+#endif
+        }
+
+        void FileIOService::DrainRing()
+        {
+            while (m_numQueued > 0 || m_numInFlight > 0)
+            {
+                SubmitQueued();
+                ReapRing();
+            }
+        }
+    }
+}
@@ -0,0 +1,87 @@
+#include "toolkit/hash.hh"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define LPTK_HASH_SSE2 1
+#endif
+
+namespace lptk
+{
+    namespace detail
+    {
+#if defined(LPTK_HASH_SSE2)
+        namespace
+        {
+            // lanes 2i and 2i+1 of HashStripe, in one register.
+            inline __m128i StripeLanes(__m128i acc, const char* p, __m128i secret)
+            {
+                const __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+                const __m128i key = _mm_xor_si128(value, secret);
+                const __m128i product = _mm_mul_epu32(key, _mm_srli_epi64(key, 32));
+                const __m128i swapped = _mm_shuffle_epi32(value, _MM_SHUFFLE(1, 0, 3, 2));
+                return _mm_add_epi64(acc, _mm_add_epi64(product, swapped));
+            }
+
+            inline __m128i ScrambleLanes(__m128i acc, __m128i secret, __m128i prime)
+            {
+                acc = _mm_xor_si128(acc, _mm_srli_epi64(acc, 47));
+                acc = _mm_xor_si128(acc, secret);
+                // 64 by 32 bit multiply, from two 32x32->64 ones.
+                const __m128i lo = _mm_mul_epu32(acc, prime);
+                const __m128i hi = _mm_mul_epu32(_mm_srli_epi64(acc, 32), prime);
+                return _mm_add_epi64(lo, _mm_slli_epi64(hi, 32));
+            }
+
+            inline __m128i LoadPair(uint64_t lo, uint64_t hi)
+            {
+                return _mm_set_epi64x(int64_t(hi), int64_t(lo));
+            }
+        }
+
+        uint64_t HashLong(const char* p, size_t len, uint64_t seed)
+        {
+            uint64_t init[8] = {};
+            HashInitLanes(init, seed);
+            __m128i acc[4];
+            __m128i secret[4];
+            __m128i scrambleSecret[4];
+            for (int i = 0; i < 4; ++i)
+            {
+                acc[i] = LoadPair(init[2 * i], init[2 * i + 1]);
+                secret[i] = LoadPair(kHashStripeSecret[2 * i], kHashStripeSecret[2 * i + 1]);
+                scrambleSecret[i] = LoadPair(kHashStripeSecret[7 - 2 * i], kHashStripeSecret[6 - 2 * i]);
+            }
+            const __m128i prime = _mm_set1_epi64x(int64_t(kHashScramblePrime));
+            const __m128i secretStep = _mm_set1_epi64x(int64_t(kHashP2));
+
+            const size_t numStripes = (len - 1) / kHashStripeSize;
+            for (size_t stripe = 0; stripe < numStripes; ++stripe)
+            {
+                const char* stripeData = p + stripe * kHashStripeSize;
+                for (int i = 0; i < 4; ++i)
+                {
+                    acc[i] = StripeLanes(acc[i], stripeData + 16 * i, secret[i]);
+                    secret[i] = _mm_add_epi64(secret[i], secretStep);
+                }
+                if ((stripe + 1) % kHashStripesPerScramble == 0)
+                {
+                    for (int i = 0; i < 4; ++i)
+                        acc[i] = ScrambleLanes(acc[i], scrambleSecret[i], prime);
+                }
+            }
+            for (int i = 0; i < 4; ++i)
+                acc[i] = StripeLanes(acc[i], p + len - kHashStripeSize + 16 * i, secret[i]);
+
+            uint64_t lanes[8];
+            for (int i = 0; i < 4; ++i)
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes + 2 * i), acc[i]);
+            return HashMergeLanes(lanes, len);
+        }
+#else
+        uint64_t HashLong(const char* p, size_t len, uint64_t seed)
+        {
+            return HashLongScalar<HashReadMemory>(p, len, seed);
+        }
+#endif
+    }
+}
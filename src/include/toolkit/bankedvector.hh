@@ -1,5 +1,6 @@
 #pragma once
 
+#include <atomic>
 #include <type_traits>
 #include "toolkit/mem/allocator.hh"
 
@@ -25,6 +26,16 @@ namespace lptk
       would be to configure your chunk sizes for "normal" uses, and allow
       for some amount of overflow.
 
+    - Since elements never move, any number of threads can append at once
+      with concurrent_push_back and concurrent_emplace_back. Each one takes
+      the next index with a fetch-add and allocates its chunk if it's the
+      first one there. Elements are published in index order, so readers on
+      other threads can use everything below size() while appends go on.
+      Nothing else may modify the vector during concurrent appends.
+      Publishing in order means an appender that gets descheduled between
+      taking its index and publishing stalls every append after it, so keep
+      the work done in the element's constructor short.
+
     */
 
     ////////////////////////////////////////////////////////////////////////////////
@@ -50,12 +61,21 @@ namespace lptk
         using iterator = base_iterator<false>;
         using const_iterator = base_iterator<true>;
 
-        bool empty() const { return m_size == 0; }
+        bool empty() const { return size() == 0; }
 
         template<typename... Arg>
         bool emplace_back(Arg&&... args);
         bool push_back(const T&);
         bool push_back(T&&);
+
+        // thread safe against each other and against readers below size().
+        // An append that finds the vector full fails, and so does one whose
+        // chunk can't be allocated, along with the appends that took a later
+        // index. Appends with earlier indices still go through.
+        template<typename... Arg>
+        bool concurrent_emplace_back(Arg&&... args);
+        bool concurrent_push_back(const T&);
+        bool concurrent_push_back(T&&);
         
         bool insert(size_t index, const T&);
         bool insert(size_t index, T&&);
@@ -70,8 +90,9 @@ namespace lptk
         T& back();
         const T& back() const;
 
-        size_t size() const { return m_size; }
-        size_t capacity() const { return m_numChunks * m_chunkLength; }
+        // the published size: everything below it is constructed.
+        size_t size() const { return m_size.load(std::memory_order_acquire); }
+        size_t capacity() const { return m_numChunks.load(std::memory_order_relaxed) * m_chunkLength; }
         size_t max_capacity() const { return m_maxNumChunks * m_chunkLength; }
 
         bool resize(size_t newSize, const value_type& def = value_type{});
@@ -85,26 +106,39 @@ namespace lptk
         const T& at(size_t index) const;
 
         iterator begin() { return iterator{ this, 0 }; }
-        iterator end() { return iterator{ this, m_size }; }
+        iterator end() { return iterator{ this, size() }; }
         const_iterator begin() const { return const_iterator{ this, 0 }; }
-        const_iterator end() const { return const_iterator{ this, m_size }; }
+        const_iterator end() const { return const_iterator{ this, size() }; }
 
     private:
+        using ChunkPtr = std::atomic<T*>;
+
         bool uninitialized_insert_n(size_t index, size_t n);
 
         void destroy();
         void move_from(BankedVector&& other);
         std::pair<size_t, size_t> chunk_index_offset(size_t index) const;
-        bool expand_chunks();
+        T* chunk(size_t index) const;
+        bool ensure_chunk(size_t index);
         bool ensure_chunk_allocated(size_t index);
+        void set_size(size_t newSize);
+        void fail_append(size_t index);
+        bool publish(size_t index, T* element);
 
         mem::Allocator* m_alloc = nullptr;
         size_t m_chunkLength = 0;
         size_t m_maxNumChunks = 0;
 
-        T** m_chunks = nullptr;
-        size_t m_numChunks = 0;
-        size_t m_size = 0;
+        std::atomic<ChunkPtr*> m_chunks{ nullptr };
+        // one past the highest allocated chunk. With concurrent appends the
+        // ones below may still be on their way.
+        std::atomic<size_t> m_numChunks{ 0 };
+        std::atomic<size_t> m_size{ 0 };
+        // next index for a concurrent append, m_size when there are none.
+        std::atomic<size_t> m_reserved{ 0 };
+        // lowest index a concurrent append failed at, kNoFailure if none.
+        static constexpr size_t kNoFailure = ~size_t(0);
+        std::atomic<size_t> m_firstFailed{ kNoFailure };
     };
 
 }
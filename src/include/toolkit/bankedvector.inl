@@ -1,5 +1,7 @@
 #pragma once
 
+#include <thread>
+
 namespace lptk
 {
     ////////////////////////////////////////////////////////////////////////////////
@@ -44,29 +46,36 @@ namespace lptk
         if (!m_alloc)
             return;
 
+        const size_t size = this->size();
+        const size_t numChunks = m_numChunks.load(std::memory_order_relaxed);
         if (!std::is_trivially_destructible_v<T>)
         {
             size_t curChunkOffset = 0;
-            for (size_t curChunk = 0; curChunk < m_numChunks; ++curChunk)
+            for (size_t curChunk = 0; curChunk < numChunks && curChunkOffset < size; ++curChunk)
             {
-                auto chunk = m_chunks[curChunk];
-                const size_t chunkSize = lptk::Min(m_chunkLength, m_size - curChunkOffset);
+                auto chunk = this->chunk(curChunk);
+                const size_t chunkSize = lptk::Min(m_chunkLength, size - curChunkOffset);
                 for (size_t curOffset = 0; curOffset < chunkSize; ++curOffset)
                     chunk[curOffset].~T();
                 curChunkOffset += m_chunkLength;
             }
         }
 
-        for (size_t i = 0; i < m_numChunks; ++i)
-            m_alloc->Free(m_chunks[m_numChunks - 1 - i]);
-        m_alloc->DestroyN(m_maxNumChunks, m_chunks);
+        // a failed concurrent append can leave a gap.
+        for (size_t i = 0; i < numChunks; ++i)
+        {
+            if (auto chunk = this->chunk(numChunks - 1 - i))
+                m_alloc->Free(chunk);
+        }
+        if (auto chunks = m_chunks.load(std::memory_order_relaxed))
+            m_alloc->DestroyN(m_maxNumChunks, chunks);
 
         m_alloc = nullptr;
         m_chunkLength = 0;
         m_maxNumChunks = 0;
-        m_chunks = nullptr;
-        m_numChunks = 0;
-        m_size = 0;
+        m_chunks.store(nullptr, std::memory_order_relaxed);
+        m_numChunks.store(0, std::memory_order_relaxed);
+        set_size(0);
     }
         
     template<typename T>
@@ -93,9 +102,10 @@ namespace lptk
         m_chunkLength = other.m_chunkLength;
         m_maxNumChunks = other.m_maxNumChunks;
 
-        m_chunks = std::exchange(other.m_chunks, nullptr);
-        m_numChunks = std::exchange(other.m_numChunks, 0);
-        m_size = std::exchange(other.m_size, 0);
+        m_chunks.store(other.m_chunks.exchange(nullptr, std::memory_order_relaxed), std::memory_order_relaxed);
+        m_numChunks.store(other.m_numChunks.exchange(0, std::memory_order_relaxed), std::memory_order_relaxed);
+        set_size(other.size());
+        other.set_size(0);
     }
         
     template<typename T>
@@ -104,47 +114,87 @@ namespace lptk
         auto result = std::make_pair(index / m_chunkLength, index % m_chunkLength);
         return result;
     }
+
+    template<typename T>
+    inline T* BankedVector<T>::chunk(size_t index) const
+    {
+        ASSERT(index < m_maxNumChunks);
+        return m_chunks.load(std::memory_order_acquire)[index].load(std::memory_order_acquire);
+    }
         
+    // Safe to race with itself: the chunk table and each chunk go in with a
+    // CAS, whoever loses frees theirs.
     template<typename T>
-    bool BankedVector<T>::expand_chunks()
+    bool BankedVector<T>::ensure_chunk(size_t index)
     {
-        if (m_numChunks == m_maxNumChunks)
+        if (index >= m_maxNumChunks)
             return false;
 
-        if(!m_chunks)
-            m_chunks = m_alloc->CreateN<T*>(m_maxNumChunks);
+        ChunkPtr* chunks = m_chunks.load(std::memory_order_acquire);
+        if (!chunks)
+        {
+            ChunkPtr* newChunks = m_alloc->CreateN<ChunkPtr>(m_maxNumChunks);
+            if (!newChunks)
+                return false;
+            if (m_chunks.compare_exchange_strong(chunks, newChunks, std::memory_order_acq_rel))
+                chunks = newChunks;
+            else
+                m_alloc->DestroyN(m_maxNumChunks, newChunks);
+        }
 
-        m_chunks[m_numChunks] = reinterpret_cast<T*>(m_alloc->Alloc(sizeof(T) * m_chunkLength, alignof(T)));
-        if (m_chunks[m_numChunks])
+        if (!chunks[index].load(std::memory_order_acquire))
         {
-            ++m_numChunks;
-            return true;
+            T* newChunk = reinterpret_cast<T*>(m_alloc->Alloc(sizeof(T) * m_chunkLength, alignof(T)));
+            if (!newChunk)
+                return false;
+            T* expected = nullptr;
+            if (!chunks[index].compare_exchange_strong(expected, newChunk, std::memory_order_acq_rel))
+                m_alloc->Free(newChunk);
         }
-        else
-            return false;
+
+        size_t numChunks = m_numChunks.load(std::memory_order_relaxed);
+        while (numChunks <= index &&
+            !m_numChunks.compare_exchange_weak(numChunks, index + 1, std::memory_order_relaxed))
+        {
+        }
+        return true;
     }
         
     template<typename T>
     inline bool BankedVector<T>::ensure_chunk_allocated(size_t index)
     {
-        while (index >= m_numChunks)
+        const size_t numChunks = m_numChunks.load(std::memory_order_relaxed);
+        if (index < numChunks && chunk(index))
+            return true;
+        for (size_t cur = numChunks; cur < index; ++cur)
         {
-            if (!expand_chunks())
+            if (!ensure_chunk(cur))
                 return false;
         }
-        return true;
+        // below numChunks, this fills a gap a failed concurrent append left.
+        return ensure_chunk(index);
+    }
+
+    // for the single threaded modifiers, which also end any concurrent appends.
+    template<typename T>
+    inline void BankedVector<T>::set_size(size_t newSize)
+    {
+        m_size.store(newSize, std::memory_order_release);
+        m_reserved.store(newSize, std::memory_order_relaxed);
+        m_firstFailed.store(kNoFailure, std::memory_order_relaxed);
     }
         
     template<typename T>
     bool BankedVector<T>::uninitialized_insert_n(size_t index, size_t n)
     {
-        const auto index_offset = chunk_index_offset(m_size + n - 1); 
+        const size_t size = this->size();
+        const auto index_offset = chunk_index_offset(size + n - 1); 
         if (ensure_chunk_allocated(index_offset.first))
         {
-            m_size += n;
-            for (size_t i = index; i < m_size - n; ++i)
+            set_size(size + n);
+            for (size_t i = index; i < size; ++i)
             {
-                const auto cur = m_size - 1 - (i - index);
+                const auto cur = size + n - 1 - (i - index);
                 const auto from = cur - n;
                 auto& curRef = this->at(cur);
                 auto& fromRef = this->at(from);
@@ -163,11 +213,12 @@ namespace lptk
     template<typename... Arg>
     bool BankedVector<T>::emplace_back(Arg&&... args)
     {
-        const auto index_offset = chunk_index_offset(m_size);
+        const size_t size = this->size();
+        const auto index_offset = chunk_index_offset(size);
         if (ensure_chunk_allocated(index_offset.first))
         {
-            ++m_size;
-            new (&m_chunks[index_offset.first][index_offset.second]) T(std::forward<Arg>(args)...);
+            set_size(size + 1);
+            new (&chunk(index_offset.first)[index_offset.second]) T(std::forward<Arg>(args)...);
             return true;
         }
         else
@@ -179,42 +230,88 @@ namespace lptk
     template<typename T>
     bool BankedVector<T>::push_back(const T& v)
     {
-        const auto index_offset = chunk_index_offset(m_size);
-        if (ensure_chunk_allocated(index_offset.first))
-        {
-            ++m_size;
-            new (&m_chunks[index_offset.first][index_offset.second]) T(v);
-            return true;
-        }
-        else
+        return emplace_back(v);
+    }
+
+    template<typename T>
+    bool BankedVector<T>::push_back(T&& v)
+    {
+        return emplace_back(std::move(v));
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////
+    template<typename T>
+    template<typename... Arg>
+    bool BankedVector<T>::concurrent_emplace_back(Arg&&... args)
+    {
+        const size_t index = m_reserved.fetch_add(1, std::memory_order_relaxed);
+        if (index >= max_capacity() || index > m_firstFailed.load(std::memory_order_relaxed))
+            return false;
+
+        const auto index_offset = chunk_index_offset(index);
+        if (!ensure_chunk(index_offset.first))
         {
+            fail_append(index);
             return false;
         }
+        T* element = &chunk(index_offset.first)[index_offset.second];
+        new (element) T(std::forward<Arg>(args)...);
+        return publish(index, element);
     }
 
     template<typename T>
-    bool BankedVector<T>::push_back(T&& v)
+    bool BankedVector<T>::concurrent_push_back(const T& v)
     {
-        const auto index_offset = chunk_index_offset(m_size);
-        if (ensure_chunk_allocated(index_offset.first))
+        return concurrent_emplace_back(v);
+    }
+
+    template<typename T>
+    bool BankedVector<T>::concurrent_push_back(T&& v)
+    {
+        return concurrent_emplace_back(std::move(v));
+    }
+
+    // lowers m_firstFailed to index, the appends after it can never publish.
+    template<typename T>
+    void BankedVector<T>::fail_append(size_t index)
+    {
+        size_t firstFailed = m_firstFailed.load(std::memory_order_relaxed);
+        while (index < firstFailed &&
+            !m_firstFailed.compare_exchange_weak(firstFailed, index, std::memory_order_relaxed))
         {
-            ++m_size;
-            new (&m_chunks[index_offset.first][index_offset.second]) T(std::move(v));
-            return true;
         }
-        else
+    }
+
+    // waits for the appends before this one to publish theirs, so size()
+    // never covers an element still being constructed. Gives up once one
+    // of them has failed.
+    template<typename T>
+    bool BankedVector<T>::publish(size_t index, T* element)
+    {
+        constexpr unsigned kSpinsBeforeYield = 64;
+        unsigned spins = 0;
+        while (m_size.load(std::memory_order_acquire) != index)
         {
-            return false;
+            if (index > m_firstFailed.load(std::memory_order_relaxed))
+            {
+                element->~T();
+                return false;
+            }
+            if (++spins >= kSpinsBeforeYield)
+                std::this_thread::yield();
         }
+        m_size.store(index + 1, std::memory_order_release);
+        return true;
     }
         
+    ////////////////////////////////////////////////////////////////////////////////
     template<typename T>
     bool BankedVector<T>::insert(size_t index, const T& v)
     {
         if (uninitialized_insert_n(index, 1))
         {
             const auto index_offset = chunk_index_offset(index);
-            new (&m_chunks[index_offset.first][index_offset.second]) T(v);
+            new (&chunk(index_offset.first)[index_offset.second]) T(v);
             return true;
         }
         return false;
@@ -226,7 +323,7 @@ namespace lptk
         if (uninitialized_insert_n(index, 1))
         {
             const auto index_offset = chunk_index_offset(index);
-            new (&m_chunks[index_offset.first][index_offset.second]) T(std::move(v));
+            new (&chunk(index_offset.first)[index_offset.second]) T(std::move(v));
             return true;
         }
         return false;
@@ -239,7 +336,7 @@ namespace lptk
         if (uninitialized_insert_n(index, 1))
         {
             const auto index_offset = chunk_index_offset(index);
-            new (&m_chunks[index_offset.first][index_offset.second]) T(std::forward<Arg>(args)...);
+            new (&chunk(index_offset.first)[index_offset.second]) T(std::forward<Arg>(args)...);
             return true;
         }
         return false;
@@ -260,16 +357,17 @@ namespace lptk
     template<typename T>
     bool BankedVector<T>::erase(size_t index)
     {
-        if (index >= size())
+        const size_t size = this->size();
+        if (index >= size)
             return false;
 
-        for (auto cur = index; cur < m_size - 1; ++cur)
+        for (auto cur = index; cur < size - 1; ++cur)
         {
             const auto index_offset = chunk_index_offset(cur);
-            m_chunks[index_offset.first][index_offset.second].~T();
+            chunk(index_offset.first)[index_offset.second].~T();
             const auto next_offset = chunk_index_offset(cur + 1);
-            auto& next = m_chunks[next_offset.first][next_offset.second];
-            new (&m_chunks[index_offset.first][index_offset.second]) T(std::move(next));
+            auto& next = chunk(next_offset.first)[next_offset.second];
+            new (&chunk(index_offset.first)[index_offset.second]) T(std::move(next));
         }
 
         pop_back();
@@ -285,27 +383,25 @@ namespace lptk
     template<typename T>
     inline void BankedVector<T>::pop_back()
     {
-        ASSERT(m_size > 0);
-        const auto index_offset = chunk_index_offset(--m_size);
-        m_chunks[index_offset.first][index_offset.second].~T();
+        const size_t size = this->size();
+        ASSERT(size > 0);
+        set_size(size - 1);
+        const auto index_offset = chunk_index_offset(size - 1);
+        chunk(index_offset.first)[index_offset.second].~T();
     }
 
     template<typename T>
     inline T& BankedVector<T>::back()
     {
-        ASSERT(m_size > 0);
-        const auto index_offset = chunk_index_offset(m_size - 1);
-        ASSERT(index_offset.first < m_numChunks);
-        return m_chunks[index_offset.first][index_offset.second];
+        ASSERT(size() > 0);
+        return this->at(size() - 1);
     }
 
     template<typename T>
     inline const T& BankedVector<T>::back() const
     {
-        ASSERT(m_size > 0);
-        const auto index_offset = chunk_index_offset(m_size - 1);
-        ASSERT(index_offset.first < m_numChunks);
-        return m_chunks[index_offset.first][index_offset.second];
+        ASSERT(size() > 0);
+        return this->at(size() - 1);
     }
 
     template<typename T>
@@ -323,45 +419,46 @@ namespace lptk
     template<typename T>
     inline T& BankedVector<T>::at(size_t index)
     {
-        ASSERT(index < m_size);
+        ASSERT(index < size());
         const auto index_offset = chunk_index_offset(index);
-        ASSERT(index_offset.first < m_numChunks);
-        return m_chunks[index_offset.first][index_offset.second];
+        ASSERT(index_offset.first < m_numChunks.load(std::memory_order_relaxed));
+        return chunk(index_offset.first)[index_offset.second];
     }
 
     template<typename T>
     inline const T& BankedVector<T>::at(size_t index) const
     {
-        ASSERT(index < m_size);
+        ASSERT(index < size());
         const auto index_offset = chunk_index_offset(index);
-        ASSERT(index_offset.first < m_numChunks);
-        return m_chunks[index_offset.first][index_offset.second];
+        ASSERT(index_offset.first < m_numChunks.load(std::memory_order_relaxed));
+        return chunk(index_offset.first)[index_offset.second];
     }
         
     template<typename T>
     bool BankedVector<T>::resize(size_t newSize, const value_type& def)
     {
-        if (m_size == newSize)
+        const size_t size = this->size();
+        if (size == newSize)
             return true;
 
         // shrinking case
-        for (auto cur = newSize; cur < m_size; ++cur)
+        for (auto cur = newSize; cur < size; ++cur)
         {
             const auto index_offset = chunk_index_offset(cur);
-            m_chunks[index_offset.first][index_offset.second].~T();
+            chunk(index_offset.first)[index_offset.second].~T();
         }
 
         // growing case
-        if (newSize > m_size && !reserve(newSize))
+        if (newSize > size && !reserve(newSize))
             return false;
 
-        for (auto cur = m_size; cur < newSize; ++cur)
+        for (auto cur = size; cur < newSize; ++cur)
         {
             const auto index_offset = chunk_index_offset(cur);
-            new (&m_chunks[index_offset.first][index_offset.second]) T(def);
+            new (&chunk(index_offset.first)[index_offset.second]) T(def);
         }
 
-        m_size = newSize;
+        set_size(newSize);
         return true;
     }
 
@@ -372,7 +469,7 @@ namespace lptk
             return true;
         if (newCapacity > max_capacity())
             return false;
-        const auto index_offset = chunk_index_offset(newCapacity);
+        const auto index_offset = chunk_index_offset(newCapacity - 1);
         return ensure_chunk_allocated(index_offset.first);
     }
     
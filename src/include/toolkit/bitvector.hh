@@ -10,7 +10,9 @@
 namespace lptk 
 {
     ////////////////////////////////////////////////////////////////////////////////
-    class BitVector
+    // ALLOC is the allocation policy for the bits, see toolkit/mem/alloc_policy.hh.
+    template<class ALLOC>
+    class BitVectorImpl
     {
         using PrimType = uint64_t;
         static constexpr auto kNumBits = sizeof(PrimType) * 8;
@@ -18,11 +20,11 @@ namespace lptk
         static constexpr auto kMask = ~PrimType(0);
 
     public:
-        BitVector(size_t initialSize = 0, bool initialVal = false);
-        BitVector(BitVector&& o);
-        BitVector(const BitVector& o);
-        BitVector& operator=(const BitVector& o);
-        BitVector& operator=(BitVector&& o);
+        BitVectorImpl(size_t initialSize = 0, bool initialVal = false, const ALLOC& alloc = ALLOC(MEMPOOL_General));
+        BitVectorImpl(BitVectorImpl&& o);
+        BitVectorImpl(const BitVectorImpl& o);
+        BitVectorImpl& operator=(const BitVectorImpl& o);
+        BitVectorImpl& operator=(BitVectorImpl&& o);
 
         void set(size_t index, bool value);
         bool get(size_t index) const;
@@ -33,7 +35,7 @@ namespace lptk
         void push_back(bool value);
 
         bool operator[](size_t index) const;
-        void swap(BitVector& other);
+        void swap(BitVectorImpl& other);
 
         size_t pop_count() const;
         size_t find_first_true() const;
@@ -43,26 +45,31 @@ namespace lptk
 
         void unset_all();
 
-        void subtract(const BitVector& other);
-        void add(const BitVector& other);
+        void subtract(const BitVectorImpl& other);
+        void add(const BitVectorImpl& other);
     private:
         size_t m_numBits;
-        DynAry<PrimType> m_bytes;
+        DynAry<PrimType, alignof(PrimType), MEMPOOL_General, ALLOC> m_bytes;
     };
+
+    using BitVector = BitVectorImpl<mem::PoolPolicy>;
+    // the default is compiled once, in bitvector.cpp.
+    extern template class BitVectorImpl<mem::PoolPolicy>;
     
     ////////////////////////////////////////////////////////////////////////////////
+    template<class BitVectorType>
     class BitVectorEnumerator
     {
-        const BitVector& m_bv;
+        const BitVectorType& m_bv;
     public:
-        BitVectorEnumerator(const BitVector& bv) : m_bv(bv) {}
+        BitVectorEnumerator(const BitVectorType& bv) : m_bv(bv) {}
 
         class iterator
         {
-            ::std::reference_wrapper<const BitVector> m_bv;
+            ::std::reference_wrapper<const BitVectorType> m_bv;
             size_t m_index = 0;
         public:
-            iterator(::std::reference_wrapper<const BitVector> bv, size_t index) : m_bv(bv), m_index(index) {}
+            iterator(::std::reference_wrapper<const BitVectorType> bv, size_t index) : m_bv(bv), m_index(index) {}
 
             iterator& operator++() {
                 m_index = m_bv.get().find_next_true(m_index + 1);
@@ -89,10 +96,13 @@ namespace lptk
         iterator end() const { return iterator(m_bv, m_bv.size()); }
     };
 
-    inline BitVectorEnumerator enumerate(const BitVector& bv) {
-        return BitVectorEnumerator(::std::cref(bv));
+    template<class ALLOC>
+    inline BitVectorEnumerator<BitVectorImpl<ALLOC>> enumerate(const BitVectorImpl<ALLOC>& bv) {
+        return BitVectorEnumerator<BitVectorImpl<ALLOC>>(::std::cref(bv));
     }
 }
 
+#include "bitvector.inl"
+
 #endif
 
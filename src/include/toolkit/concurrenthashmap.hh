@@ -0,0 +1,380 @@
+#pragma once
+#ifndef INCLUDED_LPTK_CONCURRENTHASHMAP_HH
+#define INCLUDED_LPTK_CONCURRENTHASHMAP_HH
+
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <type_traits>
+#include "hashmap.hh"
+#include "dynary.hh"
+#include "parallel.hh"
+
+namespace lptk
+{
+    namespace detail
+    {
+        constexpr unsigned ShardBits(size_t numShards)
+        {
+            return numShards <= 1 ? 0 : 1 + ShardBits(numShards / 2);
+        }
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////
+    /*
+    Hash map shared between threads or fibers. Keys are spread over SHARDS
+    shards by the top bits of MakeHash, each one a linear probing table in a
+    DynAry with its own Spinlock, so writers only contend when they hit the
+    same shard and a shard that grows only holds up its own writers.
+
+    Reads take no lock. Every shard has a version that writers make odd while
+    they change it; a reader copies what it finds and tries again if the
+    version moved. That only works when a torn copy is harmless, so K and V
+    have to be trivially copyable, and lookups give back a copy:
+
+        ConcurrentHashMap<uint64_t, Entry> table;
+        table.set(id, entry);
+        Entry found;
+        if (table.get(id, found))
+            ...
+
+    A reader may still be in a table its shard has outgrown, so old tables are
+    kept until reclaim() or the destructor. They add up to less than the live
+    ones.
+    */
+    template<class K, class V, size_t SHARDS = 64>
+    class ConcurrentHashMap
+    {
+        static_assert(std::is_trivially_copyable<K>::value && std::is_trivially_copyable<V>::value,
+            "reads copy keys and values while they may be written");
+        static_assert(SHARDS > 0 && (SHARDS & (SHARDS - 1)) == 0, "SHARDS must be a power of 2");
+    public:
+        static constexpr unsigned kCacheLine = 64;
+        static constexpr size_t kMinCapacity = 16;
+
+        // capacity is a hint for the whole map, spread evenly over the shards.
+        explicit ConcurrentHashMap(size_t capacity = 0);
+        ~ConcurrentHashMap();
+
+        ConcurrentHashMap(const ConcurrentHashMap&) = delete;
+        ConcurrentHashMap& operator=(const ConcurrentHashMap&) = delete;
+
+        // true if the key was added, false if an existing value was replaced.
+        bool set(const K& key, const V& value);
+        // adds the key only if it isn't there yet. True if it was added.
+        bool insert(const K& key, const V& value);
+        // copies the value out, true if the key was found.
+        bool get(const K& key, V& value) const;
+        bool has(const K& key) const;
+        // true if the key was there.
+        bool del(const K& key);
+
+        // a snapshot, may be stale as soon as it's returned.
+        size_t size() const;
+        bool empty() const { return size() == 0; }
+        void clear();
+
+        // Frees the tables shards have outgrown. Not safe while other threads
+        // may be reading.
+        void reclaim();
+
+    private:
+        struct Slot
+        {
+            // 0 when empty, else the key's hash with the top bit set.
+            size_t m_hash = 0;
+            K m_key;
+            V m_value;
+        };
+
+        struct Table
+        {
+            explicit Table(size_t capacity) : m_slots(capacity, Slot()), m_mask(capacity - 1) {}
+
+            DynAry<Slot> m_slots;
+            size_t m_mask;
+            Table* m_retired = nullptr;
+        };
+
+        struct alignas(kCacheLine) Shard
+        {
+            Spinlock m_lock;
+            // odd while a writer is changing the shard.
+            std::atomic<uint32_t> m_version{ 0 };
+            std::atomic<Table*> m_table{ nullptr };
+            std::atomic<size_t> m_size{ 0 };
+        };
+
+        static constexpr size_t kOccupied = ~(~size_t(0) >> 1);
+
+        static size_t HashOf(const K& key) { return MakeHash(key) | kOccupied; }
+        Shard& ShardOf(size_t hash) { return m_shards[(hash >> kShardShift) & (SHARDS - 1)]; }
+        const Shard& ShardOf(size_t hash) const { return m_shards[(hash >> kShardShift) & (SHARDS - 1)]; }
+
+        bool Add(const K& key, const V& value, bool replace);
+        static bool Find(const Table& table, size_t hash, const K& key, V& value);
+        static size_t FindIndex(const Table& table, size_t hash, const K& key);
+        Table* Grow(Shard& shard, Table* table);
+        static void BeginWrite(Shard& shard);
+        static void EndWrite(Shard& shard);
+        static void FreeTables(Table* table);
+
+        // shards come from the bits right under the flag bit, slots from the bottom ones.
+        static constexpr unsigned kShardShift = unsigned(sizeof(size_t) * 8 - 1) - detail::ShardBits(SHARDS);
+
+        Shard m_shards[SHARDS];
+        size_t m_initialCapacity;
+    };
+
+    ////////////////////////////////////////////////////////////////////////////////
+    template<class K, class V, size_t SHARDS>
+    ConcurrentHashMap<K, V, SHARDS>::ConcurrentHashMap(size_t capacity)
+    {
+        // room for the hint at the max load of 3/4.
+        size_t perShard = (capacity / SHARDS) * 4 / 3 + 1;
+        m_initialCapacity = kMinCapacity;
+        while (m_initialCapacity < perShard)
+            m_initialCapacity *= 2;
+    }
+
+    template<class K, class V, size_t SHARDS>
+    ConcurrentHashMap<K, V, SHARDS>::~ConcurrentHashMap()
+    {
+        for (auto& shard : m_shards)
+            FreeTables(shard.m_table.load(std::memory_order_relaxed));
+    }
+
+    template<class K, class V, size_t SHARDS>
+    bool ConcurrentHashMap<K, V, SHARDS>::set(const K& key, const V& value)
+    {
+        return Add(key, value, true);
+    }
+
+    template<class K, class V, size_t SHARDS>
+    bool ConcurrentHashMap<K, V, SHARDS>::insert(const K& key, const V& value)
+    {
+        return Add(key, value, false);
+    }
+
+    template<class K, class V, size_t SHARDS>
+    bool ConcurrentHashMap<K, V, SHARDS>::get(const K& key, V& value) const
+    {
+        const size_t hash = HashOf(key);
+        const Shard& shard = ShardOf(hash);
+        for (;;)
+        {
+            const uint32_t version = shard.m_version.load(std::memory_order_acquire);
+            if (version & 1)
+                continue;
+            const Table* table = shard.m_table.load(std::memory_order_acquire);
+            const bool found = table && Find(*table, hash, key, value);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (shard.m_version.load(std::memory_order_relaxed) == version)
+                return found;
+        }
+    }
+
+    template<class K, class V, size_t SHARDS>
+    bool ConcurrentHashMap<K, V, SHARDS>::has(const K& key) const
+    {
+        V value;
+        return get(key, value);
+    }
+
+    template<class K, class V, size_t SHARDS>
+    bool ConcurrentHashMap<K, V, SHARDS>::del(const K& key)
+    {
+        const size_t hash = HashOf(key);
+        Shard& shard = ShardOf(hash);
+        std::lock_guard<Spinlock> lock(shard.m_lock);
+        Table* table = shard.m_table.load(std::memory_order_relaxed);
+        if (!table)
+            return false;
+        size_t hole = FindIndex(*table, hash, key);
+        if (table->m_slots[hole].m_hash == 0)
+            return false;
+
+        // shift back the entries after it that may move, so no probe has to
+        // step over a gap.
+        const size_t mask = table->m_mask;
+        BeginWrite(shard);
+        for (size_t index = (hole + 1) & mask; table->m_slots[index].m_hash != 0; index = (index + 1) & mask)
+        {
+            const size_t home = table->m_slots[index].m_hash & mask;
+            if (((index - home) & mask) >= ((index - hole) & mask))
+            {
+                table->m_slots[hole] = table->m_slots[index];
+                hole = index;
+            }
+        }
+        table->m_slots[hole].m_hash = 0;
+        EndWrite(shard);
+        shard.m_size.store(shard.m_size.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    template<class K, class V, size_t SHARDS>
+    size_t ConcurrentHashMap<K, V, SHARDS>::size() const
+    {
+        size_t total = 0;
+        for (auto& shard : m_shards)
+            total += shard.m_size.load(std::memory_order_relaxed);
+        return total;
+    }
+
+    template<class K, class V, size_t SHARDS>
+    void ConcurrentHashMap<K, V, SHARDS>::clear()
+    {
+        for (auto& shard : m_shards)
+        {
+            std::lock_guard<Spinlock> lock(shard.m_lock);
+            Table* table = shard.m_table.load(std::memory_order_relaxed);
+            if (!table)
+                continue;
+            BeginWrite(shard);
+            for (auto& slot : table->m_slots)
+                slot.m_hash = 0;
+            EndWrite(shard);
+            shard.m_size.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    template<class K, class V, size_t SHARDS>
+    void ConcurrentHashMap<K, V, SHARDS>::reclaim()
+    {
+        for (auto& shard : m_shards)
+        {
+            std::lock_guard<Spinlock> lock(shard.m_lock);
+            Table* table = shard.m_table.load(std::memory_order_relaxed);
+            if (table)
+            {
+                FreeTables(table->m_retired);
+                table->m_retired = nullptr;
+            }
+        }
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////
+    template<class K, class V, size_t SHARDS>
+    bool ConcurrentHashMap<K, V, SHARDS>::Add(const K& key, const V& value, bool replace)
+    {
+        const size_t hash = HashOf(key);
+        Shard& shard = ShardOf(hash);
+        std::lock_guard<Spinlock> lock(shard.m_lock);
+        Table* table = shard.m_table.load(std::memory_order_relaxed);
+        if (table)
+        {
+            Slot& slot = table->m_slots[FindIndex(*table, hash, key)];
+            if (slot.m_hash != 0)
+            {
+                if (replace)
+                {
+                    BeginWrite(shard);
+                    slot.m_value = value;
+                    EndWrite(shard);
+                }
+                return false;
+            }
+        }
+
+        const size_t size = shard.m_size.load(std::memory_order_relaxed);
+        if (!table || (size + 1) * 4 > table->m_slots.size() * 3)
+            table = Grow(shard, table);
+        Slot& slot = table->m_slots[FindIndex(*table, hash, key)];
+        BeginWrite(shard);
+        slot.m_key = key;
+        slot.m_value = value;
+        slot.m_hash = hash;
+        EndWrite(shard);
+        shard.m_size.store(size + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Runs while writers may be changing the table: every slot is copied before
+    // it's looked at, and the probe is bounded, so a torn table can give a wrong
+    // answer but never a bad read. The caller throws the answer away then.
+    template<class K, class V, size_t SHARDS>
+    bool ConcurrentHashMap<K, V, SHARDS>::Find(const Table& table, size_t hash, const K& key, V& value)
+    {
+        const size_t mask = table.m_mask;
+        const Slot* slots = table.m_slots.data();
+        for (size_t index = hash & mask, probes = 0; probes <= mask; index = (index + 1) & mask, ++probes)
+        {
+            Slot slot;
+            memcpy(&slot, &slots[index], sizeof(Slot));
+            if (slot.m_hash == 0)
+                return false;
+            if (slot.m_hash == hash && slot.m_key == key)
+            {
+                value = slot.m_value;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // with the shard locked: the key's slot, or the empty one it would go in.
+    template<class K, class V, size_t SHARDS>
+    size_t ConcurrentHashMap<K, V, SHARDS>::FindIndex(const Table& table, size_t hash, const K& key)
+    {
+        const size_t mask = table.m_mask;
+        size_t index = hash & mask;
+        while (table.m_slots[index].m_hash != 0 &&
+            !(table.m_slots[index].m_hash == hash && table.m_slots[index].m_key == key))
+        {
+            index = (index + 1) & mask;
+        }
+        return index;
+    }
+
+    // with the shard locked. The new table is filled in before it's published,
+    // readers go on using the old one until then.
+    template<class K, class V, size_t SHARDS>
+    typename ConcurrentHashMap<K, V, SHARDS>::Table* ConcurrentHashMap<K, V, SHARDS>::Grow(Shard& shard, Table* table)
+    {
+        Table* newTable = new Table(table ? table->m_slots.size() * 2 : m_initialCapacity);
+        if (table)
+        {
+            for (const auto& slot : table->m_slots)
+            {
+                if (slot.m_hash == 0)
+                    continue;
+                size_t index = slot.m_hash & newTable->m_mask;
+                while (newTable->m_slots[index].m_hash != 0)
+                    index = (index + 1) & newTable->m_mask;
+                newTable->m_slots[index] = slot;
+            }
+            newTable->m_retired = table;
+        }
+        BeginWrite(shard);
+        shard.m_table.store(newTable, std::memory_order_release);
+        EndWrite(shard);
+        return newTable;
+    }
+
+    template<class K, class V, size_t SHARDS>
+    void ConcurrentHashMap<K, V, SHARDS>::BeginWrite(Shard& shard)
+    {
+        shard.m_version.store(shard.m_version.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    template<class K, class V, size_t SHARDS>
+    void ConcurrentHashMap<K, V, SHARDS>::EndWrite(Shard& shard)
+    {
+        shard.m_version.store(shard.m_version.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    template<class K, class V, size_t SHARDS>
+    void ConcurrentHashMap<K, V, SHARDS>::FreeTables(Table* table)
+    {
+        while (table)
+        {
+            Table* retired = table->m_retired;
+            delete table;
+            table = retired;
+        }
+    }
+}
+
+#endif
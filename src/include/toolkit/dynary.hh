@@ -3,216 +3,84 @@
 #define INCLUDED_toolkit_dynary_hh
 
 #include <cstring>
+#include <utility>
 #include <type_traits>
 #include "toolkit/mathcommon.hh"
+#include "toolkit/mem/alloc_policy.hh"
 
 namespace lptk
 {
 
+namespace detail
+{
+
 ////////////////////////////////////////////////////////////////////////////////
-// DynAry is a vector-like structure with realloc'd growing capacity.
-template<class T, unsigned int ALIGN=alignof(T), MemPoolId DefaultPool = MEMPOOL_General>
-class DynAry
+// DynAryBase holds the elements of DynAry and SmallDynAry and everything that
+// works on them without caring where they live. Derived provides reserve(),
+// which is the only way the storage grows.
+template<class Derived, class T, unsigned int ALIGN, class ALLOC>
+class DynAryBase
 {
 public:
     using iterator = T*;
     using const_iterator = T*;
     using size_type = size_t;
     using value_type = T;
-private:
+    using allocator_type = ALLOC;
+protected:
     T* m_array;
     size_type m_capacity;
     size_type m_size;
     float m_grow;
-    MemPoolId m_pool;
-public:
-    ////////////////////////////////////////	
-    // ctors
-    explicit DynAry(MemPoolId pool = DefaultPool) 
-        : m_array(nullptr)
-        , m_capacity(0)
-        , m_size(0)
-        , m_grow(1.5f)
-        , m_pool(pool)
-    {
-    }
-
-    DynAry(size_type initialSize, const T& init, MemPoolId pool = DefaultPool) 
-        : m_array(nullptr)
-        , m_capacity(initialSize)
-        , m_size(initialSize)
-        , m_grow(1.5f)
-        , m_pool(pool)
-    {
-        internal_ctor_init(init);
-    }
-
-    explicit DynAry(size_type initialSize, MemPoolId pool = DefaultPool) 
-        : m_array(nullptr)
-        , m_capacity(initialSize)
-        , m_size(initialSize)
-        , m_grow(1.5f)
-        , m_pool(pool)
-    {
-        internal_ctor_init(T());
-    }
+    ALLOC m_alloc;
 
-    template<class Iter>
-        DynAry(Iter begin, Iter end, MemPoolId pool = DefaultPool)
-        : m_array(nullptr)
-        , m_capacity(end - begin)
-        , m_size(end - begin)
+    template<class A>
+    DynAryBase(T* array, size_type capacity, size_type size, A&& alloc)
+        : m_array(array)
+        , m_capacity(capacity)
+        , m_size(size)
         , m_grow(1.5f)
-        , m_pool(pool)
+        , m_alloc(std::forward<A>(alloc))
     {
-        internal_ctor_init(begin, end);
     }
 
-    template<class U>
-    DynAry(std::initializer_list<U> init)
-        : m_array(nullptr)
-        , m_capacity(init.size())
-        , m_size(init.size())
-        , m_grow(1.5f)
-        , m_pool(DefaultPool)
-    {
-        internal_ctor_init(init.begin(), init.end());
-    }
+    DynAryBase(const DynAryBase&) = delete;
+    DynAryBase& operator=(const DynAryBase&) = delete;
+    ~DynAryBase() = default;
 
-    DynAry(const DynAry& other) 
-        : m_array(nullptr)
-        , m_capacity(other.m_capacity)
-        , m_size(other.m_size)
-        , m_grow(other.m_grow)
-        , m_pool(other.m_pool)
-    {
-        void* p = mem_allocate(sizeof(T) * m_capacity, m_pool, ALIGN);
-        m_array = reinterpret_cast<T*>(p);
-        const T* src = reinterpret_cast<T*>(other.m_array);
-        for(size_type i = 0, c = m_size; i < c; ++i)
-            new (&m_array[i]) T(src[i]);
-    }
-
-    DynAry(const DynAry& other, MemPoolId pool) 
-        : m_array(nullptr)
-        , m_capacity(other.m_capacity)
-        , m_size(other.m_size)
-        , m_grow(other.m_grow)
-        , m_pool(pool)
-    {
-        void* p = mem_allocate(sizeof(T) * m_capacity, m_pool, ALIGN);
-        m_array = reinterpret_cast<T*>(p);
-        const T* src = reinterpret_cast<T*>(other.m_array);
-        for(size_type i = 0, c = m_size; i < c; ++i)
-            new (&m_array[i]) T(src[i]);
-    }
-
-    DynAry(DynAry&& other)
-        : m_array(nullptr)
-        , m_capacity(0)
-        , m_size(0)
-        , m_grow(other.m_grow)
-        , m_pool(other.m_pool)
-    {
-        std::swap(m_array, other.m_array);
-        std::swap(m_capacity, other.m_capacity);
-        std::swap(m_size, other.m_size);
-    }
-
-    ////////////////////////////////////////	
-    ~DynAry()
-    {
-        for(size_type i = 0, c = m_size; i < c; ++i)
-            m_array[i].~T();
-        mem_free(m_array);
-    }
-
-    ////////////////////////////////////////	
+public:
+    ////////////////////////////////////////
     // assignment
-    DynAry& operator=(const DynAry& other)
-    {
-        if(&other != this)
-        {
-            clear();
-            DynAry otherCopy(other);
-            swap(otherCopy);
-        }
-        return *this;
-    }
-
-    DynAry& operator=(DynAry&& other)
+    void assign(size_type count, const T& value)
     {
         clear();
-        swap(other);
-        return *this;
-    }
-
-    void assign(size_type count, const T& value) 
-    {
-        clear();
-        reserve(count);
-        T* objs = reinterpret_cast<T*>(m_array);
+        derived().reserve(count);
         for(size_type i = 0, c = count; i < c; ++i)
-            new (&objs[i]) T(value);
+            new (&m_array[i]) T(value);
         m_size = count;
     }
 
     template<class Iter>
-    void assign(Iter first, Iter last) 
+    typename std::enable_if<!std::is_integral<Iter>::value, void>::type
+    assign(Iter first, Iter last)
     {
         clear();
         size_type count = last - first;
-        reserve(count);
-        T* objs = reinterpret_cast<T*>(m_array);
+        derived().reserve(count);
         size_type i = 0;
         Iter cur = first;
         for(; cur != last; ++i, ++cur)
-            new (&objs[i]) T(*cur);
+            new (&m_array[i]) T(*cur);
         m_size = count;
     }
 
-    ////////////////////////////////////////	
-    // capacity 
-    void set_capacity(size_type newCapacity)
-    {
-        if(m_capacity == newCapacity)
-            return;
-        else if(newCapacity > m_capacity)
-        {
-            reserve(newCapacity);
-        }
-        else // newCapacity < m_capacity
-        {
-            for(size_t i = newCapacity; i < m_size; ++i)
-                m_array[i].~T();
-
-            const size_t newSize = Min(m_size, newCapacity);
-            if(__is_trivially_copyable(T))
-            //if(std::is_trivially_copyable<T>::value)
-            {
-                m_array = reinterpret_cast<T*>(mem_reallocate(m_array, sizeof(T) * newCapacity, m_pool, ALIGN));
-            }
-            else
-            {
-                T* newAry = reinterpret_cast<T*>(mem_allocate(sizeof(T) * newCapacity, m_pool, ALIGN));
-                for(size_t i = 0, c = newSize; i < c; ++i)
-                {
-                    new (&newAry[i]) T(std::move(m_array[i]));
-                    m_array[i].~T();
-                }
-                mem_free(m_array);
-                m_array = newAry;
-            }
-            m_size = newSize;
-            m_capacity = newCapacity;
-        }
-    }
-
+    ////////////////////////////////////////
+    // capacity
     void resize(size_type newSize, const T& initVal)
     {
         if( newSize > m_size )
             insert(end(), newSize - m_size, initVal);
-        else 
+        else
         {
             for(size_type i = newSize, c = m_size; i < c; ++i)
                 m_array[i].~T();
@@ -224,7 +92,7 @@ public:
     {
         if( newSize > m_size )
             insert_default_n(end(), newSize - m_size);
-        else 
+        else
         {
             for(size_type i = newSize, c = m_size; i < c; ++i)
                 m_array[i].~T();
@@ -232,32 +100,8 @@ public:
         }
     }
 
-    void reserve(size_type newCapacity)
-    {
-        if(newCapacity > m_capacity)
-        {
-            if(__is_trivially_copyable(T))
-            //if(std::is_trivially_copyable<T>::value)
-            {
-                m_array = reinterpret_cast<T*>(mem_reallocate(m_array, sizeof(T) * newCapacity, m_pool, ALIGN));
-            }
-            else
-            {
-                T* newPtr = reinterpret_cast<T*>(mem_allocate(sizeof(T) * newCapacity, m_pool, ALIGN));
-                for(size_type i = 0, c = m_size; i < c; ++i)
-                {
-                    new (&newPtr[i]) T(std::move(m_array[i]));
-                    m_array[i].~T();
-                }
-                mem_free(m_array);
-                m_array = newPtr;
-            }
-            m_capacity = newCapacity;
-        }
-    }
-
-    ////////////////////////////////////////	
-    // modifying 
+    ////////////////////////////////////////
+    // modifying
     void clear()
     {
         for(size_type i = 0, c = m_size; i < c; ++i)
@@ -315,9 +159,9 @@ public:
             return;
 
         const size_type cutIndex = (size_type)(first - begin());
-        ASSERT(cutIndex + amountToCut <= m_size && "Invalid range"); 
+        ASSERT(cutIndex + amountToCut <= m_size && "Invalid range");
         const size_type lastIndex = cutIndex + amountToCut;
-        for(size_type i = cutIndex; i < lastIndex; ++i) 
+        for(size_type i = cutIndex; i < lastIndex; ++i)
         {
             m_array[i].~T();
         }
@@ -335,15 +179,6 @@ public:
         m_size -= amountToCut;
     }
 
-    void swap(DynAry &other)
-    {
-        std::swap(other.m_array, m_array);
-        std::swap(other.m_capacity, m_capacity);
-        std::swap(other.m_size, m_size);
-        std::swap(other.m_grow, m_grow);
-        std::swap(other.m_pool, m_pool);	
-    }
-
     void push_back(const T& v)
     {
         const size_type insertIndex = uninitialized_insert_n(end(), 1);
@@ -375,7 +210,7 @@ public:
     void pop_back()
     {
         ASSERT( m_size > 0 );
-        erase(end() - 1);	
+        erase(end() - 1);
     }
 
     int index_of(const_iterator iter)
@@ -383,6 +218,8 @@ public:
         return (iter - begin());
     }
 
+    const ALLOC& get_allocator() const { return m_alloc; }
+
     size_type size() const { return m_size; }
     size_type capacity() const { return m_capacity; }
     bool empty() const { return m_size == 0; }
@@ -394,43 +231,55 @@ public:
     const T& at(size_type index) const { ASSERT(index < m_size); return m_array[index]; }
 
     const T& get(size_type index) const { ASSERT(index < m_size); return m_array[index]; }
-    void set(size_type index, const T& v) { ASSERT(index < m_size); m_array[index] = v; } 
+    void set(size_type index, const T& v) { ASSERT(index < m_size); m_array[index] = v; }
 
     T& front() { ASSERT(m_size > 0); return m_array[0]; }
     const T& front() const { ASSERT(m_size > 0); return m_array[0]; }
     T& back() { ASSERT(m_size > 0); return m_array[m_size-1]; }
     const T& back() const { ASSERT(m_size > 0); return m_array[m_size-1]; }
 
-    T* data() { return &(m_array[0]); }
-    const T* data() const { return &(m_array[0]); }
+    T* data() { return m_array; }
+    const T* data() const { return m_array; }
 
-    iterator begin() { return &(m_array[0]); }
-    const_iterator begin() const { return &(m_array[0]); }
-    iterator end() { return &(m_array[m_size]); }
-    const_iterator end() const { return &(m_array[m_size]); }
+    iterator begin() { return m_array; }
+    const_iterator begin() const { return m_array; }
+    iterator end() { return m_array + m_size; }
+    const_iterator end() const { return m_array + m_size; }
 
-private:
+protected:
     ////////////////////////////////////////
-    template<class U>
-    void internal_ctor_init(U&& init)
+    Derived& derived() { return *static_cast<Derived*>(this); }
+
+    // moves count elements to uninitialized memory, leaving from destroyed.
+    static void relocate(T* from, T* to, size_type count)
     {
-        ASSERT(m_size <= m_capacity);
-        if(m_capacity > 0)
-            m_array = reinterpret_cast<T*>(mem_allocate(sizeof(T) * m_capacity, m_pool, ALIGN));
-        for(size_type i = 0, c = m_size; i < c; ++i)
-            new (&m_array[i]) T(std::forward<U>(init));
+        if(__is_trivially_copyable(T))
+        {
+            if(count > 0)
+                memcpy(static_cast<void*>(to), static_cast<const void*>(from), sizeof(T) * count);
+        }
+        else
+        {
+            for(size_type i = 0; i < count; ++i)
+            {
+                new (&to[i]) T(std::move(from[i]));
+                from[i].~T();
+            }
+        }
     }
 
-    template<class Iter>
-    typename std::enable_if<!std::is_integral<Iter>::value, void>::type
-    internal_ctor_init(Iter begin, Iter end)
+    // moves the elements from a heap block to one of newCapacity, m_size and
+    // m_capacity are left for the caller.
+    T* reallocate(size_type count, size_type newCapacity)
     {
-        ASSERT(m_size <= m_capacity);
-        m_array = reinterpret_cast<T*>(mem_allocate(sizeof(T) * m_capacity, m_pool, ALIGN));
-        Iter cur = begin;
-        int i = 0;
-        for(; cur != end; ++cur, ++i)
-            new (&m_array[i]) T(*cur);
+        if(__is_trivially_copyable(T))
+        //if(std::is_trivially_copyable<T>::value)
+            return reinterpret_cast<T*>(m_alloc.Reallocate(m_array, sizeof(T) * m_capacity, sizeof(T) * newCapacity, ALIGN));
+
+        T* newAry = reinterpret_cast<T*>(m_alloc.Allocate(sizeof(T) * newCapacity, ALIGN));
+        relocate(m_array, newAry, count);
+        m_alloc.Free(m_array);
+        return newAry;
     }
 
     ////////////////////////////////////////
@@ -439,7 +288,7 @@ private:
         size_t size = static_cast<size_t>(minSize * m_grow);
         if(size < 8) size = 8;
         ASSERT(size > m_capacity);
-        reserve(size);
+        derived().reserve(size);
     }
 
     size_type uninitialized_insert_n(const_iterator pos, size_type n)
@@ -447,9 +296,9 @@ private:
         ASSERT(pos <= begin() + m_size);
 
         // compute insert index before possible resize
-        size_type insertIndex = (size_type)(pos - begin());	
+        size_type insertIndex = (size_type)(pos - begin());
 
-        ASSERT(insertIndex >= 0 && insertIndex <= (size_type)(end() - begin()) && "bad insert index");
+        ASSERT(insertIndex <= (size_type)(end() - begin()) && "bad insert index");
         if (size() + n > m_capacity)
         {
             grow(size() + n);
@@ -500,5 +349,210 @@ private:
 
 }
 
-#endif
+////////////////////////////////////////////////////////////////////////////////
+// DynAry is a vector-like structure with realloc'd growing capacity.
+// ALLOC is an allocation policy from toolkit/mem/alloc_policy.hh; the
+// default allocates from DefaultPool, mem::AllocatorPolicy from any
+// mem::Allocator.
+template<class T, unsigned int ALIGN=alignof(T), MemPoolId DefaultPool = MEMPOOL_General,
+    class ALLOC = mem::PoolPolicy>
+class DynAry : public detail::DynAryBase<DynAry<T, ALIGN, DefaultPool, ALLOC>, T, ALIGN, ALLOC>
+{
+    using Base = detail::DynAryBase<DynAry, T, ALIGN, ALLOC>;
+public:
+    using typename Base::iterator;
+    using typename Base::const_iterator;
+    using typename Base::size_type;
+    using typename Base::value_type;
+    using typename Base::allocator_type;
+private:
+    using Base::m_array;
+    using Base::m_capacity;
+    using Base::m_size;
+    using Base::m_grow;
+    using Base::m_alloc;
+public:
+    ////////////////////////////////////////
+    // ctors
+    explicit DynAry(MemPoolId pool = DefaultPool)
+        : Base(nullptr, 0, 0, pool)
+    {
+    }
+
+    DynAry(size_type initialSize, const T& init, MemPoolId pool = DefaultPool)
+        : Base(nullptr, initialSize, initialSize, pool)
+    {
+        internal_ctor_init(init);
+    }
+
+    explicit DynAry(size_type initialSize, MemPoolId pool = DefaultPool)
+        : Base(nullptr, initialSize, initialSize, pool)
+    {
+        internal_ctor_init(T());
+    }
+
+    template<class Iter>
+        DynAry(Iter begin, Iter end, MemPoolId pool = DefaultPool)
+        : Base(nullptr, end - begin, end - begin, pool)
+    {
+        internal_ctor_init(begin, end);
+    }
+
+    explicit DynAry(const ALLOC& alloc)
+        : Base(nullptr, 0, 0, alloc)
+    {
+    }
 
+    DynAry(size_type initialSize, const T& init, const ALLOC& alloc)
+        : Base(nullptr, initialSize, initialSize, alloc)
+    {
+        internal_ctor_init(init);
+    }
+
+    DynAry(size_type initialSize, const ALLOC& alloc)
+        : Base(nullptr, initialSize, initialSize, alloc)
+    {
+        internal_ctor_init(T());
+    }
+
+    template<class Iter>
+        DynAry(Iter begin, Iter end, const ALLOC& alloc)
+        : Base(nullptr, end - begin, end - begin, alloc)
+    {
+        internal_ctor_init(begin, end);
+    }
+
+    template<class U>
+    DynAry(std::initializer_list<U> init)
+        : Base(nullptr, init.size(), init.size(), DefaultPool)
+    {
+        internal_ctor_init(init.begin(), init.end());
+    }
+
+    DynAry(const DynAry& other)
+        : DynAry(other, other.m_alloc)
+    {
+    }
+
+    DynAry(const DynAry& other, MemPoolId pool)
+        : DynAry(other, ALLOC(pool))
+    {
+    }
+
+    DynAry(const DynAry& other, const ALLOC& alloc)
+        : Base(nullptr, other.m_capacity, other.m_size, alloc)
+    {
+        m_grow = other.m_grow;
+        void* p = m_alloc.Allocate(sizeof(T) * m_capacity, ALIGN);
+        m_array = reinterpret_cast<T*>(p);
+        const T* src = reinterpret_cast<T*>(other.m_array);
+        for(size_type i = 0, c = m_size; i < c; ++i)
+            new (&m_array[i]) T(src[i]);
+    }
+
+    DynAry(DynAry&& other)
+        : Base(nullptr, 0, 0, other.m_alloc)
+    {
+        m_grow = other.m_grow;
+        std::swap(m_array, other.m_array);
+        std::swap(m_capacity, other.m_capacity);
+        std::swap(m_size, other.m_size);
+    }
+
+    ////////////////////////////////////////
+    ~DynAry()
+    {
+        this->clear();
+        m_alloc.Free(m_array);
+    }
+
+    ////////////////////////////////////////
+    // assignment
+    DynAry& operator=(const DynAry& other)
+    {
+        if(&other != this)
+        {
+            this->clear();
+            DynAry otherCopy(other);
+            swap(otherCopy);
+        }
+        return *this;
+    }
+
+    DynAry& operator=(DynAry&& other)
+    {
+        this->clear();
+        swap(other);
+        return *this;
+    }
+
+    ////////////////////////////////////////
+    // capacity
+    void set_capacity(size_type newCapacity)
+    {
+        if(m_capacity == newCapacity)
+            return;
+        else if(newCapacity > m_capacity)
+        {
+            reserve(newCapacity);
+        }
+        else // newCapacity < m_capacity
+        {
+            for(size_t i = newCapacity; i < m_size; ++i)
+                m_array[i].~T();
+
+            const size_t newSize = Min(m_size, newCapacity);
+            m_array = this->reallocate(newSize, newCapacity);
+            m_size = newSize;
+            m_capacity = newCapacity;
+        }
+    }
+
+    void reserve(size_type newCapacity)
+    {
+        if(newCapacity > m_capacity)
+        {
+            m_array = this->reallocate(m_size, newCapacity);
+            m_capacity = newCapacity;
+        }
+    }
+
+    ////////////////////////////////////////
+    // modifying
+    void swap(DynAry &other)
+    {
+        std::swap(other.m_array, m_array);
+        std::swap(other.m_capacity, m_capacity);
+        std::swap(other.m_size, m_size);
+        std::swap(other.m_grow, m_grow);
+        std::swap(other.m_alloc, m_alloc);
+    }
+
+private:
+    ////////////////////////////////////////
+    template<class U>
+    void internal_ctor_init(U&& init)
+    {
+        ASSERT(m_size <= m_capacity);
+        if(m_capacity > 0)
+            m_array = reinterpret_cast<T*>(m_alloc.Allocate(sizeof(T) * m_capacity, ALIGN));
+        for(size_type i = 0, c = m_size; i < c; ++i)
+            new (&m_array[i]) T(std::forward<U>(init));
+    }
+
+    template<class Iter>
+    typename std::enable_if<!std::is_integral<Iter>::value, void>::type
+    internal_ctor_init(Iter begin, Iter end)
+    {
+        ASSERT(m_size <= m_capacity);
+        m_array = reinterpret_cast<T*>(m_alloc.Allocate(sizeof(T) * m_capacity, ALIGN));
+        Iter cur = begin;
+        int i = 0;
+        for(; cur != end; ++cur, ++i)
+            new (&m_array[i]) T(*cur);
+    }
+};
+
+}
+
+#endif
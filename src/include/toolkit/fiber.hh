@@ -3,6 +3,9 @@
 #define INCLUDED_LPTK_FIBER_HH
 
 #include <atomic>
+#include <new>
+#include <type_traits>
+#include <utility>
 #include "toolkit/thread.hh"
 #include "toolkit/spinlockqueue.hh"
 #include "toolkit/parallel.hh"
@@ -40,6 +43,14 @@ Then kick them and wait for results!
     lptk::fiber::Counter taskCounter;
     lptk::fiber::RunTasks(tasks, 100, &taskCounter);
     lptk::fiber::WaitForCounter(taskCounter);
+
+Or let the fiber system keep the tasks, and pass a lambda that gets the task index:
+
+    lptk::fiber::RunTasks(100, [&](size_t i) { compute(&computeData[i]); }, &taskCounter);
+    lptk::fiber::WaitForCounter(&taskCounter);
+
+Those tasks live in a per-thread arena that is recycled once the counter reaches
+zero, so after the first few batches this doesn't allocate at all.
 */
 
 namespace lptk
@@ -47,6 +58,7 @@ namespace lptk
     namespace fiber
     {
         class Fiber;
+        class TaskArena;
 
         struct FiberNodeTraits {
             static Fiber* GetNext(Fiber* ptr);
@@ -54,6 +66,10 @@ namespace lptk
         };
 
         ////////////////////////////////////////////////////////////////////////////////
+        // Counts outstanding work. Fibers waiting on it with WaitForCounter are
+        // suspended and parked on the counter, and the DecRef that reaches zero
+        // reschedules them. Don't destroy a counter that is still being
+        // decremented; wait for it first.
         class Counter final
         {
             friend class FiberManager;
@@ -71,8 +87,19 @@ namespace lptk
             }
 
             void DecRef() {
-                // If we're subtracting from 0, we just hit 0, so we need to notify our wait queue.
-                m_counter.fetch_sub(1u, std::memory_order_acq_rel);
+                // If we're subtracting from 1, we're about to hit 0 and need to notify our
+                // wait queue. That decrement happens under the wait lock so nobody sees 
+                // zero (and frees the counter) before the waiters have been taken.
+                auto count = m_counter.load(std::memory_order_relaxed);
+                while (count > 1u)
+                {
+                    if (m_counter.compare_exchange_weak(count, count - 1u,
+                        std::memory_order_acq_rel, std::memory_order_relaxed))
+                    {
+                        return;
+                    }
+                }
+                DecRefAndNotify();
             }
 
             size_t GetCount() const {
@@ -80,7 +107,18 @@ namespace lptk
             }
 
         private:
+            void DecRefAndNotify();
+            // Parks the fiber on this counter. Returns false if the counter already
+            // reached zero, in which case the caller must reschedule it.
+            bool AddWaiter(Fiber* fiber);
+            // Waits until a DecRefAndNotify that reached zero is done touching this counter.
+            void SyncNotify();
+
             std::atomic<size_t> m_counter;
+            Spinlock m_waitLock;
+            Fiber* m_waiters = nullptr;
+            // released by the DecRef that reaches zero, see RunArenaTasks.
+            TaskArena* m_arenas = nullptr;
         };
 
 
@@ -148,6 +186,11 @@ namespace lptk
             // Stop is called before all fibers have completed. 
             virtual void CancelRequest(ServiceRequest*) {}
 
+            // Called whenever the service thread has new work: a request was queued or
+            // Stop was called. Override this if Update blocks on something other than
+            // the service's own wait, like epoll, to interrupt it.
+            virtual void WakeUpdate() {}
+
             // Enqueues the current fiber with the given request data. 
             // Used to implement the service function.
             void EnqueueRequest(void* requestData);
@@ -214,9 +257,22 @@ namespace lptk
         };
 
 
+        ////////////////////////////////////////////////////////////////////////////////
+        // Each stack class has its own pool of fibers. Tasks submitted as Large only
+        // run on large stack fibers (or directly on a worker thread's own stack).
+        enum class StackClass
+        {
+            Small,
+            Large,
+            Num
+        };
+
         ////////////////////////////////////////////////////////////////////////////////
         // Specifies the initialization parameters of the fiber system. Must be
         // supplied to Init()
+        //
+        // Stacks are reserved up front but only committed as they are touched, and 
+        // each stack has a guard page below it so an overflow faults right away.
         struct FiberInitStruct
         {
             // Number of worker threads that handle normal and high priority tasks.
@@ -225,6 +281,10 @@ namespace lptk
             unsigned stackSize = 32 * (1 << 10);
             // Number of small stack fibers in each worker thread.
             unsigned numFibers = 128;
+            // Stack size in bytes for 'large' stack fibers.
+            unsigned largeStackSize = 1 << 20;
+            // Number of large stack fibers.
+            unsigned numLargeFibers = 8;
         };
 
         ////////////////////////////////////////////////////////////////////////////////
@@ -237,8 +297,15 @@ namespace lptk
         // releases all resources associated with fibers and joins worker threads.
         bool Purge();
 
-        // Run 'small' stack tasks in the normal queue.
-        void RunTasks(Task* tasks, size_t numTasks, Counter* counter, int priority = 0);
+        // true between a successful Init() and Purge().
+        bool IsInitialized();
+
+        // number of threads running fibers, the Init() thread included.
+        unsigned GetNumFiberThreads();
+
+        // Run tasks in the normal queue, on fibers with the given stack class.
+        void RunTasks(Task* tasks, size_t numTasks, Counter* counter, int priority = 0,
+            StackClass stackClass = StackClass::Small);
         
         // cooperative yield - allow us to switch to another fiber.
         void YieldFiber();
@@ -250,8 +317,89 @@ namespace lptk
         // return index >= 0 for valid worker thread, -1 otherwise.
         int GetFiberThreadId();
 
-        // yield current fiber and keep doing so anytime we are rescheduled until the counter has reached zero.
-        void WaitForCounter(Counter* counter);
+        // suspend the current fiber until the counter has reached zero. If no other fiber
+        // is free to switch to, tasks are run inline on this fiber's stack instead, unless
+        // allowInlineTasks is false (when an inline task could need what we're waiting on).
+        void WaitForCounter(Counter* counter, bool allowInlineTasks = true);
+
+        ////////////////////////////////////////////////////////////////////////////////
+        // Task arenas hold the tasks of one batch, and anything those tasks need.
+        // Each fiber thread has its own pool of them (other threads share one), and
+        // an arena keeps its chunks when it goes back, so a warmed up pool serves
+        // batches without allocating.
+
+        // Takes an arena from the calling thread's pool.
+        TaskArena* AcquireTaskArena();
+        // Memory is 16 byte aligned, and only reclaimed with the whole arena.
+        void* AllocFromTaskArena(TaskArena* arena, size_t numBytes);
+        // Same as RunTasks, and hands the arena back to its pool once the counter
+        // next reaches zero. Nothing in the arena may be touched after that.
+        void RunArenaTasks(Task* tasks, size_t numTasks, Counter* counter, TaskArena* arena,
+            int priority = 0, StackClass stackClass = StackClass::Small);
+
+        // Runs fn(i) as a task for each i in [0, numTasks). fn is copied into the
+        // arena once, shared by the whole batch, and destroyed after the last call.
+        template<class Fn>
+        void RunTasks(size_t numTasks, Fn&& fn, Counter* counter, int priority = 0,
+            StackClass stackClass = StackClass::Small);
+
+        ////////////////////////////////////////////////////////////////////////////////
+        namespace detail
+        {
+            template<class Fn>
+            struct TaskBatch
+            {
+                struct Item
+                {
+                    TaskBatch* m_batch;
+                    size_t m_index;
+                };
+
+                template<class F>
+                TaskBatch(F&& fn, size_t numTasks)
+                    : m_fn(std::forward<F>(fn))
+                    , m_numRemaining(numTasks)
+                {}
+
+                static void Run(void* userData)
+                {
+                    auto item = reinterpret_cast<Item*>(userData);
+                    auto batch = item->m_batch;
+                    batch->m_fn(item->m_index);
+                    // lambdas capturing by reference don't need to count.
+                    if (!std::is_trivially_destructible<Fn>::value &&
+                        batch->m_numRemaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                    {
+                        batch->~TaskBatch();
+                    }
+                }
+
+                Fn m_fn;
+                std::atomic<size_t> m_numRemaining;
+            };
+        }
+
+        template<class Fn>
+        void RunTasks(size_t numTasks, Fn&& fn, Counter* counter, int priority, StackClass stackClass)
+        {
+            using Batch = detail::TaskBatch<typename std::decay<Fn>::type>;
+            static_assert(alignof(Batch) <= 16, "task arena memory is only 16 byte aligned");
+            if (numTasks == 0)
+                return;
+
+            auto arena = AcquireTaskArena();
+            auto batch = new (AllocFromTaskArena(arena, sizeof(Batch))) Batch(std::forward<Fn>(fn), numTasks);
+            auto tasks = reinterpret_cast<Task*>(AllocFromTaskArena(arena, numTasks * sizeof(Task)));
+            auto items = reinterpret_cast<typename Batch::Item*>(
+                AllocFromTaskArena(arena, numTasks * sizeof(typename Batch::Item)));
+            for (size_t i = 0; i < numTasks; ++i)
+            {
+                items[i].m_batch = batch;
+                items[i].m_index = i;
+                new (&tasks[i]) Task(&Batch::Run, &items[i]);
+            }
+            RunArenaTasks(tasks, numTasks, counter, arena, priority, stackClass);
+        }
     }
 }
 
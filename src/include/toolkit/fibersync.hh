@@ -0,0 +1,174 @@
+#pragma once
+#ifndef INCLUDED_LPTK_FIBERSYNC_HH
+#define INCLUDED_LPTK_FIBERSYNC_HH
+
+#include "toolkit/fiber.hh"
+#include "toolkit/parallel.hh"
+
+////////////////////////////////////////////////////////////////////////////////
+/*
+Synchronization for code running in fibers. Unlike Spinlock, Semaphore and
+Mutex, waiting on these only suspends the calling fiber; the worker thread goes
+on to run other fibers and tasks. They may only be waited on from a fiber
+thread (see IsInFiberThread), but can be signalled from anywhere.
+
+    lptk::fiber::FiberMutex mutex;
+    {
+        std::lock_guard<lptk::fiber::FiberMutex> lock(mutex);
+        // ... YieldFiber() and WaitForCounter() are fine in here
+    }
+*/
+
+namespace lptk
+{
+    namespace fiber
+    {
+        ////////////////////////////////////////////////////////////////////////////////
+        // A suspended fiber, parked on a one-shot counter the waker decrements.
+        // Lives on the waiting fiber's stack.
+        struct FiberWaiter
+        {
+            FiberWaiter() { m_counter.IncRef(); }
+
+            Counter m_counter;
+            FiberWaiter* m_next = nullptr;
+            // what the waiter is after, for owners that hand out amounts.
+            unsigned long m_wanted = 0;
+        };
+
+        ////////////////////////////////////////////////////////////////////////////////
+        // FIFO of waiting fibers. Not synchronized, the owner guards it with its lock.
+        class FiberWaitList
+        {
+        public:
+            FiberWaitList() = default;
+            ~FiberWaitList() { ASSERT(m_head == nullptr); }
+
+            FiberWaitList(const FiberWaitList&) = delete;
+            FiberWaitList& operator=(const FiberWaitList&) = delete;
+            FiberWaitList(FiberWaitList&&) = delete;
+            FiberWaitList& operator=(FiberWaitList&&) = delete;
+
+            bool empty() const { return m_head == nullptr; }
+            FiberWaiter* front() const { return m_head; }
+            void push(FiberWaiter* waiter);
+            FiberWaiter* pop();
+            // takes the whole list, for waking everything
+            FiberWaiter* pop_all();
+
+            // suspends the calling fiber until Wake is called on the waiter.
+            static void Wait(FiberWaiter* waiter);
+            // reschedules the waiter's fiber. The waiter may be gone once this returns.
+            static void Wake(FiberWaiter* waiter);
+        private:
+            FiberWaiter* m_head = nullptr;
+            FiberWaiter* m_tail = nullptr;
+        };
+
+        ////////////////////////////////////////////////////////////////////////////////
+        // Mutual exclusion between fibers. Unlock hands ownership straight to the
+        // longest waiting fiber, so waiters are served in order. Not recursive.
+        // Named lowercase so it works with std::lock_guard and std::unique_lock.
+        class FiberMutex
+        {
+        public:
+            FiberMutex() = default;
+            ~FiberMutex() { ASSERT(!m_locked); }
+
+            FiberMutex(const FiberMutex&) = delete;
+            FiberMutex& operator=(const FiberMutex&) = delete;
+            FiberMutex(FiberMutex&&) = delete;
+            FiberMutex& operator=(FiberMutex&&) = delete;
+
+            void lock();
+            bool try_lock();
+            void unlock();
+        private:
+            Spinlock m_lock;
+            bool m_locked = false;
+            FiberWaitList m_waiters;
+        };
+
+        ////////////////////////////////////////////////////////////////////////////////
+        // Condition variable for use with FiberMutex. As usual, always wait in a
+        // loop that checks the actual condition.
+        class FiberCondition
+        {
+        public:
+            FiberCondition() = default;
+            ~FiberCondition() = default;
+
+            FiberCondition(const FiberCondition&) = delete;
+            FiberCondition& operator=(const FiberCondition&) = delete;
+            FiberCondition(FiberCondition&&) = delete;
+            FiberCondition& operator=(FiberCondition&&) = delete;
+
+            // mutex must be locked by the caller. It is released while suspended
+            // and locked again before returning.
+            void Wait(FiberMutex& mutex);
+            template<class Pred>
+            void Wait(FiberMutex& mutex, Pred pred)
+            {
+                while (!pred())
+                    Wait(mutex);
+            }
+
+            void NotifyOne();
+            void NotifyAll();
+        private:
+            Spinlock m_lock;
+            FiberWaitList m_waiters;
+        };
+
+        ////////////////////////////////////////////////////////////////////////////////
+        // Counting semaphore. Released counts go to waiting fibers first, in order:
+        // the longest waiting fiber gets its whole request at once, and nothing is
+        // handed out past it until then, so a large Acquire isn't starved by
+        // small ones.
+        class FiberSemaphore
+        {
+        public:
+            explicit FiberSemaphore(unsigned long count = 0) : m_count(count) {}
+            ~FiberSemaphore() = default;
+
+            FiberSemaphore(const FiberSemaphore&) = delete;
+            FiberSemaphore& operator=(const FiberSemaphore&) = delete;
+            FiberSemaphore(FiberSemaphore&&) = delete;
+            FiberSemaphore& operator=(FiberSemaphore&&) = delete;
+
+            void Acquire(unsigned long val = 1);
+            bool TryAcquire();
+            void Release(unsigned long val = 1);
+            unsigned long GetCount();
+        private:
+            Spinlock m_lock;
+            unsigned long m_count;
+            FiberWaitList m_waiters;
+        };
+
+        ////////////////////////////////////////////////////////////////////////////////
+        // Single use countdown. Fibers calling Wait are suspended until CountDown
+        // has been called 'count' times. This is a Counter with a friendlier face.
+        class Latch
+        {
+        public:
+            explicit Latch(size_t count) { if (count) m_counter.IncRef(count); }
+            ~Latch() = default;
+
+            Latch(const Latch&) = delete;
+            Latch& operator=(const Latch&) = delete;
+            Latch(Latch&&) = delete;
+            Latch& operator=(Latch&&) = delete;
+
+            void CountDown(size_t count = 1);
+            bool TryWait() const { return m_counter.IsZero(); }
+            void Wait();
+            void ArriveAndWait(size_t count = 1);
+        private:
+            Counter m_counter;
+        };
+    }
+}
+
+#endif
+
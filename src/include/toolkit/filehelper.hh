@@ -24,6 +24,7 @@ namespace lptk
 	constexpr char kFileSep = FILE_SEP;
 	constexpr char kFileSepStr[] = FILE_SEP_STR;
 
+// These block the calling thread. In fibers, use lptk::fiber::FileIOService instead.
 template<class Container>
     Container ReadFile(const char* filename);
 template<class Container>
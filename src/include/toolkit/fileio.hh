@@ -0,0 +1,183 @@
+#pragma once
+#ifndef INCLUDED_LPTK_FILEIO_HH
+#define INCLUDED_LPTK_FILEIO_HH
+
+#include <cstdint>
+#include "toolkit/fiber.hh"
+#include "toolkit/dynary.hh"
+
+////////////////////////////////////////////////////////////////////////////////
+/*
+Asynchronous file reads and writes for fibers. Instead of blocking the worker
+thread in fread, the calling fiber is suspended until the I/O finishes:
+
+    lptk::fiber::FileIOService fileService;
+    fileService.Start();
+
+    // in a fiber:
+    auto contents = fileService.ReadFile<lptk::DynAry<char>>("data/level.bin");
+
+    fileService.Stop();
+
+Requests are submitted in batches through io_uring on linux when the kernel
+allows it, and otherwise handed to a small pool of threads doing pread/pwrite.
+*/
+
+namespace lptk
+{
+    namespace fiber
+    {
+#if defined(WINDOWS)
+        using FileHandle = void*;
+#elif defined(LINUX)
+        using FileHandle = int;
+#endif
+
+        class FileIOService final : public FiberService
+        {
+        public:
+            // numThreads is only used if io_uring isn't available. queueDepth is the
+            // most requests in flight at once.
+            explicit FileIOService(unsigned numThreads = 2, unsigned queueDepth = 64);
+            ~FileIOService() override;
+
+            // These may only be called from a fiber, which is suspended until the
+            // request is done. Return the number of bytes transferred, which can be
+            // short at the end of a file, or -1 on error.
+            int64_t Read(FileHandle file, void* buffer, size_t size, uint64_t offset);
+            int64_t Write(FileHandle file, const void* buffer, size_t size, uint64_t offset);
+
+            // Fiber friendly versions of lptk::ReadFile and lptk::WriteFile. Opening and
+            // closing the file still happens on the calling thread.
+            template<class Container>
+            Container ReadFile(const char* filename);
+            template<class Container>
+            bool WriteFile(const char* filename, Container&& buffer);
+
+            bool IsUsingIoUring() const { return m_ring.m_fd >= 0; }
+
+            static FileHandle OpenFile(const char* filename, bool write);
+            static void CloseFile(FileHandle file);
+            static bool IsValid(FileHandle file);
+            static int64_t GetFileSize(FileHandle file);
+
+        protected:
+            bool Update() override;
+            void CancelRequest(ServiceRequest* request) override;
+            void WakeUpdate() override;
+
+        private:
+            enum class Op { Read, Write };
+            struct IORequest
+            {
+                Op m_op;
+                FileHandle m_file;
+                void* m_buffer;
+                size_t m_size;
+                uint64_t m_offset;
+                int64_t m_result;
+            };
+
+            int64_t Submit(Op op, FileHandle file, void* buffer, size_t size, uint64_t offset);
+            static int64_t Execute(IORequest* ioRequest);
+
+            // io_uring, with the rings mapped straight from the kernel.
+            struct Ring
+            {
+                int m_fd = -1;
+                unsigned m_numEntries = 0;
+                void* m_sqMap = nullptr;
+                size_t m_sqMapSize = 0;
+                void* m_cqMap = nullptr;
+                size_t m_cqMapSize = 0;
+                void* m_sqes = nullptr;
+                size_t m_sqesSize = 0;
+
+                std::atomic<unsigned>* m_sqTail = nullptr;
+                unsigned* m_sqMask = nullptr;
+                unsigned* m_sqArray = nullptr;
+                std::atomic<unsigned>* m_cqHead = nullptr;
+                std::atomic<unsigned>* m_cqTail = nullptr;
+                unsigned* m_cqMask = nullptr;
+                void* m_cqes = nullptr;
+
+                // polled in the ring while Update waits, written by WakeUpdate.
+                int m_wakeFd = -1;
+                bool m_wakeArmed = false;
+            };
+            // requests are never null, so their user_data can't clash.
+            static constexpr uint64_t kWakeUserData = 0;
+            bool InitRing(unsigned queueDepth);
+            void ReleaseRing();
+            unsigned SubmitToRing();
+            void SubmitQueued();
+            void ExecuteQueued();
+            void ArmWake();
+            unsigned ReapRing();
+            void DrainRing();
+
+            Ring m_ring;
+            // in the submission ring, not taken by the kernel yet.
+            unsigned m_numQueued = 0;
+            // taken by the kernel, each one has a completion coming.
+            unsigned m_numInFlight = 0;
+
+            // thread pool fallback
+            static void PoolThreadMain(FileIOService* service);
+            lptk::DynAry<lptk::Thread> m_poolThreads;
+            lptk::IntrusiveSpinLockQueue<ServiceRequest> m_poolQueue;
+            Semaphore m_poolSemaphore;
+            std::atomic<bool> m_poolExit = false;
+        };
+
+        ////////////////////////////////////////
+        template<class Container>
+        Container FileIOService::ReadFile(const char* filename)
+        {
+            const auto file = OpenFile(filename, false);
+            if (!IsValid(file))
+                return Container();
+            auto closeOnExit = at_scope_exit([&] { CloseFile(file); });
+
+            const auto fileSize = GetFileSize(file);
+            if (fileSize < 0)
+                return Container();
+
+            Container buffer(static_cast<size_t>(fileSize));
+            auto data = reinterpret_cast<char*>(buffer.data());
+            size_t numRead = 0;
+            while (numRead < size_t(fileSize))
+            {
+                const auto result = Read(file, data + numRead, size_t(fileSize) - numRead, numRead);
+                if (result <= 0)
+                    return Container();
+                numRead += size_t(result);
+            }
+            return buffer;
+        }
+
+        template<class Container>
+        bool FileIOService::WriteFile(const char* filename, Container&& buffer)
+        {
+            const auto file = OpenFile(filename, true);
+            if (!IsValid(file))
+                return false;
+            auto closeOnExit = at_scope_exit([&] { CloseFile(file); });
+
+            const auto data = reinterpret_cast<const char*>(buffer.data());
+            const auto size = size_t{ buffer.size() };
+            size_t numWritten = 0;
+            while (numWritten < size)
+            {
+                const auto result = Write(file, data + numWritten, size - numWritten, numWritten);
+                if (result <= 0)
+                    return false;
+                numWritten += size_t(result);
+            }
+            return true;
+        }
+    }
+}
+
+#endif
+
@@ -0,0 +1,569 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include "hashmap.hh"
+#include "mathcommon.hh"
+#include "mem/alloc_policy.hh"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LPTK_FLATHASH_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace lptk
+{
+    ////////////////////////////////////////////////////////////////////////////////
+    /*
+    Open addressing hash map in the style of a Swiss table. Next to the slots
+    there's one control byte per slot: empty, deleted, or the low 7 bits of the
+    key's hash when full. Lookups go through the control bytes 16 at a time,
+    compared all at once with SSE2, and only touch a slot when its 7 bits match,
+    so a miss usually reads one group of control bytes and no keys at all.
+
+    - capacity is a power of two, probing is quadratic over groups of 16 and
+      masks instead of taking a modulo.
+    - the control bytes of the first group are repeated past the end, so a
+      group can be loaded at any slot.
+    - up to 7/8 of the slots fill before it grows.
+    - deleting leaves a tombstone unless no probe could have passed the slot,
+      tombstones go on the next rehash.
+
+    Same interface as HashMap, and MakeHash for hashing: the 7 bits come off the
+    bottom and the probe start from the bits above, so all need to be well spread.
+    Pointers to pairs are stable until the next insert.
+    */
+
+    namespace detail
+    {
+        ////////////////////////////////////////////////////////////////////////////////
+        enum : int8_t
+        {
+            kFlatHashEmpty = -128,
+            kFlatHashDeleted = -2,
+        };
+
+        constexpr size_t kFlatHashGroupWidth = 16;
+
+        // one bit per slot of the group that matched.
+        class FlatHashBitMask
+        {
+        public:
+            explicit FlatHashBitMask(uint32_t mask) : m_mask(mask) {}
+            explicit operator bool() const { return m_mask != 0; }
+            unsigned First() const { return unsigned(FirstBitIndex(m_mask)); }
+            unsigned Last() const { return unsigned(IntLog2(m_mask)); }
+            void RemoveFirst() { m_mask &= m_mask - 1; }
+        private:
+            uint32_t m_mask;
+        };
+
+        class FlatHashGroup
+        {
+        public:
+            explicit FlatHashGroup(const int8_t* ctrl)
+            {
+#if defined(LPTK_FLATHASH_SSE2)
+                m_ctrl = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl));
+#else
+                memcpy(m_ctrl, ctrl, kFlatHashGroupWidth);
+#endif
+            }
+
+            FlatHashBitMask Match(int8_t h2) const
+            {
+#if defined(LPTK_FLATHASH_SSE2)
+                return FlatHashBitMask(uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), m_ctrl))));
+#else
+                uint32_t mask = 0;
+                for (unsigned i = 0; i < kFlatHashGroupWidth; ++i)
+                    mask |= uint32_t(m_ctrl[i] == h2) << i;
+                return FlatHashBitMask(mask);
+#endif
+            }
+
+            FlatHashBitMask MatchEmpty() const
+            {
+                return Match(kFlatHashEmpty);
+            }
+
+            // empty and deleted are the only negative values.
+            FlatHashBitMask MatchEmptyOrDeleted() const
+            {
+#if defined(LPTK_FLATHASH_SSE2)
+                return FlatHashBitMask(uint32_t(_mm_movemask_epi8(m_ctrl)));
+#else
+                uint32_t mask = 0;
+                for (unsigned i = 0; i < kFlatHashGroupWidth; ++i)
+                    mask |= uint32_t(m_ctrl[i] < 0) << i;
+                return FlatHashBitMask(mask);
+#endif
+            }
+
+        private:
+#if defined(LPTK_FLATHASH_SSE2)
+            __m128i m_ctrl;
+#else
+            int8_t m_ctrl[kFlatHashGroupWidth];
+#endif
+        };
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////
+    template< class K, class V, class ALLOC = mem::PoolPolicy>
+    class FlatHashMap
+    {
+    public:
+        class iterator;
+        class const_iterator;
+
+        struct Pair
+        {
+            template<class VV>
+            Pair(const K& k, VV&& v) : key(k), value(std::forward<VV>(v)) {}
+
+            K key;
+            V value;
+        };
+
+        // room for size items before the first rehash.
+        explicit FlatHashMap(size_t size = 0, const ALLOC& alloc = ALLOC(MEMPOOL_General))
+            : m_alloc(alloc)
+        {
+            if (size)
+                Rehash(CapacityFor(size));
+        }
+
+        ~FlatHashMap()
+        {
+            Destroy();
+        }
+
+        FlatHashMap(FlatHashMap&& other)
+            : m_alloc(other.m_alloc)
+        {
+            swap(other);
+        }
+
+        FlatHashMap& operator=(FlatHashMap&& other)
+        {
+            if (this != &other)
+            {
+                Destroy();
+                m_slots = nullptr;
+                m_ctrl = nullptr;
+                m_capacity = m_size = m_growthLeft = 0;
+                swap(other);
+            }
+            return *this;
+        }
+
+        FlatHashMap(const FlatHashMap&) = delete;
+        FlatHashMap& operator=(const FlatHashMap&) = delete;
+
+        Pair* set(const K& key, const V& value) { return Insert(key, value); }
+        Pair* set(const K& key, V&& value) { return Insert(key, std::move(value)); }
+        bool has(const K& key) const { return Find(key) != kNotFound; }
+        const V& get(const K& key) const;
+        V& get(const K& key);
+        Pair* getpair(const K& key);
+        const Pair* getpair(const K& key) const;
+        void del(const K& key);
+
+        const V& operator[](const K& key) const { return get(key); }
+        V& operator[](const K& key);
+
+        const ALLOC& get_allocator() const { return m_alloc; }
+
+        size_t capacity() const { return m_capacity; }
+        size_t size() const { return m_size; }
+        bool empty() const { return m_size == 0; }
+
+        // rehashes into at least newSize slots.
+        void resize(size_t newSize);
+        void reserve(size_t numItems);
+
+        void clear();
+
+        void swap(FlatHashMap& other);
+
+        iterator begin() { return iterator(this, NextFull(0)); }
+        iterator end() { return iterator(this, m_capacity); }
+        const_iterator begin() const { return const_iterator(this, NextFull(0)); }
+        const_iterator end() const { return const_iterator(this, m_capacity); }
+
+    private:
+        static constexpr size_t kNotFound = ~size_t(0);
+        static constexpr size_t kMinCapacity = detail::kFlatHashGroupWidth;
+        static constexpr size_t kNumClonedBytes = detail::kFlatHashGroupWidth - 1;
+
+        static size_t HashOf(const K& key) { return MakeHash(key); }
+        static int8_t H2(size_t hash) { return int8_t(hash & 0x7f); }
+        static size_t H1(size_t hash) { return hash >> 7; }
+        static bool IsFull(int8_t ctrl) { return ctrl >= 0; }
+        static size_t MaxLoad(size_t capacity) { return capacity - capacity / 8; }
+        static size_t CapacityFor(size_t numItems);
+
+        size_t Mask() const { return m_capacity - 1; }
+        size_t Find(const K& key) const { return Find(key, HashOf(key)); }
+        size_t Find(const K& key, size_t hash) const;
+        size_t FindFirstNonFull(size_t hash) const;
+        size_t PrepareInsert(size_t hash);
+        template<class VV>
+        Pair* Insert(const K& key, VV&& value);
+        void SetCtrl(size_t index, int8_t ctrl);
+        void EraseAt(size_t index);
+        void Rehash(size_t newCapacity);
+        void Destroy();
+        size_t NextFull(size_t index) const;
+
+        Pair* m_slots = nullptr;
+        int8_t* m_ctrl = nullptr;
+        size_t m_capacity = 0;
+        size_t m_size = 0;
+        // inserts into empty slots left before a rehash, tombstones don't count.
+        size_t m_growthLeft = 0;
+        ALLOC m_alloc;
+    };
+
+    ////////////////////////////////////////////////////////////////////////////////
+    template< class K, class V, class ALLOC>
+    class FlatHashMap<K,V,ALLOC>::iterator
+    {
+        friend class FlatHashMap<K, V, ALLOC>;
+    public:
+        iterator() = default;
+
+        Pair& operator*() const { return m_owner->m_slots[m_index]; }
+        Pair* operator->() const { return &m_owner->m_slots[m_index]; }
+
+        iterator& operator++()
+        {
+            m_index = m_owner->NextFull(m_index + 1);
+            return *this;
+        }
+
+        iterator operator++(int)
+        {
+            iterator temp = *this;
+            ++*this;
+            return temp;
+        }
+
+        bool operator==(const iterator& o) const { return m_owner == o.m_owner && m_index == o.m_index; }
+        bool operator!=(const iterator& o) const { return !(*this == o); }
+    protected:
+        iterator(FlatHashMap* owner, size_t index) : m_owner(owner), m_index(index) {}
+    private:
+        FlatHashMap* m_owner = nullptr;
+        size_t m_index = ~size_t(0);
+    };
+
+    template< class K, class V, class ALLOC>
+    class FlatHashMap<K,V,ALLOC>::const_iterator
+    {
+        friend class FlatHashMap<K, V, ALLOC>;
+    public:
+        const_iterator() = default;
+
+        const Pair& operator*() const { return m_owner->m_slots[m_index]; }
+        const Pair* operator->() const { return &m_owner->m_slots[m_index]; }
+
+        const_iterator& operator++()
+        {
+            m_index = m_owner->NextFull(m_index + 1);
+            return *this;
+        }
+
+        const_iterator operator++(int)
+        {
+            const_iterator temp = *this;
+            ++*this;
+            return temp;
+        }
+
+        bool operator==(const const_iterator& o) const { return m_owner == o.m_owner && m_index == o.m_index; }
+        bool operator!=(const const_iterator& o) const { return !(*this == o); }
+    protected:
+        const_iterator(const FlatHashMap* owner, size_t index) : m_owner(owner), m_index(index) {}
+    private:
+        const FlatHashMap* m_owner = nullptr;
+        size_t m_index = ~size_t(0);
+    };
+
+    ////////////////////////////////////////////////////////////////////////////////
+    // Impl
+    template< class K, class V, class ALLOC>
+    const V& FlatHashMap<K,V,ALLOC>::get(const K& key) const
+    {
+        auto const index = Find(key);
+        ASSERT(index != kNotFound);
+        return m_slots[index].value;
+    }
+
+    template< class K, class V, class ALLOC>
+    V& FlatHashMap<K,V,ALLOC>::get(const K& key)
+    {
+        auto const index = Find(key);
+        ASSERT(index != kNotFound);
+        return m_slots[index].value;
+    }
+
+    template< class K, class V, class ALLOC>
+    typename FlatHashMap<K,V,ALLOC>::Pair* FlatHashMap<K,V,ALLOC>::getpair(const K& key)
+    {
+        auto const index = Find(key);
+        return index == kNotFound ? nullptr : &m_slots[index];
+    }
+
+    template< class K, class V, class ALLOC>
+    const typename FlatHashMap<K,V,ALLOC>::Pair* FlatHashMap<K,V,ALLOC>::getpair(const K& key) const
+    {
+        auto const index = Find(key);
+        return index == kNotFound ? nullptr : &m_slots[index];
+    }
+
+    template< class K, class V, class ALLOC>
+    V& FlatHashMap<K,V,ALLOC>::operator[](const K& key)
+    {
+        auto const hash = HashOf(key);
+        auto index = Find(key, hash);
+        if (index == kNotFound)
+        {
+            index = PrepareInsert(hash);
+            new (&m_slots[index]) Pair(key, V());
+        }
+        return m_slots[index].value;
+    }
+
+    template< class K, class V, class ALLOC>
+    void FlatHashMap<K,V,ALLOC>::del(const K& key)
+    {
+        auto const index = Find(key);
+        ASSERT(index != kNotFound);
+        if (index != kNotFound)
+            EraseAt(index);
+    }
+
+    template< class K, class V, class ALLOC>
+    void FlatHashMap<K,V,ALLOC>::resize(size_t newSize)
+    {
+        ASSERT(newSize >= m_size);
+        size_t newCapacity = kMinCapacity;
+        while (newCapacity < newSize || MaxLoad(newCapacity) < m_size)
+            newCapacity *= 2;
+        Rehash(newCapacity);
+    }
+
+    template< class K, class V, class ALLOC>
+    void FlatHashMap<K,V,ALLOC>::reserve(size_t numItems)
+    {
+        if (numItems > m_size + m_growthLeft)
+            Rehash(CapacityFor(numItems));
+    }
+
+    template< class K, class V, class ALLOC>
+    void FlatHashMap<K,V,ALLOC>::clear()
+    {
+        if (!m_capacity)
+            return;
+        for (size_t i = 0; i < m_capacity; ++i)
+        {
+            if (IsFull(m_ctrl[i]))
+                m_slots[i].~Pair();
+        }
+        memset(m_ctrl, detail::kFlatHashEmpty, m_capacity + kNumClonedBytes);
+        m_size = 0;
+        m_growthLeft = MaxLoad(m_capacity);
+    }
+
+    template< class K, class V, class ALLOC>
+    void FlatHashMap<K,V,ALLOC>::swap(FlatHashMap& other)
+    {
+        std::swap(m_slots, other.m_slots);
+        std::swap(m_ctrl, other.m_ctrl);
+        std::swap(m_capacity, other.m_capacity);
+        std::swap(m_size, other.m_size);
+        std::swap(m_growthLeft, other.m_growthLeft);
+        std::swap(m_alloc, other.m_alloc);
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////
+    // Internal impl
+    template< class K, class V, class ALLOC>
+    size_t FlatHashMap<K,V,ALLOC>::CapacityFor(size_t numItems)
+    {
+        size_t capacity = kMinCapacity;
+        while (MaxLoad(capacity) < numItems)
+            capacity *= 2;
+        return capacity;
+    }
+
+    template< class K, class V, class ALLOC>
+    size_t FlatHashMap<K,V,ALLOC>::Find(const K& key, size_t hash) const
+    {
+        if (!m_capacity)
+            return kNotFound;
+
+        auto const h2 = H2(hash);
+        auto const mask = Mask();
+        size_t pos = H1(hash) & mask;
+        for (size_t step = detail::kFlatHashGroupWidth; ; step += detail::kFlatHashGroupWidth)
+        {
+            const detail::FlatHashGroup group(m_ctrl + pos);
+            for (auto match = group.Match(h2); match; match.RemoveFirst())
+            {
+                auto const index = (pos + match.First()) & mask;
+                if (m_slots[index].key == key)
+                    return index;
+            }
+            // there's always an empty slot somewhere, so this ends.
+            if (group.MatchEmpty())
+                return kNotFound;
+            pos = (pos + step) & mask;
+        }
+    }
+
+    template< class K, class V, class ALLOC>
+    size_t FlatHashMap<K,V,ALLOC>::FindFirstNonFull(size_t hash) const
+    {
+        auto const mask = Mask();
+        size_t pos = H1(hash) & mask;
+        for (size_t step = detail::kFlatHashGroupWidth; ; step += detail::kFlatHashGroupWidth)
+        {
+            auto const match = detail::FlatHashGroup(m_ctrl + pos).MatchEmptyOrDeleted();
+            if (match)
+                return (pos + match.First()) & mask;
+            pos = (pos + step) & mask;
+        }
+    }
+
+    template< class K, class V, class ALLOC>
+    size_t FlatHashMap<K,V,ALLOC>::PrepareInsert(size_t hash)
+    {
+        if (!m_capacity)
+            Rehash(kMinCapacity);
+
+        auto index = FindFirstNonFull(hash);
+        if (m_growthLeft == 0 && m_ctrl[index] != detail::kFlatHashDeleted)
+        {
+            // mostly tombstones: clean up in place, otherwise grow.
+            Rehash(m_size + 1 > MaxLoad(m_capacity) / 2 ? m_capacity * 2 : m_capacity);
+            index = FindFirstNonFull(hash);
+        }
+
+        if (m_ctrl[index] == detail::kFlatHashEmpty)
+            --m_growthLeft;
+        SetCtrl(index, H2(hash));
+        ++m_size;
+        return index;
+    }
+
+    template< class K, class V, class ALLOC>
+    template<class VV>
+    typename FlatHashMap<K,V,ALLOC>::Pair* FlatHashMap<K,V,ALLOC>::Insert(const K& key, VV&& value)
+    {
+        auto const hash = HashOf(key);
+        auto index = Find(key, hash);
+        if (index != kNotFound)
+        {
+            m_slots[index].value = std::forward<VV>(value);
+        }
+        else
+        {
+            index = PrepareInsert(hash);
+            new (&m_slots[index]) Pair(key, std::forward<VV>(value));
+        }
+        return &m_slots[index];
+    }
+
+    template< class K, class V, class ALLOC>
+    void FlatHashMap<K,V,ALLOC>::SetCtrl(size_t index, int8_t ctrl)
+    {
+        m_ctrl[index] = ctrl;
+        // the copy past the end, for the first kNumClonedBytes slots.
+        m_ctrl[((index - kNumClonedBytes) & Mask()) + kNumClonedBytes] = ctrl;
+    }
+
+    template< class K, class V, class ALLOC>
+    void FlatHashMap<K,V,ALLOC>::EraseAt(size_t index)
+    {
+        m_slots[index].~Pair();
+        --m_size;
+
+        // if every group window over this slot has an empty, no probe ever went
+        // past it, and it can be empty again instead of a tombstone.
+        auto const before = detail::FlatHashGroup(m_ctrl + ((index - detail::kFlatHashGroupWidth) & Mask())).MatchEmpty();
+        auto const after = detail::FlatHashGroup(m_ctrl + index).MatchEmpty();
+        const bool neverFull = before && after &&
+            after.First() + (detail::kFlatHashGroupWidth - 1 - before.Last()) < detail::kFlatHashGroupWidth;
+        if (neverFull)
+        {
+            SetCtrl(index, detail::kFlatHashEmpty);
+            ++m_growthLeft;
+        }
+        else
+        {
+            SetCtrl(index, detail::kFlatHashDeleted);
+        }
+    }
+
+    template< class K, class V, class ALLOC>
+    void FlatHashMap<K,V,ALLOC>::Rehash(size_t newCapacity)
+    {
+        ASSERT(IsPower2(newCapacity) && newCapacity >= kMinCapacity && MaxLoad(newCapacity) >= m_size);
+
+        // one block: the slots, then the control bytes.
+        const size_t slotBytes = AlignValue(newCapacity * sizeof(Pair), detail::kFlatHashGroupWidth);
+        const auto align = unsigned(Max(alignof(Pair), detail::kFlatHashGroupWidth));
+        auto mem = reinterpret_cast<char*>(m_alloc.Allocate(slotBytes + newCapacity + kNumClonedBytes, align));
+        ASSERT(mem);
+
+        Pair* oldSlots = m_slots;
+        int8_t* oldCtrl = m_ctrl;
+        const size_t oldCapacity = m_capacity;
+
+        m_slots = reinterpret_cast<Pair*>(mem);
+        m_ctrl = reinterpret_cast<int8_t*>(mem + slotBytes);
+        m_capacity = newCapacity;
+        memset(m_ctrl, detail::kFlatHashEmpty, newCapacity + kNumClonedBytes);
+
+        for (size_t i = 0; i < oldCapacity; ++i)
+        {
+            if (!IsFull(oldCtrl[i]))
+                continue;
+            Pair& pair = oldSlots[i];
+            auto const hash = HashOf(pair.key);
+            auto const index = FindFirstNonFull(hash);
+            SetCtrl(index, H2(hash));
+            new (&m_slots[index]) Pair(std::move(pair));
+            pair.~Pair();
+        }
+        m_growthLeft = MaxLoad(newCapacity) - m_size;
+
+        if (oldSlots)
+            m_alloc.Free(oldSlots);
+    }
+
+    template< class K, class V, class ALLOC>
+    void FlatHashMap<K,V,ALLOC>::Destroy()
+    {
+        if (!m_slots)
+            return;
+        for (size_t i = 0; i < m_capacity; ++i)
+        {
+            if (IsFull(m_ctrl[i]))
+                m_slots[i].~Pair();
+        }
+        m_alloc.Free(m_slots);
+    }
+
+    template< class K, class V, class ALLOC>
+    size_t FlatHashMap<K,V,ALLOC>::NextFull(size_t index) const
+    {
+        while (index < m_capacity && !IsFull(m_ctrl[index]))
+            ++index;
+        return index;
+    }
+}
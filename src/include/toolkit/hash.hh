@@ -0,0 +1,279 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+namespace lptk
+{
+    ////////////////////////////////////////////////////////////////////////////////
+    /*
+    64 bit hashing, in the family of wyhash. Keys up to kHashShortMax bytes go
+    through 16 or 48 byte steps of a 64x64->128 bit multiply, folded. Longer
+    keys are cut in 64 byte stripes and run through 8 independent lanes,
+    2 per SSE2 register where there is SSE2 (see src/hash.cpp), then folded
+    into the same finish as the short keys.
+
+    HashBytes is the one to use at runtime. HashBytesConstexpr computes the
+    same value at compile time, on little endian machines, which is all the
+    ones we build for. HashInt64 is a bijective mixer for arithmetic keys, so
+    distinct integers never share a hash.
+    */
+
+    namespace detail
+    {
+        constexpr uint64_t kHashP0 = 0xa0761d6478bd642full;
+        constexpr uint64_t kHashP1 = 0xe7037ed1a0b428dbull;
+        constexpr uint64_t kHashP2 = 0x8ebc6af09c88c6e3ull;
+        constexpr uint64_t kHashP3 = 0x589965cc75374cc3ull;
+        constexpr size_t kHashShortMax = 256;
+        constexpr size_t kHashStripeSize = 64;
+        constexpr size_t kHashStripesPerScramble = 16;
+        constexpr uint64_t kHashScramblePrime = 0x9e3779b1ull;
+        constexpr uint64_t kHashStripeSecret[8] = {
+            0xbe4ba423396cfeb8ull, 0x1cad21f72c81017cull, 0xdb979083e96dd4deull, 0x1f67b3b7a4a44072ull,
+            0x78e5c0cc4ee679cbull, 0x2172ffcc7dd05a82ull, 0x8e2443f7744608b8ull, 0x4c263a81e69035e0ull,
+        };
+
+        constexpr void HashMulFull(uint64_t a, uint64_t b, uint64_t& lo, uint64_t& hi)
+        {
+#if defined(__SIZEOF_INT128__)
+            const auto r = static_cast<unsigned __int128>(a) * b;
+            lo = uint64_t(r);
+            hi = uint64_t(r >> 64);
+#else
+            const uint64_t aLo = a & 0xffffffff, aHi = a >> 32;
+            const uint64_t bLo = b & 0xffffffff, bHi = b >> 32;
+            const uint64_t ll = aLo * bLo, lh = aLo * bHi, hl = aHi * bLo, hh = aHi * bHi;
+            const uint64_t mid = (ll >> 32) + (lh & 0xffffffff) + (hl & 0xffffffff);
+            lo = (ll & 0xffffffff) | (mid << 32);
+            hi = hh + (lh >> 32) + (hl >> 32) + (mid >> 32);
+#endif
+        }
+
+        constexpr uint64_t HashMum(uint64_t a, uint64_t b)
+        {
+            uint64_t lo = 0, hi = 0;
+            HashMulFull(a, b, lo, hi);
+            return lo ^ hi;
+        }
+
+        // little endian reads, one byte at a time so they work in constant expressions.
+        struct HashReadConstexpr
+        {
+            static constexpr uint64_t Read64(const char* p)
+            {
+                uint64_t v = 0;
+                for (int i = 7; i >= 0; --i)
+                    v = (v << 8) | uint8_t(p[i]);
+                return v;
+            }
+            static constexpr uint64_t Read32(const char* p)
+            {
+                return uint64_t(uint8_t(p[0])) | uint64_t(uint8_t(p[1])) << 8 |
+                    uint64_t(uint8_t(p[2])) << 16 | uint64_t(uint8_t(p[3])) << 24;
+            }
+        };
+
+        struct HashReadMemory
+        {
+            static uint64_t Read64(const char* p)
+            {
+                uint64_t v;
+                memcpy(&v, p, sizeof(v));
+                return v;
+            }
+            static uint64_t Read32(const char* p)
+            {
+                uint32_t v;
+                memcpy(&v, p, sizeof(v));
+                return v;
+            }
+        };
+
+        constexpr uint64_t HashSeed(uint64_t seed)
+        {
+            return seed ^ HashMum(seed ^ kHashP0, kHashP1);
+        }
+
+        // keys of up to kHashShortMax bytes, down to the two words HashFinish takes.
+        template<class R>
+        constexpr void HashShort(const char* p, size_t len, uint64_t& seed, uint64_t& a, uint64_t& b)
+        {
+            if (len <= 16)
+            {
+                if (len >= 4)
+                {
+                    const size_t mid = (len >> 3) << 2;
+                    a = (R::Read32(p) << 32) | R::Read32(p + mid);
+                    b = (R::Read32(p + len - 4) << 32) | R::Read32(p + len - 4 - mid);
+                }
+                else if (len > 0)
+                {
+                    a = (uint64_t(uint8_t(p[0])) << 16) | (uint64_t(uint8_t(p[len >> 1])) << 8) | uint8_t(p[len - 1]);
+                    b = 0;
+                }
+                else
+                {
+                    a = b = 0;
+                }
+                return;
+            }
+
+            size_t i = len;
+            if (i > 48)
+            {
+                uint64_t see1 = seed, see2 = seed;
+                do
+                {
+                    seed = HashMum(R::Read64(p) ^ kHashP1, R::Read64(p + 8) ^ seed);
+                    see1 = HashMum(R::Read64(p + 16) ^ kHashP2, R::Read64(p + 24) ^ see1);
+                    see2 = HashMum(R::Read64(p + 32) ^ kHashP3, R::Read64(p + 40) ^ see2);
+                    p += 48;
+                    i -= 48;
+                } while (i > 48);
+                seed ^= see1 ^ see2;
+            }
+            while (i > 16)
+            {
+                seed = HashMum(R::Read64(p) ^ kHashP1, R::Read64(p + 8) ^ seed);
+                p += 16;
+                i -= 16;
+            }
+            // the last 16 bytes, overlapping what came before when i < 16.
+            a = R::Read64(p + i - 16);
+            b = R::Read64(p + i - 8);
+        }
+
+        // the secret moves on with every stripe, else the same bit flipped in two
+        // stripes adds up the same.
+        template<class R>
+        constexpr void HashStripe(uint64_t* acc, const char* p, size_t stripe)
+        {
+            for (int i = 0; i < 8; ++i)
+            {
+                const uint64_t value = R::Read64(p + 8 * i);
+                const uint64_t key = value ^ (kHashStripeSecret[i] + uint64_t(stripe) * kHashP2);
+                acc[i ^ 1] += value;
+                acc[i] += (key & 0xffffffff) * (key >> 32);
+            }
+        }
+
+        constexpr void HashScramble(uint64_t* acc)
+        {
+            for (int i = 0; i < 8; ++i)
+            {
+                uint64_t v = acc[i];
+                v ^= v >> 47;
+                v ^= kHashStripeSecret[7 - i];
+                acc[i] = v * kHashScramblePrime;
+            }
+        }
+
+        constexpr void HashInitLanes(uint64_t* acc, uint64_t seed)
+        {
+            acc[0] = kHashP0 ^ seed; acc[1] = kHashP1; acc[2] = kHashP2 ^ seed; acc[3] = kHashP3;
+            acc[4] = ~kHashP0 ^ seed; acc[5] = ~kHashP1; acc[6] = ~kHashP2 ^ seed; acc[7] = ~kHashP3;
+        }
+
+        constexpr uint64_t HashMergeLanes(const uint64_t* acc, size_t len)
+        {
+            uint64_t result = uint64_t(len) * kHashP0;
+            for (int i = 0; i < 8; i += 2)
+                result += HashMum(acc[i] ^ kHashStripeSecret[i], acc[i + 1] ^ kHashStripeSecret[i + 1]);
+            return result;
+        }
+
+        // keys longer than kHashShortMax. Whole stripes, then the last 64 bytes
+        // as one more, overlapping.
+        template<class R>
+        constexpr uint64_t HashLongScalar(const char* p, size_t len, uint64_t seed)
+        {
+            uint64_t acc[8] = {};
+            HashInitLanes(acc, seed);
+            const size_t numStripes = (len - 1) / kHashStripeSize;
+            for (size_t stripe = 0; stripe < numStripes; ++stripe)
+            {
+                HashStripe<R>(acc, p + stripe * kHashStripeSize, stripe);
+                if ((stripe + 1) % kHashStripesPerScramble == 0)
+                    HashScramble(acc);
+            }
+            HashStripe<R>(acc, p + len - kHashStripeSize, numStripes);
+            return HashMergeLanes(acc, len);
+        }
+
+        // same result as HashLongScalar, with SSE2 where there is.
+        uint64_t HashLong(const char* p, size_t len, uint64_t seed);
+
+        constexpr uint64_t HashFinish(uint64_t a, uint64_t b, uint64_t seed, size_t len)
+        {
+            a ^= kHashP1;
+            b ^= seed;
+            HashMulFull(a, b, a, b);
+            return HashMum(a ^ kHashP0 ^ uint64_t(len), b ^ kHashP1);
+        }
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////
+    inline uint64_t HashBytes(const void* data, size_t len, uint64_t seed = 0)
+    {
+        const auto p = reinterpret_cast<const char*>(data);
+        seed = detail::HashSeed(seed);
+        uint64_t a = 0, b = 0;
+        if (len <= detail::kHashShortMax)
+        {
+            detail::HashShort<detail::HashReadMemory>(p, len, seed, a, b);
+        }
+        else
+        {
+            a = detail::HashLong(p, len, seed);
+            b = detail::kHashP3;
+        }
+        return detail::HashFinish(a, b, seed, len);
+    }
+
+    constexpr uint64_t HashBytesConstexpr(const char* p, size_t len, uint64_t seed = 0)
+    {
+        seed = detail::HashSeed(seed);
+        uint64_t a = 0, b = 0;
+        if (len <= detail::kHashShortMax)
+        {
+            detail::HashShort<detail::HashReadConstexpr>(p, len, seed, a, b);
+        }
+        else
+        {
+            a = detail::HashLongScalar<detail::HashReadConstexpr>(p, len, seed);
+            b = detail::kHashP3;
+        }
+        return detail::HashFinish(a, b, seed, len);
+    }
+
+    // for string literals: HashStringConstexpr("name") == HashString("name").
+    constexpr uint64_t HashStringConstexpr(const char* s, uint64_t seed = 0)
+    {
+        size_t len = 0;
+        while (s[len])
+            ++len;
+        return HashBytesConstexpr(s, len, seed);
+    }
+
+    inline uint64_t HashString(const char* s, uint64_t seed = 0)
+    {
+        return HashBytes(s, strlen(s), seed);
+    }
+
+    // murmur3's finalizer: every input bit reaches every output bit, and it's a bijection.
+    constexpr uint64_t HashInt64(uint64_t x)
+    {
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdull;
+        x ^= x >> 33;
+        x *= 0xc4ceb9fe1a85ec53ull;
+        x ^= x >> 33;
+        return x;
+    }
+
+    constexpr uint64_t HashCombine(uint64_t seed, uint64_t hash)
+    {
+        return detail::HashMum(seed ^ detail::kHashP0, hash ^ detail::kHashP1);
+    }
+}
@@ -5,6 +5,8 @@
 #include <string>
 //#include <vector>
 #include <algorithm>
+#include <type_traits>
+#include "hash.hh"
 #include "str.hh"
 #include "dynary.hh"
 #include "bitvector.hh"
@@ -15,45 +17,51 @@
 namespace lptk
 {
 
-// Default Hash
+// Default Hash: arithmetic keys are mixed, anything else is hashed as bytes,
+// see toolkit/hash.hh. Tables use the low and the high bits, so overloads for
+// other key types should be as well spread.
 template< class T >
-inline size_t MakeHash(const T& key) 
+inline typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value, size_t>::type
+MakeHash(const T& key)
 {
-    size_t result = 0;
-    int len = sizeof(T);
-
-    // reinterpret the bytes as a string
-    const char* p = reinterpret_cast<const char*>(&key);
+    return size_t(HashInt64(uint64_t(key)));
+}
 
-    while(len--) 
-        result += 261 * *p++;
+template< class T >
+inline typename std::enable_if<std::is_pointer<T>::value, size_t>::type
+MakeHash(const T& key)
+{
+    return size_t(HashInt64(uint64_t(reinterpret_cast<uintptr_t>(key))));
+}
 
-    return result;
+template< class T >
+inline typename std::enable_if<!std::is_integral<T>::value && !std::is_enum<T>::value &&
+    !std::is_pointer<T>::value, size_t>::type
+MakeHash(const T& key)
+{
+    return size_t(HashBytes(&key, sizeof(T)));
 }
 
 inline size_t MakeHash(const char* key) 
 {
-    size_t result = 0;
-    const char* p = key;
-
-    while(*p) result += 261 * *p++;
-    return result;
+    return size_t(HashString(key));
 }
 
 template<MemPoolId POOL>
 inline size_t MakeHash(const StringImpl<POOL>& str)
 {
-    return MakeHash(str.c_str());
+    return size_t(HashBytes(str.c_str(), str.length()));
 }
 
 inline size_t MakeHash(const std::string& str)
 {
-    return MakeHash(str.c_str());
+    return size_t(HashBytes(str.data(), str.size()));
 }
 
 ////////////////////////////////////////////////////////////////////////////////	
-// Resizing hash map
-template< class K, class V>
+// Resizing hash map. ALLOC is the allocation policy for the table, see
+// toolkit/mem/alloc_policy.hh.
+template< class K, class V, class ALLOC = mem::PoolPolicy>
 class HashMap
 {
     friend class iterator;
@@ -86,9 +94,9 @@ public:
         V value;
     };
 
-    explicit HashMap(size_t size = 31) 
-        : m_pairs(size, MEMPOOL_General)
-        , m_used(size, false)
+    explicit HashMap(size_t size = 31, const ALLOC& alloc = ALLOC(MEMPOOL_General)) 
+        : m_pairs(size, alloc)
+        , m_used(size, false, alloc)
         , m_maxLoad(0.5f)
         , m_grow(1.5f)
         , m_numSetItems(0)
@@ -129,6 +137,8 @@ public:
     const V& operator[](const K& key) const { return get(key); }
     V& operator[](const K& key) ;
 
+    const ALLOC& get_allocator() const { return m_pairs.get_allocator(); }
+
     size_t capacity() const { return m_pairs.capacity(); }
     size_t size() const { return m_numSetItems; }
     bool empty() const { return size() == 0; }
@@ -153,18 +163,18 @@ private:
     size_t FindPair(const K& key) const;
     size_t Probe(const K &key) const;
 
-    DynAry<Pair> m_pairs;
-    BitVector m_used;
+    DynAry<Pair, alignof(Pair), MEMPOOL_General, ALLOC> m_pairs;
+    BitVectorImpl<ALLOC> m_used;
     float m_maxLoad;
     float m_grow;
     size_t m_numSetItems;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
-template< class K, class V>
-class HashMap<K,V>::iterator
+template< class K, class V, class ALLOC>
+class HashMap<K,V,ALLOC>::iterator
 {
-    friend class HashMap<K, V>;
+    friend class HashMap<K, V, ALLOC>;
 public:
     iterator() : m_owner(0), m_index(static_cast<decltype(m_index)>(-1)) {}
     iterator(const iterator& other) : m_owner(other.m_owner), m_index(other.m_index) {}
@@ -175,11 +185,11 @@ public:
         return *this;
     }
 
-    typename HashMap<K, V>::Pair& operator*() {
+    typename HashMap<K, V, ALLOC>::Pair& operator*() {
         return m_owner->m_pairs[m_index];
     }
 
-    typename HashMap<K, V>::Pair* operator->() {
+    typename HashMap<K, V, ALLOC>::Pair* operator->() {
         return &m_owner->m_pairs[m_index];
     }
 
@@ -216,10 +226,10 @@ private:
     size_t m_index;
 };
 
-template< class K, class V>
-class HashMap<K,V>::const_iterator
+template< class K, class V, class ALLOC>
+class HashMap<K,V,ALLOC>::const_iterator
 {
-    friend class HashMap<K, V>;
+    friend class HashMap<K, V, ALLOC>;
 public:
     const_iterator() : m_owner(0), m_index(static_cast<decltype(m_index)>(-1)) {}
     const_iterator(const const_iterator& other) : m_owner(other.m_owner), m_index(other.m_index) {}
@@ -230,11 +240,11 @@ public:
         return *this;
     }
 
-    const typename HashMap<K, V>::Pair& operator*() {
+    const typename HashMap<K, V, ALLOC>::Pair& operator*() {
         return m_owner->m_pairs[m_index];
     }
 
-    const typename HashMap<K, V>::Pair* operator->() {
+    const typename HashMap<K, V, ALLOC>::Pair* operator->() {
         return &m_owner->m_pairs[m_index];
     }
 
@@ -273,8 +283,8 @@ private:
 
 ////////////////////////////////////////////////////////////////////////////////	
 // Impl
-template< class K, class V>
-typename HashMap<K,V>::Pair* HashMap<K,V>::set(const K& key, const V& value)
+template< class K, class V, class ALLOC>
+typename HashMap<K,V,ALLOC>::Pair* HashMap<K,V,ALLOC>::set(const K& key, const V& value)
 {					
     // grow if we need to.
     if( m_numSetItems > (m_maxLoad * m_pairs.size()) )
@@ -294,8 +304,8 @@ typename HashMap<K,V>::Pair* HashMap<K,V>::set(const K& key, const V& value)
     return &m_pairs[index];
 }
 	
-template< class K, class V>
-typename HashMap<K,V>::Pair* HashMap<K,V>::set(const K& key, V&& value)
+template< class K, class V, class ALLOC>
+typename HashMap<K,V,ALLOC>::Pair* HashMap<K,V,ALLOC>::set(const K& key, V&& value)
 {					
     // grow if we need to.
     if( m_numSetItems > (m_maxLoad * m_pairs.size()) )
@@ -315,8 +325,8 @@ typename HashMap<K,V>::Pair* HashMap<K,V>::set(const K& key, V&& value)
     return &m_pairs[index];
 }
 
-template< class K, class V>
-V& HashMap<K,V>::operator[](const K& key) 
+template< class K, class V, class ALLOC>
+V& HashMap<K,V,ALLOC>::operator[](const K& key) 
 {
     auto const index = Probe(key);
     if(m_used[index])
@@ -324,31 +334,31 @@ V& HashMap<K,V>::operator[](const K& key)
     else return set(key,V())->value;
 }
 
-template< class K, class V>
-bool HashMap<K,V>::has(const K& key) const
+template< class K, class V, class ALLOC>
+bool HashMap<K,V,ALLOC>::has(const K& key) const
 {
     auto const index = Probe(key);
     return (m_used[index]);
 }
 
-template< class K, class V>
-const V& HashMap<K,V>::get(const K& key) const
+template< class K, class V, class ALLOC>
+const V& HashMap<K,V,ALLOC>::get(const K& key) const
 {
     auto const index = Probe(key);
     ASSERT(m_used[index]);
     return m_pairs[index].value;
 }
 
-template< class K, class V>
-V& HashMap<K,V>::get(const K& key) 
+template< class K, class V, class ALLOC>
+V& HashMap<K,V,ALLOC>::get(const K& key) 
 {
     auto const index = Probe(key);
     ASSERT(m_used[index]);
     return m_pairs[index].value;
 }
 
-template< class K, class V>
-typename HashMap<K,V>::Pair* HashMap<K,V>::getpair(const K& key)
+template< class K, class V, class ALLOC>
+typename HashMap<K,V,ALLOC>::Pair* HashMap<K,V,ALLOC>::getpair(const K& key)
 {
     auto const index = Probe(key);
     if(!m_used[index])
@@ -357,8 +367,8 @@ typename HashMap<K,V>::Pair* HashMap<K,V>::getpair(const K& key)
     return pair;
 }
 
-template< class K, class V>
-const typename HashMap<K,V>::Pair* HashMap<K,V>::getpair(const K& key) const
+template< class K, class V, class ALLOC>
+const typename HashMap<K,V,ALLOC>::Pair* HashMap<K,V,ALLOC>::getpair(const K& key) const
 {
     auto const index = Probe(key);
     if(!m_used[index])
@@ -367,8 +377,8 @@ const typename HashMap<K,V>::Pair* HashMap<K,V>::getpair(const K& key) const
     return pair;
 }
 
-template< class K, class V>
-void HashMap<K,V>::del(const K& key) 
+template< class K, class V, class ALLOC>
+void HashMap<K,V,ALLOC>::del(const K& key) 
 {
     auto const delIndex = Probe(key);
     ASSERT(m_used[delIndex]);
@@ -394,12 +404,12 @@ void HashMap<K,V>::del(const K& key)
     }
 }
 
-template< class K, class V>
-void HashMap<K,V>::resize(size_t newSize)
+template< class K, class V, class ALLOC>
+void HashMap<K,V,ALLOC>::resize(size_t newSize)
 {
     ASSERT(newSize >= m_numSetItems);
 
-    HashMap newHash(newSize);
+    HashMap newHash(newSize, m_pairs.get_allocator());
 
     for(auto i = size_t(0), c = m_pairs.size(); i < c; ++i)
     {
@@ -410,8 +420,8 @@ void HashMap<K,V>::resize(size_t newSize)
     swap(newHash);
 }
 
-template< class K, class V>
-void HashMap<K,V>::clear()
+template< class K, class V, class ALLOC>
+void HashMap<K,V,ALLOC>::clear()
 {
     for (auto& pair : m_pairs)
         pair = Pair();
@@ -419,8 +429,8 @@ void HashMap<K,V>::clear()
     m_numSetItems = 0;
 }
 
-template< class K, class V>
-void HashMap<K,V>::swap(HashMap &other)
+template< class K, class V, class ALLOC>
+void HashMap<K,V,ALLOC>::swap(HashMap &other)
 {
     std::swap(m_maxLoad, other.m_maxLoad);
     std::swap(m_grow, other.m_grow);
@@ -430,8 +440,8 @@ void HashMap<K,V>::swap(HashMap &other)
 }
 
 
-template< class K, class V>
-typename HashMap<K,V>::iterator HashMap<K,V>::begin()
+template< class K, class V, class ALLOC>
+typename HashMap<K,V,ALLOC>::iterator HashMap<K,V,ALLOC>::begin()
 {
     for(size_t i = 0, c = m_pairs.size(); i < c; ++i)
     {
@@ -441,15 +451,15 @@ typename HashMap<K,V>::iterator HashMap<K,V>::begin()
     return end();
 }
 
-template< class K, class V>
-typename HashMap<K,V>::iterator HashMap<K,V>::end()
+template< class K, class V, class ALLOC>
+typename HashMap<K,V,ALLOC>::iterator HashMap<K,V,ALLOC>::end()
 {
     return iterator(this, m_pairs.size());
 }
 
 
-template< class K, class V>
-typename HashMap<K,V>::const_iterator HashMap<K,V>::begin() const
+template< class K, class V, class ALLOC>
+typename HashMap<K,V,ALLOC>::const_iterator HashMap<K,V,ALLOC>::begin() const
 {
     for(size_t i = 0, c = m_pairs.size(); i < c; ++i)
     {
@@ -459,16 +469,16 @@ typename HashMap<K,V>::const_iterator HashMap<K,V>::begin() const
     return end();
 }
 
-template< class K, class V>
-typename HashMap<K,V>::const_iterator HashMap<K,V>::end() const
+template< class K, class V, class ALLOC>
+typename HashMap<K,V,ALLOC>::const_iterator HashMap<K,V,ALLOC>::end() const
 {
     return const_iterator(this, m_pairs.size());
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 // Internal impl
-template< class K, class V>
-void HashMap<K,V>::Initialize()
+template< class K, class V, class ALLOC>
+void HashMap<K,V,ALLOC>::Initialize()
 {
     m_maxLoad = 0.5f;
     m_grow = 1.5f;
@@ -477,8 +487,8 @@ void HashMap<K,V>::Initialize()
     m_numSetItems = 0;
 }
 
-template< class K, class V>
-size_t HashMap<K,V>::Probe(const K& key) const
+template< class K, class V, class ALLOC>
+size_t HashMap<K,V,ALLOC>::Probe(const K& key) const
 {
     auto const keyhash = MakeHash(key) ;
     const auto pairsSize = m_pairs.size();
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <new>
+#include <cstddef>
+#include <cstdint>
 
 namespace lptk 
 {
@@ -33,5 +35,55 @@ namespace lptk
     // raw allocate functions - wrapper around whatever we use to allocate (usually malloc/free)
     void* raw_allocate(size_t n);
     void raw_free(void* p);
+
+    ////////////////////////////////////////////////////////////////////////////////
+    // Pool budgets. Past the soft limit the pressure callbacks run, once each time
+    // usage crosses it from below. An allocation that would take a pool past its
+    // hard limit runs them again with MemPressure::Hard, and fails with null if
+    // they didn't free enough. Usage is counted from the time limits are set, so
+    // set them before other threads use the pool. 0 means no limit.
+    enum class MemPressure
+    {
+        Soft,
+        Hard,
+    };
+
+    // runs on the allocating thread. Allocations made from inside a callback
+    // don't run the callbacks again.
+    typedef void (*MemPressureCallback)(MemPoolId id, MemPressure pressure, size_t used, void* user);
+
+    void mem_SetPoolLimits(MemPoolId id, size_t softLimit, size_t hardLimit);
+    void mem_GetPoolLimits(MemPoolId id, size_t& softLimit, size_t& hardLimit);
+    // callbacks are for all pools. false if there are too many.
+    bool mem_AddPressureCallback(MemPressureCallback callback, void* user);
+    // the callback may still be running on another thread when this returns.
+    void mem_RemovePressureCallback(MemPressureCallback callback, void* user);
+
+    ////////////////////////////////////////////////////////////////////////////////
+    // Allocation tracking, compiled into PROFILE builds only and off until enabled.
+    // Counts allocations per pool with a histogram of their sizes, and samples the
+    // call stack of one allocation in every sampleInterval bytes, so call sites
+    // are weighted by the bytes they allocate. Peak usage is approximate: it is
+    // checked each time a thread's usage of a pool grows by another 256 KiB, so
+    // it can read low by up to that much per allocating thread.
+    struct MemPoolStats
+    {
+        static constexpr unsigned kNumSizeBuckets = 32;
+
+        size_t m_current = 0;
+        size_t m_peak = 0;
+        uint64_t m_numAllocs = 0;
+        uint64_t m_numFrees = 0;
+        // [i] counts requests of [2^i, 2^(i+1)) bytes, the last bucket everything above.
+        uint64_t m_sizeHistogram[kNumSizeBuckets] = {};
+    };
+
+    // returns false in builds without tracking.
+    bool mem_EnableTracking(bool enabled, size_t sampleInterval = 512 * 1024);
+    bool mem_IsTrackingEnabled();
+    // counts since tracking was first enabled, only m_current without tracking.
+    MemPoolStats mem_GetPoolStats(MemPoolId id);
+    // writes the pool stats and the top sampled call sites, see mem_ReportText.
+    bool mem_DumpTracking(const char* filename);
 }
 
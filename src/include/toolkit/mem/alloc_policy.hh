@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstring>
+#include "../mem.hh"
+#include "allocator.hh"
+
+namespace lptk
+{
+    namespace mem
+    {
+        ////////////////////////////////////////////////////////////////////////////////
+        // Allocation policies for the containers (DynAry, BitVectorImpl, HashMap).
+        // A policy is stored by value in the container, and needs:
+        //   explicit Policy(MemPoolId)
+        //   void* Allocate(size_t size, unsigned align) const
+        //   void* Reallocate(void* p, size_t oldSize, size_t newSize, unsigned align) const
+        //   void Free(void* p) const
+
+        ////////////////////////////////////////////////////////////////////////////////
+        // The default: lptk::mem_allocate and friends, tagged with a pool.
+        class PoolPolicy
+        {
+        public:
+            explicit PoolPolicy(MemPoolId pool = MEMPOOL_General) : m_pool(pool) {}
+
+            void* Allocate(size_t size, unsigned align) const
+            {
+                return mem_allocate(size, m_pool, align);
+            }
+
+            void* Reallocate(void* p, size_t, size_t newSize, unsigned align) const
+            {
+                return mem_reallocate(p, newSize, m_pool, align);
+            }
+
+            void Free(void* p) const { mem_free(p); }
+
+            MemPoolId GetPool() const { return m_pool; }
+        private:
+            MemPoolId m_pool;
+        };
+
+        ////////////////////////////////////////////////////////////////////////////////
+        // Any mem::Allocator, e.g. a LinearChunkAllocator that a parse or request
+        // builds all of its containers in and then drops in one go. Constructed
+        // from a pool it uses the default allocator.
+        class AllocatorPolicy
+        {
+        public:
+            explicit AllocatorPolicy(MemPoolId) : m_alloc(GetDefaultAllocator()) {}
+            AllocatorPolicy(mem::Allocator* alloc = GetDefaultAllocator()) : m_alloc(alloc) {}
+
+            void* Allocate(size_t size, unsigned align) const
+            {
+                return m_alloc->Alloc(size, align);
+            }
+
+            void* Reallocate(void* p, size_t oldSize, size_t newSize, unsigned align) const
+            {
+                // like mem_reallocate, p stays valid when this fails.
+                void* result = m_alloc->Alloc(newSize, align);
+                if (result && p)
+                {
+                    memcpy(result, p, oldSize < newSize ? oldSize : newSize);
+                    m_alloc->Free(p);
+                }
+                return result;
+            }
+
+            void Free(void* p) const
+            {
+                if (p)
+                    m_alloc->Free(p);
+            }
+
+            mem::Allocator* GetAllocator() const { return m_alloc; }
+        private:
+            mem::Allocator* m_alloc;
+        };
+    }
+}
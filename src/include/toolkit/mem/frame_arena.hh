@@ -0,0 +1,42 @@
+#pragma once
+
+#include "linear_chunk_allocator.hh"
+
+namespace lptk
+{
+    namespace mem
+    {
+        //////////////////////////////////////////////////////////////////////////////// 
+        // Double buffered scratch memory for work done in frames or requests.
+        // NextFrame switches to the other buffer and clears it, so memory from the
+        // previous frame is still valid for one more frame, and everything older
+        // is gone. Free does nothing, like the LinearChunkAllocator underneath.
+        class FrameArena : public mem::Allocator
+        {
+        public:
+            FrameArena(size_t blockSize = 1 << 16, mem::Allocator* alloc = mem::GetDefaultAllocator());
+            FrameArena(const FrameArena&) = delete;
+            FrameArena& operator=(const FrameArena&) = delete;
+
+            void* Alloc(size_t numBytes, unsigned align)
+                override;
+            void Free(void*)
+                override;
+
+            void NextFrame();
+
+            // the current frame's allocator, for markers.
+            LinearChunkAllocator& Current() { return m_frames[m_current]; }
+            // the previous frame's allocations, still valid.
+            LinearChunkAllocator& Previous() { return m_frames[m_current ^ 1]; }
+        private:
+            LinearChunkAllocator m_frames[2];
+            unsigned m_current = 0;
+        };
+
+        // The calling thread's own frame arena, created on first use. Fibers can
+        // move between threads, so don't keep memory from it across a yield or a
+        // wait.
+        FrameArena* GetThreadFrameArena();
+    }
+}
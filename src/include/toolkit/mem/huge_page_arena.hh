@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include "../common.hh"
+#include "allocator.hh"
+
+namespace lptk
+{
+    namespace mem
+    {
+        ////////////////////////////////////////////////////////////////////////////////
+        // Allocator for big, long lived tables that are accessed at random. Memory
+        // comes from large virtual reservations aligned to 2 MiB and is committed
+        // in 2 MiB steps, so the kernel can back it with huge pages and save TLB
+        // misses. Allocations are carved out of the reservations; freed blocks go
+        // on a first fit free list, in address order so neighbours merge, and
+        // freeing the last block moves the top back.
+        //
+        // Not thread safe, like the other sub allocators.
+        class HugePageArena : public mem::Allocator
+        {
+        public:
+            static constexpr size_t kHugePageSize = size_t(2) << 20;
+
+            enum class PageMode
+            {
+                // transparent huge pages through madvise, if the kernel has them.
+                Transparent,
+                // explicit MAP_HUGETLB pages from the kernel's reserved pool. The
+                // whole reservation is committed up front. Falls back to
+                // Transparent when the pool is too small.
+                HugeTLB,
+                // plain pages, still reserved and committed in big steps.
+                Normal,
+            };
+
+            explicit HugePageArena(size_t reserveSize = size_t(1) << 30, PageMode mode = PageMode::Transparent);
+            ~HugePageArena();
+
+            HugePageArena(const HugePageArena&) = delete;
+            HugePageArena& operator=(const HugePageArena&) = delete;
+
+            void* Alloc(size_t size, unsigned align)
+                override;
+            void Free(void*)
+                override;
+
+            // releases every reservation, all allocations become invalid.
+            void Reset();
+
+            // address space held, memory that can be touched, and bytes handed out.
+            size_t GetReservedBytes() const { return m_reservedBytes; }
+            size_t GetCommittedBytes() const { return m_committedBytes; }
+            size_t GetAllocatedBytes() const { return m_allocatedBytes; }
+            // the mode in use, HugeTLB may have fallen back.
+            PageMode GetPageMode() const { return m_mode; }
+        private:
+            struct Region;
+            struct FreeBlock;
+
+            Region* ReserveRegion(size_t minSize);
+            void ReleaseRegion(Region* region);
+            bool Commit(Region* region, size_t end);
+            void* AllocFromFreeList(size_t size, unsigned align);
+            void* AllocFromRegion(Region* region, size_t size, unsigned align);
+            void AddFreeBlock(char* start, size_t size);
+            void RetireTail(Region* region);
+
+            size_t m_reserveSize = 0;
+            PageMode m_mode = PageMode::Transparent;
+            Region* m_regions = nullptr;
+            FreeBlock* m_freeBlocks = nullptr;
+            size_t m_reservedBytes = 0;
+            size_t m_committedBytes = 0;
+            size_t m_allocatedBytes = 0;
+        };
+    }
+}
@@ -7,9 +7,35 @@ namespace lptk
     namespace mem
     {
         //////////////////////////////////////////////////////////////////////////////// 
+        // Bump allocator over a chain of chunks. Free does nothing; memory comes
+        // back all at once with Clear, or stack-like by rewinding to a Marker.
+        // Chunks are kept for later allocations to reuse, until the destructor
+        // or ReleaseIdleChunks.
         class LinearChunkAllocator : public mem::Allocator
         {
+            struct BlockHeader;
         public:
+            // position to rewind to, everything allocated after it is released.
+            class Marker
+            {
+                friend class LinearChunkAllocator;
+                BlockHeader* m_block = nullptr;
+                size_t m_pos = 0;
+            };
+
+            // rewinds to the position at construction when it goes out of scope.
+            class ScopedMarker
+            {
+            public:
+                explicit ScopedMarker(LinearChunkAllocator& alloc) : m_alloc(alloc), m_marker(alloc.GetMarker()) {}
+                ~ScopedMarker() { m_alloc.Rewind(m_marker); }
+                ScopedMarker(const ScopedMarker&) = delete;
+                ScopedMarker& operator=(const ScopedMarker&) = delete;
+            private:
+                LinearChunkAllocator& m_alloc;
+                Marker m_marker;
+            };
+
             LinearChunkAllocator(size_t blockSize = 1 << 15, mem::Allocator* alloc = mem::GetDefaultAllocator());
             LinearChunkAllocator(const LinearChunkAllocator&) = delete;
             LinearChunkAllocator& operator=(const LinearChunkAllocator&) = delete;
@@ -25,6 +51,13 @@ namespace lptk
             char* CopyString(const char* src);
 
             void Clear();
+            // frees the chunks past the current one, say after Clear or under
+            // memory pressure. Returns the number of bytes handed back.
+            size_t ReleaseIdleChunks();
+
+            // markers must be rewound in reverse order of taking them.
+            Marker GetMarker() const;
+            void Rewind(const Marker& marker);
         private:
             void Destruct();
             void Move(LinearChunkAllocator&& other);
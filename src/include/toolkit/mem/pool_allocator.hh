@@ -1,6 +1,8 @@
 #pragma once
 
 #include <cstdint>
+#include <atomic>
+#include <mutex>
 #include "../common.hh"
 #include "allocator.hh"
 
@@ -65,6 +67,100 @@ namespace lptk
             bool m_canGrow = true;
             mem::Allocator* m_alloc = nullptr;
         };
+
+        ////////////////////////////////////////////////////////////////////////////////
+        // Thread safe PoolAlloc. The shared free list is a lock-free stack of
+        // batches, up to half a magazine of items each, with a tagged head against
+        // ABA. Every thread also keeps a magazine of free items per pool, so most
+        // Alloc/Free calls stay thread local, and the rest move a whole batch with
+        // a single compare-exchange. Pools that can't grow have no magazines, so
+        // every Alloc/Free goes to the shared list: a free item held in another
+        // thread's magazine would otherwise make Alloc fail while items are free.
+        //
+        // Blocks are only freed with the pool, so a racing pop may read an item
+        // that was just handed out, but never unmapped memory. Growth takes a lock
+        // so that threads finding the list empty at once add a single block.
+        class ConcurrentPoolAlloc : public mem::Allocator
+        {
+        public:
+            static constexpr unsigned kCacheLine = 64;
+            // threads past this many share the list, without a magazine.
+            static constexpr unsigned kMaxMagazines = 64;
+            static constexpr unsigned kMagazineSize = 32;
+
+            ConcurrentPoolAlloc(mem::Allocator* alloc = mem::GetDefaultAllocator());
+            ConcurrentPoolAlloc(size_t itemsPerBlock, size_t itemSize, bool canGrow = true,
+                mem::Allocator* alloc = mem::GetDefaultAllocator());
+            ~ConcurrentPoolAlloc();
+
+            ConcurrentPoolAlloc(const ConcurrentPoolAlloc&) = delete;
+            ConcurrentPoolAlloc& operator=(const ConcurrentPoolAlloc&) = delete;
+            ConcurrentPoolAlloc(ConcurrentPoolAlloc&&) = delete;
+            ConcurrentPoolAlloc& operator=(ConcurrentPoolAlloc&&) = delete;
+
+            // not thread safe, call before sharing the pool.
+            void Init(size_t itemsPerBlock, size_t itemSize, bool canGrow = true,
+                mem::Allocator* alloc = mem::GetDefaultAllocator());
+
+            void* Alloc(size_t size, unsigned align)
+                override;
+            void Free(void*)
+                override;
+
+            // for debugging
+            bool IsValidPtr(const void*) const;
+        private:
+            class BlockItem
+            {
+            public:
+                // next item in the same batch
+                BlockItem* m_next = nullptr;
+                // next batch on the shared list, read by racing pops.
+                std::atomic<BlockItem*> m_nextBatch{ nullptr };
+            };
+            static_assert(sizeof(BlockItem) <= 16, "items are only 16 bytes minimum");
+
+            class Block
+            {
+            public:
+                Block* m_next = nullptr;
+                BlockItem* First() const
+                {
+                    constexpr size_t blockSize = (sizeof(Block) + 15) & ~15;
+                    return reinterpret_cast<BlockItem*>(
+                        reinterpret_cast<uintptr_t>(this) + blockSize);
+                }
+            };
+
+            struct alignas(kCacheLine) Magazine
+            {
+                unsigned m_count = 0;
+                BlockItem* m_items[kMagazineSize];
+            };
+
+            // item pointer and ABA tag packed in one word.
+            using TaggedPtr = uint64_t;
+            static TaggedPtr MakeTagged(BlockItem* item, uint64_t tag);
+            static BlockItem* TaggedItem(TaggedPtr tagged);
+            static uint64_t TaggedTag(TaggedPtr tagged);
+
+            // batches from first to last are linked through m_nextBatch already.
+            void PushBatches(BlockItem* first, BlockItem* last);
+            BlockItem* PopBatch();
+            // links in a new block, cut into batches. Returns the first batch.
+            BlockItem* AllocBlock(BlockItem*& lastBatch);
+            BlockItem* Grow();
+            Magazine* GetMagazine() const;
+
+            ////////////////////////////////////////
+            alignas(kCacheLine) std::atomic<TaggedPtr> m_next{ 0 };
+            alignas(kCacheLine) std::atomic<Block*> m_block{ nullptr };
+            std::mutex m_growMutex;
+            size_t m_itemsPerBlock = 0;
+            size_t m_itemSize = 0;
+            bool m_canGrow = true;
+            mem::Allocator* m_alloc = nullptr;
+            Magazine* m_magazines = nullptr;
+        };
     }
 }
-
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+#include "../common.hh"
+#include "../dynary.hh"
+#include "allocator.hh"
+#include "alloc_policy.hh"
+
+namespace lptk
+{
+    namespace mem
+    {
+        ////////////////////////////////////////////////////////////////////////////////
+        // Allocator for a mix of small objects. Sizes up to kMaxSize round up to
+        // one of a set of size classes, two per power of two, and each class hands
+        // out items from its own slabs like a PoolAlloc. Slabs are kSlabSize
+        // blocks from the parent allocator, 64 byte aligned, and an item's slab
+        // is found by a binary search of the sorted slab list. A slab that
+        // becomes empty goes back to the parent, except for one kept per class.
+        // Bigger requests go straight to the parent.
+        //
+        // Not thread safe, like PoolAlloc.
+        class SlabAllocator : public mem::Allocator
+        {
+        public:
+            static constexpr size_t kSlabSize = 64 * 1024;
+            static constexpr size_t kMinSize = 8;
+            static constexpr size_t kMaxSize = 2048;
+            // 8 and 16, then two classes for every power of two up to kMaxSize.
+            static constexpr unsigned kNumClasses = 2 + 2 * 7;
+
+            // occupancy of a size class, for tuning the classes.
+            struct ClassStats
+            {
+                size_t m_itemSize = 0;
+                size_t m_numSlabs = 0;
+                size_t m_numItemsUsed = 0;
+                size_t m_numItemsTotal = 0;
+                size_t m_peakItemsUsed = 0;
+                size_t m_numAllocs = 0;
+                // over all allocs, against m_numAllocs * m_itemSize.
+                size_t m_totalBytesRequested = 0;
+            };
+
+            explicit SlabAllocator(mem::Allocator* parent = mem::GetDefaultAllocator());
+            ~SlabAllocator();
+
+            SlabAllocator(const SlabAllocator&) = delete;
+            SlabAllocator& operator=(const SlabAllocator&) = delete;
+
+            void* Alloc(size_t size, unsigned align)
+                override;
+            void Free(void*)
+                override;
+
+            static size_t ClassSize(unsigned sizeClass);
+            const ClassStats& GetClassStats(unsigned sizeClass) const;
+            // requests that were too big or too aligned for the classes.
+            size_t GetNumParentAllocs() const { return m_numParentAllocs; }
+            void ReportText(const char* title = nullptr) const;
+        private:
+            struct Slab;
+
+            static unsigned ChooseClass(size_t size, unsigned align);
+            Slab* NewSlab(unsigned sizeClass);
+            void ReleaseSlab(Slab* slab);
+            Slab* FindSlab(const void* p) const;
+            void LinkPartial(Slab* slab);
+            void UnlinkPartial(Slab* slab);
+
+            mem::Allocator* m_parent;
+            // slabs with free items, per class
+            Slab* m_partial[kNumClasses] = {};
+            ClassStats m_stats[kNumClasses];
+            // every live slab, sorted by address, to find an item's slab and to
+            // tell slab items from parent allocations on Free.
+            DynAry<Slab*, alignof(Slab*), MEMPOOL_General, AllocatorPolicy> m_slabs;
+            size_t m_numParentAllocs = 0;
+        };
+    }
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstdint>
+#include "../common.hh"
+#include "../mathcommon.hh"
+#include "allocator.hh"
+
+namespace lptk
+{
+    namespace mem
+    {
+        ////////////////////////////////////////////////////////////////////////////////
+        // Allocator over an inline buffer of N bytes, so it can live on the stack or
+        // inside another object. Allocations that don't fit go to the parent. Frees
+        // are meant to be LIFO: freeing the newest allocation gives its space back
+        // right away, an older one is only reclaimed once everything after it is
+        // freed too. Each allocation in the buffer costs an 8 byte header.
+        //
+        // With mem::AllocatorPolicy this keeps small temporary containers off the heap:
+        //   mem::StackAllocator<512> scratch;
+        //   DynAry<int, alignof(int), MEMPOOL_General, mem::AllocatorPolicy> values(&scratch);
+        //
+        // Not thread safe.
+        template<size_t N>
+        class StackAllocator : public mem::Allocator
+        {
+            static_assert(N > 0 && N < (size_t(1) << 31), "offsets are kept in 31 bits");
+        public:
+            explicit StackAllocator(mem::Allocator* parent = mem::GetDefaultAllocator()) : m_parent(parent) {}
+            ~StackAllocator() { ASSERT(m_top == 0); }
+
+            StackAllocator(const StackAllocator&) = delete;
+            StackAllocator& operator=(const StackAllocator&) = delete;
+
+            void* Alloc(size_t size, unsigned align) override
+            {
+                ASSERT(align > 0 && IsPower2(align));
+                align = Max(align, unsigned(kMinAlign));
+                const auto base = reinterpret_cast<uintptr_t>(m_buffer);
+                const size_t start = size_t(AlignValue<uintptr_t>(base + m_top + sizeof(Header), align) - base);
+                if (start >= N || size > N - start)
+                    return m_parent->Alloc(size, align);
+
+                Header* header = HeaderAt(start);
+                header->m_prevTop = uint32_t(m_top);
+                header->m_prevLast = uint32_t(m_last);
+                header->m_freed = 0;
+                m_last = start;
+                m_top = start + size;
+                return m_buffer + start;
+            }
+
+            void Free(void* ptr) override
+            {
+                if (!ptr)
+                    return;
+                if (!Owns(ptr))
+                {
+                    m_parent->Free(ptr);
+                    return;
+                }
+
+                const size_t offset = size_t(reinterpret_cast<unsigned char*>(ptr) - m_buffer);
+                ASSERT(offset <= m_last && !HeaderAt(offset)->m_freed);
+                HeaderAt(offset)->m_freed = 1;
+                // pop everything freed off the top, out of order frees included.
+                while (m_top > 0 && HeaderAt(m_last)->m_freed)
+                {
+                    const Header* header = HeaderAt(m_last);
+                    m_top = header->m_prevTop;
+                    m_last = header->m_prevLast;
+                }
+            }
+
+            bool Owns(const void* ptr) const
+            {
+                const auto p = reinterpret_cast<const unsigned char*>(ptr);
+                return p >= m_buffer && p < m_buffer + N;
+            }
+
+            // bytes of the buffer in use, headers and padding included.
+            size_t GetUsed() const { return m_top; }
+            static constexpr size_t GetCapacity() { return N; }
+            mem::Allocator* GetParent() const { return m_parent; }
+
+        private:
+            struct Header
+            {
+                uint32_t m_prevTop;
+                uint32_t m_prevLast : 31;
+                uint32_t m_freed : 1;
+            };
+            static constexpr size_t kMinAlign = 8;
+
+            Header* HeaderAt(size_t start)
+            {
+                return reinterpret_cast<Header*>(m_buffer + start - sizeof(Header));
+            }
+
+            alignas(16) unsigned char m_buffer[N];
+            size_t m_top = 0;
+            size_t m_last = 0;
+            mem::Allocator* m_parent;
+        };
+    }
+}
@@ -67,6 +67,8 @@ namespace lptk
         bool Listen(const char* service);
         Socket Accept();
         void Close();
+
+        inline const Socket& GetSocket() const { return m_socket; }
     private:
         uint32_t m_flags;
         Socket m_socket;
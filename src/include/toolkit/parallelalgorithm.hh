@@ -0,0 +1,285 @@
+#pragma once
+#ifndef INCLUDED_LPTK_PARALLELALGORITHM_HH
+#define INCLUDED_LPTK_PARALLELALGORITHM_HH
+
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include "toolkit/fiber.hh"
+#include "toolkit/dynary.hh"
+#include "toolkit/range.hh"
+#include "toolkit/mathcommon.hh"
+
+////////////////////////////////////////////////////////////////////////////////
+/*
+Data parallel loops on top of the fiber scheduler:
+
+    lptk::ParallelFor(0, positions.size(), [&](size_t i) {
+        positions[i] += velocities[i] * dt;
+    });
+
+    const double total = lptk::ParallelReduce(0, values.size(), 0.0,
+        [&](size_t i) { return values[i]; },
+        [](double a, double b) { return a + b; });
+
+    lptk::ParallelInclusiveScan(counts, offsets, std::plus<uint32_t>());
+    lptk::ParallelSort(keys);
+
+The range is cut into chunks sized for the number of fiber threads: several per
+thread so stealing can even out uneven work, but never smaller than minGrain
+items so the task overhead stays small. Everything runs serially on the calling
+thread when the fiber system isn't initialized, when the caller isn't a fiber
+thread (it couldn't wait), when there is a single fiber thread, or when the
+range is too small to split.
+
+All of these block until done, and must not be called while holding something
+the loop bodies need.
+*/
+
+namespace lptk
+{
+    // Items per chunk below which splitting isn't worth a task. Raise it for
+    // cheap loop bodies, lower it for expensive ones.
+    constexpr size_t kDefaultParallelGrain = 2048;
+    constexpr size_t kDefaultParallelSortGrain = 1 << 14;
+
+    // Calls fn(Range<size_t>) for consecutive chunks covering [begin, end).
+    template<class Fn>
+    void ParallelForRange(size_t begin, size_t end, Fn&& fn, size_t minGrain = kDefaultParallelGrain);
+
+    // Calls fn(i) for each i in [begin, end).
+    template<class Fn>
+    void ParallelFor(size_t begin, size_t end, Fn&& fn, size_t minGrain = kDefaultParallelGrain);
+    template<class Fn>
+    void ParallelFor(const Range<size_t>& range, Fn&& fn, size_t minGrain = kDefaultParallelGrain);
+
+    // Folds map(i) for each i in [begin, end) with combine, which must be
+    // associative. Chunks are combined in order, so combine needn't commute.
+    template<class T, class MapFn, class CombineFn>
+    T ParallelReduce(size_t begin, size_t end, const T& identity, MapFn&& map, CombineFn&& combine,
+        size_t minGrain = kDefaultParallelGrain);
+
+    // out[i] = in[0] op in[1] ... op in[i]. op must be associative. in and out
+    // may be the same array.
+    template<class T, class Op>
+    void ParallelInclusiveScan(const T* in, T* out, size_t count, Op op, size_t minGrain = kDefaultParallelGrain);
+    template<class T, class Op>
+    void ParallelInclusiveScan(const DynAry<T>& in, DynAry<T>& out, Op op, size_t minGrain = kDefaultParallelGrain);
+
+    // Unstable sort. Chunks are sorted in parallel and then merged in parallel,
+    // through a temporary array of count default constructed T.
+    template<class T, class Less = std::less<T>>
+    void ParallelSort(T* first, T* last, Less less = Less(), size_t minGrain = kDefaultParallelSortGrain);
+    template<class T, class Less = std::less<T>>
+    void ParallelSort(DynAry<T>& ary, Less less = Less(), size_t minGrain = kDefaultParallelSortGrain);
+
+    ////////////////////////////////////////////////////////////////////////////////
+    namespace detail
+    {
+        constexpr size_t kParallelChunksPerThread = 8;
+
+        // Returns the number of chunks to split count items into, 1 meaning serial.
+        inline size_t ParallelChunkCount(size_t count, size_t minGrain)
+        {
+            minGrain = lptk::Max<size_t>(minGrain, 1);
+            if (count <= minGrain || !fiber::IsInitialized() || !fiber::IsInFiberThread())
+                return 1;
+            const size_t numThreads = fiber::GetNumFiberThreads();
+            if (numThreads <= 1)
+                return 1;
+            const size_t grain = lptk::Max(minGrain, count / (numThreads * kParallelChunksPerThread));
+            return (count + grain - 1) / grain;
+        }
+
+        // Runs fn(chunkIndex) for each chunk as a task, and waits for them.
+        template<class Fn>
+        void RunChunks(size_t numChunks, const Fn& fn)
+        {
+            fiber::Counter counter;
+            fiber::RunTasks(numChunks, [&fn](size_t chunk) { fn(chunk); }, &counter);
+            fiber::WaitForCounter(&counter);
+        }
+
+        // Chunk c of count items split in numChunks as evenly as possible.
+        inline Range<size_t> ChunkRange(size_t begin, size_t count, size_t numChunks, size_t chunk)
+        {
+            return Range<size_t>(begin + count * chunk / numChunks, begin + count * (chunk + 1) / numChunks);
+        }
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////
+    template<class Fn>
+    void ParallelForRange(size_t begin, size_t end, Fn&& fn, size_t minGrain)
+    {
+        if (end <= begin)
+            return;
+        const size_t count = end - begin;
+        const size_t numChunks = detail::ParallelChunkCount(count, minGrain);
+        if (numChunks == 1)
+        {
+            fn(Range<size_t>(begin, end));
+            return;
+        }
+        detail::RunChunks(numChunks, [&](size_t chunk) {
+            fn(detail::ChunkRange(begin, count, numChunks, chunk));
+        });
+    }
+
+    template<class Fn>
+    void ParallelFor(size_t begin, size_t end, Fn&& fn, size_t minGrain)
+    {
+        ParallelForRange(begin, end, [&fn](const Range<size_t>& range) {
+            for (size_t i = range.Start(), e = range.End(); i < e; ++i)
+                fn(i);
+        }, minGrain);
+    }
+
+    template<class Fn>
+    void ParallelFor(const Range<size_t>& range, Fn&& fn, size_t minGrain)
+    {
+        ParallelFor(range.Start(), range.End(), std::forward<Fn>(fn), minGrain);
+    }
+
+    template<class T, class MapFn, class CombineFn>
+    T ParallelReduce(size_t begin, size_t end, const T& identity, MapFn&& map, CombineFn&& combine,
+        size_t minGrain)
+    {
+        auto reduceRange = [&](const Range<size_t>& range) {
+            T result = identity;
+            for (size_t i = range.Start(), e = range.End(); i < e; ++i)
+                result = combine(result, map(i));
+            return result;
+        };
+
+        const size_t count = end > begin ? end - begin : 0;
+        const size_t numChunks = detail::ParallelChunkCount(count, minGrain);
+        if (numChunks == 1)
+            return reduceRange(Range<size_t>(begin, end));
+
+        DynAry<T> partials(numChunks, identity);
+        detail::RunChunks(numChunks, [&](size_t chunk) {
+            partials[chunk] = reduceRange(detail::ChunkRange(begin, count, numChunks, chunk));
+        });
+
+        T result = identity;
+        for (auto& partial : partials)
+            result = combine(result, partial);
+        return result;
+    }
+
+    template<class T, class Op>
+    void ParallelInclusiveScan(const T* in, T* out, size_t count, Op op, size_t minGrain)
+    {
+        if (count == 0)
+            return;
+
+        auto scanRange = [&](const Range<size_t>& range, const T* carry) {
+            size_t i = range.Start();
+            T acc = carry ? op(*carry, in[i]) : in[i];
+            out[i] = acc;
+            for (++i; i < range.End(); ++i)
+            {
+                acc = op(acc, in[i]);
+                out[i] = acc;
+            }
+        };
+
+        const size_t numChunks = detail::ParallelChunkCount(count, minGrain);
+        if (numChunks == 1)
+        {
+            scanRange(Range<size_t>(0, count), nullptr);
+            return;
+        }
+
+        // total of each chunk, then a running total over those, then each chunk
+        // is scanned again starting from the total of the ones before it.
+        DynAry<T> sums(numChunks, in[0]);
+        detail::RunChunks(numChunks, [&](size_t chunk) {
+            const auto range = detail::ChunkRange(0, count, numChunks, chunk);
+            T acc = in[range.Start()];
+            for (size_t i = range.Start() + 1; i < range.End(); ++i)
+                acc = op(acc, in[i]);
+            sums[chunk] = acc;
+        });
+        for (size_t chunk = 1; chunk < numChunks; ++chunk)
+            sums[chunk] = op(sums[chunk - 1], sums[chunk]);
+        detail::RunChunks(numChunks, [&](size_t chunk) {
+            scanRange(detail::ChunkRange(0, count, numChunks, chunk), chunk > 0 ? &sums[chunk - 1] : nullptr);
+        });
+    }
+
+    template<class T, class Op>
+    void ParallelInclusiveScan(const DynAry<T>& in, DynAry<T>& out, Op op, size_t minGrain)
+    {
+        if (&in != &out)
+            out.resize(in.size());
+        ParallelInclusiveScan(in.data(), out.data(), in.size(), op, minGrain);
+    }
+
+    template<class T, class Less>
+    void ParallelSort(T* first, T* last, Less less, size_t minGrain)
+    {
+        const size_t count = last > first ? size_t(last - first) : 0;
+        size_t numChunks = detail::ParallelChunkCount(count, minGrain);
+        if (numChunks == 1)
+        {
+            std::sort(first, last, less);
+            return;
+        }
+
+        // a power of two number of equal runs, so they merge pairwise.
+        numChunks = size_t(1) << lptk::IntLog2_64(numChunks);
+        size_t width = (count + numChunks - 1) / numChunks;
+        detail::RunChunks(numChunks, [&](size_t chunk) {
+            T* begin = first + lptk::Min(count, chunk * width);
+            T* end = first + lptk::Min(count, (chunk + 1) * width);
+            std::sort(begin, end, less);
+        });
+
+        // Each round merges pairs of runs into runs twice as long. As the pairs
+        // get fewer, every merge is cut into more pieces: pieces of the left run
+        // at even intervals, with the matching part of the right run found by
+        // binary search, so each piece merges independently.
+        DynAry<T> temp(count);
+        T* src = first;
+        T* dst = temp.data();
+        for (; width < count; width *= 2)
+        {
+            const size_t numPairs = (count + 2 * width - 1) / (2 * width);
+            const size_t numPieces = lptk::Max<size_t>(1, numChunks / numPairs);
+            detail::RunChunks(numPairs * numPieces, [&](size_t task) {
+                const size_t pair = task / numPieces;
+                const size_t piece = task % numPieces;
+                T* a = src + pair * 2 * width;
+                T* b = src + lptk::Min(count, pair * 2 * width + width);
+                T* bEnd = src + lptk::Min(count, pair * 2 * width + 2 * width);
+                const size_t lenA = size_t(b - a);
+
+                T* pieceA = a + lenA * piece / numPieces;
+                T* pieceAEnd = a + lenA * (piece + 1) / numPieces;
+                T* pieceB = piece == 0 ? b : std::lower_bound(b, bEnd, *pieceA, less);
+                T* pieceBEnd = piece == numPieces - 1 ? bEnd : std::lower_bound(b, bEnd, *pieceAEnd, less);
+
+                T* out = dst + (pieceA - src) + (pieceB - b);
+                std::merge(std::make_move_iterator(pieceA), std::make_move_iterator(pieceAEnd),
+                    std::make_move_iterator(pieceB), std::make_move_iterator(pieceBEnd), out, less);
+            });
+            std::swap(src, dst);
+        }
+
+        if (src != first)
+        {
+            ParallelForRange(0, count, [&](const Range<size_t>& range) {
+                std::move(src + range.Start(), src + range.End(), first + range.Start());
+            }, minGrain);
+        }
+    }
+
+    template<class T, class Less>
+    void ParallelSort(DynAry<T>& ary, Less less, size_t minGrain)
+    {
+        ParallelSort(ary.data(), ary.data() + ary.size(), less, minGrain);
+    }
+}
+
+#endif
@@ -0,0 +1,103 @@
+#pragma once
+#ifndef INCLUDED_LPTK_PROFILE_HH
+#define INCLUDED_LPTK_PROFILE_HH
+
+#include <atomic>
+#include <cstdint>
+
+////////////////////////////////////////////////////////////////////////////////
+/*
+Timeline profiler. Each thread records fixed size events into its own ring
+buffer, overwriting the oldest ones when full, and the whole thing can be
+dumped as a Chrome trace (load it in chrome://tracing or ui.perfetto.dev):
+
+    void Update()
+    {
+        PROFILE_SCOPE("Update");
+        ...
+    }
+
+    lptk::profile::DumpChromeTrace("trace.json");
+
+The macros only record anything in PROFILE builds. Names must be string
+literals, or otherwise outlive the dump; only the pointer is stored.
+
+The fiber system records tasks, fiber switches, steals, idle waits and
+service updates.
+*/
+
+#if defined(PROFILE)
+#define L__PROFILE_CAT2(a, b) a##b
+#define L__PROFILE_CAT(a, b) L__PROFILE_CAT2(a, b)
+#define PROFILE_SCOPE(name) lptk::profile::ScopedEvent L__PROFILE_CAT(profileScope_, __LINE__)(name)
+#define PROFILE_BEGIN(name) lptk::profile::Record(lptk::profile::EventType::Begin, name)
+#define PROFILE_END(name) lptk::profile::Record(lptk::profile::EventType::End, name)
+#define PROFILE_INSTANT(name, arg) lptk::profile::Record(lptk::profile::EventType::Instant, name, uint64_t(arg))
+#define PROFILE_THREAD_NAME(name) lptk::profile::RegisterThread(name)
+#else
+#define PROFILE_SCOPE(name) do {} while(0)
+#define PROFILE_BEGIN(name) do {} while(0)
+#define PROFILE_END(name) do {} while(0)
+#define PROFILE_INSTANT(name, arg) do {} while(0)
+#define PROFILE_THREAD_NAME(name) do {} while(0)
+#endif
+
+namespace lptk
+{
+    namespace profile
+    {
+        enum class EventType : uint32_t
+        {
+            Begin,
+            End,
+            Instant,
+        };
+
+        struct Event
+        {
+            uint64_t m_time; // cpu ticks where available, nanoseconds otherwise
+            const char* m_name;
+            uint64_t m_arg;
+            EventType m_type;
+        };
+
+        // Gives the calling thread its ring buffer, and a name in the trace. Threads
+        // that record without registering get one on their first event, which
+        // allocates, so worker threads should register up front.
+        void RegisterThread(const char* name);
+
+        // Size in events of rings created after this call. Rounded up to a power of two.
+        void SetRingSize(size_t numEvents);
+
+        // Recording can be paused, the rings keep what they have.
+        void SetEnabled(bool enabled);
+        bool IsEnabled();
+
+        void Record(EventType type, const char* name, uint64_t arg = 0);
+
+        // Writes everything currently in the rings. Threads may keep recording
+        // while this runs; events overwritten during the copy are dropped.
+        bool DumpChromeTrace(const char* filename);
+
+        // Forgets all recorded events.
+        void Clear();
+
+        ////////////////////////////////////////////////////////////////////////////////
+        class ScopedEvent
+        {
+        public:
+            explicit ScopedEvent(const char* name) : m_name(name) { Record(EventType::Begin, name); }
+            ~ScopedEvent() { Record(EventType::End, m_name); }
+
+            ScopedEvent(const ScopedEvent&) = delete;
+            ScopedEvent& operator=(const ScopedEvent&) = delete;
+            ScopedEvent(ScopedEvent&&) = delete;
+            ScopedEvent& operator=(ScopedEvent&&) = delete;
+        private:
+            const char* m_name;
+        };
+    }
+}
+
+#endif
+
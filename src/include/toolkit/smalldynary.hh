@@ -0,0 +1,287 @@
+#pragma once
+#ifndef INCLUDED_toolkit_smalldynary_hh
+#define INCLUDED_toolkit_smalldynary_hh
+
+#include "toolkit/dynary.hh"
+
+namespace lptk
+{
+
+////////////////////////////////////////////////////////////////////////////////
+// SmallDynAry is a DynAry that keeps its first N elements inside the object
+// and only allocates once it outgrows them, so lists that are almost always
+// short never touch the allocator. Same interface as DynAry, except that
+// capacity() never goes below N, and that moving or swapping a SmallDynAry
+// whose elements are inline moves the elements one by one.
+template<class T, size_t N, unsigned int ALIGN=alignof(T), MemPoolId DefaultPool = MEMPOOL_General,
+    class ALLOC = mem::PoolPolicy>
+class SmallDynAry : public detail::DynAryBase<SmallDynAry<T, N, ALIGN, DefaultPool, ALLOC>, T, ALIGN, ALLOC>
+{
+    static_assert(N > 0, "use DynAry for no inline elements");
+    using Base = detail::DynAryBase<SmallDynAry, T, ALIGN, ALLOC>;
+public:
+    using typename Base::iterator;
+    using typename Base::const_iterator;
+    using typename Base::size_type;
+    using typename Base::value_type;
+    using typename Base::allocator_type;
+    static constexpr size_type kInlineCapacity = N;
+private:
+    using Base::m_array;
+    using Base::m_capacity;
+    using Base::m_size;
+    using Base::m_grow;
+    using Base::m_alloc;
+    alignas(ALIGN < alignof(T) ? alignof(T) : ALIGN) unsigned char m_inline[N * sizeof(T)];
+public:
+    ////////////////////////////////////////
+    // ctors
+    explicit SmallDynAry(MemPoolId pool = DefaultPool)
+        : Base(inline_data(), N, 0, pool)
+    {
+    }
+
+    SmallDynAry(size_type initialSize, const T& init, MemPoolId pool = DefaultPool)
+        : SmallDynAry(pool)
+    {
+        internal_ctor_init(initialSize, init);
+    }
+
+    explicit SmallDynAry(size_type initialSize, MemPoolId pool = DefaultPool)
+        : SmallDynAry(pool)
+    {
+        internal_ctor_init(initialSize, T());
+    }
+
+    template<class Iter>
+        SmallDynAry(Iter begin, Iter end, MemPoolId pool = DefaultPool)
+        : SmallDynAry(pool)
+    {
+        internal_ctor_init(begin, end);
+    }
+
+    explicit SmallDynAry(const ALLOC& alloc)
+        : Base(inline_data(), N, 0, alloc)
+    {
+    }
+
+    SmallDynAry(size_type initialSize, const T& init, const ALLOC& alloc)
+        : SmallDynAry(alloc)
+    {
+        internal_ctor_init(initialSize, init);
+    }
+
+    SmallDynAry(size_type initialSize, const ALLOC& alloc)
+        : SmallDynAry(alloc)
+    {
+        internal_ctor_init(initialSize, T());
+    }
+
+    template<class Iter>
+        SmallDynAry(Iter begin, Iter end, const ALLOC& alloc)
+        : SmallDynAry(alloc)
+    {
+        internal_ctor_init(begin, end);
+    }
+
+    template<class U>
+    SmallDynAry(std::initializer_list<U> init)
+        : SmallDynAry(DefaultPool)
+    {
+        internal_ctor_init(init.begin(), init.end());
+    }
+
+    SmallDynAry(const SmallDynAry& other)
+        : SmallDynAry(other.m_alloc)
+    {
+        m_grow = other.m_grow;
+        internal_ctor_init(other.begin(), other.end());
+    }
+
+    SmallDynAry(const SmallDynAry& other, MemPoolId pool)
+        : SmallDynAry(pool)
+    {
+        m_grow = other.m_grow;
+        internal_ctor_init(other.begin(), other.end());
+    }
+
+    SmallDynAry(const SmallDynAry& other, const ALLOC& alloc)
+        : SmallDynAry(alloc)
+    {
+        m_grow = other.m_grow;
+        internal_ctor_init(other.begin(), other.end());
+    }
+
+    SmallDynAry(SmallDynAry&& other)
+        : SmallDynAry(other.m_alloc)
+    {
+        m_grow = other.m_grow;
+        take(other);
+    }
+
+    ////////////////////////////////////////
+    ~SmallDynAry()
+    {
+        this->clear();
+        release_heap();
+    }
+
+    ////////////////////////////////////////
+    // assignment
+    SmallDynAry& operator=(const SmallDynAry& other)
+    {
+        if(&other != this)
+            this->assign(other.begin(), other.end());
+        return *this;
+    }
+
+    SmallDynAry& operator=(SmallDynAry&& other)
+    {
+        if(&other != this)
+        {
+            this->clear();
+            release_heap();
+            m_alloc = other.m_alloc;
+            m_grow = other.m_grow;
+            take(other);
+        }
+        return *this;
+    }
+
+    ////////////////////////////////////////
+    // capacity
+    void set_capacity(size_type newCapacity)
+    {
+        if(newCapacity < N)
+            newCapacity = N;
+        if(m_capacity == newCapacity)
+            return;
+        else if(newCapacity > m_capacity)
+        {
+            reserve(newCapacity);
+        }
+        else // newCapacity < m_capacity, so the elements are on the heap
+        {
+            for(size_t i = newCapacity; i < m_size; ++i)
+                m_array[i].~T();
+
+            const size_t newSize = Min(m_size, newCapacity);
+            if(newCapacity == N)
+            {
+                T* heap = m_array;
+                Base::relocate(heap, inline_data(), newSize);
+                m_alloc.Free(heap);
+                m_array = inline_data();
+            }
+            else
+            {
+                m_array = this->reallocate(newSize, newCapacity);
+            }
+            m_size = newSize;
+            m_capacity = newCapacity;
+        }
+    }
+
+    void reserve(size_type newCapacity)
+    {
+        if(newCapacity > m_capacity)
+        {
+            if(is_inline())
+            {
+                T* newPtr = reinterpret_cast<T*>(m_alloc.Allocate(sizeof(T) * newCapacity, ALIGN));
+                Base::relocate(m_array, newPtr, m_size);
+                m_array = newPtr;
+            }
+            else
+            {
+                m_array = this->reallocate(m_size, newCapacity);
+            }
+            m_capacity = newCapacity;
+        }
+    }
+
+    ////////////////////////////////////////
+    // modifying
+    void swap(SmallDynAry &other)
+    {
+        if(&other == this)
+            return;
+        if(!is_inline() && !other.is_inline())
+        {
+            std::swap(other.m_array, m_array);
+            std::swap(other.m_capacity, m_capacity);
+            std::swap(other.m_size, m_size);
+            std::swap(other.m_grow, m_grow);
+            std::swap(other.m_alloc, m_alloc);
+            return;
+        }
+        SmallDynAry temp(std::move(other));
+        other = std::move(*this);
+        *this = std::move(temp);
+    }
+
+    // true while the elements are in the object itself.
+    bool is_inline() const { return m_array == inline_data(); }
+
+private:
+    ////////////////////////////////////////
+    T* inline_data() { return reinterpret_cast<T*>(m_inline); }
+    const T* inline_data() const { return reinterpret_cast<const T*>(m_inline); }
+
+    // back to the inline buffer, with no elements left.
+    void release_heap()
+    {
+        ASSERT(m_size == 0);
+        if(!is_inline())
+        {
+            m_alloc.Free(m_array);
+            m_array = inline_data();
+            m_capacity = N;
+        }
+    }
+
+    // with this one empty and inline: takes other's heap block, or moves its
+    // inline elements over. other is left empty and inline.
+    void take(SmallDynAry& other)
+    {
+        ASSERT(m_size == 0 && is_inline());
+        if(other.is_inline())
+        {
+            Base::relocate(other.m_array, m_array, other.m_size);
+        }
+        else
+        {
+            m_array = other.m_array;
+            m_capacity = other.m_capacity;
+            other.m_array = other.inline_data();
+            other.m_capacity = N;
+        }
+        m_size = other.m_size;
+        other.m_size = 0;
+    }
+
+    template<class U>
+    void internal_ctor_init(size_type count, U&& init)
+    {
+        reserve(count);
+        for(size_type i = 0; i < count; ++i)
+            new (&m_array[i]) T(std::forward<U>(init));
+        m_size = count;
+    }
+
+    template<class Iter>
+    typename std::enable_if<!std::is_integral<Iter>::value, void>::type
+    internal_ctor_init(Iter begin, Iter end)
+    {
+        reserve(size_type(end - begin));
+        Iter cur = begin;
+        size_type i = 0;
+        for(; cur != end; ++cur, ++i)
+            new (&m_array[i]) T(*cur);
+        m_size = i;
+    }
+};
+
+}
+
+#endif
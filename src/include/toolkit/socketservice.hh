@@ -0,0 +1,93 @@
+#pragma once
+#ifndef INCLUDED_LPTK_SOCKETSERVICE_HH
+#define INCLUDED_LPTK_SOCKETSERVICE_HH
+
+#include "toolkit/fiber.hh"
+#include "toolkit/network.hh"
+#include "toolkit/dynary.hh"
+
+////////////////////////////////////////////////////////////////////////////////
+/*
+Blocking style socket calls for fibers. The calling fiber is suspended until
+the socket is ready, instead of blocking the worker thread or polling:
+
+    lptk::fiber::SocketService socketService;
+    socketService.Start();
+
+    // in a fiber, one per connection:
+    char buf[256];
+    int64_t len;
+    while ((len = socketService.Read(socket, buf, sizeof(buf))) > 0)
+        socketService.Write(socket, buf, size_t(len));
+
+    socketService.Stop();
+
+Readiness is tracked with epoll on linux. At most one fiber may be reading and
+one writing the same socket at a time.
+*/
+
+namespace lptk
+{
+    namespace fiber
+    {
+        class SocketService final : public FiberService
+        {
+        public:
+            SocketService();
+            ~SocketService() override;
+
+            // These may only be called from a fiber. Read returns as soon as some
+            // data is available, like Socket::Read: >0 bytes read, 0 on close, <0
+            // on error. Write returns once all of buf is sent, or -1 on error.
+            // The socket's blocking mode is left alone. Linux doesn't care, on
+            // windows it has to be non-blocking or the worker thread blocks:
+            // connect with SOCKETF_NonBlock, or accept from a listener made with it.
+            int64_t Read(const Socket& socket, void* buf, size_t count);
+            int64_t Write(const Socket& socket, const void* buf, size_t count);
+            // Waits for a connection. Returns an invalid socket on error. Listen
+            // with SOCKETF_NonBlock: Accept leaves the listener's mode alone, and
+            // on a blocking listener a connection taken by another thread between
+            // the wakeup and the accept blocks the worker thread until the next.
+            Socket Accept(const ServerConnection& server);
+
+        protected:
+            bool Update() override;
+            void CancelRequest(ServiceRequest* request) override;
+            void WakeUpdate() override;
+
+        private:
+            enum class Wait { Read, Write };
+            struct SocketRequest
+            {
+                Socket::SocketType m_socket;
+                Wait m_wait;
+                bool m_ready;
+            };
+
+            // suspends until the socket is ready, or returns false on error.
+            bool WaitForSocket(Socket::SocketType socket, Wait wait);
+            void CompleteSocketRequest(ServiceRequest* request, bool ready);
+
+#if defined(LINUX)
+            // Waiting fibers, indexed by file descriptor.
+            struct SocketWaiters
+            {
+                ServiceRequest* m_reader = nullptr;
+                ServiceRequest* m_writer = nullptr;
+                bool m_registered = false;
+            };
+            bool Register(int fd, SocketWaiters& waiters);
+
+            int m_epoll = -1;
+            int m_wakeFd = -1;
+            lptk::DynAry<SocketWaiters> m_waiters;
+#elif defined(WINDOWS)
+            lptk::DynAry<ServiceRequest*> m_waiters;
+#endif
+            unsigned m_numWaiting = 0;
+        };
+    }
+}
+
+#endif
+
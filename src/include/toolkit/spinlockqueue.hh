@@ -149,6 +149,7 @@ namespace lptk
         void push(NodeType* node);
         void push_range(NodeType* begin, size_t count);
         NodeType* pop();
+        bool empty();
     };
 
 
@@ -225,6 +226,15 @@ namespace lptk
             NodeTraits::SetNext(result, nullptr);
         return result;
     }
+
+    template<typename T, typename NodeTraits>
+    bool IntrusiveSpinLockQueue<T, NodeTraits>::empty()
+    {
+        m_lock.lock();
+        const bool result = m_head == nullptr;
+        m_lock.unlock();
+        return result;
+    }
 }
 
 #endif
@@ -9,6 +9,7 @@
 
 #include "mathcommon.hh"
 #include "compat.hh"
+#include "hash.hh"
 
 namespace lptk
 {
@@ -519,10 +520,7 @@ namespace literals {
 
 template<typename StrType>
 inline size_t ComputeHash(const StrType& x) {
-    size_t result = 0UL;
-    const char* p = x.c_str();
-    while(*p) result += 261 * *p++;
-    return result;
+    return size_t(HashBytes(x.c_str(), x.length()));
 }
 
 template< int SIZE >
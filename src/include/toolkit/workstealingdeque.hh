@@ -0,0 +1,189 @@
+#pragma once
+#ifndef INCLUDED_toolkit_workstealingdeque_HH
+#define INCLUDED_toolkit_workstealingdeque_HH
+
+#include <atomic>
+#include <cstdint>
+#include <new>
+#include "toolkit/common.hh"
+#include "toolkit/mem.hh"
+
+namespace lptk
+{
+    ////////////////////////////////////////////////////////////////////////////////
+    // Chase-Lev work stealing deque of pointers (see "Correct and Efficient
+    // Work-Stealing for Weak Memory Models", Le et al. 2013).
+    //
+    // The owning thread pushes and pops at the bottom, LIFO. Any other thread may
+    // steal from the top, FIFO. The ring buffer grows when full; old buffers may
+    // still be read by a concurrent steal, so they are retired and only freed
+    // when the deque is destroyed.
+    template<class T>
+    class WorkStealingDeque
+    {
+    public:
+        static constexpr unsigned kCacheLine = 64;
+
+        explicit WorkStealingDeque(unsigned initialLog2Size = 8);
+        ~WorkStealingDeque();
+
+        WorkStealingDeque(const WorkStealingDeque&) = delete;
+        WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+        WorkStealingDeque(WorkStealingDeque&&) = delete;
+        WorkStealingDeque& operator=(WorkStealingDeque&&) = delete;
+
+        // owner only
+        void push(T* item);
+        T* pop();
+
+        // any thread. Returns null if empty or if another thread won the race
+        // for the top item.
+        T* steal();
+
+        // approximate when called from anything but the owner
+        bool empty() const;
+        size_t size() const;
+    private:
+        struct Buffer
+        {
+            int64_t m_mask;
+            Buffer* m_retired;
+
+            std::atomic<T*>* Items() { return reinterpret_cast<std::atomic<T*>*>(this + 1); }
+            T* Get(int64_t index) { return Items()[index & m_mask].load(std::memory_order_relaxed); }
+            void Put(int64_t index, T* item) { Items()[index & m_mask].store(item, std::memory_order_relaxed); }
+        };
+
+        static Buffer* MakeBuffer(int64_t size);
+        Buffer* Grow(Buffer* buffer, int64_t bottom, int64_t top);
+
+        alignas(kCacheLine) std::atomic<int64_t> m_top;
+        alignas(kCacheLine) std::atomic<int64_t> m_bottom;
+        alignas(kCacheLine) std::atomic<Buffer*> m_buffer;
+    };
+
+    ////////////////////////////////////////
+    template<class T>
+    WorkStealingDeque<T>::WorkStealingDeque(unsigned initialLog2Size)
+        : m_top(0)
+        , m_bottom(0)
+        , m_buffer(MakeBuffer(int64_t(1) << initialLog2Size))
+    {
+    }
+
+    template<class T>
+    WorkStealingDeque<T>::~WorkStealingDeque()
+    {
+        Buffer* buffer = m_buffer.load(std::memory_order_relaxed);
+        while (buffer)
+        {
+            Buffer* retired = buffer->m_retired;
+            mem_free(buffer);
+            buffer = retired;
+        }
+    }
+
+    template<class T>
+    auto WorkStealingDeque<T>::MakeBuffer(int64_t size) -> Buffer*
+    {
+        void* mem = mem_allocate(sizeof(Buffer) + size_t(size) * sizeof(std::atomic<T*>), MEMPOOL_General, kCacheLine);
+        Buffer* buffer = new (mem) Buffer;
+        buffer->m_mask = size - 1;
+        buffer->m_retired = nullptr;
+        for (int64_t i = 0; i < size; ++i)
+            new (&buffer->Items()[i]) std::atomic<T*>(nullptr);
+        return buffer;
+    }
+
+    template<class T>
+    auto WorkStealingDeque<T>::Grow(Buffer* buffer, int64_t bottom, int64_t top) -> Buffer*
+    {
+        Buffer* newBuffer = MakeBuffer(2 * (buffer->m_mask + 1));
+        for (int64_t i = top; i < bottom; ++i)
+            newBuffer->Put(i, buffer->Get(i));
+        newBuffer->m_retired = buffer;
+        m_buffer.store(newBuffer, std::memory_order_release);
+        return newBuffer;
+    }
+
+    template<class T>
+    void WorkStealingDeque<T>::push(T* item)
+    {
+        const int64_t bottom = m_bottom.load(std::memory_order_relaxed);
+        const int64_t top = m_top.load(std::memory_order_acquire);
+        Buffer* buffer = m_buffer.load(std::memory_order_relaxed);
+        if (bottom - top > buffer->m_mask)
+            buffer = Grow(buffer, bottom, top);
+        buffer->Put(bottom, item);
+        std::atomic_thread_fence(std::memory_order_release);
+        m_bottom.store(bottom + 1, std::memory_order_relaxed);
+    }
+
+    template<class T>
+    T* WorkStealingDeque<T>::pop()
+    {
+        const int64_t bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+        Buffer* buffer = m_buffer.load(std::memory_order_relaxed);
+        m_bottom.store(bottom, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t top = m_top.load(std::memory_order_relaxed);
+
+        T* result = nullptr;
+        if (top <= bottom)
+        {
+            result = buffer->Get(bottom);
+            if (top == bottom)
+            {
+                // last item, race any thieves for it.
+                if (!m_top.compare_exchange_strong(top, top + 1,
+                    std::memory_order_seq_cst, std::memory_order_relaxed))
+                {
+                    result = nullptr;
+                }
+                m_bottom.store(bottom + 1, std::memory_order_relaxed);
+            }
+        }
+        else
+        {
+            m_bottom.store(bottom + 1, std::memory_order_relaxed);
+        }
+        return result;
+    }
+
+    template<class T>
+    T* WorkStealingDeque<T>::steal()
+    {
+        int64_t top = m_top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const int64_t bottom = m_bottom.load(std::memory_order_acquire);
+
+        if (top < bottom)
+        {
+            Buffer* buffer = m_buffer.load(std::memory_order_acquire);
+            T* result = buffer->Get(top);
+            if (!m_top.compare_exchange_strong(top, top + 1,
+                std::memory_order_seq_cst, std::memory_order_relaxed))
+            {
+                return nullptr;
+            }
+            return result;
+        }
+        return nullptr;
+    }
+
+    template<class T>
+    bool WorkStealingDeque<T>::empty() const
+    {
+        return size() == 0;
+    }
+
+    template<class T>
+    size_t WorkStealingDeque<T>::size() const
+    {
+        const int64_t bottom = m_bottom.load(std::memory_order_relaxed);
+        const int64_t top = m_top.load(std::memory_order_relaxed);
+        return bottom > top ? size_t(bottom - top) : 0;
+    }
+}
+
+#endif
@@ -4,9 +4,25 @@
 #include <atomic>
 #include <limits>
 #include <cstdint>
+#include <cstring>
+#include <utility>
 #include "toolkit/mathcommon.hh"
 //#include <malloc.h>
 
+#if defined(WINDOWS)
+#include <windows.h>
+#elif defined(LINUX)
+#include <sys/mman.h>
+#endif
+
+#if defined(PROFILE)
+#include <cstdio>
+#include <cstdlib>
+#if defined(LINUX)
+#include <execinfo.h>
+#endif
+#endif
+
 //#define PLAIN_MALLOC
 
 static const char *g_poolName[] = {
@@ -18,76 +34,1233 @@ static const char *g_poolName[] = {
 };
 static_assert(lptk::MEMPOOL_NUM == ARRAY_SIZE(g_poolName), "size mismatch for pool names");
 
-static std::atomic<size_t> g_poolMemUsed[lptk::MEMPOOL_NUM];
+////////////////////////////////////////////////////////////////////////////////
+/*
+Small requests are rounded up to a size class and served from spans: blocks of
+kSpanSize bytes that hold objects of a single class and pool. Each thread
+caches free objects per pool and class, so the common path takes no lock and
+touches no shared cache line:
+
+    mem_allocate -> thread cache free list [pool][class]
+                 -> central list of spans with room [pool][class], locked
+                 -> a new span, from the free spans or the OS
+
+Large requests get a span of their own with a 64 bit size. Freed ones up to
+kMaxCachedLargeSize go to the page heap for reuse. Those are carved out of the
+mid heap, one shared mapping, bigger ones are mapped and unmapped straight
+from the OS. On Linux mem_reallocate grows the latter with mremap, which moves
+page table entries instead of copying. Spans have their header up front and
+are kSpanSize aligned, or page aligned in the mid heap, so mem_free finds it
+by masking the pointer, and small objects carry no header at all.
+
+Usage counters are per thread as well, and only summed by mem_GetSizeAllocated.
+Pools with limits set also charge a shared counter, see PoolLimits.
 
-namespace lptk 
+PROFILE builds add allocation tracking, off until mem_EnableTracking. Counts
+and the size histogram are per thread counters like the usage. Each thread
+counts down the bytes it allocates, and when it crosses the sample interval
+the current call stack goes into a fixed table of call sites, weighted by the
+bytes since the previous sample. Big allocations are always sampled, and the
+cost of small ones stays a counter bump.
+*/
+namespace lptk
 {
-    constexpr size_t kHeaderSize = sizeof(uint32_t) + sizeof(uint8_t);
-    // header:
-    // allocSize: uint32_t
-    // allocPool: uint8_t
-    // ... padding ...
-    // paddingOffset: uint8_t
-    // ... data ... <-- result
+    namespace
+    {
+        constexpr size_t kSpanSize = size_t(1) << 18;
+        constexpr size_t kSpanHeaderSize = 128;
+        constexpr size_t kPageSize = 4096;
+        constexpr size_t kMaxSmallSize = 16 * 1024;
+        constexpr size_t kMaxSmallAlign = 64;
+        // 16 to 128 in steps of 16, then 4 classes per power of two up to kMaxSmallSize.
+        constexpr unsigned kNumSizeClasses = 8 + 7 * 4;
+        constexpr uint8_t kLargeClass = 0xff;
+        constexpr uint32_t kSpanMagic = 0x5350414e;
+        // completely free spans kept for reuse, the rest go back to the OS.
+        constexpr size_t kMaxFreeSpans = 64;
+        // freed large spans up to this size are cached by the page heap, bigger
+        // ones are unmapped straight away.
+        constexpr size_t kMaxCachedLargeSize = size_t(1) << 20;
+        constexpr size_t kNumPageBins = kMaxCachedLargeSize / kPageSize;
+        constexpr size_t kMaxPageHeapBytes = size_t(32) << 20;
+        // address space reserved for the mid heap, see MidHeap.
+#if defined(LINUX) && UINTPTR_MAX > 0xffffffffu
+        constexpr size_t kMidHeapSize = size_t(16) << 30;
+#else
+        constexpr size_t kMidHeapSize = 0;
+#endif
 
-    ////////////////////////////////////////////////////////////////////////////////
-    inline static void extractHeader(
-            const void* p,
-        void *& realp,
-        size_t& outPadding,
-        size_t& outAllocedSize,
-        uint8_t& outPoolId)
-    {
-        const size_t ptrData = reinterpret_cast<size_t>(p);
-        const size_t padding = *reinterpret_cast<uint8_t*>(ptrData-1);
-        const size_t ptrHeader = ptrData - padding;
-        const size_t locPool = ptrHeader + sizeof(uint32_t);
-        const size_t allocedSize = *reinterpret_cast<uint32_t*>(ptrHeader);
-        const uint8_t poolId = *reinterpret_cast<uint8_t*>(locPool);
-        
-        realp = reinterpret_cast<void*>(ptrHeader);
-        outPadding = padding;
-        outAllocedSize = allocedSize;
-        outPoolId = poolId;
-    }
-
-    inline static size_t computeTotalSize(
-            size_t requestSize,
-            size_t align)
-    {
-        size_t totalSize = requestSize + kHeaderSize + align;
-        if(totalSize > std::numeric_limits<uint32_t>::max()) 
-            ASSERT(false);
-        return totalSize;
-    }
-
-    inline static void* writeHeader(
-       void* p,
-       MemPoolId id,
-       size_t n,
-       size_t totalSize,
-       size_t align)
-    {
-        (void)n;
-        const size_t ptrHeader = reinterpret_cast<size_t>(p);
-        const size_t alignMask = ~size_t(align - 1);
-        const size_t ptrData = (ptrHeader + kHeaderSize + align) & alignMask;
-        const size_t padding = ptrData - ptrHeader;
-        
-        const size_t locSize = ptrHeader;
-        const size_t locPool = ptrHeader + sizeof(uint32_t);
-        const size_t locPadding = ptrData - 1;
-        
-        ASSERT(padding <= std::numeric_limits<uint8_t>::max());
-        ASSERT(padding >= kHeaderSize);
-        ASSERT(locPool < locPadding);
-        ASSERT(totalSize - padding >= n);
-        
-        *reinterpret_cast<uint32_t*>(locSize) = static_cast<uint32_t>(totalSize);
-        *reinterpret_cast<uint8_t*>(locPool) = static_cast<uint8_t>(id);
-        *reinterpret_cast<uint8_t*>(locPadding) = static_cast<uint8_t>(padding);
-        
-        return reinterpret_cast<void*>(ptrData);
+        // Usable before static constructors have run, allocations can come from anywhere.
+        class StaticSpinlock
+        {
+        public:
+            void lock() { while (m_lock.exchange(true, std::memory_order_acquire)) {} }
+            void unlock() { m_lock.store(false, std::memory_order_release); }
+        private:
+            std::atomic<bool> m_lock{ false };
+        };
+
+        struct Span
+        {
+            uint32_t m_magic;
+            uint8_t m_pool;
+            uint8_t m_sizeClass;
+            bool m_inCentral;
+            // small spans: object size. large spans: offset of the data from the span.
+            size_t m_objectSize;
+            size_t m_regionSize;
+            size_t m_numUsed;
+            void* m_freeList;
+            // objects past m_bump haven't been handed out yet, so aren't touched either.
+            char* m_bump;
+            char* m_end;
+            Span* m_prev;
+            Span* m_next;
+        };
+        static_assert(sizeof(Span) <= kSpanHeaderSize, "span header too big");
+
+        inline size_t ClassSize(unsigned sizeClass)
+        {
+            if (sizeClass < 8)
+                return (sizeClass + 1) * 16;
+            const size_t base = size_t(128) << ((sizeClass - 8) / 4);
+            return base + ((sizeClass - 8) % 4 + 1) * (base / 4);
+        }
+
+        inline unsigned SizeToClass(size_t n)
+        {
+            if (n <= 128)
+                return n == 0 ? 0 : unsigned((n - 1) / 16);
+            const unsigned log2 = unsigned(IntLog2_64(n - 1));
+            const size_t base = size_t(1) << log2;
+            return 8 + (log2 - 7) * 4 + unsigned((n - 1 - base) / (base / 4));
+        }
+
+        // objects held by a thread cache list before half of them go back.
+        inline uint32_t BatchSize(unsigned sizeClass)
+        {
+            return uint32_t(Clamp<size_t>(16 * 1024 / ClassSize(sizeClass), 2, 32));
+        }
+
+        // the mid heap's range, empty until it is mapped.
+        std::atomic<uintptr_t> s_midHeapBase{ 0 };
+        std::atomic<uintptr_t> s_midHeapEnd{ 0 };
+
+        inline bool InMidHeap(const void* p)
+        {
+            const auto address = reinterpret_cast<uintptr_t>(p);
+            return address >= s_midHeapBase.load(std::memory_order_relaxed) &&
+                address < s_midHeapEnd.load(std::memory_order_relaxed);
+        }
+
+        // Spans in the mid heap are only page aligned, but their data starts
+        // at most a page in.
+        inline Span* SpanOf(const void* p)
+        {
+            const auto address = reinterpret_cast<uintptr_t>(p);
+            auto span = reinterpret_cast<Span*>(InMidHeap(p) ?
+                (address - 1) & ~uintptr_t(kPageSize - 1) : address & ~uintptr_t(kSpanSize - 1));
+            ASSERT(span->m_magic == kSpanMagic);
+            return span;
+        }
+
+        inline void*& NextOf(void* object)
+        {
+            return *reinterpret_cast<void**>(object);
+        }
+
+        ////////////////////////////////////////////////////////////////////////////////
+        // kSpanSize aligned, zeroed memory straight from the OS.
+#if defined(WINDOWS)
+        void* OsAllocSpan(size_t size)
+        {
+            for (;;)
+            {
+                // VirtualAlloc only aligns to 64k, find an aligned spot in a bigger
+                // reservation and take that. Another thread can grab it in between.
+                auto probe = reinterpret_cast<char*>(VirtualAlloc(nullptr, size + kSpanSize, MEM_RESERVE, PAGE_NOACCESS));
+                if (!probe)
+                    return nullptr;
+                VirtualFree(probe, 0, MEM_RELEASE);
+                auto aligned = reinterpret_cast<char*>(AlignValue<uintptr_t>(reinterpret_cast<uintptr_t>(probe), kSpanSize));
+                if (auto result = VirtualAlloc(aligned, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE))
+                    return result;
+            }
+        }
+
+        bool OsFreeSpan(void* p, size_t)
+        {
+            return VirtualFree(p, 0, MEM_RELEASE) != 0;
+        }
+
+        // VirtualFree can only release whole reservations.
+        bool OsTrimSpan(void*, size_t, size_t)
+        {
+            return false;
+        }
+#elif defined(LINUX)
+        void* OsAllocSpan(size_t size)
+        {
+            const size_t reserveSize = size + kSpanSize;
+            auto reserved = reinterpret_cast<char*>(mmap(nullptr, reserveSize, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+            if (reserved == MAP_FAILED)
+                return nullptr;
+
+            // trimming can fail near vm.max_map_count, give the whole
+            // reservation back rather than leaking it.
+            auto aligned = reinterpret_cast<char*>(AlignValue<uintptr_t>(reinterpret_cast<uintptr_t>(reserved), kSpanSize));
+            const size_t tail = size_t(reserved + reserveSize - (aligned + size));
+            if ((aligned != reserved && munmap(reserved, size_t(aligned - reserved)) != 0) ||
+                (tail && munmap(aligned + size, tail) != 0))
+            {
+                const bool freed = munmap(reserved, reserveSize) == 0;
+                ASSERT(freed);
+                return nullptr;
+            }
+            return aligned;
+        }
+
+        bool OsFreeSpan(void* p, size_t size)
+        {
+            return munmap(p, size) == 0;
+        }
+
+        // gives back the pages past newSize, the start stays where it is.
+        bool OsTrimSpan(void* p, size_t size, size_t newSize)
+        {
+            return munmap(reinterpret_cast<char*>(p) + newSize, size - newSize) == 0;
+        }
+#endif
+
+        ////////////////////////////////////////////////////////////////////////////////
+        struct CentralList
+        {
+            StaticSpinlock m_lock;
+            // spans with objects to hand out.
+            Span* m_spans = nullptr;
+        };
+
+        CentralList s_central[MEMPOOL_NUM][kNumSizeClasses];
+        StaticSpinlock s_freeSpansLock;
+        Span* s_freeSpans = nullptr;
+        size_t s_numFreeSpans = 0;
+
+        void LinkSpan(CentralList& central, Span* span)
+        {
+            span->m_prev = nullptr;
+            span->m_next = central.m_spans;
+            if (central.m_spans)
+                central.m_spans->m_prev = span;
+            central.m_spans = span;
+            span->m_inCentral = true;
+        }
+
+        void UnlinkSpan(CentralList& central, Span* span)
+        {
+            if (span->m_prev)
+                span->m_prev->m_next = span->m_next;
+            else
+                central.m_spans = span->m_next;
+            if (span->m_next)
+                span->m_next->m_prev = span->m_prev;
+            span->m_prev = span->m_next = nullptr;
+            span->m_inCentral = false;
+        }
+
+        Span* NewSmallSpan(MemPoolId pool, unsigned sizeClass)
+        {
+            s_freeSpansLock.lock();
+            Span* span = s_freeSpans;
+            if (span)
+            {
+                s_freeSpans = span->m_next;
+                --s_numFreeSpans;
+            }
+            s_freeSpansLock.unlock();
+
+            if (!span)
+            {
+                void* mem = OsAllocSpan(kSpanSize);
+                if (!mem)
+                    return nullptr;
+                span = new (mem) Span;
+            }
+
+            const size_t objectSize = ClassSize(sizeClass);
+            span->m_magic = kSpanMagic;
+            span->m_pool = uint8_t(pool);
+            span->m_sizeClass = uint8_t(sizeClass);
+            span->m_inCentral = false;
+            span->m_objectSize = objectSize;
+            span->m_regionSize = kSpanSize;
+            span->m_numUsed = 0;
+            span->m_freeList = nullptr;
+            span->m_bump = reinterpret_cast<char*>(span) + kSpanHeaderSize;
+            span->m_end = span->m_bump + (kSpanSize - kSpanHeaderSize) / objectSize * objectSize;
+            span->m_prev = span->m_next = nullptr;
+            return span;
+        }
+
+        void ReleaseSmallSpan(Span* span)
+        {
+            s_freeSpansLock.lock();
+            const bool keep = s_numFreeSpans < kMaxFreeSpans;
+            if (keep)
+            {
+                span->m_next = s_freeSpans;
+                s_freeSpans = span;
+                ++s_numFreeSpans;
+            }
+            s_freeSpansLock.unlock();
+
+            // one the OS won't take back stays cached, over the limit.
+            if (!keep && !OsFreeSpan(span, kSpanSize))
+            {
+                s_freeSpansLock.lock();
+                span->m_next = s_freeSpans;
+                s_freeSpans = span;
+                ++s_numFreeSpans;
+                s_freeSpansLock.unlock();
+            }
+        }
+
+        // Takes up to count objects, linked through their first word. Returns how many.
+        uint32_t CentralAlloc(MemPoolId pool, unsigned sizeClass, uint32_t count, void*& head)
+        {
+            auto& central = s_central[pool][sizeClass];
+            uint32_t numTaken = 0;
+            void* list = nullptr;
+
+            central.m_lock.lock();
+            while (numTaken < count)
+            {
+                Span* span = central.m_spans;
+                if (!span)
+                {
+                    // the OS call and the first touch of the span go without the
+                    // lock, other threads can go on with this class meanwhile.
+                    central.m_lock.unlock();
+                    span = NewSmallSpan(pool, sizeClass);
+                    central.m_lock.lock();
+                    if (!span)
+                        break;
+                    LinkSpan(central, span);
+                }
+
+                while (numTaken < count && span->m_freeList)
+                {
+                    void* object = span->m_freeList;
+                    span->m_freeList = NextOf(object);
+                    NextOf(object) = list;
+                    list = object;
+                    ++numTaken;
+                    ++span->m_numUsed;
+                }
+                while (numTaken < count && span->m_bump < span->m_end)
+                {
+                    void* object = span->m_bump;
+                    span->m_bump += span->m_objectSize;
+                    NextOf(object) = list;
+                    list = object;
+                    ++numTaken;
+                    ++span->m_numUsed;
+                }
+
+                if (!span->m_freeList && span->m_bump == span->m_end)
+                    UnlinkSpan(central, span);
+            }
+            central.m_lock.unlock();
+
+            head = list;
+            return numTaken;
+        }
+
+        // Gives back a list of objects, all of the same pool and class.
+        void CentralFree(MemPoolId pool, unsigned sizeClass, void* list)
+        {
+            auto& central = s_central[pool][sizeClass];
+            Span* emptySpans = nullptr;
+
+            central.m_lock.lock();
+            while (list)
+            {
+                void* object = list;
+                list = NextOf(object);
+
+                Span* span = SpanOf(object);
+                NextOf(object) = span->m_freeList;
+                span->m_freeList = object;
+                --span->m_numUsed;
+
+                if (!span->m_inCentral)
+                {
+                    LinkSpan(central, span);
+                }
+                else if (span->m_numUsed == 0 && (span->m_prev || span->m_next))
+                {
+                    // keep the last span around, or a single alloc/free pair would
+                    // fetch and release a span every time.
+                    UnlinkSpan(central, span);
+                    span->m_next = emptySpans;
+                    emptySpans = span;
+                }
+            }
+            central.m_lock.unlock();
+
+            while (emptySpans)
+            {
+                Span* next = emptySpans->m_next;
+                ReleaseSmallSpan(emptySpans);
+                emptySpans = next;
+            }
+        }
+
+#if defined(PROFILE)
+        ////////////////////////////////////////////////////////////////////////////////
+        constexpr unsigned kNumSizeBuckets = MemPoolStats::kNumSizeBuckets;
+        constexpr int kMaxStackDepth = 16;
+        constexpr size_t kNumCallSites = 4096;
+        constexpr size_t kMaxCallSiteProbes = 32;
+        constexpr size_t kNumReportedCallSites = 16;
+
+        std::atomic<bool> s_trackingEnabled{ false };
+        std::atomic<int64_t> s_sampleInterval{ 512 * 1024 };
+        std::atomic<size_t> s_peakUsed[MEMPOOL_NUM];
+
+        struct TrackingCounters
+        {
+            std::atomic<uint64_t> m_numAllocs{ 0 };
+            std::atomic<uint64_t> m_numFrees{ 0 };
+            std::atomic<uint64_t> m_sizeHistogram[kNumSizeBuckets] = {};
+        };
+
+        // counters have a single writer at a time, like the usage counters.
+        inline void Bump(std::atomic<uint64_t>& counter, uint64_t n = 1)
+        {
+            counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+        }
+
+        inline unsigned SizeBucket(size_t n)
+        {
+            return n == 0 ? 0 : Min(unsigned(IntLog2_64(n)), kNumSizeBuckets - 1);
+        }
+
+        struct CallSite
+        {
+            uint64_t m_hash;
+            uint64_t m_numSamples;
+            uint64_t m_sampledBytes;
+            uint32_t m_pool;
+            uint32_t m_depth;
+            void* m_frames[kMaxStackDepth];
+        };
+
+        StaticSpinlock s_callSitesLock;
+        CallSite s_callSites[kNumCallSites];
+        uint64_t s_numDroppedSamples = 0;
+
+        inline int CaptureStack(void** frames, int maxDepth)
+        {
+#if defined(LINUX)
+            return backtrace(frames, maxDepth);
+#elif defined(WINDOWS)
+            return int(CaptureStackBackTrace(0, DWORD(maxDepth), frames, nullptr));
+#else
+            unused_args(frames, maxDepth);
+            return 0;
+#endif
+        }
+
+        // stacks start inside the allocator, those frames are the same for every site.
+        void RecordSample(MemPoolId pool, uint64_t numBytes)
+        {
+            void* frames[kMaxStackDepth];
+            const auto depth = uint32_t(Max(CaptureStack(frames, kMaxStackDepth), 0));
+            uint64_t hash = 14695981039346656037ull ^ uint64_t(pool);
+            for (uint32_t i = 0; i < depth; ++i)
+                hash = (hash ^ uint64_t(reinterpret_cast<uintptr_t>(frames[i]))) * 1099511628211ull;
+
+            s_callSitesLock.lock();
+            CallSite* found = nullptr;
+            for (size_t probe = 0; probe < kMaxCallSiteProbes && !found; ++probe)
+            {
+                CallSite& site = s_callSites[(hash + probe) & (kNumCallSites - 1)];
+                if (site.m_numSamples == 0)
+                {
+                    site.m_hash = hash;
+                    site.m_pool = uint32_t(pool);
+                    site.m_depth = depth;
+                    memcpy(site.m_frames, frames, depth * sizeof(void*));
+                    found = &site;
+                }
+                else if (site.m_hash == hash && site.m_pool == uint32_t(pool) && site.m_depth == depth &&
+                    memcmp(site.m_frames, frames, depth * sizeof(void*)) == 0)
+                {
+                    found = &site;
+                }
+            }
+
+            if (found)
+            {
+                ++found->m_numSamples;
+                found->m_sampledBytes += numBytes;
+            }
+            else
+            {
+                ++s_numDroppedSamples;
+            }
+            s_callSitesLock.unlock();
+        }
+
+        void UpdatePeak(MemPoolId pool)
+        {
+            const size_t used = mem_GetSizeAllocated(pool);
+            size_t peak = s_peakUsed[pool].load(std::memory_order_relaxed);
+            while (used > peak && !s_peakUsed[pool].compare_exchange_weak(peak, used, std::memory_order_relaxed)) {}
+        }
+#endif
+
+        ////////////////////////////////////////////////////////////////////////////////
+        class ThreadCache;
+        StaticSpinlock s_threadCachesLock;
+        ThreadCache* s_threadCaches = nullptr;
+        // usage from exited threads, and from threads without a cache.
+        std::atomic<int64_t> s_orphanUsed[MEMPOOL_NUM];
+#if defined(PROFILE)
+        TrackingCounters s_orphanTracking[MEMPOOL_NUM];
+#endif
+
+        class ThreadCache
+        {
+        public:
+            ThreadCache()
+            {
+                for (auto& used : m_used)
+                    used.store(0, std::memory_order_relaxed);
+#if defined(PROFILE)
+                m_bytesUntilSample = s_sampleInterval.load(std::memory_order_relaxed);
+#endif
+
+                s_threadCachesLock.lock();
+                m_next = s_threadCaches;
+                if (m_next)
+                    m_next->m_prev = this;
+                s_threadCaches = this;
+                s_threadCachesLock.unlock();
+            }
+
+            ~ThreadCache();
+
+            ThreadCache(const ThreadCache&) = delete;
+            ThreadCache& operator=(const ThreadCache&) = delete;
+            ThreadCache(ThreadCache&&) = delete;
+            ThreadCache& operator=(ThreadCache&&) = delete;
+
+            void* Alloc(MemPoolId pool, unsigned sizeClass)
+            {
+                auto& freeList = m_lists[pool][sizeClass];
+                if (!freeList.m_head)
+                {
+                    freeList.m_count = CentralAlloc(pool, sizeClass, BatchSize(sizeClass), freeList.m_head);
+                    if (!freeList.m_head)
+                        return nullptr;
+                }
+                void* object = freeList.m_head;
+                freeList.m_head = NextOf(object);
+                --freeList.m_count;
+                return object;
+            }
+
+            void Free(void* object, MemPoolId pool, unsigned sizeClass)
+            {
+                auto& freeList = m_lists[pool][sizeClass];
+                NextOf(object) = freeList.m_head;
+                freeList.m_head = object;
+
+                const auto batchSize = BatchSize(sizeClass);
+                if (++freeList.m_count > 2 * batchSize)
+                {
+                    // keep the most recently freed half, they're the warm ones.
+                    void* last = freeList.m_head;
+                    for (uint32_t i = 1; i < batchSize; ++i)
+                        last = NextOf(last);
+                    CentralFree(pool, sizeClass, std::exchange(NextOf(last), nullptr));
+                    freeList.m_count = batchSize;
+                }
+            }
+
+            // only this thread writes its counters, other threads just read them.
+            void AddUsed(MemPoolId pool, int64_t numBytes)
+            {
+                m_used[pool].store(m_used[pool].load(std::memory_order_relaxed) + numBytes, std::memory_order_relaxed);
+            }
+
+            int64_t GetUsed(MemPoolId pool) const
+            {
+                return m_used[pool].load(std::memory_order_relaxed);
+            }
+
+            ThreadCache* GetNext() const { return m_next; }
+
+#if defined(PROFILE)
+            // newBlock is false for blocks that grew in place, they only count towards sampling.
+            void TrackAlloc(MemPoolId pool, size_t numBytes, bool newBlock);
+            void TrackFree(MemPoolId pool) { Bump(m_tracking[pool].m_numFrees); }
+            const TrackingCounters& GetTracking(MemPoolId pool) const { return m_tracking[pool]; }
+#endif
+
+        private:
+            struct FreeList
+            {
+                void* m_head = nullptr;
+                uint32_t m_count = 0;
+            };
+
+            std::atomic<int64_t> m_used[MEMPOOL_NUM];
+            ThreadCache* m_prev = nullptr;
+            ThreadCache* m_next = nullptr;
+            FreeList m_lists[MEMPOOL_NUM][kNumSizeClasses];
+#if defined(PROFILE)
+            TrackingCounters m_tracking[MEMPOOL_NUM];
+            int64_t m_bytesUntilSample = 0;
+            // this thread's usage when the peak was last checked, or its low since.
+            int64_t m_usedAtPeakCheck[MEMPOOL_NUM] = {};
+            bool m_sampling = false;
+#endif
+        };
+
+        // Set once the thread's cache is gone. Allocations made later in thread
+        // or program exit go straight to the central lists.
+        thread_local bool t_threadCacheDestroyed = false;
+        thread_local ThreadCache t_threadCache;
+
+        ThreadCache::~ThreadCache()
+        {
+            t_threadCacheDestroyed = true;
+            for (int pool = 0; pool < MEMPOOL_NUM; ++pool)
+            {
+                for (unsigned sizeClass = 0; sizeClass < kNumSizeClasses; ++sizeClass)
+                {
+                    if (m_lists[pool][sizeClass].m_head)
+                        CentralFree(MemPoolId(pool), sizeClass, m_lists[pool][sizeClass].m_head);
+                }
+            }
+
+            s_threadCachesLock.lock();
+            for (int pool = 0; pool < MEMPOOL_NUM; ++pool)
+                s_orphanUsed[pool].fetch_add(GetUsed(MemPoolId(pool)), std::memory_order_relaxed);
+#if defined(PROFILE)
+            for (int pool = 0; pool < MEMPOOL_NUM; ++pool)
+            {
+                const auto& from = m_tracking[pool];
+                auto& to = s_orphanTracking[pool];
+                Bump(to.m_numAllocs, from.m_numAllocs.load(std::memory_order_relaxed));
+                Bump(to.m_numFrees, from.m_numFrees.load(std::memory_order_relaxed));
+                for (unsigned i = 0; i < kNumSizeBuckets; ++i)
+                    Bump(to.m_sizeHistogram[i], from.m_sizeHistogram[i].load(std::memory_order_relaxed));
+            }
+#endif
+            if (m_prev)
+                m_prev->m_next = m_next;
+            else
+                s_threadCaches = m_next;
+            if (m_next)
+                m_next->m_prev = m_prev;
+            s_threadCachesLock.unlock();
+        }
+
+        inline ThreadCache* GetThreadCache()
+        {
+            return t_threadCacheDestroyed ? nullptr : &t_threadCache;
+        }
+
+        inline void AddUsed(ThreadCache* cache, MemPoolId pool, int64_t numBytes)
+        {
+            if (cache)
+                cache->AddUsed(pool, numBytes);
+            else
+                s_orphanUsed[pool].fetch_add(numBytes, std::memory_order_relaxed);
+        }
+
+#if defined(PROFILE)
+        void ThreadCache::TrackAlloc(MemPoolId pool, size_t numBytes, bool newBlock)
+        {
+            auto& counters = m_tracking[pool];
+            if (newBlock)
+            {
+                Bump(counters.m_numAllocs);
+                Bump(counters.m_sizeHistogram[SizeBucket(numBytes)]);
+            }
+
+            // the peak is checked whenever this thread's usage has grown by a span,
+            // so it is low by at most a span per thread.
+            const int64_t used = GetUsed(pool);
+            int64_t& checked = m_usedAtPeakCheck[pool];
+            if (used < checked)
+                checked = used;
+            else if (used - checked >= int64_t(kSpanSize))
+            {
+                checked = used;
+                UpdatePeak(pool);
+            }
+
+            m_bytesUntilSample -= int64_t(numBytes);
+            if (m_bytesUntilSample > 0 || m_sampling)
+                return;
+
+            // a sample stands for every interval crossed since the previous one.
+            const int64_t interval = s_sampleInterval.load(std::memory_order_relaxed);
+            const int64_t numIntervals = 1 + (-m_bytesUntilSample) / interval;
+            m_bytesUntilSample += numIntervals * interval;
+
+            // capturing the stack may allocate.
+            m_sampling = true;
+            RecordSample(pool, uint64_t(numIntervals * interval));
+            m_sampling = false;
+        }
+
+        inline void TrackAlloc(MemPoolId pool, size_t numBytes, bool newBlock = true)
+        {
+            if (!s_trackingEnabled.load(std::memory_order_relaxed))
+                return;
+            if (auto cache = GetThreadCache())
+                cache->TrackAlloc(pool, numBytes, newBlock);
+        }
+
+        inline void TrackFree(MemPoolId pool)
+        {
+            if (!s_trackingEnabled.load(std::memory_order_relaxed))
+                return;
+            if (auto cache = GetThreadCache())
+                cache->TrackFree(pool);
+        }
+#endif
+
+        ////////////////////////////////////////////////////////////////////////////////
+        // Pools with limits also count their usage in one shared counter, so the
+        // limit check is exact. Pools without only pay for loading m_enabled.
+        struct PoolLimits
+        {
+            std::atomic<bool> m_enabled;
+            std::atomic<bool> m_underPressure;
+            std::atomic<int64_t> m_used;
+            std::atomic<int64_t> m_softLimit;
+            std::atomic<int64_t> m_hardLimit;
+        };
+
+        struct PressureCallback
+        {
+            MemPressureCallback m_callback;
+            void* m_user;
+        };
+
+        constexpr size_t kMaxPressureCallbacks = 16;
+
+        PoolLimits s_limits[MEMPOOL_NUM];
+        StaticSpinlock s_pressureCallbacksLock;
+        PressureCallback s_pressureCallbacks[kMaxPressureCallbacks];
+        size_t s_numPressureCallbacks = 0;
+        thread_local bool t_inPressureCallback = false;
+
+        inline bool HasLimits(MemPoolId pool)
+        {
+            return s_limits[pool].m_enabled.load(std::memory_order_relaxed);
+        }
+
+        // false if no callback ran.
+        bool NotifyPressure(MemPoolId pool, MemPressure pressure, int64_t used)
+        {
+            if (t_inPressureCallback)
+                return false;
+
+            // call them outside the lock, they may well free memory.
+            PressureCallback callbacks[kMaxPressureCallbacks];
+            s_pressureCallbacksLock.lock();
+            const size_t numCallbacks = s_numPressureCallbacks;
+            for (size_t i = 0; i < numCallbacks; ++i)
+                callbacks[i] = s_pressureCallbacks[i];
+            s_pressureCallbacksLock.unlock();
+
+            t_inPressureCallback = true;
+            for (size_t i = 0; i < numCallbacks; ++i)
+                callbacks[i].m_callback(pool, pressure, size_t(Max<int64_t>(used, 0)), callbacks[i].m_user);
+            t_inPressureCallback = false;
+            return numCallbacks > 0;
+        }
+
+        void UnchargeLimit(MemPoolId pool, size_t numBytes)
+        {
+            auto& limits = s_limits[pool];
+            const int64_t used = limits.m_used.fetch_sub(int64_t(numBytes), std::memory_order_relaxed) - int64_t(numBytes);
+            if (limits.m_underPressure.load(std::memory_order_relaxed) &&
+                used < limits.m_softLimit.load(std::memory_order_relaxed))
+            {
+                limits.m_underPressure.store(false, std::memory_order_relaxed);
+            }
+        }
+
+        // counts numBytes against the pool's limits, false if that's past the hard limit.
+        bool ChargeLimit(MemPoolId pool, size_t numBytes)
+        {
+            auto& limits = s_limits[pool];
+            const int64_t hardLimit = limits.m_hardLimit.load(std::memory_order_relaxed);
+            int64_t used = limits.m_used.fetch_add(int64_t(numBytes), std::memory_order_relaxed) + int64_t(numBytes);
+            if (hardLimit && used > hardLimit)
+            {
+                // the callbacks get one chance to make room.
+                limits.m_used.fetch_sub(int64_t(numBytes), std::memory_order_relaxed);
+                if (!NotifyPressure(pool, MemPressure::Hard, used - int64_t(numBytes)))
+                    return false;
+                used = limits.m_used.fetch_add(int64_t(numBytes), std::memory_order_relaxed) + int64_t(numBytes);
+                if (used > hardLimit)
+                {
+                    limits.m_used.fetch_sub(int64_t(numBytes), std::memory_order_relaxed);
+                    return false;
+                }
+            }
+
+            const int64_t softLimit = limits.m_softLimit.load(std::memory_order_relaxed);
+            if (softLimit && used >= softLimit && !limits.m_underPressure.exchange(true, std::memory_order_relaxed))
+                NotifyPressure(pool, MemPressure::Soft, used);
+            return true;
+        }
+
+        ////////////////////////////////////////////////////////////////////////////////
+        // The first bin from first to last with its bit set, or ~0 if none.
+        size_t FindNonEmptyBin(const uint64_t* nonEmpty, size_t first, size_t last)
+        {
+            for (size_t word = first / 64; word <= last / 64; ++word)
+            {
+                uint64_t bits = nonEmpty[word];
+                if (word == first / 64)
+                    bits &= ~uint64_t(0) << (first % 64);
+                if (word == last / 64)
+                    bits &= ~uint64_t(0) >> (63 - last % 64);
+                if (bits)
+                    return word * 64 + IntLog2_64(bits & (~bits + 1));
+            }
+            return ~size_t(0);
+        }
+
+        ////////////////////////////////////////////////////////////////////////////////
+        // Large spans up to kMaxCachedLargeSize with at most page alignment are
+        // carved out of one range of address space, mapped once, instead of
+        // getting a mapping each. A mapping per block would have every live
+        // block be its own VMA, and a few tens of thousands of them run into
+        // vm.max_map_count. The range is mapped without reserving swap, pages
+        // only cost memory once touched, and freed ones are given back with
+        // madvise, which doesn't split it.
+        //
+        // Free extents are binned by their number of pages, with one more bin
+        // for bigger ones, and merged with their free neighbours. Each keeps a
+        // Span header in its first page as the list node, and its length in
+        // the page tags of its first and last page, so a freed block finds
+        // the free extents either side of it. Tags are zero everywhere else.
+        // Nothing past m_top has been handed out yet.
+        struct MidHeap
+        {
+            StaticSpinlock m_lock;
+            bool m_initDone = false;
+            char* m_base = nullptr;
+            char* m_top = nullptr;
+            char* m_end = nullptr;
+            uint32_t* m_pageTags = nullptr;
+            Span* m_bins[kNumPageBins + 1] = {};
+            uint64_t m_nonEmpty[kNumPageBins / 64] = {};
+        };
+
+        MidHeap s_midHeap;
+
+        inline size_t MidPage(const void* p)
+        {
+            return size_t(reinterpret_cast<const char*>(p) - s_midHeap.m_base) / kPageSize;
+        }
+
+        inline size_t MidBin(size_t numPages)
+        {
+            return Min(numPages, kNumPageBins + 1) - 1;
+        }
+
+        // with s_midHeap locked, on first use. False if the range can't be mapped,
+        // then mid-size spans get mappings of their own as before.
+        bool MidHeapInit()
+        {
+#if defined(LINUX)
+            if (s_midHeap.m_initDone)
+                return s_midHeap.m_base != nullptr;
+            s_midHeap.m_initDone = true;
+            if (kMidHeapSize == 0)
+                return false;
+
+            const size_t tagsSize = kMidHeapSize / kPageSize * sizeof(uint32_t);
+            void* base = mmap(nullptr, kMidHeapSize, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+            void* tags = mmap(nullptr, tagsSize, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+            if (base == MAP_FAILED || tags == MAP_FAILED)
+            {
+                if (base != MAP_FAILED)
+                    munmap(base, kMidHeapSize);
+                if (tags != MAP_FAILED)
+                    munmap(tags, tagsSize);
+                return false;
+            }
+
+            s_midHeap.m_base = s_midHeap.m_top = reinterpret_cast<char*>(base);
+            s_midHeap.m_end = s_midHeap.m_base + kMidHeapSize;
+            s_midHeap.m_pageTags = reinterpret_cast<uint32_t*>(tags);
+            s_midHeapBase.store(reinterpret_cast<uintptr_t>(s_midHeap.m_base), std::memory_order_relaxed);
+            s_midHeapEnd.store(reinterpret_cast<uintptr_t>(s_midHeap.m_end), std::memory_order_relaxed);
+            return true;
+#else
+            return false;
+#endif
+        }
+
+        // with s_midHeap locked.
+        void MidLinkFree(char* start, size_t numPages)
+        {
+            const size_t page = MidPage(start);
+            s_midHeap.m_pageTags[page] = uint32_t(numPages);
+            s_midHeap.m_pageTags[page + numPages - 1] = uint32_t(numPages);
+
+            const size_t bin = MidBin(numPages);
+            auto extent = reinterpret_cast<Span*>(start);
+            extent->m_regionSize = numPages * kPageSize;
+            extent->m_prev = nullptr;
+            extent->m_next = s_midHeap.m_bins[bin];
+            if (extent->m_next)
+                extent->m_next->m_prev = extent;
+            s_midHeap.m_bins[bin] = extent;
+            if (bin < kNumPageBins)
+                s_midHeap.m_nonEmpty[bin / 64] |= uint64_t(1) << (bin % 64);
+        }
+
+        // with s_midHeap locked.
+        void MidUnlinkFree(Span* extent)
+        {
+            const size_t numPages = extent->m_regionSize / kPageSize;
+            const size_t page = MidPage(extent);
+            s_midHeap.m_pageTags[page] = 0;
+            s_midHeap.m_pageTags[page + numPages - 1] = 0;
+
+            const size_t bin = MidBin(numPages);
+            if (extent->m_prev)
+                extent->m_prev->m_next = extent->m_next;
+            else
+                s_midHeap.m_bins[bin] = extent->m_next;
+            if (extent->m_next)
+                extent->m_next->m_prev = extent->m_prev;
+            if (bin < kNumPageBins && !s_midHeap.m_bins[bin])
+                s_midHeap.m_nonEmpty[bin / 64] &= ~(uint64_t(1) << (bin % 64));
+        }
+
+        // page aligned, null when the range is full or can't be mapped.
+        void* MidAlloc(size_t regionSize)
+        {
+            const size_t numPages = regionSize / kPageSize;
+            char* result = nullptr;
+
+            s_midHeap.m_lock.lock();
+            if (MidHeapInit())
+            {
+                // the smallest bin that fits, else first fit among the bigger extents.
+                Span* extent = nullptr;
+                const size_t bin = FindNonEmptyBin(s_midHeap.m_nonEmpty, numPages - 1, kNumPageBins - 1);
+                if (bin != ~size_t(0))
+                    extent = s_midHeap.m_bins[bin];
+                for (Span* big = s_midHeap.m_bins[kNumPageBins]; big && !extent; big = big->m_next)
+                {
+                    if (big->m_regionSize >= regionSize)
+                        extent = big;
+                }
+
+                if (extent)
+                {
+                    // the rest stays free, its neighbours are both in use.
+                    const size_t extentSize = extent->m_regionSize;
+                    MidUnlinkFree(extent);
+                    result = reinterpret_cast<char*>(extent);
+                    if (extentSize > regionSize)
+                        MidLinkFree(result + regionSize, (extentSize - regionSize) / kPageSize);
+                }
+                else if (size_t(s_midHeap.m_end - s_midHeap.m_top) >= regionSize)
+                {
+                    result = s_midHeap.m_top;
+                    s_midHeap.m_top += regionSize;
+                }
+            }
+            s_midHeap.m_lock.unlock();
+            return result;
+        }
+
+        // Gives back a page aligned block, whole or a span's tail.
+        void MidFree(void* p, size_t size)
+        {
+#if defined(LINUX)
+            // before it is free, so nobody can have taken it again. The first page
+            // may become the extent's list node, it stays.
+            auto start = reinterpret_cast<char*>(p);
+            if (size > kPageSize)
+                madvise(start + kPageSize, size - kPageSize, MADV_DONTNEED);
+
+            s_midHeap.m_lock.lock();
+            size_t numPages = size / kPageSize;
+            const size_t page = MidPage(start);
+            if (page > 0 && s_midHeap.m_pageTags[page - 1])
+            {
+                const size_t prevPages = s_midHeap.m_pageTags[page - 1];
+                start -= prevPages * kPageSize;
+                MidUnlinkFree(reinterpret_cast<Span*>(start));
+                numPages += prevPages;
+            }
+            char* end = start + numPages * kPageSize;
+            if (end < s_midHeap.m_top && s_midHeap.m_pageTags[MidPage(end)])
+            {
+                const size_t nextPages = s_midHeap.m_pageTags[MidPage(end)];
+                MidUnlinkFree(reinterpret_cast<Span*>(end));
+                numPages += nextPages;
+                end += nextPages * kPageSize;
+            }
+
+            if (end == s_midHeap.m_top)
+                s_midHeap.m_top = start;
+            else
+                MidLinkFree(start, numPages);
+            s_midHeap.m_lock.unlock();
+#else
+            unused_args(p, size);
+#endif
+        }
+
+        ////////////////////////////////////////////////////////////////////////////////
+        // Freed large spans up to kMaxCachedLargeSize, binned by their number of
+        // pages, so the middle sizes don't pay for an mmap and munmap each time.
+        // A span bigger than asked for gets its tail unmapped, which keeps the
+        // start kSpanSize aligned; where the OS can't do that only the exact
+        // bin is searched.
+        struct PageHeap
+        {
+            StaticSpinlock m_lock;
+            Span* m_bins[kNumPageBins] = {};
+            uint64_t m_nonEmpty[kNumPageBins / 64] = {};
+            size_t m_numBytes = 0;
+        };
+
+        PageHeap s_pageHeap;
+#if defined(LINUX)
+        constexpr bool kCanTrimSpans = true;
+#else
+        constexpr bool kCanTrimSpans = false;
+#endif
+
+        // with s_pageHeap locked.
+        void PageHeapPush(Span* span)
+        {
+            const size_t bin = span->m_regionSize / kPageSize - 1;
+            span->m_next = s_pageHeap.m_bins[bin];
+            s_pageHeap.m_bins[bin] = span;
+            s_pageHeap.m_nonEmpty[bin / 64] |= uint64_t(1) << (bin % 64);
+            s_pageHeap.m_numBytes += span->m_regionSize;
+        }
+
+        // with s_pageHeap locked. The smallest span of at least regionSize.
+        Span* PageHeapPop(size_t regionSize)
+        {
+            const size_t first = regionSize / kPageSize - 1;
+            const size_t last = kCanTrimSpans ? kNumPageBins - 1 : first;
+            const size_t bin = FindNonEmptyBin(s_pageHeap.m_nonEmpty, first, last);
+            if (bin == ~size_t(0))
+                return nullptr;
+
+            Span* span = s_pageHeap.m_bins[bin];
+            s_pageHeap.m_bins[bin] = span->m_next;
+            if (!span->m_next)
+                s_pageHeap.m_nonEmpty[bin / 64] &= ~(uint64_t(1) << (bin % 64));
+            s_pageHeap.m_numBytes -= span->m_regionSize;
+            return span;
+        }
+
+        // gives back the span's pages past newSize.
+        bool TrimLargeSpan(Span* span, size_t newSize)
+        {
+            if (InMidHeap(span))
+            {
+                MidFree(reinterpret_cast<char*>(span) + newSize, span->m_regionSize - newSize);
+                return true;
+            }
+            return OsTrimSpan(span, span->m_regionSize, newSize);
+        }
+
+        // one the page heap doesn't keep.
+        bool FreeLargeSpan(Span* span)
+        {
+            if (InMidHeap(span))
+            {
+                MidFree(span, span->m_regionSize);
+                return true;
+            }
+            return OsFreeSpan(span, span->m_regionSize);
+        }
+
+        // a cached span cut down to regionSize, null if there's none.
+        Span* TakeLargeSpan(size_t regionSize)
+        {
+            if (regionSize > kMaxCachedLargeSize)
+                return nullptr;
+
+            s_pageHeap.m_lock.lock();
+            Span* span = PageHeapPop(regionSize);
+            s_pageHeap.m_lock.unlock();
+
+            if (span && span->m_regionSize != regionSize)
+            {
+                if (!TrimLargeSpan(span, regionSize))
+                {
+                    s_pageHeap.m_lock.lock();
+                    PageHeapPush(span);
+                    s_pageHeap.m_lock.unlock();
+                    return nullptr;
+                }
+                span->m_regionSize = regionSize;
+            }
+            return span;
+        }
+
+        // into the page heap while it has room, else back to the OS. One the OS
+        // won't take back is cached anyway rather than lost.
+        void ReleaseLargeSpan(Span* span)
+        {
+            const size_t regionSize = span->m_regionSize;
+            if (regionSize <= kMaxCachedLargeSize)
+            {
+                s_pageHeap.m_lock.lock();
+                const bool keep = s_pageHeap.m_numBytes + regionSize <= kMaxPageHeapBytes;
+                if (keep)
+                    PageHeapPush(span);
+                s_pageHeap.m_lock.unlock();
+                if (keep)
+                    return;
+            }
+
+            if (!FreeLargeSpan(span))
+            {
+                ASSERT(regionSize <= kMaxCachedLargeSize && "leaking a large span the OS won't unmap");
+                if (regionSize <= kMaxCachedLargeSize)
+                {
+                    s_pageHeap.m_lock.lock();
+                    PageHeapPush(span);
+                    s_pageHeap.m_lock.unlock();
+                }
+            }
+        }
+
+        ////////////////////////////////////////////////////////////////////////////////
+        inline size_t LargeRegionSize(size_t n, size_t align)
+        {
+            return AlignValue(AlignValue(kSpanHeaderSize, align) + n, kPageSize);
+        }
+
+        void* LargeAllocate(size_t n, MemPoolId id, size_t align)
+        {
+            ASSERT(align <= kSpanSize / 2);
+            const size_t dataOffset = AlignValue(kSpanHeaderSize, align);
+            const size_t regionSize = LargeRegionSize(n, align);
+            // spans in the page heap may be from the mid heap, only page aligned.
+            void* mem = nullptr;
+            if (align <= kPageSize && regionSize <= kMaxCachedLargeSize)
+            {
+                mem = TakeLargeSpan(regionSize);
+                if (!mem)
+                    mem = MidAlloc(regionSize);
+            }
+            if (!mem)
+                mem = OsAllocSpan(regionSize);
+            if (!mem)
+                return nullptr;
+
+            Span* span = new (mem) Span;
+            span->m_magic = kSpanMagic;
+            span->m_pool = uint8_t(id);
+            span->m_sizeClass = kLargeClass;
+            span->m_inCentral = false;
+            span->m_objectSize = dataOffset;
+            span->m_regionSize = regionSize;
+            span->m_numUsed = 1;
+            span->m_freeList = nullptr;
+            span->m_bump = span->m_end = nullptr;
+            span->m_prev = span->m_next = nullptr;
+
+            AddUsed(GetThreadCache(), id, int64_t(regionSize));
+            return reinterpret_cast<char*>(mem) + dataOffset;
+        }
+
+        // Grows a large allocation by remapping its pages: in place if the address
+        // space after it is free, else into a new kSpanSize aligned range. Null if
+        // the OS can't or the span is in the mid heap, then the caller copies.
+        void* LargeReallocate(Span* span, void* p, size_t n)
+        {
+#if defined(LINUX)
+            if (InMidHeap(span))
+                return nullptr;
+            const size_t dataOffset = span->m_objectSize;
+            const size_t oldSize = span->m_regionSize;
+            const size_t newSize = AlignValue(dataOffset + n, kPageSize);
+            const auto pool = MemPoolId(span->m_pool);
+            ASSERT(reinterpret_cast<char*>(p) == reinterpret_cast<char*>(span) + dataOffset);
+
+            void* mem = mremap(span, oldSize, newSize, 0);
+            if (mem == MAP_FAILED)
+            {
+                // the fresh mapping at dest is replaced, untouched, by the moved pages.
+                void* dest = OsAllocSpan(newSize);
+                if (!dest)
+                    return nullptr;
+                mem = mremap(span, oldSize, newSize, MREMAP_MAYMOVE | MREMAP_FIXED, dest);
+                if (mem == MAP_FAILED)
+                {
+                    const bool freed = OsFreeSpan(dest, newSize);
+                    ASSERT(freed);
+                    return nullptr;
+                }
+            }
+
+            span = reinterpret_cast<Span*>(mem);
+            span->m_regionSize = newSize;
+            AddUsed(GetThreadCache(), pool, int64_t(newSize) - int64_t(oldSize));
+            return reinterpret_cast<char*>(mem) + dataOffset;
+#else
+            unused_args(span, p, n);
+            return nullptr;
+#endif
+        }
+
+        // size class for a small request, or kLargeClass.
+        inline unsigned ChooseClass(size_t n, size_t align)
+        {
+            if (align <= 16)
+                return n <= kMaxSmallSize ? SizeToClass(n) : kLargeClass;
+            if (align > kMaxSmallAlign)
+                return kLargeClass;
+
+            // objects sit at kSpanHeaderSize + i * size, so a size that is a multiple
+            // of align keeps them all aligned.
+            n = AlignValue(Max(n, align), align);
+            if (n > kMaxSmallSize)
+                return kLargeClass;
+            unsigned sizeClass = SizeToClass(n);
+            while (ClassSize(sizeClass) % align != 0)
+                ++sizeClass;
+            return sizeClass;
+        }
+
+        inline size_t UsableSize(const Span* span, const void* p)
+        {
+            if (span->m_sizeClass == kLargeClass)
+                return span->m_regionSize - size_t(reinterpret_cast<const char*>(p) - reinterpret_cast<const char*>(span));
+            return span->m_objectSize;
+        }
     }
 
     ////////////////////////////////////////////////////////////////////////////////
@@ -99,16 +1272,39 @@ namespace lptk
 #else
         ASSERT(id < MEMPOOL_NUM);
 
-        const size_t totalSize = computeTotalSize(n, align);
-        void* p = raw_allocate(totalSize);
-        if(!p) return nullptr;
+        const unsigned sizeClass = ChooseClass(n, align);
+        const bool limited = HasLimits(id);
+        const size_t charge = !limited ? 0 : sizeClass == kLargeClass ? LargeRegionSize(n, align) : ClassSize(sizeClass);
+        if (limited && !ChargeLimit(id, charge))
+            return nullptr;
+
+        void* result = nullptr;
+        if (sizeClass == kLargeClass)
+        {
+            result = LargeAllocate(n, id, align);
+        }
+        else
+        {
+            auto cache = GetThreadCache();
+            if (cache)
+            {
+                result = cache->Alloc(id, sizeClass);
+            }
+            else if (CentralAlloc(id, sizeClass, 1, result) == 0)
+            {
+                result = nullptr;
+            }
 
-        void *result = writeHeader(p, id, n, totalSize, align);
-        g_poolMemUsed[id].fetch_add(totalSize);
+            if (result)
+                AddUsed(cache, id, int64_t(ClassSize(sizeClass)));
+        }
 
-        //	std::cout << "allocated: " << std::hex << ptrHeader << " (" << ptrData << ")" << 
-        //		" in pool " << g_poolName[id] << 
-        //		" of size " << std::dec << totalSize << " with padding " << padding << std::endl;
+        if (!result && limited)
+            UnchargeLimit(id, charge);
+#if defined(PROFILE)
+        if (result)
+            TrackAlloc(id, n);
+#endif
         return result;
 #endif
     }
@@ -121,35 +1317,37 @@ namespace lptk
         if(!previous)
             return mem_allocate(n, id, align);
 
-        void* realp = nullptr;
-        size_t padding, allocedSize;
-        uint8_t poolId;
-        extractHeader(previous, realp, padding, allocedSize, poolId);
+        // grow or shrink in place while it fits, in its original pool.
+        Span* span = SpanOf(previous);
+        const size_t usableSize = UsableSize(span, previous);
+        const bool aligned = (reinterpret_cast<uintptr_t>(previous) & (align - 1)) == 0;
+        if (n <= usableSize && aligned)
+            return previous;
 
-        ASSERT(realp != nullptr);
-
-        // if realp isn't aligned as we'd like, then make sure we realloc.
-        const size_t realpBits = reinterpret_cast<size_t>(realp);
-        const size_t alignResult = (realpBits & ~(size_t(align)-1));
-
-        const size_t totalSize = computeTotalSize(n, align);
-        void* newp = alignResult == 0 ? realloc(realp, totalSize) : raw_allocate(totalSize);
-        
-        void* result = nullptr;
-        if(newp != realp)
-        {
-            result = writeHeader(newp, id, n, totalSize, align);
-            memcpy(result, previous, allocedSize - padding);
-            mem_free(previous);
-        }
-        else
+        // large to large moves pages instead of bytes, where the OS can.
+        if (span->m_sizeClass == kLargeClass && n > kMaxSmallSize && aligned)
         {
-            g_poolMemUsed[poolId].fetch_sub(allocedSize);
-            result = writeHeader(realp, id, n, totalSize, align);
-            ASSERT(result == previous);
+            const auto pool = MemPoolId(span->m_pool);
+            const bool limited = HasLimits(pool);
+            const size_t growth = AlignValue(span->m_objectSize + n, kPageSize) - span->m_regionSize;
+            if (limited && !ChargeLimit(pool, growth))
+                return nullptr;
+            if (void* result = LargeReallocate(span, previous, n))
+            {
+#if defined(PROFILE)
+                TrackAlloc(pool, n - usableSize, false);
+#endif
+                return result;
+            }
+            if (limited)
+                UnchargeLimit(pool, growth);
         }
-        
-        g_poolMemUsed[id].fetch_add(totalSize);
+
+        void* result = mem_allocate(n, id, align);
+        if (!result)
+            return nullptr;
+        memcpy(result, previous, Min(n, usableSize));
+        mem_free(previous);
         return result;
 #endif
     }
@@ -158,21 +1356,42 @@ namespace lptk
     {
         if(!p) return;
 #ifdef PLAIN_MALLOC
-        free(p); 
+        free(p);
         return;
 #else
-        void* realp = nullptr;
-        size_t padding, allocedSize;
-        uint8_t poolId;
-        extractHeader(p, realp, padding, allocedSize, poolId);
+        Span* span = SpanOf(p);
+        const auto pool = MemPoolId(span->m_pool);
+        ASSERT(pool < MEMPOOL_NUM);
+#if defined(PROFILE)
+        TrackFree(pool);
+#endif
 
-        ASSERT(poolId < MEMPOOL_NUM);
+        auto cache = GetThreadCache();
+        if (span->m_sizeClass == kLargeClass)
+        {
+            const size_t regionSize = span->m_regionSize;
+            if (HasLimits(pool))
+                UnchargeLimit(pool, regionSize);
+            AddUsed(cache, pool, -int64_t(regionSize));
+            ReleaseLargeSpan(span);
+            return;
+        }
 
-        g_poolMemUsed[poolId].fetch_sub(allocedSize);
-        raw_free(realp);
+        if (HasLimits(pool))
+            UnchargeLimit(pool, span->m_objectSize);
+        AddUsed(cache, pool, -int64_t(span->m_objectSize));
+        if (cache)
+        {
+            cache->Free(p, pool, span->m_sizeClass);
+        }
+        else
+        {
+            NextOf(p) = nullptr;
+            CentralFree(pool, span->m_sizeClass, p);
+        }
 #endif
     }
-    
+
     void* raw_allocate(size_t n)
     {
         return malloc(n);
@@ -186,12 +1405,12 @@ namespace lptk
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-void *operator new(size_t n, lptk::MemPoolId id, unsigned int align) 
+void *operator new(size_t n, lptk::MemPoolId id, unsigned int align)
 {
     return lptk::mem_allocate(n, id, align);
 }
 
-void *operator new[](size_t n, lptk::MemPoolId id, unsigned int align) 
+void *operator new[](size_t n, lptk::MemPoolId id, unsigned int align)
 {
     return lptk::mem_allocate(n, id, align);
 }
@@ -199,10 +1418,80 @@ void *operator new[](size_t n, lptk::MemPoolId id, unsigned int align)
 ////////////////////////////////////////////////////////////////////////////////
 namespace lptk
 {
+#if defined(PROFILE)
+    namespace
+    {
+        void WriteTrackingReport(FILE* fp)
+        {
+            for (int i = 0; i < MEMPOOL_NUM; ++i)
+            {
+                const auto stats = mem_GetPoolStats(MemPoolId(i));
+                if (stats.m_numAllocs == 0 && stats.m_peak == 0)
+                    continue;
+                fprintf(fp, "%s : %zu bytes, peak %zu, %llu allocs, %llu frees\n", g_poolName[i], stats.m_current,
+                    stats.m_peak, (unsigned long long)stats.m_numAllocs, (unsigned long long)stats.m_numFrees);
+                fprintf(fp, "  sizes:");
+                for (unsigned bucket = 0; bucket < kNumSizeBuckets; ++bucket)
+                {
+                    if (stats.m_sizeHistogram[bucket])
+                        fprintf(fp, " %llu+ x%llu", bucket ? 1ull << bucket : 0ull, (unsigned long long)stats.m_sizeHistogram[bucket]);
+                }
+                fprintf(fp, "\n");
+            }
+
+            // copy the heaviest sites out, printing them can allocate.
+            CallSite top[kNumReportedCallSites];
+            size_t numTop = 0;
+            s_callSitesLock.lock();
+            for (const auto& site : s_callSites)
+            {
+                if (site.m_numSamples == 0)
+                    continue;
+                size_t pos = Min(numTop, kNumReportedCallSites - 1);
+                if (numTop == kNumReportedCallSites && top[pos].m_sampledBytes >= site.m_sampledBytes)
+                    continue;
+                for (; pos > 0 && top[pos - 1].m_sampledBytes < site.m_sampledBytes; --pos)
+                    top[pos] = top[pos - 1];
+                top[pos] = site;
+                numTop = Min(numTop + 1, kNumReportedCallSites);
+            }
+            const uint64_t numDropped = s_numDroppedSamples;
+            s_callSitesLock.unlock();
+
+            fprintf(fp, "Top call sites, sampled every %lld bytes:\n", (long long)s_sampleInterval.load(std::memory_order_relaxed));
+            for (size_t i = 0; i < numTop; ++i)
+            {
+                const CallSite& site = top[i];
+                fprintf(fp, "#%zu %s : ~%llu bytes in %llu samples\n", i, g_poolName[site.m_pool],
+                    (unsigned long long)site.m_sampledBytes, (unsigned long long)site.m_numSamples);
+#if defined(LINUX)
+                char** symbols = backtrace_symbols(site.m_frames, int(site.m_depth));
+                for (uint32_t frame = 0; frame < site.m_depth; ++frame)
+                    fprintf(fp, "    %s\n", symbols ? symbols[frame] : "?");
+                free(symbols);
+#else
+                for (uint32_t frame = 0; frame < site.m_depth; ++frame)
+                    fprintf(fp, "    %p\n", site.m_frames[frame]);
+#endif
+            }
+            if (numDropped)
+                fprintf(fp, "%llu samples dropped, the call site table is full\n", (unsigned long long)numDropped);
+            fflush(fp);
+        }
+    }
+#endif
+
     size_t mem_GetSizeAllocated(MemPoolId id)
     {
         ASSERT(id < MEMPOOL_NUM);
-        return g_poolMemUsed[id];
+        // memory freed on another thread than it was allocated on makes single
+        // counters negative, only the sum means anything.
+        int64_t total = s_orphanUsed[id].load(std::memory_order_relaxed);
+        s_threadCachesLock.lock();
+        for (auto cache = s_threadCaches; cache; cache = cache->GetNext())
+            total += cache->GetUsed(id);
+        s_threadCachesLock.unlock();
+        return size_t(Max<int64_t>(total, 0));
     }
 
     void mem_ReportText(const char* title)
@@ -211,9 +1500,149 @@ namespace lptk
         std::cout << "Tagged memory usage " << (title ? title : "")  << ":" << std::endl;
         for(int i = 0; i < MEMPOOL_NUM; ++i)
         {
-            std::cout << g_poolName[i] << " : " << g_poolMemUsed[i] << std::endl;
+            std::cout << g_poolName[i] << " : " << mem_GetSizeAllocated(MemPoolId(i));
+            if (HasLimits(MemPoolId(i)))
+            {
+                std::cout << " (soft limit " << s_limits[i].m_softLimit.load(std::memory_order_relaxed)
+                    << ", hard limit " << s_limits[i].m_hardLimit.load(std::memory_order_relaxed) << ")";
+            }
+            std::cout << std::endl;
         }
+#if defined(PROFILE)
+        if (s_trackingEnabled.load(std::memory_order_relaxed))
+        {
+            std::cout.flush();
+            WriteTrackingReport(stdout);
+        }
+#endif
     }
 
-}
+    ////////////////////////////////////////////////////////////////////////////////
+    void mem_SetPoolLimits(MemPoolId id, size_t softLimit, size_t hardLimit)
+    {
+        ASSERT(id < MEMPOOL_NUM);
+        ASSERT(!softLimit || !hardLimit || softLimit <= hardLimit);
+        auto& limits = s_limits[id];
+        const bool enable = softLimit || hardLimit;
+        if (enable && !limits.m_enabled.load(std::memory_order_relaxed))
+        {
+            limits.m_used.store(int64_t(mem_GetSizeAllocated(id)), std::memory_order_relaxed);
+            limits.m_underPressure.store(false, std::memory_order_relaxed);
+        }
+        limits.m_softLimit.store(int64_t(softLimit), std::memory_order_relaxed);
+        limits.m_hardLimit.store(int64_t(hardLimit), std::memory_order_relaxed);
+        limits.m_enabled.store(enable, std::memory_order_relaxed);
+    }
+
+    void mem_GetPoolLimits(MemPoolId id, size_t& softLimit, size_t& hardLimit)
+    {
+        ASSERT(id < MEMPOOL_NUM);
+        softLimit = size_t(s_limits[id].m_softLimit.load(std::memory_order_relaxed));
+        hardLimit = size_t(s_limits[id].m_hardLimit.load(std::memory_order_relaxed));
+    }
+
+    bool mem_AddPressureCallback(MemPressureCallback callback, void* user)
+    {
+        ASSERT(callback);
+        s_pressureCallbacksLock.lock();
+        const bool added = s_numPressureCallbacks < kMaxPressureCallbacks;
+        if (added)
+            s_pressureCallbacks[s_numPressureCallbacks++] = { callback, user };
+        s_pressureCallbacksLock.unlock();
+        return added;
+    }
+
+    void mem_RemovePressureCallback(MemPressureCallback callback, void* user)
+    {
+        s_pressureCallbacksLock.lock();
+        for (size_t i = 0; i < s_numPressureCallbacks; ++i)
+        {
+            if (s_pressureCallbacks[i].m_callback == callback && s_pressureCallbacks[i].m_user == user)
+            {
+                s_pressureCallbacks[i] = s_pressureCallbacks[--s_numPressureCallbacks];
+                break;
+            }
+        }
+        s_pressureCallbacksLock.unlock();
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////
+#if defined(PROFILE)
+    bool mem_EnableTracking(bool enabled, size_t sampleInterval)
+    {
+        ASSERT(sampleInterval > 0);
+        s_sampleInterval.store(int64_t(Max<size_t>(sampleInterval, 1)), std::memory_order_relaxed);
+        if (enabled)
+        {
+            for (int i = 0; i < MEMPOOL_NUM; ++i)
+                UpdatePeak(MemPoolId(i));
+        }
+        s_trackingEnabled.store(enabled, std::memory_order_relaxed);
+        return true;
+    }
+
+    bool mem_IsTrackingEnabled()
+    {
+        return s_trackingEnabled.load(std::memory_order_relaxed);
+    }
+
+    MemPoolStats mem_GetPoolStats(MemPoolId id)
+    {
+        ASSERT(id < MEMPOOL_NUM);
+        MemPoolStats stats;
+        stats.m_current = mem_GetSizeAllocated(id);
 
+        auto add = [&stats](const TrackingCounters& counters)
+        {
+            stats.m_numAllocs += counters.m_numAllocs.load(std::memory_order_relaxed);
+            stats.m_numFrees += counters.m_numFrees.load(std::memory_order_relaxed);
+            for (unsigned i = 0; i < kNumSizeBuckets; ++i)
+                stats.m_sizeHistogram[i] += counters.m_sizeHistogram[i].load(std::memory_order_relaxed);
+        };
+
+        s_threadCachesLock.lock();
+        add(s_orphanTracking[id]);
+        for (auto cache = s_threadCaches; cache; cache = cache->GetNext())
+            add(cache->GetTracking(id));
+        s_threadCachesLock.unlock();
+
+        stats.m_peak = Max(s_peakUsed[id].load(std::memory_order_relaxed), stats.m_current);
+        return stats;
+    }
+
+    bool mem_DumpTracking(const char* filename)
+    {
+        FILE* fp = fopen(filename, "w");
+        if (!fp)
+            return false;
+        WriteTrackingReport(fp);
+        fclose(fp);
+        return true;
+    }
+#else
+    bool mem_EnableTracking(bool enabled, size_t sampleInterval)
+    {
+        unused_args(enabled, sampleInterval);
+        return false;
+    }
+
+    bool mem_IsTrackingEnabled()
+    {
+        return false;
+    }
+
+    MemPoolStats mem_GetPoolStats(MemPoolId id)
+    {
+        MemPoolStats stats;
+        stats.m_current = mem_GetSizeAllocated(id);
+        return stats;
+    }
+
+    bool mem_DumpTracking(const char* filename)
+    {
+        unused_arg(filename);
+        return false;
+    }
+#endif
+
+}
@@ -0,0 +1,33 @@
+#include "toolkit/mem/frame_arena.hh"
+
+namespace lptk
+{
+    namespace mem
+    {
+        FrameArena::FrameArena(size_t blockSize, mem::Allocator* alloc)
+            : m_frames{ LinearChunkAllocator(blockSize, alloc), LinearChunkAllocator(blockSize, alloc) }
+        {
+        }
+
+        void* FrameArena::Alloc(size_t numBytes, unsigned align)
+        {
+            return m_frames[m_current].Alloc(numBytes, align);
+        }
+
+        void FrameArena::Free(void*)
+        {
+        }
+
+        void FrameArena::NextFrame()
+        {
+            m_current ^= 1;
+            m_frames[m_current].Clear();
+        }
+
+        FrameArena* GetThreadFrameArena()
+        {
+            static thread_local FrameArena s_frameArena;
+            return &s_frameArena;
+        }
+    }
+}
@@ -0,0 +1,369 @@
+#include "toolkit/mem/huge_page_arena.hh"
+#include "toolkit/mathcommon.hh"
+
+#if defined(WINDOWS)
+#include <windows.h>
+#elif defined(LINUX)
+#include <sys/mman.h>
+#endif
+
+namespace lptk
+{
+    namespace mem
+    {
+        ////////////////////////////////////////////////////////////////////////////////
+        // Every allocation is a chunk with a header right before the returned
+        // pointer, giving the chunk's size and where it starts. Free chunks keep
+        // their size and the next free chunk at their start instead.
+        namespace
+        {
+            struct ChunkHeader
+            {
+                uint64_t m_chunkSize;
+                uint64_t m_dataOffset;
+            };
+            static_assert(sizeof(ChunkHeader) == 16, "header must keep data 16 aligned");
+
+            // split off the tail of a free chunk only when it is worth tracking.
+            constexpr size_t kMinSplitSize = 256;
+
+            ////////////////////////////////////////////////////////////////////////////////
+            // huge page aligned address space. HugeTLB comes back committed, or not
+            // at all.
+#if defined(LINUX)
+            char* OsReserve(size_t size, bool hugeTLB)
+            {
+                if (hugeTLB)
+                {
+                    // no MAP_NORESERVE: a short pool fails here instead of with SIGBUS on touch.
+                    void* mem = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+                    return mem == MAP_FAILED ? nullptr : reinterpret_cast<char*>(mem);
+                }
+
+                // over reserve to find an aligned spot, then trim.
+                const size_t reserveSize = size + HugePageArena::kHugePageSize;
+                void* mem = mmap(nullptr, reserveSize, PROT_NONE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+                if (mem == MAP_FAILED)
+                    return nullptr;
+                char* reserved = reinterpret_cast<char*>(mem);
+                char* base = reinterpret_cast<char*>(AlignValue<uintptr_t>(
+                    reinterpret_cast<uintptr_t>(reserved), HugePageArena::kHugePageSize));
+                if (base != reserved)
+                    munmap(reserved, size_t(base - reserved));
+                const size_t tail = size_t(reserved + reserveSize - (base + size));
+                if (tail)
+                    munmap(base + size, tail);
+                return base;
+            }
+
+            bool OsCommit(char* p, size_t size)
+            {
+                return mprotect(p, size, PROT_READ | PROT_WRITE) == 0;
+            }
+
+            void OsRelease(char* p, size_t size)
+            {
+                munmap(p, size);
+            }
+#elif defined(WINDOWS)
+            char* OsReserve(size_t size, bool)
+            {
+                for (;;)
+                {
+                    // VirtualAlloc only aligns to 64k, find an aligned spot in a bigger
+                    // reservation and take that. Another thread can grab it in between.
+                    auto probe = reinterpret_cast<char*>(VirtualAlloc(nullptr, size + HugePageArena::kHugePageSize,
+                        MEM_RESERVE, PAGE_NOACCESS));
+                    if (!probe)
+                        return nullptr;
+                    VirtualFree(probe, 0, MEM_RELEASE);
+                    auto aligned = reinterpret_cast<char*>(AlignValue<uintptr_t>(
+                        reinterpret_cast<uintptr_t>(probe), HugePageArena::kHugePageSize));
+                    if (VirtualAlloc(aligned, size, MEM_RESERVE, PAGE_NOACCESS))
+                        return aligned;
+                }
+            }
+
+            bool OsCommit(char* p, size_t size)
+            {
+                return VirtualAlloc(p, size, MEM_COMMIT, PAGE_READWRITE) != nullptr;
+            }
+
+            void OsRelease(char* p, size_t)
+            {
+                VirtualFree(p, 0, MEM_RELEASE);
+            }
+#endif
+        }
+
+        struct HugePageArena::Region
+        {
+            Region* m_next;
+            size_t m_size;
+            // bytes from the region start that are committed, and in use.
+            size_t m_committed;
+            size_t m_top;
+        };
+
+        struct HugePageArena::FreeBlock
+        {
+            FreeBlock* m_next;
+            size_t m_size;
+        };
+
+        ////////////////////////////////////////////////////////////////////////////////
+        HugePageArena::HugePageArena(size_t reserveSize, PageMode mode)
+            : m_reserveSize(AlignValue(Max(reserveSize, kHugePageSize), kHugePageSize))
+            , m_mode(mode)
+        {
+#if !defined(LINUX)
+            m_mode = PageMode::Normal;
+#endif
+        }
+
+        HugePageArena::~HugePageArena()
+        {
+            Reset();
+        }
+
+        void HugePageArena::Reset()
+        {
+            while (m_regions)
+            {
+                Region* next = m_regions->m_next;
+                ReleaseRegion(m_regions);
+                m_regions = next;
+            }
+            m_freeBlocks = nullptr;
+            ASSERT(m_reservedBytes == 0 && m_committedBytes == 0);
+            m_allocatedBytes = 0;
+        }
+
+        ////////////////////////////////////////////////////////////////////////////////
+        HugePageArena::Region* HugePageArena::ReserveRegion(size_t minSize)
+        {
+            const size_t size = AlignValue(Max(minSize, m_reserveSize), kHugePageSize);
+
+            char* base = nullptr;
+            size_t committed = 0;
+            if (m_mode == PageMode::HugeTLB)
+            {
+                base = OsReserve(size, true);
+                if (base)
+                    committed = size;
+                else
+                    m_mode = PageMode::Transparent;
+            }
+            if (!base)
+            {
+                base = OsReserve(size, false);
+                if (!base)
+                    return nullptr;
+#if defined(LINUX)
+                if (m_mode == PageMode::Transparent)
+                    madvise(base, size, MADV_HUGEPAGE);
+#endif
+                if (!OsCommit(base, kHugePageSize))
+                {
+                    OsRelease(base, size);
+                    return nullptr;
+                }
+                committed = kHugePageSize;
+            }
+
+            Region* region = new (base) Region;
+            region->m_next = nullptr;
+            region->m_size = size;
+            region->m_committed = committed;
+            region->m_top = AlignValue<size_t>(sizeof(Region), 16);
+
+            m_reservedBytes += size;
+            m_committedBytes += committed;
+            return region;
+        }
+
+        void HugePageArena::ReleaseRegion(Region* region)
+        {
+            m_reservedBytes -= region->m_size;
+            m_committedBytes -= region->m_committed;
+            OsRelease(reinterpret_cast<char*>(region), region->m_size);
+        }
+
+        bool HugePageArena::Commit(Region* region, size_t end)
+        {
+            if (end <= region->m_committed)
+                return true;
+            const size_t newCommitted = Min(AlignValue(end, kHugePageSize), region->m_size);
+            if (!OsCommit(reinterpret_cast<char*>(region) + region->m_committed, newCommitted - region->m_committed))
+                return false;
+            m_committedBytes += newCommitted - region->m_committed;
+            region->m_committed = newCommitted;
+            return true;
+        }
+
+        ////////////////////////////////////////////////////////////////////////////////
+        void* HugePageArena::AllocFromFreeList(size_t size, unsigned align)
+        {
+            for (FreeBlock** link = &m_freeBlocks; *link; link = &(*link)->m_next)
+            {
+                FreeBlock* block = *link;
+                const auto start = reinterpret_cast<uintptr_t>(block);
+                const uintptr_t data = AlignValue<uintptr_t>(start + sizeof(ChunkHeader), align);
+                const uintptr_t end = AlignValue<uintptr_t>(data + size, 16);
+                if (end > start + block->m_size)
+                    continue;
+
+                size_t chunkSize = block->m_size;
+                *link = block->m_next;
+                if (start + chunkSize - end >= kMinSplitSize)
+                {
+                    auto rest = new (reinterpret_cast<void*>(end)) FreeBlock;
+                    rest->m_size = size_t(start + chunkSize - end);
+                    rest->m_next = *link;
+                    *link = rest;
+                    chunkSize = size_t(end - start);
+                }
+
+                auto header = reinterpret_cast<ChunkHeader*>(data - sizeof(ChunkHeader));
+                header->m_chunkSize = chunkSize;
+                header->m_dataOffset = data - start;
+                m_allocatedBytes += chunkSize;
+                return reinterpret_cast<void*>(data);
+            }
+            return nullptr;
+        }
+
+        void* HugePageArena::AllocFromRegion(Region* region, size_t size, unsigned align)
+        {
+            const auto base = reinterpret_cast<uintptr_t>(region);
+            const uintptr_t start = base + region->m_top;
+            const uintptr_t data = AlignValue<uintptr_t>(start + sizeof(ChunkHeader), align);
+            const uintptr_t end = AlignValue<uintptr_t>(data + size, 16);
+            if (end > base + region->m_size || !Commit(region, size_t(end - base)))
+                return nullptr;
+
+            auto header = reinterpret_cast<ChunkHeader*>(data - sizeof(ChunkHeader));
+            header->m_chunkSize = end - start;
+            header->m_dataOffset = data - start;
+            region->m_top = size_t(end - base);
+            m_allocatedBytes += end - start;
+            return reinterpret_cast<void*>(data);
+        }
+
+        void* HugePageArena::Alloc(size_t size, unsigned align)
+        {
+            align = Max(align, 16u);
+            ASSERT(IsPower2(align) && align <= kHugePageSize);
+
+            if (void* result = AllocFromFreeList(size, align))
+                return result;
+            if (m_regions)
+            {
+                if (void* result = AllocFromRegion(m_regions, size, align))
+                    return result;
+            }
+
+            Region* region = ReserveRegion(AlignValue<size_t>(sizeof(Region), 16) + sizeof(ChunkHeader) + align + size);
+            if (!region)
+                return nullptr;
+            void* result = AllocFromRegion(region, size, align);
+
+            // A region bigger than a reservation is there for this one block, so
+            // it goes behind the head, which keeps serving the rest. Otherwise
+            // the head is full and the new region takes over. Either way the
+            // region that stops growing hands its tail to the free list.
+            if (m_regions && region->m_size > m_reserveSize)
+            {
+                region->m_next = m_regions->m_next;
+                m_regions->m_next = region;
+                RetireTail(region);
+            }
+            else
+            {
+                Region* full = m_regions;
+                region->m_next = m_regions;
+                m_regions = region;
+                if (full)
+                    RetireTail(full);
+            }
+            return result;
+        }
+
+        void HugePageArena::Free(void* ptr)
+        {
+            if (!ptr)
+                return;
+            const auto header = reinterpret_cast<const ChunkHeader*>(reinterpret_cast<char*>(ptr) - sizeof(ChunkHeader));
+            const size_t chunkSize = size_t(header->m_chunkSize);
+            char* start = reinterpret_cast<char*>(ptr) - header->m_dataOffset;
+            ASSERT(m_allocatedBytes >= chunkSize);
+            m_allocatedBytes -= chunkSize;
+            AddFreeBlock(start, chunkSize);
+        }
+
+        // The free list is kept in address order so a block merges with the free
+        // ones on either side. One that ends up at the head region's top moves
+        // the top back instead.
+        void HugePageArena::AddFreeBlock(char* start, size_t size)
+        {
+            FreeBlock** link = &m_freeBlocks;
+            FreeBlock** prevLink = nullptr;
+            while (*link && reinterpret_cast<char*>(*link) < start)
+            {
+                prevLink = link;
+                link = &(*link)->m_next;
+            }
+
+            FreeBlock* prev = prevLink ? *prevLink : nullptr;
+            FreeBlock* next = *link;
+            FreeBlock* block;
+            FreeBlock** blockLink;
+            if (prev && reinterpret_cast<char*>(prev) + prev->m_size == start)
+            {
+                prev->m_size += size;
+                block = prev;
+                blockLink = prevLink;
+            }
+            else
+            {
+                block = new (start) FreeBlock;
+                block->m_size = size;
+                block->m_next = next;
+                *link = block;
+                blockLink = link;
+            }
+            if (next && reinterpret_cast<char*>(block) + block->m_size == reinterpret_cast<char*>(next))
+            {
+                block->m_size += next->m_size;
+                block->m_next = next->m_next;
+            }
+
+            char* head = reinterpret_cast<char*>(m_regions);
+            if (m_regions && reinterpret_cast<char*>(block) + block->m_size == head + m_regions->m_top)
+            {
+                *blockLink = block->m_next;
+                m_regions->m_top = size_t(reinterpret_cast<char*>(block) - head);
+            }
+        }
+
+        // Puts what's left past the region's top on the free list. That has to
+        // be committed first, which is at most the size of the allocation that
+        // didn't fit in it.
+        void HugePageArena::RetireTail(Region* region)
+        {
+            size_t end = region->m_size;
+            if (end - region->m_top < kMinSplitSize)
+                return;
+            if (!Commit(region, end))
+                end = region->m_committed;
+            if (end <= region->m_top || end - region->m_top < kMinSplitSize)
+                return;
+
+            char* start = reinterpret_cast<char*>(region) + region->m_top;
+            region->m_top = end;
+            AddFreeBlock(start, end - size_t(start - reinterpret_cast<char*>(region)));
+        }
+    }
+}
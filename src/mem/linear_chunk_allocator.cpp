@@ -65,47 +65,45 @@ namespace lptk
 
         void* LinearChunkAllocator::Alloc(size_t numBytes, unsigned align)
         {
-            lptk::unused_arg(align); // TODO should be able to align up to builtin alignment
+            // block data starts 16 aligned, anything beyond that needs padding.
+            align = lptk::Max(align, 16u);
             numBytes = lptk::AlignValue<size_t>(numBytes, 16u);
+            const size_t headerSize = lptk::AlignValue<size_t>(sizeof(BlockHeader), 16);
+            auto paddingAt = [align, headerSize](BlockHeader* block, size_t pos)
+            {
+                const auto start = reinterpret_cast<uintptr_t>(block) + headerSize + pos;
+                return size_t(lptk::AlignValue<uintptr_t>(start, align) - start);
+            };
 
             if (!m_cur)
             {
-                BlockHeader* newHeader = MakeBlock(numBytes);
-                m_root = newHeader;
-                m_cur = newHeader;
+                if (!m_root)
+                    m_root = MakeBlock(numBytes + align - 16);
+                m_cur = m_root;
                 m_pos = 0;
             }
-            else if ((m_cur->m_size - m_pos) < numBytes)
+
+            size_t padding = paddingAt(m_cur, m_pos);
+            if ((m_cur->m_size - m_pos) < numBytes + padding)
             {
-                if (m_cur->m_next)
-                {
-                    if (m_cur->m_next->m_size < numBytes)
-                    {
-                        BlockHeader* newHeader = MakeBlock(numBytes);
-                        newHeader->m_next = m_cur->m_next;
-                        m_cur->m_next = newHeader;
-                        m_cur = newHeader;
-                        m_pos = 0;
-                    }
-                    else
-                    {
-                        m_cur = m_cur->m_next;
-                        m_pos = 0;
-                    }
-                }
-                else
+                // move on to the next chunk kept from before, unless it's too small.
+                BlockHeader* next = m_cur->m_next;
+                if (!next || next->m_size < numBytes + paddingAt(next, 0))
                 {
-                    BlockHeader* newHeader = MakeBlock(numBytes);
+                    BlockHeader* newHeader = MakeBlock(numBytes + align - 16);
+                    newHeader->m_next = next;
                     m_cur->m_next = newHeader;
-                    m_cur = newHeader;
-                    m_pos = 0;
+                    next = newHeader;
                 }
+                m_cur = next;
+                m_pos = 0;
+                padding = paddingAt(m_cur, m_pos);
             }
 
-            char* dataStart = reinterpret_cast<char*>(m_cur) + lptk::AlignValue<size_t>(sizeof(BlockHeader), 16);
+            char* dataStart = reinterpret_cast<char*>(m_cur) + headerSize;
 
-            char* result = dataStart + m_pos;
-            m_pos += numBytes;
+            char* result = dataStart + m_pos + padding;
+            m_pos += padding + numBytes;
             ASSERT(m_pos <= m_cur->m_size);
 
             return result;
@@ -128,6 +126,49 @@ namespace lptk
             m_pos = 0;
             m_cur = m_root;
         }
+
+        size_t LinearChunkAllocator::ReleaseIdleChunks()
+        {
+            // markers can't point past the current chunk, so these are free to go.
+            BlockHeader* cur = m_cur ? m_cur->m_next : m_root;
+            if (m_cur)
+                m_cur->m_next = nullptr;
+            else
+                m_root = nullptr;
+
+            const size_t headerSize = lptk::AlignValue<size_t>(sizeof(BlockHeader), 16);
+            size_t numBytes = 0;
+            while (cur)
+            {
+                BlockHeader* next = cur->m_next;
+                numBytes += cur->m_size + headerSize;
+                m_alloc->Free(cur);
+                cur = next;
+            }
+            return numBytes;
+        }
+
+        LinearChunkAllocator::Marker LinearChunkAllocator::GetMarker() const
+        {
+            Marker marker;
+            marker.m_block = m_cur;
+            marker.m_pos = m_pos;
+            return marker;
+        }
+
+        void LinearChunkAllocator::Rewind(const Marker& marker)
+        {
+            // chunks past the marker stay linked after it, for the next allocations.
+            if (marker.m_block)
+            {
+                m_cur = marker.m_block;
+                m_pos = marker.m_pos;
+            }
+            else
+            {
+                Clear();
+            }
+        }
     }
 }
 
@@ -1,4 +1,5 @@
 #include "toolkit/mem/pool_allocator.hh"
+#include "toolkit/mathcommon.hh"
 
 namespace lptk
 {
@@ -138,6 +139,274 @@ namespace lptk
             item->m_next = m_next;
             m_next = item;
         }
+
+        namespace
+        {
+            ////////////////////////////////////////////////////////////////////////////////
+            // Every thread takes one of the magazine slots while it lives, the slot
+            // indexes each pool's magazine array. Slots are reused once a thread
+            // exits, along with whatever its magazines still hold.
+            std::mutex s_slotsMutex;
+            int s_freeSlots[ConcurrentPoolAlloc::kMaxMagazines];
+            int s_numFreeSlots = 0;
+            int s_numSlots = 0;
+
+            class MagazineSlot
+            {
+            public:
+                MagazineSlot()
+                {
+                    std::lock_guard<std::mutex> lock(s_slotsMutex);
+                    if (s_numFreeSlots > 0)
+                        m_index = s_freeSlots[--s_numFreeSlots];
+                    else if (s_numSlots < int(ConcurrentPoolAlloc::kMaxMagazines))
+                        m_index = s_numSlots++;
+                }
+
+                ~MagazineSlot()
+                {
+                    if (m_index < 0)
+                        return;
+                    std::lock_guard<std::mutex> lock(s_slotsMutex);
+                    s_freeSlots[s_numFreeSlots++] = m_index;
+                }
+
+                int m_index = -1;
+            };
+
+            thread_local MagazineSlot t_magazineSlot;
+        }
+
+        ////////////////////////////////////////////////////////////////////////////////
+        // Items are 16 byte aligned, so 64 bit pointers fit in 44 bits with
+        // 20 bits of tag.
+        ConcurrentPoolAlloc::TaggedPtr ConcurrentPoolAlloc::MakeTagged(BlockItem* item, uint64_t tag)
+        {
+            const auto ptr = uint64_t(reinterpret_cast<uintptr_t>(item));
+            if (sizeof(void*) == 4)
+                return ptr | (tag << 32);
+            ASSERT(ptr < (uint64_t(1) << 48) && (ptr & 15) == 0);
+            return (ptr >> 4) | (tag << 44);
+        }
+
+        ConcurrentPoolAlloc::BlockItem* ConcurrentPoolAlloc::TaggedItem(TaggedPtr tagged)
+        {
+            if (sizeof(void*) == 4)
+                return reinterpret_cast<BlockItem*>(uintptr_t(tagged & 0xffffffffu));
+            return reinterpret_cast<BlockItem*>(uintptr_t((tagged & ((uint64_t(1) << 44) - 1)) << 4));
+        }
+
+        uint64_t ConcurrentPoolAlloc::TaggedTag(TaggedPtr tagged)
+        {
+            return sizeof(void*) == 4 ? tagged >> 32 : tagged >> 44;
+        }
+
+        ////////////////////////////////////////////////////////////////////////////////
+        ConcurrentPoolAlloc::ConcurrentPoolAlloc(mem::Allocator* alloc)
+            : m_alloc(alloc)
+        {}
+
+        ConcurrentPoolAlloc::ConcurrentPoolAlloc(size_t itemsPerBlock, size_t itemSize, bool canGrow, mem::Allocator* alloc)
+        {
+            Init(itemsPerBlock, itemSize, canGrow, alloc);
+        }
+
+        void ConcurrentPoolAlloc::Init(size_t itemsPerBlock, size_t itemSize, bool canGrow, mem::Allocator* alloc)
+        {
+            ASSERT(m_itemsPerBlock == 0 && m_itemSize == 0 && !m_block.load() && !m_magazines);
+            ASSERT(itemsPerBlock > 0);
+            m_itemsPerBlock = itemsPerBlock;
+            m_itemSize = (itemSize + 15) & ~15;
+            m_canGrow = canGrow;
+            m_alloc = alloc;
+
+            // items parked in another thread's magazine can't be reached, which
+            // only a pool that grows can afford.
+            if (canGrow)
+                m_magazines = m_alloc->CreateN<Magazine>(kMaxMagazines);
+            else
+            {
+                BlockItem* lastBatch;
+                BlockItem* firstBatch = AllocBlock(lastBatch);
+                if (firstBatch)
+                    PushBatches(firstBatch, lastBatch);
+            }
+        }
+
+        ConcurrentPoolAlloc::~ConcurrentPoolAlloc()
+        {
+            Block* block = m_block.load(std::memory_order_relaxed);
+            while (block) {
+                Block* next = block->m_next;
+                m_alloc->Free(block);
+                block = next;
+            }
+            if (m_magazines)
+                m_alloc->DestroyN(kMaxMagazines, m_magazines);
+        }
+
+        ////////////////////////////////////////////////////////////////////////////////
+        void ConcurrentPoolAlloc::PushBatches(BlockItem* first, BlockItem* last)
+        {
+            TaggedPtr head = m_next.load(std::memory_order_relaxed);
+            do
+            {
+                last->m_nextBatch.store(TaggedItem(head), std::memory_order_relaxed);
+            } while (!m_next.compare_exchange_weak(head, MakeTagged(first, TaggedTag(head) + 1),
+                std::memory_order_release, std::memory_order_relaxed));
+        }
+
+        ConcurrentPoolAlloc::BlockItem* ConcurrentPoolAlloc::PopBatch()
+        {
+            TaggedPtr head = m_next.load(std::memory_order_acquire);
+            for (;;)
+            {
+                BlockItem* batch = TaggedItem(head);
+                if (!batch)
+                    return nullptr;
+                // batch may be popped and handed out meanwhile, then this reads
+                // garbage, but the tag has moved on and the exchange fails.
+                BlockItem* nextBatch = batch->m_nextBatch.load(std::memory_order_relaxed);
+                if (m_next.compare_exchange_weak(head, MakeTagged(nextBatch, TaggedTag(head) + 1),
+                    std::memory_order_acquire, std::memory_order_acquire))
+                    return batch;
+            }
+        }
+
+        ConcurrentPoolAlloc::BlockItem* ConcurrentPoolAlloc::AllocBlock(BlockItem*& lastBatch)
+        {
+            constexpr auto blockSize = (sizeof(Block) + 15u) & ~15u;
+            constexpr size_t batchSize = kMagazineSize / 2;
+            const auto allocSize = blockSize + m_itemsPerBlock * m_itemSize;
+            char* data = reinterpret_cast<char*>(m_alloc->Alloc(allocSize, 16));
+            if (!data)
+                return nullptr;
+            auto block = new (data) Block;
+
+            BlockItem* firstBatch = nullptr;
+            BlockItem* prevBatch = nullptr;
+            for (size_t start = 0; start < m_itemsPerBlock; start += batchSize)
+            {
+                const size_t end = Min(start + batchSize, m_itemsPerBlock);
+                BlockItem* batch = nullptr;
+                for (size_t i = end; i-- > start; )
+                {
+                    auto item = new (data + blockSize + i * m_itemSize) BlockItem;
+                    item->m_next = batch;
+                    batch = item;
+                }
+                if (prevBatch)
+                    prevBatch->m_nextBatch.store(batch, std::memory_order_relaxed);
+                else
+                    firstBatch = batch;
+                prevBatch = batch;
+            }
+            lastBatch = prevBatch;
+
+            // blocks are only ever added, IsValidPtr may walk them concurrently.
+            block->m_next = m_block.load(std::memory_order_relaxed);
+            m_block.store(block, std::memory_order_release);
+            return firstBatch;
+        }
+
+        ConcurrentPoolAlloc::BlockItem* ConcurrentPoolAlloc::Grow()
+        {
+            std::lock_guard<std::mutex> lock(m_growMutex);
+            // whoever held the lock before may have grown the pool already.
+            if (BlockItem* batch = PopBatch())
+                return batch;
+            if (!m_canGrow)
+                return nullptr;
+
+            BlockItem* lastBatch;
+            BlockItem* firstBatch = AllocBlock(lastBatch);
+            if (!firstBatch)
+                return nullptr;
+            if (firstBatch != lastBatch)
+                PushBatches(firstBatch->m_nextBatch.load(std::memory_order_relaxed), lastBatch);
+            return firstBatch;
+        }
+
+        ConcurrentPoolAlloc::Magazine* ConcurrentPoolAlloc::GetMagazine() const
+        {
+            const int slot = t_magazineSlot.m_index;
+            return slot >= 0 && m_magazines ? &m_magazines[slot] : nullptr;
+        }
+
+        ////////////////////////////////////////////////////////////////////////////////
+        void* ConcurrentPoolAlloc::Alloc(size_t size, unsigned align)
+        {
+            lptk::unused_arg(align);
+            if (size > m_itemSize)
+                return nullptr;
+
+            Magazine* magazine = GetMagazine();
+            if (magazine && magazine->m_count > 0)
+                return magazine->m_items[--magazine->m_count];
+
+            BlockItem* batch = PopBatch();
+            if (!batch)
+                batch = Grow();
+            if (!batch)
+                return nullptr;
+
+            BlockItem* result = batch;
+            if (magazine)
+            {
+                for (BlockItem* item = batch->m_next; item; item = item->m_next)
+                    magazine->m_items[magazine->m_count++] = item;
+            }
+            else if (batch->m_next)
+            {
+                PushBatches(batch->m_next, batch->m_next);
+            }
+            ASSERT(IsValidPtr(result));
+            return result;
+        }
+
+        void ConcurrentPoolAlloc::Free(void* ptr)
+        {
+            if (!ptr) return;
+            ASSERT(IsValidPtr(ptr));
+            auto item = new (ptr) BlockItem;
+
+            Magazine* magazine = GetMagazine();
+            if (!magazine)
+            {
+                PushBatches(item, item);
+                return;
+            }
+
+            if (magazine->m_count == kMagazineSize)
+            {
+                // give back the older half, the recently freed items are the warm ones.
+                constexpr unsigned half = kMagazineSize / 2;
+                for (unsigned i = 0; i < half - 1; ++i)
+                    magazine->m_items[i]->m_next = magazine->m_items[i + 1];
+                magazine->m_items[half - 1]->m_next = nullptr;
+                PushBatches(magazine->m_items[0], magazine->m_items[0]);
+                for (unsigned i = half; i < kMagazineSize; ++i)
+                    magazine->m_items[i - half] = magazine->m_items[i];
+                magazine->m_count = half;
+            }
+            magazine->m_items[magazine->m_count++] = item;
+        }
+
+        bool ConcurrentPoolAlloc::IsValidPtr(const void* p) const
+        {
+            Block* cur = m_block.load(std::memory_order_acquire);
+            while (cur)
+            {
+                const auto blockStart = reinterpret_cast<size_t>(p);
+                const auto blockEnd = blockStart + m_itemSize;
+                const auto start = reinterpret_cast<size_t>(cur->First());
+                const auto end = reinterpret_cast<size_t>(cur->First()) + m_itemsPerBlock * m_itemSize;
+
+                if (blockStart >= start && blockEnd <= end)
+                    return true;
+                cur = cur->m_next;
+            }
+            return false;
+        }
     }
 }
-
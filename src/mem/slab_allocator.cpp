@@ -0,0 +1,250 @@
+#include "toolkit/mem/slab_allocator.hh"
+#include "toolkit/mathcommon.hh"
+#include <algorithm>
+
+namespace lptk
+{
+    namespace mem
+    {
+        struct SlabAllocator::Slab
+        {
+            Slab* m_prev;
+            Slab* m_next;
+            void* m_freeList;
+            // items past m_bump haven't been handed out yet.
+            char* m_bump;
+            char* m_end;
+            size_t m_numUsed;
+            size_t m_numItems;
+            unsigned m_sizeClass;
+            bool m_inPartial;
+        };
+
+        namespace
+        {
+            // items start here, so every class size that is a multiple of an
+            // alignment up to 64 keeps its items aligned.
+            constexpr size_t kSlabHeaderSize = 64;
+            constexpr unsigned kMaxAlign = 64;
+
+            inline void*& NextOf(void* item)
+            {
+                return *reinterpret_cast<void**>(item);
+            }
+        }
+
+        ////////////////////////////////////////////////////////////////////////////////
+        SlabAllocator::SlabAllocator(mem::Allocator* parent)
+            : m_parent(parent)
+            , m_slabs(AllocatorPolicy(parent))
+        {
+            static_assert(sizeof(Slab) <= kSlabHeaderSize, "slab header too big");
+            for (unsigned i = 0; i < kNumClasses; ++i)
+                m_stats[i].m_itemSize = ClassSize(i);
+        }
+
+        SlabAllocator::~SlabAllocator()
+        {
+            for (Slab* slab : m_slabs)
+                m_parent->Free(slab);
+        }
+
+        size_t SlabAllocator::ClassSize(unsigned sizeClass)
+        {
+            ASSERT(sizeClass < kNumClasses);
+            if (sizeClass < 2)
+                return kMinSize << sizeClass;
+            // 24, 32, 48, 64, 96, ...
+            const size_t base = size_t(16) << ((sizeClass - 2) / 2);
+            return (sizeClass & 1) ? base * 2 : base + base / 2;
+        }
+
+        unsigned SlabAllocator::ChooseClass(size_t size, unsigned align)
+        {
+            if (size > kMaxSize || align > kMaxAlign)
+                return kNumClasses;
+            size = Max(size, size_t(align));
+            for (unsigned sizeClass = 0; sizeClass < kNumClasses; ++sizeClass)
+            {
+                const size_t classSize = ClassSize(sizeClass);
+                if (classSize >= size && classSize % align == 0)
+                    return sizeClass;
+            }
+            return kNumClasses;
+        }
+
+        const SlabAllocator::ClassStats& SlabAllocator::GetClassStats(unsigned sizeClass) const
+        {
+            ASSERT(sizeClass < kNumClasses);
+            return m_stats[sizeClass];
+        }
+
+        ////////////////////////////////////////////////////////////////////////////////
+        void SlabAllocator::LinkPartial(Slab* slab)
+        {
+            Slab*& head = m_partial[slab->m_sizeClass];
+            slab->m_prev = nullptr;
+            slab->m_next = head;
+            if (head)
+                head->m_prev = slab;
+            head = slab;
+            slab->m_inPartial = true;
+        }
+
+        void SlabAllocator::UnlinkPartial(Slab* slab)
+        {
+            if (slab->m_prev)
+                slab->m_prev->m_next = slab->m_next;
+            else
+                m_partial[slab->m_sizeClass] = slab->m_next;
+            if (slab->m_next)
+                slab->m_next->m_prev = slab->m_prev;
+            slab->m_prev = slab->m_next = nullptr;
+            slab->m_inPartial = false;
+        }
+
+        SlabAllocator::Slab* SlabAllocator::NewSlab(unsigned sizeClass)
+        {
+            // only aligned for the items, asking for kSlabSize alignment would make
+            // parents like the default allocator pad every slab to twice its size.
+            char* mem = reinterpret_cast<char*>(m_parent->Alloc(kSlabSize, kMaxAlign));
+            if (!mem)
+                return nullptr;
+            ASSERT((reinterpret_cast<uintptr_t>(mem) & (kMaxAlign - 1)) == 0);
+
+            const size_t itemSize = ClassSize(sizeClass);
+            auto slab = new (mem) Slab;
+            slab->m_prev = slab->m_next = nullptr;
+            slab->m_freeList = nullptr;
+            slab->m_bump = mem + kSlabHeaderSize;
+            slab->m_numItems = (kSlabSize - kSlabHeaderSize) / itemSize;
+            slab->m_end = slab->m_bump + slab->m_numItems * itemSize;
+            slab->m_numUsed = 0;
+            slab->m_sizeClass = sizeClass;
+            slab->m_inPartial = false;
+
+            m_slabs.insert(std::lower_bound(m_slabs.begin(), m_slabs.end(), slab), slab);
+            auto& stats = m_stats[sizeClass];
+            ++stats.m_numSlabs;
+            stats.m_numItemsTotal += slab->m_numItems;
+            return slab;
+        }
+
+        void SlabAllocator::ReleaseSlab(Slab* slab)
+        {
+            auto& stats = m_stats[slab->m_sizeClass];
+            --stats.m_numSlabs;
+            stats.m_numItemsTotal -= slab->m_numItems;
+
+            auto it = std::lower_bound(m_slabs.begin(), m_slabs.end(), slab);
+            ASSERT(it != m_slabs.end() && *it == slab);
+            m_slabs.erase(it);
+            m_parent->Free(slab);
+        }
+
+        SlabAllocator::Slab* SlabAllocator::FindSlab(const void* p) const
+        {
+            // the last slab starting at or before p, if p is inside it.
+            const auto address = reinterpret_cast<uintptr_t>(p);
+            auto it = std::upper_bound(m_slabs.begin(), m_slabs.end(), address,
+                [](uintptr_t address, const Slab* slab) { return address < reinterpret_cast<uintptr_t>(slab); });
+            if (it == m_slabs.begin())
+                return nullptr;
+            Slab* slab = *(it - 1);
+            return address - reinterpret_cast<uintptr_t>(slab) < kSlabSize ? slab : nullptr;
+        }
+
+        ////////////////////////////////////////////////////////////////////////////////
+        void* SlabAllocator::Alloc(size_t size, unsigned align)
+        {
+            const unsigned sizeClass = ChooseClass(size, align);
+            if (sizeClass == kNumClasses)
+            {
+                ++m_numParentAllocs;
+                return m_parent->Alloc(size, align);
+            }
+
+            Slab* slab = m_partial[sizeClass];
+            if (!slab)
+            {
+                slab = NewSlab(sizeClass);
+                if (!slab)
+                    return nullptr;
+                LinkPartial(slab);
+            }
+
+            void* result;
+            if (slab->m_freeList)
+            {
+                result = slab->m_freeList;
+                slab->m_freeList = NextOf(result);
+            }
+            else
+            {
+                ASSERT(slab->m_bump < slab->m_end);
+                result = slab->m_bump;
+                slab->m_bump += ClassSize(sizeClass);
+            }
+            if (++slab->m_numUsed == slab->m_numItems)
+                UnlinkPartial(slab);
+
+            auto& stats = m_stats[sizeClass];
+            ++stats.m_numAllocs;
+            ++stats.m_numItemsUsed;
+            stats.m_peakItemsUsed = Max(stats.m_peakItemsUsed, stats.m_numItemsUsed);
+            stats.m_totalBytesRequested += size;
+            return result;
+        }
+
+        void SlabAllocator::Free(void* p)
+        {
+            if (!p)
+                return;
+            Slab* slab = FindSlab(p);
+            if (!slab)
+            {
+                m_parent->Free(p);
+                return;
+            }
+
+            const unsigned sizeClass = slab->m_sizeClass;
+            auto& stats = m_stats[sizeClass];
+            --stats.m_numItemsUsed;
+
+            NextOf(p) = slab->m_freeList;
+            slab->m_freeList = p;
+            --slab->m_numUsed;
+
+            if (!slab->m_inPartial)
+            {
+                LinkPartial(slab);
+            }
+            else if (slab->m_numUsed == 0 && (slab->m_prev || slab->m_next))
+            {
+                // keep the class's last slab, or one alloc/free pair would get
+                // and release a slab every time.
+                UnlinkPartial(slab);
+                ReleaseSlab(slab);
+            }
+        }
+
+        ////////////////////////////////////////////////////////////////////////////////
+        void SlabAllocator::ReportText(const char* title) const
+        {
+            std::cout << std::dec;
+            std::cout << "Slab allocator " << (title ? title : "") << ":" << std::endl;
+            for (const auto& stats : m_stats)
+            {
+                if (!stats.m_numAllocs)
+                    continue;
+                std::cout << stats.m_itemSize << " bytes : "
+                    << stats.m_numItemsUsed << " / " << stats.m_numItemsTotal << " items in "
+                    << stats.m_numSlabs << " slabs, peak " << stats.m_peakItemsUsed
+                    << ", " << stats.m_numAllocs << " allocs, "
+                    << stats.m_totalBytesRequested / stats.m_numAllocs << " bytes average request"
+                    << std::endl;
+            }
+            std::cout << "parent : " << m_numParentAllocs << " allocs" << std::endl;
+        }
+    }
+}
@@ -305,6 +305,18 @@ namespace lptk
                 PrintLastNetworkError("connect");
                 return false;
             }
+
+            // only once connected, so the connect itself still blocks.
+            if (0 != (flags & SOCKETF_NonBlock))
+            {
+#if defined(LINUX)
+                int const sockFlags = fcntl(result.Raw(), F_GETFL, 0);
+                fcntl(result.Raw(), F_SETFL, sockFlags | O_NONBLOCK);
+#elif defined(WINDOWS)
+                u_long enable = 1;
+                ioctlsocket(result.Raw(), FIONBIO, &enable);
+#endif
+            }
             return true;
         });
         if(connected)
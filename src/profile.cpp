@@ -0,0 +1,259 @@
+#include "toolkit/profile.hh"
+#include "toolkit/dynary.hh"
+#include "toolkit/mathcommon.hh"
+
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+
+#if defined(WINDOWS)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace lptk
+{
+    namespace profile
+    {
+        ////////////////////////////////////////////////////////////////////////////////
+        namespace
+        {
+            // Only the owning thread writes events and advances m_write. Readers use
+            // m_write to tell which events are complete and which were overwritten.
+            struct Ring
+            {
+                Event* m_events = nullptr;
+                uint64_t m_mask = 0;
+                std::atomic<uint64_t> m_write{ 0 };
+                // events before this index have been cleared
+                std::atomic<uint64_t> m_readStart{ 0 };
+                const char* m_name = nullptr;
+                unsigned m_id = 0;
+                bool m_owned = false;
+            };
+
+            std::mutex s_ringsMutex;
+            lptk::DynAry<Ring*> s_rings;
+            size_t s_ringSize = 1 << 16;
+            std::atomic<bool> s_enabled{ true };
+
+            thread_local Ring* s_threadRing = nullptr;
+
+            // hands the ring back for reuse when its thread exits.
+            struct RingReleaser
+            {
+                ~RingReleaser()
+                {
+                    if (s_threadRing)
+                    {
+                        std::lock_guard<std::mutex> lock(s_ringsMutex);
+                        s_threadRing->m_owned = false;
+                        s_threadRing = nullptr;
+                    }
+                }
+            };
+            thread_local RingReleaser s_ringReleaser;
+
+            inline uint64_t SteadyNs()
+            {
+                return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count());
+            }
+
+            // Event time stamps. The cycle counter is about half the cost of going
+            // through the clock, and gets converted to real time when dumping.
+            inline uint64_t Now()
+            {
+#if defined(WINDOWS) || defined(__x86_64__) || defined(__i386__)
+                return __rdtsc();
+#else
+                return SteadyNs();
+#endif
+            }
+
+            // pairs of (Now, SteadyNs) taken at startup and at dump time give the tick rate.
+            struct Calibration
+            {
+                Calibration() : m_ticks(Now()), m_ns(SteadyNs()) {}
+                uint64_t m_ticks;
+                uint64_t m_ns;
+            };
+            const Calibration s_startCalibration;
+
+            Ring* AcquireRing(const char* name)
+            {
+                std::lock_guard<std::mutex> lock(s_ringsMutex);
+                Ring* ring = nullptr;
+                for (auto candidate : s_rings)
+                {
+                    if (!candidate->m_owned)
+                    {
+                        ring = candidate;
+                        break;
+                    }
+                }
+
+                if (ring)
+                {
+                    // what the last owner recorded would show under the new name.
+                    ring->m_readStart.store(ring->m_write.load(std::memory_order_relaxed), std::memory_order_relaxed);
+                }
+                else
+                {
+                    ring = new Ring;
+                    const auto numEvents = size_t(lptk::IntNextPower2((unsigned long)lptk::Max<size_t>(s_ringSize, 2)));
+                    ring->m_events = reinterpret_cast<Event*>(mem_allocate(numEvents * sizeof(Event), MEMPOOL_Debug, 64));
+                    ring->m_mask = numEvents - 1;
+                    ring->m_id = unsigned(s_rings.size());
+                    s_rings.push_back(ring);
+                }
+
+                ring->m_owned = true;
+                ring->m_name = name ? name : "Thread";
+                s_threadRing = ring;
+                (void)&s_ringReleaser; // make sure the releaser exists for this thread
+                return ring;
+            }
+
+            void WriteEscaped(FILE* fp, const char* str)
+            {
+                for (; *str; ++str)
+                {
+                    if (*str == '"' || *str == '\\')
+                        fputc('\\', fp);
+                    fputc(*str, fp);
+                }
+            }
+        }
+
+        ////////////////////////////////////////////////////////////////////////////////
+        void RegisterThread(const char* name)
+        {
+            if (s_threadRing)
+            {
+                std::lock_guard<std::mutex> lock(s_ringsMutex);
+                s_threadRing->m_name = name;
+                return;
+            }
+            AcquireRing(name);
+        }
+
+        void SetRingSize(size_t numEvents)
+        {
+            std::lock_guard<std::mutex> lock(s_ringsMutex);
+            s_ringSize = numEvents;
+        }
+
+        void SetEnabled(bool enabled)
+        {
+            s_enabled.store(enabled, std::memory_order_relaxed);
+        }
+
+        bool IsEnabled()
+        {
+            return s_enabled.load(std::memory_order_relaxed);
+        }
+
+        void Record(EventType type, const char* name, uint64_t arg)
+        {
+            if (!s_enabled.load(std::memory_order_relaxed))
+                return;
+
+            Ring* ring = s_threadRing;
+            if (!ring)
+                ring = AcquireRing(nullptr);
+
+            const auto index = ring->m_write.load(std::memory_order_relaxed);
+            Event& event = ring->m_events[index & ring->m_mask];
+            event.m_time = Now();
+            event.m_name = name;
+            event.m_arg = arg;
+            event.m_type = type;
+            ring->m_write.store(index + 1, std::memory_order_release);
+        }
+
+        bool DumpChromeTrace(const char* filename)
+        {
+            FILE* fp = fopen(filename, "wb");
+            if (!fp)
+                return false;
+
+            std::lock_guard<std::mutex> lock(s_ringsMutex);
+
+            // copy everything out first, so the base time is known.
+            struct Lane
+            {
+                const Ring* m_ring;
+                lptk::DynAry<Event> m_events;
+            };
+            lptk::DynAry<Lane> lanes(s_rings.size());
+            uint64_t baseTime = ~uint64_t(0);
+            for (size_t i = 0; i < s_rings.size(); ++i)
+            {
+                const Ring* ring = s_rings[i];
+                const auto capacity = ring->m_mask + 1;
+                const auto end = ring->m_write.load(std::memory_order_acquire);
+                auto start = lptk::Max(end > capacity ? end - capacity : 0, ring->m_readStart.load(std::memory_order_relaxed));
+
+                auto& events = lanes[i].m_events;
+                lanes[i].m_ring = ring;
+                events.reserve(size_t(end - start));
+                for (auto index = start; index < end; ++index)
+                    events.push_back(ring->m_events[index & ring->m_mask]);
+
+                // anything the writer lapped while we copied is garbage, and so is the
+                // slot it may be halfway through. The fence keeps the copies above
+                // from moving past the load.
+                std::atomic_thread_fence(std::memory_order_acquire);
+                const auto endAfter = ring->m_write.load(std::memory_order_relaxed) + 1;
+                const auto firstValid = endAfter > capacity ? endAfter - capacity : 0;
+                if (firstValid > start)
+                    events.erase(events.begin(), events.begin() + size_t(lptk::Min(firstValid - start, end - start)));
+
+                if (!events.empty())
+                    baseTime = lptk::Min(baseTime, events[0].m_time);
+            }
+
+            const Calibration dumpCalibration;
+            const auto elapsedNs = double(dumpCalibration.m_ns - s_startCalibration.m_ns);
+            const auto elapsedTicks = double(dumpCalibration.m_ticks - s_startCalibration.m_ticks);
+            const auto usPerTick = elapsedTicks > 0.0 ? 1e-3 * elapsedNs / elapsedTicks : 1e-3;
+
+            fprintf(fp, "{\"traceEvents\":[\n");
+            bool first = true;
+            for (auto& lane : lanes)
+            {
+                fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"",
+                    first ? "" : ",\n", lane.m_ring->m_id);
+                WriteEscaped(fp, lane.m_ring->m_name);
+                fprintf(fp, "\"}}");
+                first = false;
+
+                for (auto& event : lane.m_events)
+                {
+                    static const char* const kPhases[] = { "B", "E", "i" };
+                    fprintf(fp, ",\n{\"name\":\"");
+                    WriteEscaped(fp, event.m_name ? event.m_name : "");
+                    fprintf(fp, "\",\"ph\":\"%s\",\"ts\":%.3f,\"pid\":1,\"tid\":%u",
+                        kPhases[unsigned(event.m_type)], double(event.m_time - baseTime) * usPerTick, lane.m_ring->m_id);
+                    if (event.m_type == EventType::Instant)
+                        fprintf(fp, ",\"s\":\"t\"");
+                    if (event.m_arg)
+                        fprintf(fp, ",\"args\":{\"arg\":\"0x%llx\"}", (unsigned long long)event.m_arg);
+                    fprintf(fp, "}");
+                }
+            }
+            fprintf(fp, "\n]}\n");
+            fclose(fp);
+            return true;
+        }
+
+        void Clear()
+        {
+            std::lock_guard<std::mutex> lock(s_ringsMutex);
+            for (auto ring : s_rings)
+                ring->m_readStart.store(ring->m_write.load(std::memory_order_acquire), std::memory_order_relaxed);
+        }
+    }
+}
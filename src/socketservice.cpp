@@ -0,0 +1,285 @@
+#include "toolkit/socketservice.hh"
+
+#if defined(LINUX)
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#elif defined(WINDOWS)
+#include <winsock2.h>
+#endif
+
+namespace lptk
+{
+    namespace fiber
+    {
+#if defined(LINUX)
+        static bool WouldBlock()
+        {
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+#elif defined(WINDOWS)
+        static bool WouldBlock()
+        {
+            return WSAGetLastError() == WSAEWOULDBLOCK;
+        }
+#endif
+
+        ////////////////////////////////////////////////////////////////////////////////
+        SocketService::SocketService()
+        {
+#if defined(LINUX)
+            m_epoll = epoll_create1(EPOLL_CLOEXEC);
+            m_wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            ASSERT(m_epoll >= 0 && m_wakeFd >= 0);
+
+            epoll_event event = {};
+            event.events = EPOLLIN;
+            event.data.fd = m_wakeFd;
+            epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_wakeFd, &event);
+#endif
+        }
+
+        SocketService::~SocketService()
+        {
+            // Stop has been called, so nobody will poll these sockets again.
+#if defined(LINUX)
+            for (auto& waiters : m_waiters)
+            {
+                if (waiters.m_reader)
+                    CompleteSocketRequest(waiters.m_reader, false);
+                if (waiters.m_writer)
+                    CompleteSocketRequest(waiters.m_writer, false);
+            }
+            close(m_wakeFd);
+            close(m_epoll);
+#elif defined(WINDOWS)
+            for (auto request : m_waiters)
+                CompleteSocketRequest(request, false);
+#endif
+        }
+
+        int64_t SocketService::Read(const Socket& socket, void* buf, size_t count)
+        {
+            const auto s = socket.Raw();
+            for (;;)
+            {
+#if defined(LINUX)
+                const auto result = int64_t(recv(s, buf, count, MSG_DONTWAIT));
+                if (result < 0 && errno == EINTR)
+                    continue;
+#elif defined(WINDOWS)
+                const auto result = int64_t(recv(s, reinterpret_cast<char*>(buf), int(count), 0));
+#endif
+                if (result >= 0 || !WouldBlock())
+                    return result;
+                if (!WaitForSocket(s, Wait::Read))
+                    return -1;
+            }
+        }
+
+        int64_t SocketService::Write(const Socket& socket, const void* buf, size_t count)
+        {
+            const auto s = socket.Raw();
+            const auto data = reinterpret_cast<const char*>(buf);
+            size_t numWritten = 0;
+            while (numWritten < count)
+            {
+#if defined(LINUX)
+                const auto result = int64_t(send(s, data + numWritten, count - numWritten,
+                    MSG_DONTWAIT | MSG_NOSIGNAL));
+                if (result < 0 && errno == EINTR)
+                    continue;
+#elif defined(WINDOWS)
+                const auto result = int64_t(send(s, data + numWritten, int(count - numWritten), 0));
+#endif
+                if (result >= 0)
+                    numWritten += size_t(result);
+                else if (!WouldBlock() || !WaitForSocket(s, Wait::Write))
+                    return -1;
+            }
+            return int64_t(numWritten);
+        }
+
+        Socket SocketService::Accept(const ServerConnection& server)
+        {
+            // The listener's flags are the caller's, they're never changed here.
+            // A blocking listener is only accepted from once it's readable.
+            const auto s = server.GetSocket().Raw();
+#if defined(LINUX)
+            const bool nonBlocking = 0 != (fcntl(s, F_GETFL, 0) & O_NONBLOCK);
+#elif defined(WINDOWS)
+            const bool nonBlocking = false; // winsock has no way to ask
+#endif
+            bool canAccept = nonBlocking;
+            for (;;)
+            {
+                if (!canAccept && !WaitForSocket(s, Wait::Read))
+                    return Socket();
+                canAccept = false;
+#if defined(LINUX)
+                const auto fd = accept4(s, nullptr, nullptr, SOCK_CLOEXEC);
+                if (fd >= 0)
+                    return Socket(fd);
+                if (errno == EINTR || errno == ECONNABORTED)
+                {
+                    canAccept = nonBlocking;
+                    continue;
+                }
+#elif defined(WINDOWS)
+                const auto fd = accept(s, nullptr, nullptr);
+                if (fd != INVALID_SOCKET)
+                    return Socket(fd);
+#endif
+                if (!WouldBlock())
+                    return Socket();
+            }
+        }
+
+        bool SocketService::WaitForSocket(Socket::SocketType socket, Wait wait)
+        {
+            ASSERT(IsInFiberThread());
+            SocketRequest socketRequest{ socket, wait, false };
+            EnqueueRequest(&socketRequest);
+            return socketRequest.m_ready;
+        }
+
+        void SocketService::CompleteSocketRequest(ServiceRequest* request, bool ready)
+        {
+            reinterpret_cast<SocketRequest*>(request->GetData())->m_ready = ready;
+            CompleteRequest(request);
+        }
+
+        void SocketService::CancelRequest(ServiceRequest* request)
+        {
+            reinterpret_cast<SocketRequest*>(request->GetData())->m_ready = false;
+        }
+
+        ////////////////////////////////////////////////////////////////////////////////
+#if defined(LINUX)
+        void SocketService::WakeUpdate()
+        {
+            const uint64_t one = 1;
+            const auto written = write(m_wakeFd, &one, sizeof(one));
+            unused_arg(written); // only fails if the counter is already huge, which still wakes us.
+        }
+
+        bool SocketService::Register(int fd, SocketWaiters& waiters)
+        {
+            // oneshot, so a ready socket isn't reported again until someone waits on it.
+            epoll_event event = {};
+            event.events = EPOLLONESHOT | EPOLLRDHUP |
+                (waiters.m_reader ? EPOLLIN : 0u) |
+                (waiters.m_writer ? EPOLLOUT : 0u);
+            event.data.fd = fd;
+
+            // a closed fd drops out of epoll by itself, so m_registered can be stale.
+            int result = epoll_ctl(m_epoll, waiters.m_registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &event);
+            if (result < 0 && (errno == ENOENT || errno == EEXIST))
+                result = epoll_ctl(m_epoll, errno == ENOENT ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, fd, &event);
+            waiters.m_registered = result == 0;
+            return waiters.m_registered;
+        }
+
+        bool SocketService::Update()
+        {
+            while (auto request = PopServiceRequest())
+            {
+                auto socketRequest = reinterpret_cast<SocketRequest*>(request->GetData());
+                const int fd = socketRequest->m_socket;
+                if (size_t(fd) >= m_waiters.size())
+                    m_waiters.resize(lptk::Max(size_t(fd) + 1, 2 * m_waiters.size()));
+
+                auto& waiters = m_waiters[fd];
+                auto& slot = socketRequest->m_wait == Wait::Read ? waiters.m_reader : waiters.m_writer;
+                ASSERT(slot == nullptr); // one reader and one writer per socket
+                slot = request;
+                ++m_numWaiting;
+
+                if (!Register(fd, waiters))
+                {
+                    slot = nullptr;
+                    --m_numWaiting;
+                    CompleteSocketRequest(request, false);
+                }
+            }
+
+            if (m_numWaiting == 0)
+                return false;
+
+            constexpr int kMaxEvents = 64;
+            epoll_event events[kMaxEvents];
+            const int numEvents = epoll_wait(m_epoll, events, kMaxEvents, -1);
+            for (int i = 0; i < numEvents; ++i)
+            {
+                const int fd = events[i].data.fd;
+                if (fd == m_wakeFd)
+                {
+                    uint64_t count;
+                    const auto numRead = read(m_wakeFd, &count, sizeof(count));
+                    unused_arg(numRead);
+                    continue;
+                }
+
+                // errors and hangups wake both sides, the retried call reports them.
+                const auto flags = events[i].events;
+                const auto readable = (flags & (EPOLLIN | EPOLLRDHUP | EPOLLERR | EPOLLHUP)) != 0;
+                const auto writable = (flags & (EPOLLOUT | EPOLLERR | EPOLLHUP)) != 0;
+                auto& waiters = m_waiters[fd];
+                if (readable && waiters.m_reader)
+                {
+                    CompleteSocketRequest(std::exchange(waiters.m_reader, nullptr), true);
+                    --m_numWaiting;
+                }
+                if (writable && waiters.m_writer)
+                {
+                    CompleteSocketRequest(std::exchange(waiters.m_writer, nullptr), true);
+                    --m_numWaiting;
+                }
+                if (waiters.m_reader || waiters.m_writer)
+                    Register(fd, waiters);
+            }
+            return true;
+        }
+#elif defined(WINDOWS)
+        void SocketService::WakeUpdate()
+        {
+        }
+
+        bool SocketService::Update()
+        {
+            while (auto request = PopServiceRequest())
+                m_waiters.push_back(request);
+            m_numWaiting = unsigned(m_waiters.size());
+            if (m_waiters.empty())
+                return false;
+
+            // no way to interrupt WSAPoll for new requests, so keep the timeout short.
+            lptk::DynAry<WSAPOLLFD> pollFds(m_waiters.size());
+            for (size_t i = 0; i < m_waiters.size(); ++i)
+            {
+                auto socketRequest = reinterpret_cast<SocketRequest*>(m_waiters[i]->GetData());
+                pollFds[i].fd = socketRequest->m_socket;
+                pollFds[i].events = socketRequest->m_wait == Wait::Read ? POLLRDNORM : POLLWRNORM;
+                pollFds[i].revents = 0;
+            }
+
+            if (WSAPoll(pollFds.data(), ULONG(pollFds.size()), 10) > 0)
+            {
+                for (size_t i = pollFds.size(); i > 0; --i)
+                {
+                    if (pollFds[i - 1].revents != 0)
+                    {
+                        CompleteSocketRequest(m_waiters[i - 1], true);
+                        m_waiters.erase(m_waiters.begin() + (i - 1));
+                    }
+                }
+            }
+            m_numWaiting = unsigned(m_waiters.size());
+            return true;
+        }
+#endif
+    }
+}
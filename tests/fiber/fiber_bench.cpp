@@ -0,0 +1,185 @@
+#include <cstdio>
+#include <atomic>
+#include <chrono>
+#include <toolkit/fiber.hh>
+#include <toolkit/dynary.hh>
+#include <toolkit/profile.hh>
+
+using Clock = std::chrono::high_resolution_clock;
+
+////////////////////////////////////////////////////////////////////////////////
+// Two tasks ping-pong on a single worker thread, so every YieldFiber is one
+// context switch plus the scheduler queue push/pop around it.
+static void BenchSwitch(unsigned numYields)
+{
+    lptk::fiber::FiberInitStruct fiberInit;
+    fiberInit.numWorkerThreads = 1;
+    fiberInit.numFibers = 2;
+    fiberInit.numLargeFibers = 0;
+    lptk::fiber::Init(fiberInit);
+
+    lptk::fiber::Task tasks[2];
+    for (auto& task : tasks)
+    {
+        task.Set([](void* p)
+        {
+            const auto n = *reinterpret_cast<unsigned*>(p);
+            for (unsigned i = 0; i < n; ++i)
+                lptk::fiber::YieldFiber();
+        }, &numYields);
+    }
+
+    lptk::fiber::Counter counter;
+    const auto start = Clock::now();
+    lptk::fiber::RunTasks(tasks, 2, &counter);
+    lptk::fiber::WaitForCounter(&counter);
+    const auto elapsed = std::chrono::duration<double, std::nano>{ Clock::now() - start }.count();
+
+    lptk::fiber::Purge();
+
+    printf("switch: %u yields in %.3f ms, %.1f ns per yield (context switch + reschedule)\n",
+        2 * numYields, elapsed * 1e-6, elapsed / (2.0 * numYields));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Cost of pushing and running empty tasks through the scheduler.
+static void BenchTasks(unsigned numWorkers, unsigned numTasks)
+{
+    lptk::fiber::FiberInitStruct fiberInit;
+    fiberInit.numWorkerThreads = numWorkers;
+    fiberInit.numFibers = 64;
+    lptk::fiber::Init(fiberInit);
+
+    lptk::DynAry<lptk::fiber::Task> tasks(numTasks);
+    for (auto& task : tasks)
+        task.Set([](void*) {}, nullptr);
+
+    lptk::fiber::Counter counter;
+    const auto start = Clock::now();
+    lptk::fiber::RunTasks(tasks.data(), tasks.size(), &counter);
+    lptk::fiber::WaitForCounter(&counter);
+    const auto elapsed = std::chrono::duration<double, std::nano>{ Clock::now() - start }.count();
+
+    lptk::fiber::Purge();
+
+    printf("tasks: %u workers, %u tasks in %.3f ms, %.1f ns per task\n",
+        numWorkers, numTasks, elapsed * 1e-6, elapsed / numTasks);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Same as above, but the tasks are spawned from inside a fiber, so they go to
+// the spawning thread's deque and the other workers have to steal them.
+struct NestedBenchData
+{
+    lptk::DynAry<lptk::fiber::Task> m_tasks;
+};
+
+static void BenchNestedTasks(unsigned numWorkers, unsigned numTasks)
+{
+    lptk::fiber::FiberInitStruct fiberInit;
+    fiberInit.numWorkerThreads = numWorkers;
+    fiberInit.numFibers = 64;
+    lptk::fiber::Init(fiberInit);
+
+    NestedBenchData data;
+    data.m_tasks.resize(numTasks);
+    for (auto& task : data.m_tasks)
+        task.Set([](void*) {}, nullptr);
+
+    lptk::fiber::Task root([](void* p)
+    {
+        auto data = reinterpret_cast<NestedBenchData*>(p);
+        lptk::fiber::Counter counter;
+        lptk::fiber::RunTasks(data->m_tasks.data(), data->m_tasks.size(), &counter);
+        lptk::fiber::WaitForCounter(&counter);
+    }, &data);
+
+    lptk::fiber::Counter counter;
+    const auto start = Clock::now();
+    lptk::fiber::RunTasks(&root, 1, &counter);
+    lptk::fiber::WaitForCounter(&counter);
+    const auto elapsed = std::chrono::duration<double, std::nano>{ Clock::now() - start }.count();
+
+    lptk::fiber::Purge();
+
+    printf("nested tasks: %u workers, %u tasks in %.3f ms, %.1f ns per task\n",
+        numWorkers, numTasks, elapsed * 1e-6, elapsed / numTasks);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Lambda tasks, with the tasks allocated in the spawning thread's task arena.
+// Once the arenas have grown to fit a batch, repeated batches don't allocate.
+static void BenchLambdaTasks(unsigned numWorkers, unsigned numTasks, unsigned numBatches)
+{
+    lptk::fiber::FiberInitStruct fiberInit;
+    fiberInit.numWorkerThreads = numWorkers;
+    fiberInit.numFibers = 64;
+    lptk::fiber::Init(fiberInit);
+
+    std::atomic<unsigned> numRun{ 0 };
+    size_t memAfterFirst = 0;
+    double elapsed = 0.0;
+    for (unsigned batch = 0; batch < numBatches; ++batch)
+    {
+        lptk::fiber::Counter counter;
+        const auto start = Clock::now();
+        lptk::fiber::RunTasks(numTasks, [&numRun](size_t) {
+            numRun.fetch_add(1, std::memory_order_relaxed);
+        }, &counter);
+        lptk::fiber::WaitForCounter(&counter);
+        if (batch == 0)
+            memAfterFirst = lptk::mem_GetSizeAllocated(lptk::MEMPOOL_General);
+        else
+            elapsed += std::chrono::duration<double, std::nano>{ Clock::now() - start }.count();
+    }
+    const auto memGrowth = int64_t(lptk::mem_GetSizeAllocated(lptk::MEMPOOL_General)) - int64_t(memAfterFirst);
+
+    lptk::fiber::Purge();
+
+    const auto numTimed = double(numTasks) * (numBatches - 1);
+    printf("lambda tasks: %u workers, %u x %u tasks in %.3f ms, %.1f ns per task, %lld bytes allocated after the first batch\n",
+        numWorkers, numBatches - 1, numTasks, elapsed * 1e-6, elapsed / numTimed, (long long)memGrowth);
+    ASSERT(numRun.load() == numTasks * numBatches);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Cost of recording one profiler event. The rings wrap, so this never allocates
+// after the first event.
+static void BenchProfileEvents(unsigned numEvents)
+{
+#if defined(PROFILE)
+    lptk::profile::RegisterThread("Bench");
+    const auto start = Clock::now();
+    for (unsigned i = 0; i < numEvents; i += 2)
+    {
+        PROFILE_BEGIN("Bench");
+        PROFILE_END("Bench");
+    }
+    const auto elapsed = std::chrono::duration<double, std::nano>{ Clock::now() - start }.count();
+    printf("profile: %u events in %.3f ms, %.1f ns per event\n",
+        numEvents, elapsed * 1e-6, elapsed / numEvents);
+#else
+    unused_arg(numEvents);
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+int main(int, char**)
+{
+    BenchProfileEvents(10000000);
+
+    BenchSwitch(1000000);
+
+    const auto numProcs = unsigned(lptk::Max(1, lptk::NumProcessors()));
+    for (unsigned workers = 1; workers <= numProcs; workers *= 2)
+        BenchTasks(workers, 100000);
+    for (unsigned workers = 1; workers <= numProcs; workers *= 2)
+        BenchNestedTasks(workers, 100000);
+    for (unsigned workers = 1; workers <= numProcs; workers *= 2)
+        BenchLambdaTasks(workers, 100000, 11);
+
+#if defined(PROFILE)
+    lptk::profile::DumpChromeTrace("fiber_bench_trace.json");
+#endif
+    return 0;
+}
@@ -1,11 +1,18 @@
 #include <cstdio>
+#include <cstring>
 #include <memory>
 #include <thread>
 #include <chrono>
 #include <algorithm>
 #include <random>
 #include <toolkit/fiber.hh>
+#include <toolkit/fibersync.hh>
+#include <toolkit/fileio.hh>
+#include <toolkit/parallelalgorithm.hh>
 #include <toolkit/dynary.hh>
+#if defined(LINUX)
+#include <unistd.h>
+#endif
 
 using Clock = std::chrono::high_resolution_clock;
 using TimePoint = decltype(std::chrono::high_resolution_clock::now());
@@ -113,6 +120,142 @@ int main(int, char**)
         printf("Finished all fibers.\n");
     }
 
+    ////////////////////////////////////////
+    printf("Testing large stack fibers.\n");
+    {
+        // far more stack than a small fiber has, this would hit the guard page there.
+        constexpr int N = 32;
+        lptk::fiber::Task tasks[N];
+        for (auto& task : tasks)
+        {
+            task.Set([](void*)
+            {
+                volatile char buffer[256 * 1024];
+                for (size_t i = 0; i < sizeof(buffer); i += 4096)
+                    buffer[i] = char(i);
+                lptk::fiber::YieldFiber();
+                printf("Large stack fiber, thread %d, %d\n", lptk::fiber::GetFiberThreadId(), int(buffer[4096]));
+            }, nullptr);
+        }
+        lptk::fiber::RunTasks(tasks, N, &counter, 0, lptk::fiber::StackClass::Large);
+        lptk::fiber::WaitForCounter(&counter);
+    }
+
+    ////////////////////////////////////////
+    printf("Testing lambda tasks.\n");
+    {
+        constexpr int N = 10000;
+        std::atomic<int> sum{ 0 };
+        // the shared_ptr capture makes the batch count down and destroy its copy.
+        auto token = std::make_shared<int>(3);
+        for (int round = 0; round < 4; ++round)
+        {
+            lptk::fiber::RunTasks(N, [&sum, token](size_t i) {
+                sum.fetch_add(int(i % 7) * *token, std::memory_order_relaxed);
+                if (i % 1000 == 0)
+                    lptk::fiber::YieldFiber();
+            }, &counter);
+        }
+        lptk::fiber::WaitForCounter(&counter);
+
+        int expected = 0;
+        for (int i = 0; i < N; ++i)
+            expected += 4 * (i % 7) * 3;
+
+        lptk::DynAry<int> values(N);
+        lptk::ParallelFor(0, values.size(), [&values](size_t i) { values[i] = int(i) * 2; }, 64);
+        bool parallelForOk = true;
+        for (int i = 0; i < N; ++i)
+            parallelForOk = parallelForOk && values[i] == i * 2;
+
+        printf("Lambda tasks sum %d (expected %d), batch copies left %ld (expected 1), parallel for %s\n",
+            sum.load(), expected, long(token.use_count()), parallelForOk ? "ok" : "FAILED");
+    }
+
+    ////////////////////////////////////////
+    printf("Testing fiber synchronization.\n");
+    {
+        constexpr int N = 200;
+        constexpr int NumProducers = 16;
+        struct SyncData
+        {
+            lptk::fiber::FiberMutex mutex;
+            int total = 0;
+
+            lptk::fiber::FiberSemaphore semaphore{ 4 };
+            std::atomic<int> numStarted{ 0 };
+            std::atomic<int> numInside{ 0 };
+            std::atomic<int> maxInside{ 0 };
+
+            lptk::fiber::FiberCondition condition;
+            lptk::DynAry<int> items;
+            int numConsumed = 0;
+
+            lptk::fiber::Latch latch{ N };
+        };
+
+        SyncData data;
+
+        lptk::fiber::Task tasks[N];
+        for (auto& task : tasks)
+        {
+            task.Set([](void* p)
+            {
+                auto data = reinterpret_cast<SyncData*>(p);
+                {
+                    // the yield would let another fiber in without the mutex.
+                    std::lock_guard<lptk::fiber::FiberMutex> lock(data->mutex);
+                    const auto total = data->total;
+                    lptk::fiber::YieldFiber();
+                    data->total = total + 1;
+                }
+
+                // every third one takes 3 counts at once, two of those mustn't
+                // end up each holding part of what they need.
+                const int units = data->numStarted++ % 3 == 0 ? 3 : 1;
+                data->semaphore.Acquire(units);
+                const auto inside = data->numInside += units;
+                auto maxInside = data->maxInside.load();
+                while (inside > maxInside && !data->maxInside.compare_exchange_weak(maxInside, inside)) {}
+                for (int i = 0; i < 16; ++i)
+                    lptk::fiber::YieldFiber();
+                data->numInside -= units;
+                data->semaphore.Release(units);
+
+                data->latch.CountDown();
+            }, &data);
+        }
+        lptk::fiber::RunTasks(tasks, N, &counter);
+        data.latch.Wait();
+        printf("Latch released, mutex total %d (expected %d), max %d counts taken from semaphore (limit 4)\n",
+            data.total, N, data.maxInside.load());
+        lptk::fiber::WaitForCounter(&counter);
+
+        // producers and consumers handing items over through a condition
+        lptk::fiber::Task producerConsumers[2 * NumProducers];
+        for (int i = 0; i < NumProducers; ++i)
+        {
+            producerConsumers[2 * i].Set([](void* p)
+            {
+                auto data = reinterpret_cast<SyncData*>(p);
+                std::unique_lock<lptk::fiber::FiberMutex> lock(data->mutex);
+                data->condition.Wait(data->mutex, [data] { return !data->items.empty(); });
+                data->items.pop_back();
+                ++data->numConsumed;
+            }, &data);
+            producerConsumers[2 * i + 1].Set([](void* p)
+            {
+                auto data = reinterpret_cast<SyncData*>(p);
+                lptk::fiber::YieldFiber();
+                std::lock_guard<lptk::fiber::FiberMutex> lock(data->mutex);
+                data->items.push_back(1);
+                data->condition.NotifyOne();
+            }, &data);
+        }
+        lptk::fiber::RunTasks(producerConsumers, 2 * NumProducers, &counter);
+        lptk::fiber::WaitForCounter(&counter);
+        printf("Condition consumed %d items (expected %d)\n", data.numConsumed, NumProducers);
+    }
 
     ////////////////////////////////////////
     printf("Testing fiber services.\n");
@@ -166,6 +309,94 @@ int main(int, char**)
     
         sleepService.Stop();
     }
+    ////////////////////////////////////////
+    printf("Testing file io service.\n");
+    {
+        lptk::fiber::FileIOService fileService;
+        fileService.Start();
+        printf("File io using %s\n", fileService.IsUsingIoUring() ? "io_uring" : "thread pool");
+
+        constexpr int N = 64;
+        struct FileData
+        {
+            lptk::fiber::FileIOService* service;
+            int id;
+            bool ok;
+        };
+        FileData fileData[N];
+        lptk::fiber::Task tasks[N];
+        for (int i = 0; i < N; ++i)
+        {
+            fileData[i] = { &fileService, i, false };
+            tasks[i].Set([](void* p)
+            {
+                auto data = reinterpret_cast<FileData*>(p);
+                char filename[64];
+                snprintf(filename, sizeof(filename), "fiber_test_io_%d.bin", data->id);
+
+                lptk::DynAry<char> contents(4096 * 3 + data->id);
+                for (size_t i = 0; i < contents.size(); ++i)
+                    contents[i] = char(i * 31 + data->id);
+
+                data->ok = data->service->WriteFile(filename, contents);
+                const auto readBack = data->service->ReadFile<lptk::DynAry<char>>(filename);
+                data->ok = data->ok && readBack.size() == contents.size() &&
+                    memcmp(readBack.data(), contents.data(), contents.size()) == 0;
+                remove(filename);
+            }, &fileData[i]);
+        }
+        lptk::fiber::RunTasks(tasks, N, &counter);
+        lptk::fiber::WaitForCounter(&counter);
+
+        const auto numOk = std::count_if(fileData, fileData + N, [](const FileData& d) { return d.ok; });
+        printf("Finished file io, %d of %d files round tripped.\n", int(numOk), N);
+
+#if defined(LINUX)
+        // a read waiting on an empty pipe mustn't hold up the other requests.
+        int pipeFds[2];
+        if (fileService.IsUsingIoUring() && pipe(pipeFds) == 0)
+        {
+            struct PipeData
+            {
+                lptk::fiber::FileIOService* service;
+                int fd;
+                int64_t result;
+            };
+            PipeData pipeData = { &fileService, pipeFds[0], 0 };
+            lptk::fiber::Task pipeTask([](void* p)
+            {
+                auto data = reinterpret_cast<PipeData*>(p);
+                char byte;
+                data->result = data->service->Read(data->fd, &byte, 1, 0);
+            }, &pipeData);
+            lptk::fiber::Counter pipeCounter;
+            lptk::fiber::RunTasks(&pipeTask, 1, &pipeCounter);
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+            // if the file reads are stuck behind the pipe, this lets them go eventually.
+            std::thread unblock([&] {
+                std::this_thread::sleep_for(std::chrono::seconds(2));
+                const auto written = write(pipeFds[1], "x", 1);
+                (void)written;
+            });
+            const auto start = Clock::now();
+            fileData[0].ok = false;
+            lptk::fiber::Task fileTask(tasks[0].GetFunc(), tasks[0].GetUserData());
+            lptk::fiber::RunTasks(&fileTask, 1, &counter);
+            lptk::fiber::WaitForCounter(&counter);
+            const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count();
+            printf("File round trip while a pipe read waits: %s, %d ms (%s).\n", fileData[0].ok ? "ok" : "failed",
+                int(ms), ms < 1000 ? "not held up" : "HELD UP");
+
+            unblock.join();
+            lptk::fiber::WaitForCounter(&pipeCounter);
+            close(pipeFds[0]);
+            close(pipeFds[1]);
+        }
+#endif
+        fileService.Stop();
+    }
+
     lptk::fiber::Purge();
     return 0;
 }
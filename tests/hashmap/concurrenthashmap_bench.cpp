@@ -0,0 +1,107 @@
+#include <cstdio>
+#include <chrono>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <toolkit/concurrenthashmap.hh>
+#include <toolkit/hashmap.hh>
+#include <toolkit/dynary.hh>
+#include <toolkit/thread.hh>
+
+// ConcurrentHashMap against a HashMap behind one mutex, the way lookup tables
+// were shared between workers before. Every thread does random operations on
+// a prefilled map, either mostly lookups or half of them writes.
+
+using Clock = std::chrono::high_resolution_clock;
+
+class LockedHashMap
+{
+public:
+    void set(uint64_t key, uint64_t value)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_map.set(key, value);
+    }
+    bool get(uint64_t key, uint64_t& value)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto pair = m_map.getpair(key);
+        if (pair)
+            value = pair->value;
+        return pair != nullptr;
+    }
+    void del(uint64_t key)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        // HashMap::del wants the key to be there.
+        if (m_map.has(key))
+            m_map.del(key);
+    }
+private:
+    std::mutex m_mutex;
+    lptk::HashMap<uint64_t, uint64_t> m_map;
+};
+
+static constexpr uint64_t kNumKeys = 100000;
+
+////////////////////////////////////////////////////////////////////////////////
+// ns per operation, over all threads. writePercent of the operations are
+// sets and deletes, half each, so the size stays about the same.
+template<class Map>
+static double Bench(unsigned numThreads, unsigned writePercent, size_t& found)
+{
+    constexpr unsigned kOpsPerThread = 500000;
+    Map map;
+    for (uint64_t key = 0; key < kNumKeys; key += 2)
+        map.set(key, key);
+
+    std::atomic<size_t> totalFound{ 0 };
+    const auto start = Clock::now();
+    lptk::DynAry<std::thread> threads;
+    for (unsigned t = 0; t < numThreads; ++t)
+    {
+        threads.push_back(std::thread([&map, &totalFound, t, writePercent] {
+            std::mt19937_64 rng(t);
+            size_t hits = 0;
+            for (unsigned i = 0; i < kOpsPerThread; ++i)
+            {
+                const uint64_t r = rng();
+                const uint64_t key = r % kNumKeys;
+                const unsigned roll = unsigned((r >> 32) % 200);
+                uint64_t value = 0;
+                if (roll < writePercent)
+                    map.set(key, key);
+                else if (roll < writePercent * 2)
+                    map.del(key);
+                else
+                    hits += map.get(key, value);
+            }
+            totalFound += hits;
+        }));
+    }
+    for (auto& thread : threads)
+        thread.join();
+    const auto elapsed = std::chrono::duration<double, std::nano>{ Clock::now() - start }.count();
+    found += totalFound;
+    return elapsed / (double(numThreads) * kOpsPerThread);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+int main(int, char**)
+{
+    const auto numProcs = unsigned(lptk::Max(1, lptk::NumProcessors()));
+    size_t found = 0;
+    for (unsigned writePercent : { 5u, 50u })
+    {
+        for (unsigned threads = 1; threads <= numProcs * 2; threads *= 2)
+        {
+            const auto lockedNs = Bench<LockedHashMap>(threads, writePercent, found);
+            const auto concurrentNs = Bench<lptk::ConcurrentHashMap<uint64_t, uint64_t>>(threads, writePercent, found);
+            printf("%2u%% writes: %2u threads, locked %7.1f ns, concurrent %7.1f ns per op, %5.2fx\n",
+                writePercent, threads, lockedNs, concurrentNs, lockedNs / concurrentNs);
+        }
+    }
+    // keeps the lookups from being optimized out.
+    printf("(%zu found)\n", found);
+    return 0;
+}
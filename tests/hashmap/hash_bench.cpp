@@ -0,0 +1,67 @@
+#include <cstdio>
+#include <chrono>
+#include <random>
+#include <toolkit/hash.hh>
+#include <toolkit/fnvhash.hh>
+#include <toolkit/dynary.hh>
+
+// HashBytes against fnv1a and the additive hash MakeHash used to be, on
+// random keys of a few sizes. Prints GB/s and ns per key.
+
+using Clock = std::chrono::high_resolution_clock;
+
+static uint64_t AdditiveHash(const char* p, size_t len)
+{
+    uint64_t result = 0;
+    while (len--)
+        result += 261 * *p++;
+    return result;
+}
+
+template<class Fn>
+static void Time(const char* name, const lptk::DynAry<char>& data, size_t keySize, Fn&& fn, uint64_t& sink)
+{
+    const size_t numKeys = data.size() / keySize;
+    // enough passes over the data for a few hundred MB in total.
+    const size_t numPasses = lptk::Max(size_t(1), (size_t(256) << 20) / data.size());
+    const auto start = Clock::now();
+    for (size_t pass = 0; pass < numPasses; ++pass)
+    {
+        for (size_t i = 0; i < numKeys; ++i)
+            sink += fn(data.data() + i * keySize, keySize);
+    }
+    const double ns = std::chrono::duration<double, std::nano>{ Clock::now() - start }.count();
+    const double bytes = double(numPasses) * double(numKeys) * double(keySize);
+    printf("%-10s %6zu bytes: %7.2f GB/s  %8.1f ns/key\n",
+        name, keySize, bytes / ns, ns / (double(numPasses) * double(numKeys)));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+int main(int, char**)
+{
+    std::mt19937_64 rng(42);
+    lptk::DynAry<char> data;
+    data.resize(1 << 20);
+    for (auto& c : data)
+        c = char(rng());
+
+    uint64_t sink = 0;
+    for (size_t keySize : { size_t(8), size_t(16), size_t(32), size_t(100), size_t(256), size_t(1024), size_t(65536) })
+    {
+        Time("HashBytes", data, keySize, [](const char* p, size_t len) { return lptk::HashBytes(p, len); }, sink);
+        Time("fnv1a", data, keySize, [](const char* p, size_t len) { return lptk::fnv1a_n<uint64_t>(p, len); }, sink);
+        Time("additive", data, keySize, AdditiveHash, sink);
+    }
+
+    uint64_t value = 0;
+    const size_t numInts = 100000000;
+    const auto start = Clock::now();
+    for (size_t i = 0; i < numInts; ++i)
+        value += lptk::HashInt64(value + i);
+    printf("HashInt64: %.2f ns/key\n",
+        std::chrono::duration<double, std::nano>{ Clock::now() - start }.count() / double(numInts));
+
+    // keeps the hashes from being optimized out.
+    printf("(%llx)\n", (unsigned long long)(sink ^ value));
+    return 0;
+}
@@ -0,0 +1,97 @@
+#include <cstdio>
+#include <chrono>
+#include <random>
+#include <unordered_map>
+#include <toolkit/hashmap.hh>
+#include <toolkit/flathashmap.hh>
+#include <toolkit/dynary.hh>
+
+// HashMap, FlatHashMap and std::unordered_map on the same random keys:
+// inserting them all, looking up every one (hit) and as many absent ones
+// (miss), and erasing them all again. Times are per operation.
+
+using Clock = std::chrono::high_resolution_clock;
+
+struct Timings
+{
+    double m_insert = 0.0;
+    double m_hit = 0.0;
+    double m_miss = 0.0;
+    double m_erase = 0.0;
+};
+
+// same calls for the std map as for ours.
+template<class K, class V>
+class StdMap
+{
+public:
+    void set(const K& key, const V& value) { m_map[key] = value; }
+    const std::pair<const K, V>* getpair(const K& key) const
+    {
+        auto it = m_map.find(key);
+        return it == m_map.end() ? nullptr : &*it;
+    }
+    void del(const K& key) { m_map.erase(key); }
+    size_t size() const { return m_map.size(); }
+private:
+    std::unordered_map<K, V> m_map;
+};
+
+template<class Map>
+static double TimeNs(Map& map, const lptk::DynAry<uint64_t>& keys, int op, size_t& found)
+{
+    const auto start = Clock::now();
+    for (auto key : keys)
+    {
+        switch (op)
+        {
+        case 0: map.set(key, key); break;
+        case 1: found += map.getpair(key) != nullptr; break;
+        case 2: map.del(key); break;
+        }
+    }
+    return std::chrono::duration<double, std::nano>{ Clock::now() - start }.count() / double(keys.size());
+}
+
+template<class Map>
+static Timings Bench(const lptk::DynAry<uint64_t>& keys, const lptk::DynAry<uint64_t>& missing, size_t& found)
+{
+    Map map;
+    Timings timings;
+    timings.m_insert = TimeNs(map, keys, 0, found);
+    timings.m_hit = TimeNs(map, keys, 1, found);
+    timings.m_miss = TimeNs(map, missing, 1, found);
+    timings.m_erase = TimeNs(map, keys, 2, found);
+    return timings;
+}
+
+static void Print(const char* name, size_t numKeys, const Timings& timings)
+{
+    printf("%-14s %8zu keys: insert %6.1f  hit %6.1f  miss %6.1f  erase %6.1f ns\n",
+        name, numKeys, timings.m_insert, timings.m_hit, timings.m_miss, timings.m_erase);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+int main(int, char**)
+{
+    std::mt19937_64 rng(42);
+    size_t found = 0;
+    for (size_t numKeys : { size_t(1000), size_t(10000), size_t(100000) })
+    {
+        lptk::DynAry<uint64_t> keys;
+        lptk::DynAry<uint64_t> missing;
+        for (size_t i = 0; i < numKeys; ++i)
+        {
+            // odd keys go in, even ones are the misses.
+            keys.push_back(rng() | 1);
+            missing.push_back(rng() & ~uint64_t(1));
+        }
+
+        Print("HashMap", numKeys, Bench<lptk::HashMap<uint64_t, uint64_t>>(keys, missing, found));
+        Print("FlatHashMap", numKeys, Bench<lptk::FlatHashMap<uint64_t, uint64_t>>(keys, missing, found));
+        Print("unordered_map", numKeys, Bench<StdMap<uint64_t, uint64_t>>(keys, missing, found));
+    }
+    // keeps the lookups from being optimized out.
+    printf("(%zu found)\n", found);
+    return 0;
+}
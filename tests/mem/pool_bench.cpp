@@ -0,0 +1,81 @@
+#include <cstdio>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <toolkit/mem/pool_allocator.hh>
+#include <toolkit/dynary.hh>
+#include <toolkit/thread.hh>
+
+// ConcurrentPoolAlloc against a PoolAlloc behind a mutex, the way shared pools
+// had to be used before. Every thread allocates a window of items and frees
+// them again, some of them in a different order, for a number of rounds.
+
+using Clock = std::chrono::high_resolution_clock;
+
+class LockedPoolAlloc : public lptk::mem::Allocator
+{
+public:
+    LockedPoolAlloc(size_t itemsPerBlock, size_t itemSize)
+        : m_pool(itemsPerBlock, itemSize)
+    {}
+
+    void* Alloc(size_t size, unsigned align) override
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_pool.Alloc(size, align);
+    }
+
+    void Free(void* ptr) override
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pool.Free(ptr);
+    }
+private:
+    std::mutex m_mutex;
+    lptk::mem::PoolAlloc m_pool;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+static double Bench(lptk::mem::Allocator& pool, unsigned numThreads, unsigned numRounds)
+{
+    constexpr unsigned kWindow = 64;
+
+    const auto start = Clock::now();
+    lptk::DynAry<std::thread> threads;
+    for (unsigned t = 0; t < numThreads; ++t)
+    {
+        threads.push_back(std::thread([&pool, numRounds] {
+            void* items[kWindow];
+            for (unsigned round = 0; round < numRounds; ++round)
+            {
+                for (auto& item : items)
+                    item = pool.Alloc(48, 16);
+                for (unsigned i = 0; i < kWindow; i += 2)
+                    pool.Free(items[i]);
+                for (unsigned i = kWindow - 1; i < kWindow; i -= 2)
+                    pool.Free(items[i]);
+            }
+        }));
+    }
+    for (auto& thread : threads)
+        thread.join();
+    const auto elapsed = std::chrono::duration<double, std::nano>{ Clock::now() - start }.count();
+    return elapsed / (double(numThreads) * numRounds * kWindow);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+int main(int, char**)
+{
+    constexpr unsigned kNumRounds = 20000;
+    const auto numProcs = unsigned(lptk::Max(1, lptk::NumProcessors()));
+    for (unsigned threads = 1; threads <= numProcs * 2; threads *= 2)
+    {
+        LockedPoolAlloc locked(1024, 48);
+        lptk::mem::ConcurrentPoolAlloc concurrent(1024, 48);
+        const auto lockedNs = Bench(locked, threads, kNumRounds);
+        const auto concurrentNs = Bench(concurrent, threads, kNumRounds);
+        printf("pool: %2u threads, locked %7.1f ns, concurrent %7.1f ns per alloc/free, %5.2fx\n",
+            threads, lockedNs, concurrentNs, lockedNs / concurrentNs);
+    }
+    return 0;
+}
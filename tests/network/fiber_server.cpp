@@ -0,0 +1,96 @@
+#include <memory>
+#include <iostream>
+#include "toolkit/network.hh"
+#include "toolkit/fiber.hh"
+#include "toolkit/socketservice.hh"
+
+// Echo server where every connection is handled by its own fiber. Works with
+// test_client and msg_client, which get their messages sent straight back.
+
+struct Connection
+{
+    lptk::fiber::SocketService* m_service;
+    lptk::Socket m_socket;
+    lptk::fiber::Task m_task;
+};
+
+static void ServeConnection(void* p)
+{
+    auto connection = reinterpret_cast<Connection*>(p);
+    auto service = connection->m_service;
+
+    char buf[4096];
+    int64_t len;
+    while ((len = service->Read(connection->m_socket, buf, sizeof(buf))) > 0)
+    {
+        if (service->Write(connection->m_socket, buf, size_t(len)) < 0)
+            break;
+    }
+    std::cout << "client disconnected" << std::endl;
+    connection->m_socket.Close();
+}
+
+struct AcceptData
+{
+    lptk::fiber::SocketService* m_service;
+    lptk::ServerConnection* m_server;
+};
+
+static void AcceptConnections(void* p)
+{
+    auto data = reinterpret_cast<AcceptData*>(p);
+
+    // Connections are never freed, their tasks must outlive the counter. Fine for a test.
+    lptk::DynAry<std::unique_ptr<Connection>> connections;
+    lptk::fiber::Counter counter;
+    for (;;)
+    {
+        lptk::Socket socket = data->m_service->Accept(*data->m_server);
+        if (!socket.Valid())
+            break;
+        std::cout << "New client accepted" << std::endl;
+
+        connections.push_back(make_unique<Connection>());
+        auto connection = connections.back().get();
+        connection->m_service = data->m_service;
+        connection->m_socket = std::move(socket);
+        connection->m_task.Set(ServeConnection, connection);
+        lptk::fiber::RunTasks(&connection->m_task, 1, &counter);
+    }
+    lptk::fiber::WaitForCounter(&counter);
+}
+
+int main(int argc, char** argv)
+{
+    lptk::NetworkInit();
+    if(argc != 2) {
+        std::cerr << "Usage: " << argv[0] << " port" << std::endl;
+        return 1;
+    }
+
+    lptk::ServerConnection serverCx(lptk::SOCKETF_Stream | lptk::SOCKETF_NonBlock);
+    if(!serverCx.Listen(argv[1])) {
+        std::cerr << "error listening on port " << argv[1] << std::endl;
+        return 1;
+    }
+
+    std::cout << "listening" << std::endl;
+
+    lptk::fiber::FiberInitStruct fiberInit;
+    fiberInit.numWorkerThreads = 2;
+    fiberInit.numFibers = 256;
+    lptk::fiber::Init(fiberInit);
+
+    lptk::fiber::SocketService socketService;
+    socketService.Start();
+
+    AcceptData acceptData = { &socketService, &serverCx };
+    lptk::fiber::Task acceptTask(AcceptConnections, &acceptData);
+    lptk::fiber::Counter counter;
+    lptk::fiber::RunTasks(&acceptTask, 1, &counter);
+    lptk::fiber::WaitForCounter(&counter);
+
+    socketService.Stop();
+    lptk::fiber::Purge();
+    return 0;
+}
@@ -0,0 +1,125 @@
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <random>
+#include <toolkit/parallelalgorithm.hh>
+#include <toolkit/thread.hh>
+
+// Parallel algorithms against their plain serial loops. Usage:
+//   parallel_bench [maxCount] [numWorkers]
+// runs 1M, 10M, ... elements up to maxCount (default 100M).
+
+using Clock = std::chrono::high_resolution_clock;
+
+template<class Fn>
+static double TimeMs(Fn&& fn)
+{
+    const auto start = Clock::now();
+    fn();
+    return std::chrono::duration<double, std::milli>{ Clock::now() - start }.count();
+}
+
+static void Report(const char* name, size_t count, double serialMs, double parallelMs, bool ok)
+{
+    printf("%-8s %10zu elements: serial %9.3f ms, parallel %9.3f ms, %5.2fx%s\n",
+        name, count, serialMs, parallelMs, serialMs / parallelMs, ok ? "" : "  MISMATCH");
+}
+
+////////////////////////////////////////////////////////////////////////////////
+static void BenchFor(size_t count)
+{
+    lptk::DynAry<float> in(count);
+    for (size_t i = 0; i < count; ++i)
+        in[i] = float(i % 1000) * 0.01f;
+    lptk::DynAry<float> serial(count);
+    lptk::DynAry<float> parallel(count);
+
+    const auto serialMs = TimeMs([&] {
+        for (size_t i = 0; i < count; ++i)
+            serial[i] = std::sqrt(in[i]) * 2.f + 1.f;
+    });
+    const auto parallelMs = TimeMs([&] {
+        lptk::ParallelFor(0, count, [&](size_t i) { parallel[i] = std::sqrt(in[i]) * 2.f + 1.f; });
+    });
+    Report("for", count, serialMs, parallelMs, std::equal(serial.begin(), serial.end(), parallel.begin()));
+}
+
+static void BenchReduce(size_t count)
+{
+    lptk::DynAry<uint32_t> in(count);
+    for (size_t i = 0; i < count; ++i)
+        in[i] = uint32_t(i * 2654435761u);
+
+    uint64_t serial = 0;
+    uint64_t parallel = 0;
+    const auto serialMs = TimeMs([&] {
+        for (size_t i = 0; i < count; ++i)
+            serial += in[i];
+    });
+    const auto parallelMs = TimeMs([&] {
+        parallel = lptk::ParallelReduce(0, count, uint64_t(0),
+            [&](size_t i) { return uint64_t(in[i]); }, std::plus<uint64_t>());
+    });
+    Report("reduce", count, serialMs, parallelMs, serial == parallel);
+}
+
+static void BenchScan(size_t count)
+{
+    lptk::DynAry<uint32_t> in(count);
+    for (size_t i = 0; i < count; ++i)
+        in[i] = uint32_t(i % 7);
+    lptk::DynAry<uint32_t> serial(count);
+    lptk::DynAry<uint32_t> parallel(count);
+
+    const auto serialMs = TimeMs([&] {
+        uint32_t acc = 0;
+        for (size_t i = 0; i < count; ++i)
+        {
+            acc += in[i];
+            serial[i] = acc;
+        }
+    });
+    const auto parallelMs = TimeMs([&] {
+        lptk::ParallelInclusiveScan(in, parallel, std::plus<uint32_t>());
+    });
+    Report("scan", count, serialMs, parallelMs, std::equal(serial.begin(), serial.end(), parallel.begin()));
+}
+
+static void BenchSort(size_t count)
+{
+    std::mt19937 rng(42);
+    lptk::DynAry<uint32_t> serial(count);
+    for (auto& value : serial)
+        value = rng();
+    lptk::DynAry<uint32_t> parallel = serial;
+
+    const auto serialMs = TimeMs([&] { std::sort(serial.begin(), serial.end()); });
+    const auto parallelMs = TimeMs([&] { lptk::ParallelSort(parallel); });
+    Report("sort", count, serialMs, parallelMs, std::equal(serial.begin(), serial.end(), parallel.begin()));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+int main(int argc, char** argv)
+{
+    const size_t maxCount = argc > 1 ? size_t(strtoull(argv[1], nullptr, 10)) : 100000000;
+
+    // the main thread becomes a fiber thread, so it can run the algorithms directly.
+    lptk::fiber::FiberInitStruct fiberInit;
+    fiberInit.numWorkerThreads = argc > 2 ? unsigned(atoi(argv[2])) : unsigned(lptk::Max(1, lptk::NumProcessors()));
+    fiberInit.numFibers = 64;
+    lptk::fiber::Init(fiberInit);
+    printf("%u fiber threads\n", lptk::fiber::GetNumFiberThreads());
+
+    for (size_t count = 1000000; count <= maxCount; count *= 10)
+    {
+        BenchFor(count);
+        BenchReduce(count);
+        BenchScan(count);
+        BenchSort(count);
+    }
+
+    lptk::fiber::Purge();
+    return 0;
+}
@@ -0,0 +1,167 @@
+#include "toolkit/common.hh"
+#include "toolkit/bankedvector.hh"
+#include "toolkit/str.hh"
+#include <gtest/gtest.h>
+#include <atomic>
+#include <thread>
+
+using namespace lptk;
+
+TEST(BankedVectorTest, BasicTest)
+{
+    BankedVector<int> vec(4, 8, mem::GetDefaultAllocator());
+    EXPECT_TRUE(vec.empty());
+    EXPECT_EQ(32u, vec.max_capacity());
+    for (int i = 0; i < 10; ++i)
+        EXPECT_TRUE(vec.push_back(i));
+    EXPECT_EQ(10u, vec.size());
+    EXPECT_EQ(12u, vec.capacity());
+    EXPECT_EQ(9, vec.back());
+
+    EXPECT_TRUE(vec.insert(size_t(0), 42));
+    EXPECT_TRUE(vec.erase(size_t(5)));
+    EXPECT_EQ(10u, vec.size());
+    EXPECT_EQ(42, vec[0]);
+    EXPECT_EQ(3, vec[4]);
+    EXPECT_EQ(5, vec[5]);
+
+    vec.pop_back();
+    EXPECT_EQ(8, vec.back());
+
+    int count = 0;
+    for (auto& v : vec)
+    {
+        (void)v;
+        ++count;
+    }
+    EXPECT_EQ(9, count);
+
+    // full at max_capacity, reserving all of it is fine.
+    EXPECT_TRUE(vec.reserve(32));
+    EXPECT_TRUE(vec.resize(32));
+    EXPECT_FALSE(vec.push_back(1));
+    EXPECT_FALSE(vec.reserve(33));
+}
+
+TEST(BankedVectorTest, NonTrivialType)
+{
+    BankedVector<Str> vec(2, 8, mem::GetDefaultAllocator());
+    vec.push_back("one");
+    vec.emplace_back("two");
+    vec.push_back("three");
+    EXPECT_TRUE(vec.concurrent_push_back(Str("four")));
+    ASSERT_EQ(4u, vec.size());
+    EXPECT_EQ(Str("three"), vec[2]);
+    EXPECT_EQ(Str("four"), vec[3]);
+    vec.push_back("five");
+    EXPECT_EQ(Str("five"), vec.back());
+}
+
+TEST(BankedVectorTest, ConcurrentAppend)
+{
+    constexpr unsigned kNumWriters = 8;
+    constexpr size_t kPerWriter = 20000;
+    BankedVector<uint64_t> vec(1000, 1000, mem::GetDefaultAllocator());
+    std::atomic<bool> done{ false };
+    std::atomic<unsigned> badReads{ 0 };
+
+    // a reader checking everything below the published size is there.
+    std::thread reader([&] {
+        size_t checked = 0;
+        while (!done.load(std::memory_order_relaxed) || checked < vec.size())
+        {
+            const size_t size = vec.size();
+            for (; checked < size; ++checked)
+            {
+                const uint64_t value = vec[checked];
+                if ((value >> 32) >= kNumWriters || (value & 0xffffffff) >= kPerWriter)
+                    badReads.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    });
+
+    std::thread writers[kNumWriters];
+    for (unsigned w = 0; w < kNumWriters; ++w)
+    {
+        writers[w] = std::thread([&vec, w] {
+            for (uint64_t i = 0; i < kPerWriter; ++i)
+                vec.concurrent_push_back((uint64_t(w) << 32) | i);
+        });
+    }
+    for (auto& writer : writers)
+        writer.join();
+    done = true;
+    reader.join();
+
+    EXPECT_EQ(0u, badReads.load());
+    ASSERT_EQ(kNumWriters * kPerWriter, vec.size());
+
+    // every value once, each writer's in its own order.
+    size_t next[kNumWriters] = {};
+    for (auto value : vec)
+    {
+        const auto writer = size_t(value >> 32);
+        ASSERT_LT(writer, kNumWriters);
+        EXPECT_EQ(next[writer], value & 0xffffffff);
+        ++next[writer];
+    }
+    for (auto count : next)
+        EXPECT_EQ(kPerWriter, count);
+
+    // single threaded use goes on where the appends stopped.
+    EXPECT_TRUE(vec.push_back(7));
+    EXPECT_EQ(kNumWriters * kPerWriter + 1, vec.size());
+}
+
+TEST(BankedVectorTest, ConcurrentAppendRunsOut)
+{
+    constexpr unsigned kNumWriters = 4;
+    BankedVector<int> vec(16, 4, mem::GetDefaultAllocator());
+    std::atomic<unsigned> added{ 0 };
+    std::thread writers[kNumWriters];
+    for (auto& writer : writers)
+    {
+        writer = std::thread([&] {
+            for (int i = 0; i < 100; ++i)
+                added += vec.concurrent_push_back(i) ? 1 : 0;
+        });
+    }
+    for (auto& writer : writers)
+        writer.join();
+    EXPECT_EQ(64u, added.load());
+    EXPECT_EQ(64u, vec.size());
+    EXPECT_FALSE(vec.push_back(1));
+}
+
+TEST(BankedVectorTest, ConcurrentAppendAllocFails)
+{
+    // the chunk table and the first chunk, nothing after.
+    class LimitedAllocator : public mem::Allocator
+    {
+    public:
+        void* Alloc(size_t size, unsigned align) override
+        {
+            if (m_numLeft == 0)
+                return nullptr;
+            --m_numLeft;
+            return mem::GetDefaultAllocator()->Alloc(size, align);
+        }
+        void Free(void* ptr) override { mem::GetDefaultAllocator()->Free(ptr); }
+        int m_numLeft = 2;
+    };
+
+    LimitedAllocator alloc;
+    {
+        BankedVector<int> vec(4, 4, &alloc);
+        for (int i = 0; i < 4; ++i)
+            EXPECT_TRUE(vec.concurrent_push_back(i));
+        EXPECT_FALSE(vec.concurrent_push_back(4));
+        EXPECT_FALSE(vec.concurrent_push_back(5));
+        EXPECT_EQ(4u, vec.size());
+
+        // single threaded changes clear the failure.
+        vec.pop_back();
+        EXPECT_TRUE(vec.concurrent_push_back(3));
+        EXPECT_EQ(3, vec.back());
+    }
+}
@@ -0,0 +1,132 @@
+#include "toolkit/concurrenthashmap.hh"
+#include <gtest/gtest.h>
+#include <atomic>
+#include <random>
+#include <thread>
+#include <unordered_map>
+
+using namespace lptk;
+
+TEST(ConcurrentHashMapTest, BasicTest)
+{
+    ConcurrentHashMap<int, int> map;
+    int value = 0;
+    EXPECT_FALSE(map.get(1, value));
+    EXPECT_TRUE(map.empty());
+
+    EXPECT_TRUE(map.set(1, 10));
+    EXPECT_TRUE(map.set(2, 20));
+    EXPECT_FALSE(map.set(1, 11));
+    EXPECT_FALSE(map.insert(2, 21));
+    EXPECT_TRUE(map.insert(3, 30));
+
+    EXPECT_TRUE(map.get(1, value));
+    EXPECT_EQ(11, value);
+    EXPECT_TRUE(map.get(2, value));
+    EXPECT_EQ(20, value);
+    EXPECT_TRUE(map.has(3));
+    EXPECT_EQ(3u, map.size());
+
+    EXPECT_TRUE(map.del(2));
+    EXPECT_FALSE(map.del(2));
+    EXPECT_FALSE(map.has(2));
+    EXPECT_EQ(2u, map.size());
+
+    map.clear();
+    EXPECT_TRUE(map.empty());
+    EXPECT_FALSE(map.has(1));
+}
+
+TEST(ConcurrentHashMapTest, MatchesUnorderedMap)
+{
+    // a single shard, so every insert and delete goes through one table and
+    // the backward shifting on delete gets exercised.
+    ConcurrentHashMap<uint32_t, uint32_t, 1> map;
+    std::unordered_map<uint32_t, uint32_t> expected;
+    std::mt19937 rng(7);
+    for (int i = 0; i < 100000; ++i)
+    {
+        const uint32_t key = rng() % 2000;
+        if (rng() % 3 == 0)
+        {
+            EXPECT_EQ(expected.erase(key) == 1, map.del(key));
+        }
+        else
+        {
+            const bool added = expected.find(key) == expected.end();
+            expected[key] = uint32_t(i);
+            EXPECT_EQ(added, map.set(key, uint32_t(i)));
+        }
+    }
+
+    EXPECT_EQ(expected.size(), map.size());
+    for (uint32_t key = 0; key < 2000; ++key)
+    {
+        uint32_t value = 0;
+        auto it = expected.find(key);
+        ASSERT_EQ(it != expected.end(), map.get(key, value));
+        if (it != expected.end())
+        {
+            EXPECT_EQ(it->second, value);
+        }
+    }
+    map.reclaim();
+    EXPECT_EQ(expected.size(), map.size());
+}
+
+TEST(ConcurrentHashMapTest, ReadersWhileWriting)
+{
+    // writers keep value == key * 3 for every key, readers check they never
+    // see anything else while shards grow under them.
+    constexpr unsigned kNumWriters = 4;
+    constexpr unsigned kNumReaders = 4;
+    constexpr uint64_t kKeysPerWriter = 20000;
+    ConcurrentHashMap<uint64_t, uint64_t, 8> map;
+    std::atomic<bool> done{ false };
+    std::atomic<unsigned> badReads{ 0 };
+
+    std::thread readers[kNumReaders];
+    for (unsigned r = 0; r < kNumReaders; ++r)
+    {
+        readers[r] = std::thread([&, r] {
+            std::mt19937_64 rng(r);
+            while (!done.load(std::memory_order_relaxed))
+            {
+                const uint64_t key = rng() % (kNumWriters * kKeysPerWriter);
+                uint64_t value = 0;
+                if (map.get(key, value) && value != key * 3)
+                    badReads.fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+    }
+
+    std::thread writers[kNumWriters];
+    for (unsigned w = 0; w < kNumWriters; ++w)
+    {
+        writers[w] = std::thread([&, w] {
+            const uint64_t first = w * kKeysPerWriter;
+            for (uint64_t key = first; key < first + kKeysPerWriter; ++key)
+                map.set(key, key * 3);
+            // delete every other one, shifting the rest back.
+            for (uint64_t key = first; key < first + kKeysPerWriter; key += 2)
+                map.del(key);
+        });
+    }
+    for (auto& writer : writers)
+        writer.join();
+    done = true;
+    for (auto& reader : readers)
+        reader.join();
+
+    EXPECT_EQ(0u, badReads.load());
+    EXPECT_EQ(kNumWriters * kKeysPerWriter / 2, map.size());
+    for (uint64_t key = 0; key < kNumWriters * kKeysPerWriter; ++key)
+    {
+        uint64_t value = 0;
+        ASSERT_EQ((key & 1) != 0, map.get(key, value));
+        if (key & 1)
+        {
+            EXPECT_EQ(key * 3, value);
+        }
+    }
+}
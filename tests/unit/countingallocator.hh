@@ -0,0 +1,38 @@
+#pragma once
+#ifndef INCLUDED_tests_unit_countingallocator_HH
+#define INCLUDED_tests_unit_countingallocator_HH
+
+#include "toolkit/mem/allocator.hh"
+
+namespace lptk
+{
+    // Forwards to another allocator, the default one unless given, counting
+    // what passes through so tests can check containers allocate and release
+    // what they should.
+    class CountingAllocator : public mem::Allocator
+    {
+    public:
+        explicit CountingAllocator(mem::Allocator* target = mem::GetDefaultAllocator())
+            : m_target(target)
+        {}
+
+        void* Alloc(size_t size, unsigned align) override
+        {
+            ++m_numAllocs;
+            return m_target->Alloc(size, align);
+        }
+        void Free(void* ptr) override
+        {
+            if (ptr)
+                ++m_numFrees;
+            m_target->Free(ptr);
+        }
+        int GetNumLive() const { return m_numAllocs - m_numFrees; }
+
+        mem::Allocator* m_target;
+        int m_numAllocs = 0;
+        int m_numFrees = 0;
+    };
+}
+
+#endif
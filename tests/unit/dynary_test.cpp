@@ -1,6 +1,8 @@
 #include <algorithm>
 #include "toolkit/common.hh"
 #include "toolkit/dynary.hh"
+#include "toolkit/mem/linear_chunk_allocator.hh"
+#include "countingallocator.hh"
 #include <gtest/gtest.h>
 
 using namespace lptk;
@@ -277,6 +279,69 @@ TEST(DynAryTest, InitializerList)
     }
 }
 
+namespace
+{
+    // remembers the arena's chunks, to tell where the array ended up.
+    class ChunkRecorder : public mem::Allocator
+    {
+    public:
+        void* Alloc(size_t size, unsigned align) override
+        {
+            char* chunk = reinterpret_cast<char*>(mem::GetDefaultAllocator()->Alloc(size, align));
+            if (chunk && m_numChunks < kMaxChunks)
+                m_chunks[m_numChunks++] = { chunk, chunk + size };
+            return chunk;
+        }
+        void Free(void* ptr) override { mem::GetDefaultAllocator()->Free(ptr); }
+        bool Owns(const void* begin, const void* end) const
+        {
+            for (int i = 0; i < m_numChunks; ++i)
+            {
+                if (begin >= m_chunks[i].first && end <= m_chunks[i].second)
+                    return true;
+            }
+            return false;
+        }
+
+        static constexpr int kMaxChunks = 32;
+        std::pair<const char*, const char*> m_chunks[kMaxChunks];
+        int m_numChunks = 0;
+    };
+}
+
+TEST(DynAryTest, AllocatorPolicy)
+{
+    ChunkRecorder chunks;
+    {
+        mem::LinearChunkAllocator arena(1024, &chunks);
+        CountingAllocator counter(&arena);
+        DynAry<int, alignof(int), MEMPOOL_General, mem::AllocatorPolicy> ary(&counter);
+        int numGrowths = 0;
+        for (int i = 0; i < 100; ++i)
+        {
+            const auto capacity = ary.capacity();
+            ary.push_back(i);
+            numGrowths += ary.capacity() != capacity ? 1 : 0;
+        }
+        for (int i = 0; i < 100; ++i)
+            EXPECT_EQ(ary[i], i);
+        EXPECT_EQ(ary.get_allocator().GetAllocator(), &counter);
+        // one allocation per growth step, each old block handed back.
+        EXPECT_EQ(counter.m_numAllocs, numGrowths);
+        EXPECT_EQ(counter.GetNumLive(), 1);
+
+        // a copy uses the same allocator, growth moved the contents along.
+        auto copy = ary;
+        EXPECT_EQ(copy.get_allocator().GetAllocator(), &counter);
+        EXPECT_EQ(copy[99], 99);
+        EXPECT_EQ(counter.m_numAllocs, numGrowths + 1);
+
+        // both arrays are inside the arena's chunks.
+        EXPECT_TRUE(chunks.Owns(ary.data(), ary.data() + ary.capacity()));
+        EXPECT_TRUE(chunks.Owns(copy.data(), copy.data() + copy.capacity()));
+    }
+    EXPECT_GT(chunks.m_numChunks, 0);
+}
 
 // TODO: nontrivial Type
 
@@ -0,0 +1,159 @@
+#include "toolkit/flathashmap.hh"
+#include "toolkit/str.hh"
+#include "toolkit/mem/alloc_policy.hh"
+#include "countingallocator.hh"
+#include <gtest/gtest.h>
+#include <memory>
+#include <random>
+#include <unordered_map>
+
+using namespace lptk;
+
+TEST(FlatHashMapTest, BasicTest)
+{
+    FlatHashMap<Str, int> map;
+    EXPECT_FALSE(map.has("World"));
+    map["Whatup"] = 1234;
+    map["World"] = 42;
+    EXPECT_TRUE(map.has("World"));
+    EXPECT_EQ(1234, map["Whatup"]);
+    EXPECT_EQ(42, map["World"]);
+    EXPECT_EQ(nullptr, map.getpair("Nope"));
+
+    EXPECT_EQ(2u, map.size());
+}
+
+TEST(FlatHashMapTest, SetAgain)
+{
+    FlatHashMap<Str, int> map;
+    map.set("hi", 2);
+    auto pair = map.set("hi", 3);
+
+    EXPECT_EQ(pair->key, Str("hi"));
+    EXPECT_EQ(map.get("hi"), 3);
+    EXPECT_EQ(map.size(), 1u);
+}
+
+TEST(FlatHashMapTest, RegrowAndDelete)
+{
+    FlatHashMap<Str, int> map;
+    for (int i = 0; i < 1000; ++i)
+    {
+        Str str;
+        Printf(str, "index: %d", i);
+        map[str] = i;
+    }
+    EXPECT_EQ(1000u, map.size());
+    EXPECT_TRUE(IsPower2(map.capacity()));
+    EXPECT_GE(map.capacity() * 7 / 8, map.size());
+
+    for (int i = 0; i < 1000; i += 2)
+    {
+        Str str;
+        Printf(str, "index: %d", i);
+        EXPECT_EQ(i, map[str]);
+        map.del(str);
+    }
+    EXPECT_EQ(500u, map.size());
+    for (int i = 0; i < 1000; ++i)
+    {
+        Str str;
+        Printf(str, "index: %d", i);
+        EXPECT_EQ(map.has(str), (i & 1) == 1);
+    }
+}
+
+TEST(FlatHashMapTest, Iterate)
+{
+    FlatHashMap<int, int> map;
+    int expectedSum = 0;
+    for (int i = 0; i < 100; ++i)
+    {
+        map.set(i, i * 3);
+        expectedSum += i * 3;
+    }
+
+    int sum = 0;
+    size_t count = 0;
+    for (auto& pair : map)
+    {
+        EXPECT_EQ(pair.value, pair.key * 3);
+        sum += pair.value;
+        ++count;
+    }
+    EXPECT_EQ(sum, expectedSum);
+    EXPECT_EQ(count, map.size());
+
+    const auto& constMap = map;
+    count = 0;
+    for (auto it = constMap.begin(); it != constMap.end(); ++it)
+        ++count;
+    EXPECT_EQ(count, map.size());
+
+    map.clear();
+    EXPECT_TRUE(map.empty());
+    EXPECT_EQ(map.begin(), map.end());
+}
+
+// inserts and deletes at random against std::unordered_map, with churn at a
+// steady size so tombstones pile up and get rehashed away.
+TEST(FlatHashMapTest, MatchesUnorderedMap)
+{
+    FlatHashMap<uint32_t, uint32_t> map;
+    std::unordered_map<uint32_t, uint32_t> reference;
+    std::mt19937 rng(1234);
+    for (int i = 0; i < 200000; ++i)
+    {
+        const uint32_t key = rng() % 5000;
+        if (rng() % 3 == 0 && reference.count(key))
+        {
+            map.del(key);
+            reference.erase(key);
+        }
+        else
+        {
+            map.set(key, uint32_t(i));
+            reference[key] = uint32_t(i);
+        }
+    }
+
+    ASSERT_EQ(map.size(), reference.size());
+    for (const auto& kv : reference)
+    {
+        auto pair = map.getpair(kv.first);
+        ASSERT_NE(pair, nullptr);
+        EXPECT_EQ(pair->value, kv.second);
+    }
+    for (uint32_t key = 5000; key < 6000; ++key)
+        EXPECT_FALSE(map.has(key));
+    EXPECT_LE(map.capacity(), 8192u);
+}
+
+TEST(FlatHashMapTest, MoveOnlyValues)
+{
+    FlatHashMap<int, std::unique_ptr<int>> map;
+    for (int i = 0; i < 100; ++i)
+        map.set(i, std::unique_ptr<int>(new int(i)));
+    FlatHashMap<int, std::unique_ptr<int>> moved(std::move(map));
+    EXPECT_TRUE(map.empty());
+    for (int i = 0; i < 100; ++i)
+        EXPECT_EQ(*moved.get(i), i);
+}
+
+TEST(FlatHashMapTest, AllocatorPolicy)
+{
+    CountingAllocator alloc;
+    {
+        FlatHashMap<int, int, mem::AllocatorPolicy> map(1000, &alloc);
+        // slots and control bytes share a block.
+        EXPECT_EQ(alloc.GetNumLive(), 1);
+        const auto capacity = map.capacity();
+        for (int i = 0; i < 1000; ++i)
+            map[i] = i * 2;
+        for (int i = 0; i < 1000; ++i)
+            EXPECT_EQ(map.get(i), i * 2);
+        EXPECT_EQ(map.capacity(), capacity);
+        EXPECT_EQ(map.get_allocator().GetAllocator(), &alloc);
+    }
+    EXPECT_EQ(alloc.GetNumLive(), 0);
+}
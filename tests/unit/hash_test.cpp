@@ -0,0 +1,118 @@
+#include "toolkit/hash.hh"
+#include "toolkit/hashmap.hh"
+#include "toolkit/str.hh"
+#include <gtest/gtest.h>
+#include <random>
+#include <string>
+#include <unordered_set>
+
+using namespace lptk;
+
+static_assert(HashStringConstexpr("") != HashStringConstexpr("a"), "constexpr hashing");
+static_assert(HashInt64(1) != HashInt64(2), "constexpr mixing");
+
+TEST(HashTest, OrderMatters)
+{
+    EXPECT_NE(HashString("ab"), HashString("ba"));
+    EXPECT_NE(MakeHash("ab"), MakeHash("ba"));
+    EXPECT_NE(ComputeHash(Str("ab")), ComputeHash(Str("ba")));
+    EXPECT_EQ(MakeHash(Str("hello")), MakeHash("hello"));
+    EXPECT_EQ(MakeHash(std::string("hello")), MakeHash("hello"));
+    EXPECT_NE(HashString("hello", 1), HashString("hello", 2));
+}
+
+TEST(HashTest, ConstexprMatchesRuntime)
+{
+    std::mt19937 rng(7);
+    char buffer[2048];
+    for (auto& c : buffer)
+        c = char(rng());
+
+    // every length through the short paths, then across stripe and scramble boundaries.
+    for (size_t len = 0; len < sizeof(buffer); len += len < 300 ? 1 : 61)
+        ASSERT_EQ(HashBytes(buffer, len, len), HashBytesConstexpr(buffer, len, len)) << len;
+
+    constexpr uint64_t compileTime = HashStringConstexpr("some.config.key");
+    EXPECT_EQ(compileTime, HashString("some.config.key"));
+}
+
+TEST(HashTest, NoCollisionsOnSimilarKeys)
+{
+    std::unordered_set<uint64_t> seen;
+    char key[64];
+    for (int i = 0; i < 200000; ++i)
+    {
+        snprintf(key, sizeof(key), "key%d", i);
+        EXPECT_TRUE(seen.insert(HashString(key)).second) << key;
+    }
+    for (uint64_t i = 0; i < 200000; ++i)
+        EXPECT_TRUE(seen.insert(MakeHash(i)).second) << i;
+
+    // one bit different anywhere in a long key.
+    char buffer[1000] = {};
+    std::unordered_set<uint64_t> flipped;
+    for (size_t bit = 0; bit < sizeof(buffer) * 8; ++bit)
+    {
+        buffer[bit / 8] ^= char(1 << (bit % 8));
+        EXPECT_TRUE(flipped.insert(HashBytes(buffer, sizeof(buffer))).second) << bit;
+        buffer[bit / 8] ^= char(1 << (bit % 8));
+    }
+}
+
+// flipping one input bit should flip about half the output bits.
+TEST(HashTest, Avalanche)
+{
+    std::mt19937_64 rng(99);
+    for (size_t len : { size_t(3), size_t(8), size_t(24), size_t(100), size_t(1000) })
+    {
+        char buffer[1000];
+        double totalFlipped = 0;
+        int numTrials = 0;
+        for (int trial = 0; trial < 64; ++trial)
+        {
+            for (size_t i = 0; i < len; ++i)
+                buffer[i] = char(rng());
+            const auto base = HashBytes(buffer, len);
+            const size_t bit = size_t(rng() % (len * 8));
+            buffer[bit / 8] ^= char(1 << (bit % 8));
+            totalFlipped += double(PopCount64(base ^ HashBytes(buffer, len)));
+            ++numTrials;
+        }
+        const double average = totalFlipped / numTrials;
+        EXPECT_GT(average, 28.0) << len;
+        EXPECT_LT(average, 36.0) << len;
+    }
+
+    double totalFlipped = 0;
+    for (uint64_t i = 0; i < 64 * 64; ++i)
+        totalFlipped += double(PopCount64(HashInt64(i) ^ HashInt64(i ^ (uint64_t(1) << (i % 64)))));
+    EXPECT_NEAR(totalFlipped / (64 * 64), 32.0, 2.0);
+}
+
+// sequential keys spread evenly over the low bits and the high bits alike.
+TEST(HashTest, Distribution)
+{
+    constexpr int kNumBuckets = 1024;
+    constexpr int kNumKeys = kNumBuckets * 64;
+    int low[kNumBuckets] = {};
+    int high[kNumBuckets] = {};
+    char key[32];
+    for (int i = 0; i < kNumKeys; ++i)
+    {
+        snprintf(key, sizeof(key), "%d", i);
+        const uint64_t hash = HashString(key);
+        ++low[hash % kNumBuckets];
+        ++high[hash >> 54];
+    }
+
+    // chi squared over 1023 degrees of freedom stays well under 1300.
+    double chiLow = 0, chiHigh = 0;
+    const double expected = double(kNumKeys) / kNumBuckets;
+    for (int i = 0; i < kNumBuckets; ++i)
+    {
+        chiLow += (low[i] - expected) * (low[i] - expected) / expected;
+        chiHigh += (high[i] - expected) * (high[i] - expected) / expected;
+    }
+    EXPECT_LT(chiLow, 1300.0);
+    EXPECT_LT(chiHigh, 1300.0);
+}
@@ -1,5 +1,7 @@
 #include "toolkit/hashmap.hh"
 #include "toolkit/str.hh"
+#include "toolkit/mem/alloc_policy.hh"
+#include "countingallocator.hh"
 #include <gtest/gtest.h>
 
 using namespace lptk;
@@ -69,3 +71,20 @@ TEST(HashMapTest, SetAgain)
 }
 
 
+
+TEST(HashMapTest, AllocatorPolicy)
+{
+    CountingAllocator alloc;
+    {
+        HashMap<int, int, mem::AllocatorPolicy> map(31, &alloc);
+        // pairs and used bits.
+        EXPECT_EQ(alloc.GetNumLive(), 2);
+        for (int i = 0; i < 1000; ++i)
+            map[i] = i * 2;
+        for (int i = 0; i < 1000; ++i)
+            EXPECT_EQ(map.get(i), i * 2);
+        EXPECT_EQ(map.get_allocator().GetAllocator(), &alloc);
+        EXPECT_EQ(alloc.GetNumLive(), 2);
+    }
+    EXPECT_EQ(alloc.GetNumLive(), 0);
+}
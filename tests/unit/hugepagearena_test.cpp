@@ -0,0 +1,114 @@
+#include "toolkit/mem/huge_page_arena.hh"
+#include "toolkit/dynary.hh"
+#include <gtest/gtest.h>
+#include <cstring>
+
+using namespace lptk;
+
+TEST(HugePageArenaTest, CommitsAsItGrows)
+{
+    mem::HugePageArena arena(size_t(64) << 20, mem::HugePageArena::PageMode::Transparent);
+    EXPECT_EQ(arena.GetReservedBytes(), 0u);
+
+    auto p = reinterpret_cast<char*>(arena.Alloc(100, 16));
+    ASSERT_NE(p, nullptr);
+    EXPECT_EQ(arena.GetReservedBytes(), size_t(64) << 20);
+    EXPECT_EQ(arena.GetCommittedBytes(), mem::HugePageArena::kHugePageSize);
+
+    auto big = reinterpret_cast<char*>(arena.Alloc(size_t(5) << 20, 4096));
+    ASSERT_NE(big, nullptr);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(big) % 4096, 0u);
+    memset(big, 0xcd, size_t(5) << 20);
+    EXPECT_EQ(arena.GetCommittedBytes(), 3 * mem::HugePageArena::kHugePageSize);
+    EXPECT_GE(arena.GetAllocatedBytes(), (size_t(5) << 20) + 100);
+
+    // bigger than a reservation gets its own.
+    auto huge = arena.Alloc(size_t(100) << 20, 16);
+    ASSERT_NE(huge, nullptr);
+    EXPECT_GE(arena.GetReservedBytes(), size_t(164) << 20);
+
+    arena.Free(huge);
+    arena.Free(big);
+    arena.Free(p);
+    EXPECT_EQ(arena.GetAllocatedBytes(), 0u);
+    arena.Reset();
+    EXPECT_EQ(arena.GetReservedBytes(), 0u);
+    EXPECT_EQ(arena.GetCommittedBytes(), 0u);
+}
+
+TEST(HugePageArenaTest, ReusesFreedBlocks)
+{
+    mem::HugePageArena arena(size_t(4) << 20, mem::HugePageArena::PageMode::Normal);
+    DynAry<void*> blocks;
+    for (int i = 0; i < 100; ++i)
+    {
+        blocks.push_back(arena.Alloc(1000 + i, 16));
+        memset(blocks.back(), i, 1000 + i);
+    }
+    const auto committed = arena.GetCommittedBytes();
+
+    for (size_t i = 0; i < blocks.size(); i += 2)
+        arena.Free(blocks[i]);
+    // fits in the freed holes, the top doesn't move.
+    for (int i = 0; i < 50; ++i)
+        ASSERT_NE(arena.Alloc(500, 64), nullptr);
+    EXPECT_EQ(arena.GetCommittedBytes(), committed);
+    for (size_t i = 1; i < blocks.size(); i += 2)
+        EXPECT_EQ(*reinterpret_cast<uint8_t*>(blocks[i]), uint8_t(i));
+}
+
+TEST(HugePageArenaTest, HugeTLBFallsBack)
+{
+    // with no huge page pool configured this ends up transparent, either way it works.
+    mem::HugePageArena arena(size_t(4) << 20, mem::HugePageArena::PageMode::HugeTLB);
+    auto p = reinterpret_cast<char*>(arena.Alloc(size_t(1) << 20, 16));
+    ASSERT_NE(p, nullptr);
+    memset(p, 1, size_t(1) << 20);
+    EXPECT_GE(arena.GetCommittedBytes(), size_t(1) << 20);
+}
+
+TEST(HugePageArenaTest, MergesFreedNeighbours)
+{
+    mem::HugePageArena arena(size_t(4) << 20, mem::HugePageArena::PageMode::Normal);
+    void* blocks[4];
+    for (auto& block : blocks)
+        block = arena.Alloc(1000, 16);
+    void* last = arena.Alloc(1000, 16);
+
+    // three neighbours freed out of order make one block that fits 3000 bytes.
+    arena.Free(blocks[1]);
+    arena.Free(blocks[3]);
+    arena.Free(blocks[2]);
+    EXPECT_EQ(arena.Alloc(3000, 16), blocks[1]);
+
+    // freeing the last block takes its free neighbour back into the top.
+    arena.Free(blocks[0]);
+    arena.Free(last);
+    arena.Free(blocks[1]);
+    EXPECT_EQ(arena.GetAllocatedBytes(), 0u);
+    EXPECT_EQ(arena.Alloc(1000, 16), blocks[0]);
+}
+
+TEST(HugePageArenaTest, KeepsTheHeadsTail)
+{
+    const size_t kMiB = size_t(1) << 20;
+    mem::HugePageArena arena(4 * kMiB, mem::HugePageArena::PageMode::Normal);
+    auto first = reinterpret_cast<char*>(arena.Alloc(3 * kMiB, 16));
+    ASSERT_NE(first, nullptr);
+
+    // bigger than a reservation, and filling its own, the head keeps going
+    // after it.
+    ASSERT_NE(arena.Alloc(16 * kMiB - 1024, 16), nullptr);
+    const auto reserved = arena.GetReservedBytes();
+    auto next = reinterpret_cast<char*>(arena.Alloc(kMiB / 2, 16));
+    EXPECT_GT(next, first);
+    EXPECT_LT(next, first + 4 * kMiB);
+
+    // a new head, the old one's tail still serves what fits in it.
+    ASSERT_NE(arena.Alloc(2 * kMiB, 16), nullptr);
+    EXPECT_EQ(arena.GetReservedBytes(), reserved + 4 * kMiB);
+    auto small = reinterpret_cast<char*>(arena.Alloc(kMiB / 4, 16));
+    EXPECT_GT(small, next);
+    EXPECT_LT(small, first + 4 * kMiB);
+    memset(small, 1, kMiB / 4);
+}
@@ -0,0 +1,107 @@
+#include "toolkit/mem/linear_chunk_allocator.hh"
+#include "toolkit/mem/frame_arena.hh"
+#include <gtest/gtest.h>
+#include <cstring>
+#include <thread>
+
+using namespace lptk;
+
+TEST(LinearChunkAllocatorTest, Alignment)
+{
+    mem::LinearChunkAllocator alloc(256);
+    for (unsigned align : { 1u, 16u, 64u, 256u, 4096u })
+    {
+        for (size_t size : { 1u, 24u, 200u, 1000u })
+        {
+            auto p = alloc.Alloc(size, align);
+            ASSERT_NE(p, nullptr);
+            EXPECT_EQ(reinterpret_cast<uintptr_t>(p) % Max(align, 16u), 0u);
+            memset(p, 0xcd, size);
+        }
+    }
+}
+
+TEST(LinearChunkAllocatorTest, RewindKeepsEarlierAllocations)
+{
+    mem::LinearChunkAllocator alloc(1024);
+    auto kept = reinterpret_cast<char*>(alloc.Alloc(100, 16));
+    memset(kept, 1, 100);
+
+    const auto marker = alloc.GetMarker();
+    void* first = alloc.Alloc(64, 16);
+    // spill into more chunks, they stay around for later.
+    for (int i = 0; i < 20; ++i)
+        memset(alloc.Alloc(500, 16), 2, 500);
+    alloc.Rewind(marker);
+
+    EXPECT_EQ(alloc.Alloc(64, 16), first);
+    for (int i = 0; i < 100; ++i)
+        EXPECT_EQ(kept[i], 1);
+}
+
+TEST(LinearChunkAllocatorTest, ScopedMarkersNest)
+{
+    mem::LinearChunkAllocator alloc(1024);
+    void* outer;
+    void* inner;
+    {
+        mem::LinearChunkAllocator::ScopedMarker scope(alloc);
+        outer = alloc.Alloc(32, 16);
+        {
+            mem::LinearChunkAllocator::ScopedMarker innerScope(alloc);
+            inner = alloc.Alloc(2000, 16);
+        }
+        EXPECT_EQ(alloc.Alloc(2000, 16), inner);
+    }
+    EXPECT_EQ(alloc.Alloc(32, 16), outer);
+}
+
+TEST(FrameArenaTest, PreviousFrameStaysValid)
+{
+    mem::FrameArena arena(1024);
+    auto frame0 = reinterpret_cast<int*>(arena.Alloc(sizeof(int), alignof(int)));
+    *frame0 = 42;
+
+    arena.NextFrame();
+    auto frame1 = reinterpret_cast<int*>(arena.Alloc(sizeof(int), alignof(int)));
+    *frame1 = 7;
+    EXPECT_EQ(*frame0, 42);
+
+    // frame 0's buffer comes back around.
+    arena.NextFrame();
+    EXPECT_EQ(arena.Alloc(sizeof(int), alignof(int)), frame0);
+    EXPECT_EQ(*frame1, 7);
+}
+
+TEST(FrameArenaTest, PerThread)
+{
+    auto mine = mem::GetThreadFrameArena();
+    EXPECT_EQ(mem::GetThreadFrameArena(), mine);
+    mem::FrameArena* other = nullptr;
+    std::thread([&] { other = mem::GetThreadFrameArena(); }).join();
+    EXPECT_NE(other, mine);
+}
+
+TEST(LinearChunkAllocatorTest, ReleaseIdleChunks)
+{
+    mem::LinearChunkAllocator alloc(1024);
+    EXPECT_EQ(alloc.ReleaseIdleChunks(), 0u);
+    auto marker = alloc.GetMarker();
+    alloc.Alloc(800, 16);
+    alloc.Alloc(800, 16);
+    alloc.Alloc(800, 16);
+
+    // the last chunk is in use.
+    EXPECT_EQ(alloc.ReleaseIdleChunks(), 0u);
+    // rewinding to the start keeps the first chunk current.
+    alloc.Rewind(marker);
+    EXPECT_EQ(alloc.ReleaseIdleChunks(), 2 * 1024u);
+
+    // and still works after.
+    auto p = reinterpret_cast<char*>(alloc.Alloc(2000, 16));
+    ASSERT_NE(p, nullptr);
+    memset(p, 1, 2000);
+    alloc.Clear();
+    EXPECT_GE(alloc.ReleaseIdleChunks(), 2000u);
+    EXPECT_EQ(alloc.ReleaseIdleChunks(), 0u);
+}
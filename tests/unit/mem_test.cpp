@@ -0,0 +1,330 @@
+#include "toolkit/mem.hh"
+#include "toolkit/dynary.hh"
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+using namespace lptk;
+
+TEST(MemTest, SizesAndAlignment)
+{
+    DynAry<void*> ptrs;
+    for (size_t size = 0; size < 20000; size += size < 300 ? 1 : 97)
+    {
+        for (unsigned align : { 1u, 16u, 32u, 64u, 128u, 4096u })
+        {
+            auto p = reinterpret_cast<char*>(mem_allocate(size, MEMPOOL_Temp, align));
+            ASSERT_NE(p, nullptr);
+            ASSERT_EQ(reinterpret_cast<uintptr_t>(p) % Max(align, 16u), 0u);
+            memset(p, 0xcd, size);
+            ptrs.push_back(p);
+        }
+    }
+    for (auto p : ptrs)
+        mem_free(p);
+    mem_free(nullptr);
+}
+
+TEST(MemTest, ReallocateKeepsContents)
+{
+    size_t size = 3;
+    auto p = reinterpret_cast<uint8_t*>(mem_allocate(size, MEMPOOL_Temp, 16));
+    for (size_t i = 0; i < size; ++i)
+        p[i] = uint8_t(i);
+
+    // through the small classes and out into large allocations.
+    while (size < (1 << 20))
+    {
+        const size_t newSize = size * 3;
+        p = reinterpret_cast<uint8_t*>(mem_reallocate(p, newSize, MEMPOOL_Temp, 16));
+        ASSERT_NE(p, nullptr);
+        for (size_t i = 0; i < size; ++i)
+            ASSERT_EQ(p[i], uint8_t(i));
+        for (size_t i = size; i < newSize; ++i)
+            p[i] = uint8_t(i);
+        size = newSize;
+    }
+    mem_free(p);
+}
+
+TEST(MemTest, PoolAccounting)
+{
+    const auto before = mem_GetSizeAllocated(MEMPOOL_Network);
+    void* small = mem_allocate(100, MEMPOOL_Network, 16);
+    void* large = mem_allocate(1 << 20, MEMPOOL_Network, 16);
+    EXPECT_GE(mem_GetSizeAllocated(MEMPOOL_Network), before + 100 + (1 << 20));
+
+    // freed on another thread: per thread counts go out of balance, the sum doesn't.
+    std::thread([&] {
+        mem_free(small);
+        mem_free(large);
+    }).join();
+    EXPECT_EQ(mem_GetSizeAllocated(MEMPOOL_Network), before);
+}
+
+TEST(MemTest, ManyThreads)
+{
+    const auto before = mem_GetSizeAllocated(MEMPOOL_Temp);
+    constexpr int kNumThreads = 8;
+    constexpr int kNumAllocs = 20000;
+
+    // every thread frees half of its own allocations, and half of its neighbour's.
+    void* allocs[kNumThreads][kNumAllocs];
+    std::thread threads[kNumThreads];
+    for (int t = 0; t < kNumThreads; ++t)
+    {
+        threads[t] = std::thread([&allocs, t] {
+            for (int i = 0; i < kNumAllocs; ++i)
+            {
+                const size_t size = 8 + (i * 37) % 3000;
+                allocs[t][i] = mem_allocate(size, MEMPOOL_Temp, 16);
+                memset(allocs[t][i], t, size);
+            }
+            for (int i = 0; i < kNumAllocs; i += 2)
+                mem_free(allocs[t][i]);
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+
+    for (int t = 0; t < kNumThreads; ++t)
+    {
+        threads[t] = std::thread([&allocs, t] {
+            auto& neighbour = allocs[(t + 1) % kNumThreads];
+            for (int i = 1; i < kNumAllocs; i += 2)
+            {
+                ASSERT_EQ(*reinterpret_cast<uint8_t*>(neighbour[i]), uint8_t((t + 1) % kNumThreads));
+                mem_free(neighbour[i]);
+            }
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+
+    EXPECT_EQ(mem_GetSizeAllocated(MEMPOOL_Temp), before);
+}
+
+TEST(MemTest, LargeReallocateBeyond4GiB)
+{
+    const auto before = mem_GetSizeAllocated(MEMPOOL_Temp);
+    size_t size = size_t(64) << 20;
+    auto p = reinterpret_cast<uint8_t*>(mem_allocate(size, MEMPOOL_Temp, 16));
+    ASSERT_NE(p, nullptr);
+    p[0] = 1;
+    p[size - 1] = 2;
+
+    // only the touched pages are ever backed.
+    const size_t newSize = (size_t(5) << 30) + 12345;
+    p = reinterpret_cast<uint8_t*>(mem_reallocate(p, newSize, MEMPOOL_Temp, 16));
+    ASSERT_NE(p, nullptr);
+    EXPECT_EQ(p[0], 1);
+    EXPECT_EQ(p[size - 1], 2);
+    p[newSize - 1] = 3;
+    EXPECT_GE(mem_GetSizeAllocated(MEMPOOL_Temp), before + newSize);
+
+    mem_free(p);
+    EXPECT_EQ(mem_GetSizeAllocated(MEMPOOL_Temp), before);
+}
+
+#if defined(PROFILE)
+TEST(MemTest, Tracking)
+{
+    ASSERT_TRUE(mem_EnableTracking(true, 4096));
+    const auto before = mem_GetPoolStats(MEMPOOL_Network);
+
+    DynAry<void*> ptrs;
+    for (int i = 0; i < 100; ++i)
+        ptrs.push_back(mem_allocate(100, MEMPOOL_Network, 16));
+    void* big = mem_allocate(size_t(1) << 20, MEMPOOL_Network, 16);
+
+    const auto during = mem_GetPoolStats(MEMPOOL_Network);
+    EXPECT_EQ(during.m_numAllocs - before.m_numAllocs, 101u);
+    EXPECT_EQ(during.m_sizeHistogram[6] - before.m_sizeHistogram[6], 100u);
+    EXPECT_EQ(during.m_sizeHistogram[20] - before.m_sizeHistogram[20], 1u);
+    // the big allocation grows usage by more than a span, which updates the peak.
+    EXPECT_GE(during.m_peak, before.m_current + (size_t(1) << 20));
+
+    mem_free(big);
+    for (auto p : ptrs)
+        mem_free(p);
+    const auto after = mem_GetPoolStats(MEMPOOL_Network);
+    EXPECT_EQ(after.m_numFrees - before.m_numFrees, 101u);
+    EXPECT_EQ(after.m_current, before.m_current);
+    EXPECT_GE(after.m_peak, during.m_peak);
+
+    const char* filename = "mem_tracking_test.txt";
+    EXPECT_TRUE(mem_DumpTracking(filename));
+    FILE* fp = fopen(filename, "r");
+    ASSERT_NE(fp, nullptr);
+    char line[256] = {};
+    EXPECT_NE(fgets(line, sizeof(line), fp), nullptr);
+    fclose(fp);
+    remove(filename);
+
+    mem_EnableTracking(false);
+    const auto disabled = mem_GetPoolStats(MEMPOOL_Network);
+    mem_free(mem_allocate(100, MEMPOOL_Network, 16));
+    EXPECT_EQ(mem_GetPoolStats(MEMPOOL_Network).m_numAllocs, disabled.m_numAllocs);
+}
+
+TEST(MemTest, PeakWithoutSamples)
+{
+    // an interval nothing here reaches, the peak has to come from the charges.
+    ASSERT_TRUE(mem_EnableTracking(true, size_t(1) << 40));
+    const auto before = mem_GetPoolStats(MEMPOOL_Network);
+    const size_t target = before.m_peak + (size_t(2) << 20);
+
+    DynAry<void*> ptrs;
+    while (mem_GetSizeAllocated(MEMPOOL_Network) < target)
+        ptrs.push_back(mem_allocate(8 * 1024, MEMPOOL_Network, 16));
+    for (auto p : ptrs)
+        mem_free(p);
+
+    const auto after = mem_GetPoolStats(MEMPOOL_Network);
+    EXPECT_EQ(after.m_current, before.m_current);
+    EXPECT_GE(after.m_peak + (size_t(256) << 10), target);
+    mem_EnableTracking(false);
+}
+#endif
+
+TEST(MemTest, PoolLimits)
+{
+    struct PressureState
+    {
+        int m_numSoft = 0;
+        int m_numHard = 0;
+        void* m_cache = nullptr;
+    };
+    auto callback = [](MemPoolId id, MemPressure pressure, size_t, void* user)
+    {
+        auto state = static_cast<PressureState*>(user);
+        if (id != MEMPOOL_Network)
+            return;
+        if (pressure == MemPressure::Soft)
+        {
+            ++state->m_numSoft;
+        }
+        else
+        {
+            ++state->m_numHard;
+            mem_free(std::exchange(state->m_cache, nullptr));
+        }
+    };
+
+    const size_t blockSize = 16 * 1024;
+    const size_t base = mem_GetSizeAllocated(MEMPOOL_Network);
+    PressureState state;
+    ASSERT_TRUE(mem_AddPressureCallback(callback, &state));
+    mem_SetPoolLimits(MEMPOOL_Network, base + 4 * blockSize, base + 8 * blockSize);
+
+    state.m_cache = mem_allocate(blockSize, MEMPOOL_Network, 16);
+    DynAry<void*> ptrs;
+    for (int i = 0; i < 7; ++i)
+    {
+        ptrs.push_back(mem_allocate(blockSize, MEMPOOL_Network, 16));
+        ASSERT_NE(ptrs.back(), nullptr);
+        EXPECT_EQ(state.m_numSoft, i >= 2 ? 1 : 0);
+    }
+    EXPECT_EQ(state.m_numHard, 0);
+
+    // the first time the callback makes room, the second time it can't.
+    ptrs.push_back(mem_allocate(blockSize, MEMPOOL_Network, 16));
+    EXPECT_NE(ptrs.back(), nullptr);
+    EXPECT_EQ(state.m_numHard, 1);
+    EXPECT_EQ(mem_allocate(blockSize, MEMPOOL_Network, 16), nullptr);
+    EXPECT_EQ(mem_allocate(1 << 20, MEMPOOL_Network, 16), nullptr);
+    EXPECT_EQ(state.m_numHard, 3);
+
+    // dropping below the soft limit rearms it.
+    for (auto p : ptrs)
+        mem_free(p);
+    ptrs.clear();
+    for (int i = 0; i < 4; ++i)
+        ptrs.push_back(mem_allocate(blockSize, MEMPOOL_Network, 16));
+    EXPECT_EQ(state.m_numSoft, 2);
+    for (auto p : ptrs)
+        mem_free(p);
+
+    mem_SetPoolLimits(MEMPOOL_Network, 0, 0);
+    mem_RemovePressureCallback(callback, &state);
+    void* unlimited = mem_allocate(16 * blockSize, MEMPOOL_Network, 16);
+    EXPECT_NE(unlimited, nullptr);
+    mem_free(unlimited);
+    EXPECT_EQ(state.m_numHard, 3);
+    EXPECT_EQ(mem_GetSizeAllocated(MEMPOOL_Network), base);
+}
+
+TEST(MemTest, LargeSpansAreReused)
+{
+    // a freed mid size block comes back for the next one of its size, and a
+    // bigger cached one is cut down to fit.
+    void* p = mem_allocate(100 * 1024, MEMPOOL_General, 16);
+    ASSERT_NE(p, nullptr);
+    memset(p, 1, 100 * 1024);
+    mem_free(p);
+    void* q = mem_allocate(100 * 1024, MEMPOOL_General, 16);
+    EXPECT_EQ(p, q);
+    mem_free(q);
+
+    void* big = mem_allocate(512 * 1024, MEMPOOL_General, 16);
+    ASSERT_NE(big, nullptr);
+    mem_free(big);
+    void* small = mem_allocate(300 * 1024, MEMPOOL_General, 16);
+    ASSERT_NE(small, nullptr);
+    memset(small, 2, 300 * 1024);
+    mem_free(small);
+
+    // huge ones are still unmapped, and everything balances out.
+    const size_t before = mem_GetSizeAllocated(MEMPOOL_General);
+    void* huge = mem_allocate(4 * 1024 * 1024, MEMPOOL_General, 16);
+    ASSERT_NE(huge, nullptr);
+    memset(huge, 3, 4 * 1024 * 1024);
+    mem_free(huge);
+    EXPECT_EQ(before, mem_GetSizeAllocated(MEMPOOL_General));
+}
+
+#if defined(LINUX)
+TEST(MemTest, MidSizeBlocksShareMappings)
+{
+    // live mid size blocks don't each cost a mapping, so lots of them stay
+    // clear of vm.max_map_count.
+    auto countMappings = [] {
+        size_t count = 0;
+        FILE* fp = fopen("/proc/self/maps", "r");
+        if (!fp)
+            return count;
+        for (int c; (c = fgetc(fp)) != EOF;)
+            count += c == '\n';
+        fclose(fp);
+        return count;
+    };
+
+    const size_t numBlocks = 2000;
+    DynAry<void*> ptrs;
+    ptrs.reserve(numBlocks);
+    const size_t before = countMappings();
+    for (size_t i = 0; i < numBlocks; ++i)
+    {
+        const size_t size = 17 * 1024 + (i % 7) * 9000;
+        auto p = reinterpret_cast<char*>(mem_allocate(size, MEMPOOL_General, i % 2 ? 16 : 4096));
+        ASSERT_NE(p, nullptr);
+        p[0] = p[size - 1] = char(i);
+        ptrs.push_back(p);
+    }
+    EXPECT_LT(countMappings(), before + numBlocks / 10);
+
+    // every other one freed and then the rest: merged free ranges get reused.
+    for (size_t i = 0; i < numBlocks; i += 2)
+        mem_free(ptrs[i]);
+    for (size_t i = 0; i < numBlocks; i += 2)
+    {
+        ptrs[i] = mem_allocate(40 * 1024, MEMPOOL_General, 16);
+        ASSERT_NE(ptrs[i], nullptr);
+        memset(ptrs[i], 5, 40 * 1024);
+    }
+    EXPECT_LT(countMappings(), before + numBlocks / 10);
+    for (auto p : ptrs)
+        mem_free(p);
+}
+#endif
@@ -0,0 +1,110 @@
+#include "toolkit/parallelalgorithm.hh"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <random>
+
+using namespace lptk;
+
+// Runs the checks both serially and split over fiber threads.
+class ParallelAlgorithmTest : public ::testing::TestWithParam<bool>
+{
+protected:
+    void SetUp() override
+    {
+        if (GetParam())
+        {
+            fiber::FiberInitStruct init;
+            init.numWorkerThreads = 4;
+            init.numFibers = 16;
+            init.numLargeFibers = 0;
+            ASSERT_TRUE(fiber::Init(init));
+        }
+    }
+
+    void TearDown() override
+    {
+        if (GetParam())
+            fiber::Purge();
+    }
+};
+
+TEST_P(ParallelAlgorithmTest, ForVisitsEachIndexOnce)
+{
+    DynAry<int> visits(size_t(100000), 0);
+    ParallelFor(10, visits.size(), [&](size_t i) { ++visits[i]; }, 64);
+    for (size_t i = 0; i < visits.size(); ++i)
+        ASSERT_EQ(visits[i], i < 10 ? 0 : 1);
+
+    ParallelFor(5, 5, [&](size_t) { FAIL(); });
+}
+
+struct Mat2
+{
+    uint64_t m[4];
+    bool operator==(const Mat2& other) const { return std::equal(m, m + 4, other.m); }
+};
+
+static Mat2 Mul(const Mat2& a, const Mat2& b)
+{
+    return { { a.m[0] * b.m[0] + a.m[1] * b.m[2], a.m[0] * b.m[1] + a.m[1] * b.m[3],
+        a.m[2] * b.m[0] + a.m[3] * b.m[2], a.m[2] * b.m[1] + a.m[3] * b.m[3] } };
+}
+
+TEST_P(ParallelAlgorithmTest, ReduceKeepsOrder)
+{
+    // matrix products don't commute, so any reordering shows.
+    const Mat2 identity = { { 1, 0, 0, 1 } };
+    auto map = [](size_t i) { return Mat2{ { i % 5 + 1, 1, 1, 0 } }; };
+    Mat2 expected = identity;
+    for (size_t i = 0; i < 50000; ++i)
+        expected = Mul(expected, map(i));
+
+    EXPECT_TRUE(ParallelReduce(size_t(0), size_t(50000), identity, map, Mul, 16) == expected);
+    auto one = [](size_t) { return 1; };
+    EXPECT_EQ(ParallelReduce(size_t(3), size_t(3), 7, one, std::plus<int>()), 7);
+}
+
+TEST_P(ParallelAlgorithmTest, InclusiveScan)
+{
+    DynAry<uint64_t> values(123457);
+    for (size_t i = 0; i < values.size(); ++i)
+        values[i] = i * 3 + 1;
+
+    DynAry<uint64_t> sums;
+    ParallelInclusiveScan(values, sums, std::plus<uint64_t>(), 100);
+    ASSERT_EQ(sums.size(), values.size());
+    uint64_t expected = 0;
+    for (size_t i = 0; i < values.size(); ++i)
+    {
+        expected += values[i];
+        ASSERT_EQ(sums[i], expected);
+    }
+
+    ParallelInclusiveScan(values, values, std::plus<uint64_t>(), 100);
+    EXPECT_TRUE(std::equal(values.begin(), values.end(), sums.begin()));
+}
+
+TEST_P(ParallelAlgorithmTest, Sort)
+{
+    std::mt19937 rng(1234);
+    for (size_t count : { size_t(0), size_t(1), size_t(1000), size_t(100003) })
+    {
+        DynAry<uint32_t> values(count);
+        for (auto& value : values)
+            value = rng() % 5000; // plenty of duplicates
+        DynAry<uint32_t> expected = values;
+        std::sort(expected.begin(), expected.end());
+
+        ParallelSort(values, std::less<uint32_t>(), 256);
+        ASSERT_TRUE(std::equal(values.begin(), values.end(), expected.begin()));
+    }
+
+    DynAry<int> descending(50000);
+    for (size_t i = 0; i < descending.size(); ++i)
+        descending[i] = int(i);
+    ParallelSort(descending, std::greater<int>(), 256);
+    for (size_t i = 1; i < descending.size(); ++i)
+        ASSERT_GE(descending[i - 1], descending[i]);
+}
+
+INSTANTIATE_TEST_CASE_P(SerialAndFibers, ParallelAlgorithmTest, ::testing::Values(false, true));
@@ -0,0 +1,101 @@
+#include "toolkit/mem/pool_allocator.hh"
+#include "toolkit/dynary.hh"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <thread>
+
+using namespace lptk;
+
+TEST(ConcurrentPoolAllocTest, FixedSizeRunsOut)
+{
+    mem::ConcurrentPoolAlloc pool(100, 24, false);
+    EXPECT_EQ(pool.Alloc(64, 16), nullptr);
+
+    DynAry<void*> items;
+    while (void* item = pool.Alloc(24, 16))
+    {
+        EXPECT_TRUE(pool.IsValidPtr(item));
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(item) % 16, 0u);
+        items.push_back(item);
+    }
+    EXPECT_EQ(items.size(), 100u);
+    std::sort(items.begin(), items.end());
+    EXPECT_EQ(std::unique(items.begin(), items.end()), items.end());
+
+    for (auto item : items)
+        pool.Free(item);
+    pool.Free(nullptr);
+    for (size_t i = 0; i < items.size(); ++i)
+        EXPECT_NE(pool.Alloc(24, 16), nullptr);
+    EXPECT_EQ(pool.Alloc(24, 16), nullptr);
+}
+
+TEST(ConcurrentPoolAllocTest, FixedSizeFreedByAnotherThread)
+{
+    mem::ConcurrentPoolAlloc pool(100, 24, false);
+    DynAry<void*> items;
+    while (void* item = pool.Alloc(24, 16))
+        items.push_back(item);
+    ASSERT_EQ(items.size(), 100u);
+
+    // freed on this thread, every item is there for another.
+    for (auto item : items)
+        pool.Free(item);
+    std::thread([&] {
+        for (size_t i = 0; i < items.size(); ++i)
+            EXPECT_NE(pool.Alloc(24, 16), nullptr);
+    }).join();
+}
+
+TEST(ConcurrentPoolAllocTest, ManyThreads)
+{
+    constexpr int kNumThreads = 8;
+    constexpr int kNumItems = 5000;
+    mem::ConcurrentPoolAlloc pool(64, sizeof(int));
+
+    // every thread frees half of its own items and half of its neighbour's, so
+    // items move between magazines and the shared list.
+    int* items[kNumThreads][kNumItems];
+    std::thread threads[kNumThreads];
+    for (int t = 0; t < kNumThreads; ++t)
+    {
+        threads[t] = std::thread([&, t] {
+            for (int round = 0; round < 10; ++round)
+            {
+                for (int i = 0; i < kNumItems; ++i)
+                {
+                    items[t][i] = reinterpret_cast<int*>(pool.Alloc(sizeof(int), alignof(int)));
+                    *items[t][i] = t;
+                }
+                for (int i = 0; i < kNumItems; ++i)
+                {
+                    ASSERT_EQ(*items[t][i], t);
+                    pool.Free(items[t][i]);
+                }
+            }
+            for (int i = 0; i < kNumItems; ++i)
+            {
+                items[t][i] = reinterpret_cast<int*>(pool.Alloc(sizeof(int), alignof(int)));
+                *items[t][i] = t;
+            }
+            for (int i = 0; i < kNumItems; i += 2)
+                pool.Free(items[t][i]);
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+
+    for (int t = 0; t < kNumThreads; ++t)
+    {
+        threads[t] = std::thread([&, t] {
+            const int other = (t + 1) % kNumThreads;
+            for (int i = 1; i < kNumItems; i += 2)
+            {
+                ASSERT_EQ(*items[other][i], other);
+                pool.Free(items[other][i]);
+            }
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+}
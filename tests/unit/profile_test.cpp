@@ -0,0 +1,177 @@
+#include "toolkit/profile.hh"
+#include <gtest/gtest.h>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+
+using namespace lptk;
+
+namespace
+{
+    // just enough JSON to check that a trace parses.
+    class JsonChecker
+    {
+    public:
+        explicit JsonChecker(const char* text) : m_cur(text) {}
+
+        bool Parse()
+        {
+            if (!Value())
+                return false;
+            SkipSpace();
+            return *m_cur == '\0';
+        }
+
+    private:
+        void SkipSpace()
+        {
+            while (isspace((unsigned char)*m_cur))
+                ++m_cur;
+        }
+
+        bool Take(char c)
+        {
+            SkipSpace();
+            if (*m_cur != c)
+                return false;
+            ++m_cur;
+            return true;
+        }
+
+        bool Literal(const char* word)
+        {
+            const size_t len = strlen(word);
+            if (strncmp(m_cur, word, len) != 0)
+                return false;
+            m_cur += len;
+            return true;
+        }
+
+        bool String()
+        {
+            if (!Take('"'))
+                return false;
+            for (; *m_cur != '"'; ++m_cur)
+            {
+                if (*m_cur == '\0' || (unsigned char)*m_cur < 0x20)
+                    return false;
+                if (*m_cur == '\\' && !strchr("\"\\/bfnrtu", *++m_cur))
+                    return false;
+            }
+            ++m_cur;
+            return true;
+        }
+
+        bool Number()
+        {
+            char* end = nullptr;
+            strtod(m_cur, &end);
+            if (end == m_cur)
+                return false;
+            m_cur = end;
+            return true;
+        }
+
+        bool Value()
+        {
+            SkipSpace();
+            switch (*m_cur)
+            {
+            case '{':
+                ++m_cur;
+                if (Take('}'))
+                    return true;
+                do
+                {
+                    if (!String() || !Take(':') || !Value())
+                        return false;
+                } while (Take(','));
+                return Take('}');
+            case '[':
+                ++m_cur;
+                if (Take(']'))
+                    return true;
+                do
+                {
+                    if (!Value())
+                        return false;
+                } while (Take(','));
+                return Take(']');
+            case '"':
+                return String();
+            case 't':
+                return Literal("true");
+            case 'f':
+                return Literal("false");
+            case 'n':
+                return Literal("null");
+            default:
+                return Number();
+            }
+        }
+
+        const char* m_cur;
+    };
+
+    std::string ReadFile(const char* filename)
+    {
+        std::string text;
+        FILE* fp = fopen(filename, "rb");
+        if (!fp)
+            return text;
+        char buffer[4096];
+        size_t numRead;
+        while ((numRead = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+            text.append(buffer, numRead);
+        fclose(fp);
+        return text;
+    }
+
+    size_t CountOf(const std::string& text, const char* what)
+    {
+        size_t count = 0;
+        for (size_t pos = text.find(what); pos != std::string::npos; pos = text.find(what, pos + 1))
+            ++count;
+        return count;
+    }
+}
+
+TEST(ProfileTest, DumpParses)
+{
+    profile::Clear();
+    profile::RegisterThread("Main \"quoted\"");
+    profile::Record(profile::EventType::Begin, "Outer");
+    profile::Record(profile::EventType::Instant, "Marker\\", 0x1234);
+    profile::Record(profile::EventType::End, "Outer");
+
+    std::thread([] {
+        profile::RegisterThread("Worker");
+        for (int i = 0; i < 10; ++i)
+        {
+            profile::Record(profile::EventType::Begin, "Work");
+            profile::Record(profile::EventType::End, "Work");
+        }
+    }).join();
+
+    const char* filename = "profile_test_trace.json";
+    ASSERT_TRUE(profile::DumpChromeTrace(filename));
+    const std::string text = ReadFile(filename);
+    remove(filename);
+
+    EXPECT_TRUE(JsonChecker(text.c_str()).Parse()) << text;
+    EXPECT_EQ(CountOf(text, "\"name\":\"Outer\""), 2u);
+    EXPECT_EQ(CountOf(text, "\"name\":\"Work\""), 20u);
+    EXPECT_EQ(CountOf(text, "\"args\":{\"arg\":\"0x1234\"}"), 1u);
+    EXPECT_NE(text.find("Main \\\"quoted\\\""), std::string::npos);
+
+    // cleared events stay out of later dumps.
+    profile::Clear();
+    ASSERT_TRUE(profile::DumpChromeTrace(filename));
+    const std::string cleared = ReadFile(filename);
+    remove(filename);
+    EXPECT_TRUE(JsonChecker(cleared.c_str()).Parse()) << cleared;
+    EXPECT_EQ(CountOf(cleared, "\"name\":\"Outer\""), 0u);
+    EXPECT_EQ(CountOf(cleared, "\"name\":\"Work\""), 0u);
+}
@@ -0,0 +1,73 @@
+#include "toolkit/mem/slab_allocator.hh"
+#include "toolkit/dynary.hh"
+#include "countingallocator.hh"
+#include <gtest/gtest.h>
+#include <cstring>
+
+using namespace lptk;
+
+TEST(SlabAllocatorTest, ClassesCoverSizesAndAlignment)
+{
+    EXPECT_EQ(mem::SlabAllocator::ClassSize(0), mem::SlabAllocator::kMinSize);
+    EXPECT_EQ(mem::SlabAllocator::ClassSize(mem::SlabAllocator::kNumClasses - 1), mem::SlabAllocator::kMaxSize);
+
+    mem::SlabAllocator slabs;
+    DynAry<void*> items;
+    for (size_t size = 1; size <= 3000; size += 7)
+    {
+        for (unsigned align : { 1u, 8u, 16u, 64u, 256u })
+        {
+            auto p = slabs.Alloc(size, align);
+            ASSERT_NE(p, nullptr);
+            EXPECT_EQ(reinterpret_cast<uintptr_t>(p) % align, 0u);
+            memset(p, 0xcd, size);
+            items.push_back(p);
+        }
+    }
+    EXPECT_GT(slabs.GetNumParentAllocs(), 0u);
+    for (auto p : items)
+        slabs.Free(p);
+
+    for (unsigned i = 0; i < mem::SlabAllocator::kNumClasses; ++i)
+    {
+        const auto& stats = slabs.GetClassStats(i);
+        EXPECT_EQ(stats.m_numItemsUsed, 0u);
+        EXPECT_LE(stats.m_numSlabs, 1u);
+    }
+}
+
+TEST(SlabAllocatorTest, ReturnsEmptySlabs)
+{
+    CountingAllocator parent;
+    {
+        mem::SlabAllocator slabs(&parent);
+        DynAry<void*> items;
+        for (int i = 0; i < 10000; ++i)
+            items.push_back(slabs.Alloc(40, 8));
+        const auto& stats = slabs.GetClassStats(4);
+        EXPECT_EQ(stats.m_itemSize, 48u);
+        EXPECT_EQ(stats.m_numItemsUsed, 10000u);
+        EXPECT_EQ(stats.m_peakItemsUsed, 10000u);
+        EXPECT_GE(stats.m_numItemsTotal, 10000u);
+        EXPECT_GT(stats.m_numSlabs, 5u);
+
+        for (auto p : items)
+            slabs.Free(p);
+        EXPECT_EQ(stats.m_numSlabs, 1u);
+        EXPECT_EQ(stats.m_peakItemsUsed, 10000u);
+        EXPECT_EQ(stats.m_totalBytesRequested, 40u * 10000u);
+    }
+    EXPECT_EQ(parent.GetNumLive(), 0);
+}
+
+TEST(SlabAllocatorTest, SlabsArentPadded)
+{
+    // the default allocator charges what it maps, a slab should cost little
+    // more than its size.
+    mem::SlabAllocator slabs;
+    const size_t before = mem_GetSizeAllocated(MEMPOOL_General);
+    void* p = slabs.Alloc(40, 8);
+    ASSERT_NE(p, nullptr);
+    EXPECT_LT(mem_GetSizeAllocated(MEMPOOL_General) - before, mem::SlabAllocator::kSlabSize * 5 / 4);
+    slabs.Free(p);
+}
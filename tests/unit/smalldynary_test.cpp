@@ -0,0 +1,133 @@
+#include <algorithm>
+#include "toolkit/common.hh"
+#include "toolkit/smalldynary.hh"
+#include "toolkit/str.hh"
+#include "toolkit/mem/allocator.hh"
+#include "countingallocator.hh"
+#include <gtest/gtest.h>
+
+using namespace lptk;
+
+namespace
+{
+    template<class T, size_t N>
+    using CountedAry = SmallDynAry<T, N, alignof(T), MEMPOOL_General, mem::AllocatorPolicy>;
+}
+
+TEST(SmallDynAryTest, StaysInline) {
+    CountingAllocator counter;
+    {
+        CountedAry<int, 8> ary(&counter);
+        EXPECT_TRUE(ary.empty());
+        EXPECT_EQ(8u, ary.capacity());
+        for (int i = 0; i < 8; ++i)
+            ary.push_back(i);
+        EXPECT_TRUE(ary.is_inline());
+        EXPECT_EQ(8u, ary.size());
+        ary.erase(ary.begin() + 2);
+        ary.insert(ary.begin(), 42);
+        EXPECT_EQ(42, ary[0]);
+        EXPECT_EQ(3, ary[3]);
+    }
+    EXPECT_EQ(0, counter.m_numAllocs);
+}
+
+TEST(SmallDynAryTest, Spills) {
+    CountingAllocator counter;
+    {
+        CountedAry<int, 4> ary(&counter);
+        for (int i = 0; i < 100; ++i)
+            ary.push_back(i);
+        EXPECT_FALSE(ary.is_inline());
+        EXPECT_GE(ary.capacity(), 100u);
+        for (int i = 0; i < 100; ++i)
+            EXPECT_EQ(i, ary[i]);
+
+        // shrinking to the inline size brings the elements back.
+        ary.resize(3);
+        ary.set_capacity(0);
+        EXPECT_TRUE(ary.is_inline());
+        EXPECT_EQ(4u, ary.capacity());
+        EXPECT_EQ(3u, ary.size());
+        EXPECT_EQ(2, ary[2]);
+    }
+    EXPECT_GT(counter.m_numAllocs, 0);
+    EXPECT_EQ(counter.m_numAllocs, counter.m_numFrees);
+}
+
+TEST(SmallDynAryTest, CopyAndMove) {
+    int array[10] = {40,41,42,43,44,45,46,47,48,49};
+    SmallDynAry<int, 4> small(array, array + 3);
+    SmallDynAry<int, 4> big(array, array + 10);
+    EXPECT_TRUE(small.is_inline());
+    EXPECT_FALSE(big.is_inline());
+
+    SmallDynAry<int, 4> smallCopy(small);
+    SmallDynAry<int, 4> bigCopy(big);
+    EXPECT_TRUE(std::equal(small.begin(), small.end(), smallCopy.begin()));
+    EXPECT_TRUE(std::equal(big.begin(), big.end(), bigCopy.begin()));
+    EXPECT_NE(big.data(), bigCopy.data());
+
+    // moving the heap block takes it along, inline elements are moved over.
+    const int* bigData = big.data();
+    SmallDynAry<int, 4> bigMoved(std::move(big));
+    EXPECT_EQ(bigData, bigMoved.data());
+    EXPECT_TRUE(big.empty());
+    EXPECT_TRUE(big.is_inline());
+
+    SmallDynAry<int, 4> smallMoved;
+    smallMoved = std::move(small);
+    EXPECT_TRUE(smallMoved.is_inline());
+    EXPECT_EQ(3u, smallMoved.size());
+    EXPECT_EQ(42, smallMoved[2]);
+
+    smallMoved.swap(bigMoved);
+    EXPECT_EQ(10u, smallMoved.size());
+    EXPECT_EQ(3u, bigMoved.size());
+    EXPECT_EQ(49, smallMoved.back());
+    EXPECT_EQ(42, bigMoved.back());
+    EXPECT_TRUE(bigMoved.is_inline());
+
+    bigCopy = smallCopy;
+    EXPECT_EQ(3u, bigCopy.size());
+    EXPECT_TRUE(std::equal(smallCopy.begin(), smallCopy.end(), bigCopy.begin()));
+}
+
+TEST(SmallDynAryTest, NonTrivialType) {
+    SmallDynAry<Str, 2> ary;
+    ary.push_back("one");
+    ary.emplace_back("two");
+    EXPECT_TRUE(ary.is_inline());
+    ary.push_back("three");
+    ary.emplace_front("zero");
+    EXPECT_FALSE(ary.is_inline());
+    ASSERT_EQ(4u, ary.size());
+    EXPECT_EQ(Str("zero"), ary[0]);
+    EXPECT_EQ(Str("three"), ary[3]);
+
+    SmallDynAry<Str, 2> other{ "a" };
+    other.swap(ary);
+    EXPECT_EQ(1u, ary.size());
+    EXPECT_EQ(Str("a"), ary[0]);
+    EXPECT_EQ(Str("two"), other[2]);
+
+    other.erase(other.begin(), other.begin() + 3);
+    other.set_capacity(2);
+    EXPECT_TRUE(other.is_inline());
+    ASSERT_EQ(1u, other.size());
+    EXPECT_EQ(Str("three"), other[0]);
+}
+
+TEST(SmallDynAryTest, Resize) {
+    SmallDynAry<int, 4> ary(2, 7);
+    EXPECT_EQ(2u, ary.size());
+    ary.resize(6, 3);
+    EXPECT_EQ(6u, ary.size());
+    EXPECT_EQ(7, ary[1]);
+    EXPECT_EQ(3, ary[5]);
+    ary.assign(3, 9);
+    EXPECT_EQ(3u, ary.size());
+    EXPECT_EQ(9, ary[2]);
+    ary.pop_back();
+    EXPECT_EQ(2u, ary.size());
+}
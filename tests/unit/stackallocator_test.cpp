@@ -0,0 +1,80 @@
+#include "toolkit/mem/stack_allocator.hh"
+#include "toolkit/mem/alloc_policy.hh"
+#include "toolkit/dynary.hh"
+#include "countingallocator.hh"
+#include <gtest/gtest.h>
+#include <cstring>
+
+using namespace lptk;
+
+TEST(StackAllocatorTest, InlineThenParent)
+{
+    CountingAllocator parent;
+    mem::StackAllocator<256> alloc(&parent);
+    void* a = alloc.Alloc(100, 8);
+    void* b = alloc.Alloc(100, 8);
+    EXPECT_TRUE(alloc.Owns(a));
+    EXPECT_TRUE(alloc.Owns(b));
+    EXPECT_EQ(parent.m_numAllocs, 0);
+
+    void* c = alloc.Alloc(100, 8);
+    EXPECT_FALSE(alloc.Owns(c));
+    EXPECT_EQ(parent.m_numAllocs, 1);
+    alloc.Free(c);
+    EXPECT_EQ(parent.m_numFrees, 1);
+
+    alloc.Free(b);
+    alloc.Free(a);
+    EXPECT_EQ(alloc.GetUsed(), 0u);
+}
+
+TEST(StackAllocatorTest, Alignment)
+{
+    mem::StackAllocator<1024> alloc;
+    DynAry<void*> ptrs;
+    for (unsigned align : { 1u, 8u, 16u, 64u, 128u })
+    {
+        auto p = alloc.Alloc(3, align);
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(p) % align, 0u);
+        memset(p, 0xcd, 3);
+        ptrs.push_back(p);
+    }
+    for (size_t i = ptrs.size(); i > 0; --i)
+        alloc.Free(ptrs[i - 1]);
+    EXPECT_EQ(alloc.GetUsed(), 0u);
+}
+
+TEST(StackAllocatorTest, LifoReuse)
+{
+    mem::StackAllocator<256> alloc;
+    void* a = alloc.Alloc(32, 8);
+    void* b = alloc.Alloc(32, 8);
+    alloc.Free(b);
+    EXPECT_EQ(alloc.Alloc(32, 8), b);
+
+    // out of order: a's space only comes back once b is gone as well.
+    const size_t used = alloc.GetUsed();
+    alloc.Free(a);
+    EXPECT_EQ(alloc.GetUsed(), used);
+    alloc.Free(b);
+    EXPECT_EQ(alloc.GetUsed(), 0u);
+    EXPECT_EQ(alloc.Alloc(32, 8), a);
+    alloc.Free(a);
+}
+
+TEST(StackAllocatorTest, TemporaryContainer)
+{
+    CountingAllocator parent;
+    {
+        mem::StackAllocator<512> scratch(&parent);
+        {
+            DynAry<int, alignof(int), MEMPOOL_General, mem::AllocatorPolicy> values(&scratch);
+            for (int i = 0; i < 32; ++i)
+                values.push_back(i);
+            for (int i = 0; i < 32; ++i)
+                EXPECT_EQ(values[i], i);
+        }
+        EXPECT_EQ(scratch.GetUsed(), 0u);
+    }
+    EXPECT_EQ(parent.m_numAllocs, 0);
+}
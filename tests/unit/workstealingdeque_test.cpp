@@ -0,0 +1,94 @@
+#include "toolkit/workstealingdeque.hh"
+#include "toolkit/dynary.hh"
+#include <gtest/gtest.h>
+#include <thread>
+
+using namespace lptk;
+
+TEST(WorkStealingDequeTest, PopIsLifo)
+{
+    int items[3] = { 0, 1, 2 };
+    WorkStealingDeque<int> deque;
+    EXPECT_TRUE(deque.empty());
+    EXPECT_EQ(deque.pop(), nullptr);
+
+    for(auto& item : items)
+        deque.push(&item);
+    EXPECT_EQ(deque.size(), 3ul);
+
+    EXPECT_EQ(deque.pop(), &items[2]);
+    EXPECT_EQ(deque.pop(), &items[1]);
+    EXPECT_EQ(deque.pop(), &items[0]);
+    EXPECT_EQ(deque.pop(), nullptr);
+    EXPECT_TRUE(deque.empty());
+}
+
+TEST(WorkStealingDequeTest, StealIsFifo)
+{
+    int items[3] = { 0, 1, 2 };
+    WorkStealingDeque<int> deque;
+    for(auto& item : items)
+        deque.push(&item);
+
+    EXPECT_EQ(deque.steal(), &items[0]);
+    EXPECT_EQ(deque.pop(), &items[2]);
+    EXPECT_EQ(deque.steal(), &items[1]);
+    EXPECT_EQ(deque.steal(), nullptr);
+    EXPECT_EQ(deque.pop(), nullptr);
+}
+
+TEST(WorkStealingDequeTest, Grow)
+{
+    DynAry<int> items(1000);
+    WorkStealingDeque<int> deque(2);
+    for(auto& item : items)
+        deque.push(&item);
+    EXPECT_EQ(deque.size(), items.size());
+
+    for(size_t i = 0; i < items.size() / 2; ++i)
+        EXPECT_EQ(deque.steal(), &items[i]);
+    for(size_t i = items.size(); i > items.size() / 2; --i)
+        EXPECT_EQ(deque.pop(), &items[i - 1]);
+    EXPECT_TRUE(deque.empty());
+}
+
+TEST(WorkStealingDequeTest, ConcurrentSteal)
+{
+    constexpr int kNumItems = 100000;
+    constexpr int kNumThieves = 3;
+    DynAry<int> items(kNumItems);
+    WorkStealingDeque<int> deque(4);
+    std::atomic<bool> done(false);
+
+    auto thief = [&]() {
+        while(!done.load(std::memory_order_acquire) || !deque.empty())
+        {
+            if(int* item = deque.steal())
+                ++*item;
+        }
+    };
+    std::thread thieves[kNumThieves];
+    for(auto& t : thieves)
+        t = std::thread(thief);
+
+    // owner keeps pushing and popping while the thieves take from the top.
+    for(int i = 0; i < kNumItems; ++i)
+    {
+        deque.push(&items[i]);
+        if((i & 3) == 0)
+        {
+            if(int* item = deque.pop())
+                ++*item;
+        }
+    }
+    while(int* item = deque.pop())
+        ++*item;
+    done.store(true, std::memory_order_release);
+
+    for(auto& t : thieves)
+        t.join();
+
+    // every item must be taken exactly once
+    for(int i = 0; i < kNumItems; ++i)
+        EXPECT_EQ(items[i], 1);
+}